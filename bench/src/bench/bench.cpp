@@ -0,0 +1,283 @@
+#include "bench/bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+#include <kat/alloc_counter.hpp>
+
+namespace bench {
+    using Clock = std::chrono::steady_clock;
+
+    namespace {
+        constexpr uint32_t VIRTUAL_TEXTURE_SIZE = 8192;
+    } // namespace
+
+    std::vector<Scenario> defaultScenarios(const Options &options) {
+        return {
+                Scenario{"empty_frame"},
+                Scenario{"windows_" + std::to_string(options.windows), options.windows},
+                Scenario{"otc_" + std::to_string(options.submits), 1, options.submits},
+                Scenario{"barriers_" + std::to_string(options.barriers), 1, 0, options.barriers},
+                Scenario{"render_pass_creation", 1, 0, 0, true},
+                // otcs retire (and their queue stops growing) even though the frame's own submit uses an unmanaged fence that is reset every frame.
+                Scenario{"otc_steady_" + std::to_string(options.submits), 1, options.submits, 0, false, true},
+                Scenario{"virtual_texture_sparse", 1, 0, 0, false, false, VirtualTextureMode::eSparse},
+                Scenario{"virtual_texture_atlas", 1, 0, 0, false, false, VirtualTextureMode::eAtlas},
+        };
+    }
+
+    Percentiles percentiles(std::vector<double> samples) {
+        if (samples.empty()) return {};
+
+        std::sort(samples.begin(), samples.end());
+
+        auto at = [&](double p) {
+            const auto index = static_cast<size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+            return samples[std::min(index, samples.size() - 1)];
+        };
+
+        return Percentiles{
+                std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size()),
+                at(0.50),
+                at(0.90),
+                at(0.99),
+                samples.back(),
+        };
+    }
+
+    Result run(const Scenario &scenario, const Options &options) {
+        std::vector<kat::WindowId> ids;
+        std::vector<std::shared_ptr<BenchWindowHandler>> handlers;
+
+        kat::WindowOptions windowOptions{};
+        windowOptions.headless = true;
+
+        for (uint32_t i = 0; i < scenario.windows; i++) {
+            auto [id, window] = kat::Window::create(scenario.name + " " + std::to_string(i), options.extent, windowOptions);
+            auto handler = std::make_shared<BenchWindowHandler>(window, scenario);
+            window->setWindowHandler(handler);
+
+            ids.push_back(id);
+            handlers.push_back(handler);
+        }
+
+        for (uint32_t i = 0; i < options.warmupFrames; i++) {
+            kat::eventloopCycle();
+            kat::renderloopCycle();
+        }
+
+        kat::globalState->device.waitIdle();
+
+        uint64_t submitsBefore = 0;
+        for (const auto &h: handlers) {
+            submitsBefore += h->getSubmitCount();
+            h->getRenderPassCreationTimes().clear();
+        }
+
+        std::vector<double> frameTimes;
+        frameTimes.reserve(options.frames);
+
+        const uint64_t allocationsBefore = kat::alloc::count();
+        const auto start = Clock::now();
+
+        for (uint32_t i = 0; i < options.frames; i++) {
+            const auto frameStart = Clock::now();
+            kat::eventloopCycle();
+            kat::renderloopCycle();
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+        }
+
+        kat::globalState->device.waitIdle(); // throughput includes the gpu catching up
+
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const uint64_t allocations = kat::alloc::count() - allocationsBefore;
+
+        Result result{};
+        result.name = scenario.name;
+        result.frames = options.frames;
+        result.seconds = seconds;
+        result.frameTime = percentiles(std::move(frameTimes));
+
+        std::vector<double> creationTimes;
+        for (const auto &h: handlers) {
+            result.submits += h->getSubmitCount();
+            creationTimes.insert(creationTimes.end(), h->getRenderPassCreationTimes().begin(), h->getRenderPassCreationTimes().end());
+        }
+        result.submits -= submitsBefore;
+        result.submitsPerSecond = static_cast<double>(result.submits) / seconds;
+        result.allocationsPerFrame = static_cast<double>(allocations) / static_cast<double>(options.frames);
+
+        if (scenario.createRenderPass) result.renderPassCreation = percentiles(std::move(creationTimes));
+
+        if (scenario.allocationFree && allocations > 0) {
+            spdlog::error("{}: {} allocations after warmup", scenario.name, allocations);
+            result.failed = true;
+        }
+
+        for (const auto &h: handlers) {
+            if (!h->getVirtualTexture()) continue;
+
+            const auto stats = h->getVirtualTexture()->getStats();
+            if (h->getResidencyExceeded() || stats.evictedPages == 0) {
+                spdlog::error("{}: {} pages resident ({} slots), {} evicted", scenario.name, stats.residentPages, stats.slotCount, stats.evictedPages);
+                result.failed = true;
+            }
+        }
+
+        for (const auto &id: ids) {
+            kat::Window::destroy(id);
+        }
+        handlers.clear();
+        kat::flushWindowRemovals();
+
+        return result;
+    }
+
+    namespace {
+        void writePercentiles(std::ostream &out, const Percentiles &p) {
+            out << "{\"mean\": " << p.mean << ", \"p50\": " << p.p50 << ", \"p90\": " << p.p90 << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << "}";
+        }
+    } // namespace
+
+    void writeReport(std::ostream &out, const std::vector<Result> &results) {
+        out << "{\n";
+        out << "  \"device\": \"" << kat::globalState->physicalDeviceProperties.deviceName.data() << "\",\n";
+        out << "  \"scenarios\": [";
+
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto &r = results[i];
+            out << (i == 0 ? "\n" : ",\n");
+            out << "    {\"name\": \"" << r.name << "\", \"frames\": " << r.frames << ", \"seconds\": " << r.seconds << ",\n";
+            out << "     \"frame_time_ms\": ";
+            writePercentiles(out, r.frameTime);
+            out << ",\n     \"submits\": " << r.submits << ", \"submits_per_sec\": " << r.submitsPerSecond << ", \"allocations_per_frame\": " << r.allocationsPerFrame;
+            if (r.failed) out << ", \"failed\": true";
+            if (r.renderPassCreation) {
+                out << ",\n     \"render_pass_creation_ms\": ";
+                writePercentiles(out, *r.renderPassCreation);
+            }
+            out << "}";
+        }
+
+        out << "\n  ]\n}\n";
+    }
+
+    BenchWindowHandler::BenchWindowHandler(kat::Window *window, const Scenario &scenario) : m_Window(window), m_Scenario(scenario) {
+        m_RenderPass = std::make_shared<kat::RenderPass>(renderPassInfo());
+
+        for (const auto &iv: window->getImageViews()) {
+            m_Framebuffers.push_back(kat::globalState->device.createFramebuffer(vk::FramebufferCreateInfo({}, m_RenderPass->get(), iv, m_Window->getCurrentExtent().width, m_Window->getCurrentExtent().height, 1)));
+        }
+
+        if (m_Scenario.createRenderPass) m_RenderPassCreationTimes.reserve(4096);
+
+        if (m_Scenario.virtualTexture != VirtualTextureMode::eNone) {
+            kat::VirtualTextureOptions options{};
+            options.extent = vk::Extent2D(VIRTUAL_TEXTURE_SIZE, VIRTUAL_TEXTURE_SIZE);
+            options.mipLevels = 14;
+            options.memoryBudget = 4ULL * 1024 * 1024; // a few dozen pages, far fewer than the strip pans across
+            options.forceAtlas = m_Scenario.virtualTexture == VirtualTextureMode::eAtlas;
+
+            m_VirtualTexture = std::make_unique<kat::VirtualTexture>(options, [](const kat::VirtualPage &, vk::Extent2D, std::span<std::byte> texels) {
+                std::ranges::fill(texels, std::byte{0x80});
+                return true;
+            });
+        }
+    }
+
+    BenchWindowHandler::~BenchWindowHandler() {
+        for (const auto &f: m_Framebuffers) {
+            kat::destroy(f);
+        }
+    }
+
+    kat::RenderPassInfo BenchWindowHandler::renderPassInfo() const {
+        return kat::RenderPassInfo(
+                {
+                        kat::AttachmentInfo{m_Window->getSurfaceFormat().format, vk::ImageLayout::eUndefined, m_Window->getPresentLayout(), kat::LSO_STANDARD_CLEAR_STORE, kat::LSO_DONT_CARE, vk::SampleCountFlagBits::e1},
+                },
+                {
+                        kat::SubpassInfo{vk::PipelineBindPoint::eGraphics, 0, {}, {kat::AttachmentReference{0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor}}, {}, std::nullopt, {}, std::nullopt, std::nullopt, std::nullopt, std::nullopt},
+                },
+                {kat::SubpassDependency{kat::SubpassReference{vk::SubpassExternal, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlags()}, {0, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentWrite}}});
+    }
+
+    void BenchWindowHandler::recordBarriers(const vk::CommandBuffer &cmd, const kat::WindowFrameResources &resources) {
+        // a chain of general -> general transitions on the frame's image, each in its own barrier call, built the way the engine builds them.
+        const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        const kat::vku::MemoryStageReference transfer{vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite};
+
+        auto barrier = [&](vk::ImageLayout oldLayout, vk::ImageLayout newLayout) {
+            kat::vku::DependencyInfo dependencyInfo{};
+            dependencyInfo.imageMemoryBarriers.push_back(kat::vku::ImageMemoryBarrier{transfer, transfer, vk::QueueFamilyIgnored, vk::QueueFamilyIgnored, oldLayout, newLayout, resources.image, range});
+
+            kat::stack stack;
+            cmd.pipelineBarrier2(dependencyInfo.desc(stack));
+        };
+
+        barrier(vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+        for (uint32_t i = 0; i < m_Scenario.barriers; i++) {
+            barrier(vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+        }
+        barrier(vk::ImageLayout::eGeneral, m_Window->getPresentLayout());
+    }
+
+    void BenchWindowHandler::recordVirtualTexture(const vk::CommandBuffer &cmd, const kat::WindowFrameResources &resources) {
+        m_VirtualTexture->update(cmd, resources.frameIndex);
+
+        const auto stats = m_VirtualTexture->getStats();
+        m_ResidencyExceeded |= stats.residentPages > stats.slotCount + stats.mipTailPages;
+
+        // no shaders here, the feedback a pass sampling a strip of mip 0 would write is filled in directly (after update() cleared it).
+        constexpr uint32_t STRIP = 16;
+        const vk::Extent2D page = m_VirtualTexture->getPageExtent();
+        const uint32_t mip0Pages = ((VIRTUAL_TEXTURE_SIZE + page.width - 1) / page.width) * ((VIRTUAL_TEXTURE_SIZE + page.height - 1) / page.height);
+        const uint32_t first = m_VirtualTexture->pageIndex(kat::VirtualPage{0, 0, 0}) + (m_PanFrame++ * 2) % (mip0Pages - STRIP);
+        const vk::Buffer feedback = m_VirtualTexture->getFeedbackBuffer(resources.frameIndex);
+
+        auto bufferBarrier = [&](vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess) {
+            const vk::BufferMemoryBarrier2 barrier(vk::PipelineStageFlagBits2::eClear, vk::AccessFlagBits2::eTransferWrite, dstStage, dstAccess, vk::QueueFamilyIgnored, vk::QueueFamilyIgnored, feedback, 0, VK_WHOLE_SIZE);
+            cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, barrier, {}));
+        };
+
+        bufferBarrier(vk::PipelineStageFlagBits2::eClear, vk::AccessFlagBits2::eTransferWrite);
+        cmd.fillBuffer(feedback, first * sizeof(uint32_t), STRIP * sizeof(uint32_t), 1);
+        bufferBarrier(vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead);
+
+        m_VirtualTexture->finishFeedback(cmd);
+    }
+
+    void BenchWindowHandler::onRender(kat::Window &window, const kat::WindowFrameResources &resources) {
+        if (m_Scenario.createRenderPass) {
+            const auto start = Clock::now();
+            {
+                kat::RenderPass renderPass(renderPassInfo());
+            }
+            m_RenderPassCreationTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+
+        for (uint32_t i = 0; i < m_Scenario.extraSubmits; i++) {
+            kat::vku::otc([](const vk::CommandBuffer &) {});
+            m_Submits++;
+        }
+
+        kat::vku::OTCSync otcs{};
+        otcs.wait = resources.sync->imageAvailableSemaphore;
+        otcs.signal = resources.sync->renderFinishedSemaphore;
+
+        kat::vku::otc([&](const vk::CommandBuffer &cmd) {
+            if (m_VirtualTexture) recordVirtualTexture(cmd, resources);
+
+            if (m_Scenario.barriers > 0) {
+                recordBarriers(cmd, resources);
+                return;
+            }
+
+            std::array<vk::ClearValue, 1> cvs = {vk::ClearValue(vk::ClearColorValue{0.0f, 0.0f, 0.0f, 1.0f})};
+            cmd.beginRenderPass2(vk::RenderPassBeginInfo(m_RenderPass->get(), m_Framebuffers[resources.imageIndex], vk::Rect2D(vk::Offset2D(0, 0), window.getCurrentExtent()), cvs), vk::SubpassBeginInfo());
+            cmd.endRenderPass2(vk::SubpassEndInfo());
+        }, resources.sync->inFlightFence, otcs);
+        m_Submits++;
+    }
+} // namespace bench
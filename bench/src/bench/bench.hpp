@@ -0,0 +1,112 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <kat/engine.hpp>
+#include <kat/render/render_pass.hpp>
+#include <kat/render/virtual_texture.hpp>
+#include <kat/window.hpp>
+
+namespace bench {
+
+    struct Options {
+        uint32_t warmupFrames = 100;
+        uint32_t frames = 1000;
+        vk::Extent2D extent = {256, 256};
+
+        uint32_t windows = 4;    // windows_n
+        uint32_t submits = 16;   // otc_m: extra otc submits per frame
+        uint32_t barriers = 256; // barriers: pipeline barriers recorded per frame
+
+        std::string scenario; // run only this scenario if set
+        std::string output;   // write the JSON report here instead of stdout
+    };
+
+    enum class VirtualTextureMode {
+        eNone,
+        eSparse, // falls back to the atlas if the device can't do sparse residency
+        eAtlas,
+    };
+
+    struct Scenario {
+        std::string name;
+        uint32_t windows = 1;
+        uint32_t extraSubmits = 0;
+        uint32_t barriers = 0;
+        bool createRenderPass = false; // build (and destroy) a render pass every frame
+        bool allocationFree = false;   // the scenario fails if anything allocates after warmup
+
+        // stream a virtual texture with a small budget, requesting a strip of pages that pans across mip 0 every frame.
+        // the scenario fails if more pages are resident than fit into the budget, or if nothing was evicted.
+        VirtualTextureMode virtualTexture = VirtualTextureMode::eNone;
+    };
+
+    struct Percentiles {
+        double mean, p50, p90, p99, max; // milliseconds
+    };
+
+    struct Result {
+        std::string name;
+        uint32_t frames;
+        double seconds;
+        Percentiles frameTime;
+        uint64_t submits;
+        double submitsPerSecond;
+        double allocationsPerFrame; // whole process, 0 if the counter isn't installed
+        std::optional<Percentiles> renderPassCreation;
+        bool failed = false; // a check of the scenario didn't hold
+    };
+
+    std::vector<Scenario> defaultScenarios(const Options &options);
+
+    Result run(const Scenario &scenario, const Options &options);
+
+    [[nodiscard]] Percentiles percentiles(std::vector<double> samples);
+
+    void writeReport(std::ostream &out, const std::vector<Result> &results);
+
+    /**
+     * Renders a frame for one window of a scenario: a clear (or a chain of barriers), plus whatever else the scenario asks for.
+     */
+    class BenchWindowHandler : public kat::BaseWindowHandler {
+      public:
+        BenchWindowHandler(kat::Window *window, const Scenario &scenario);
+        ~BenchWindowHandler() override;
+
+        void onRender(kat::Window &window, const kat::WindowFrameResources &resources) override;
+
+        [[nodiscard]] inline uint64_t getSubmitCount() const noexcept { return m_Submits; };
+
+        [[nodiscard]] inline std::vector<double> &getRenderPassCreationTimes() noexcept { return m_RenderPassCreationTimes; };
+
+        // null unless the scenario streams a virtual texture
+        [[nodiscard]] inline const kat::VirtualTexture *getVirtualTexture() const noexcept { return m_VirtualTexture.get(); };
+
+        // more pages were resident than the budget has slots for, in any frame
+        [[nodiscard]] inline bool getResidencyExceeded() const noexcept { return m_ResidencyExceeded; };
+
+      private:
+        [[nodiscard]] kat::RenderPassInfo renderPassInfo() const;
+
+        void recordBarriers(const vk::CommandBuffer &cmd, const kat::WindowFrameResources &resources);
+        void recordVirtualTexture(const vk::CommandBuffer &cmd, const kat::WindowFrameResources &resources);
+
+        kat::Window *m_Window;
+        Scenario m_Scenario;
+
+        std::shared_ptr<kat::RenderPass> m_RenderPass;
+        std::vector<vk::Framebuffer> m_Framebuffers;
+
+        uint64_t m_Submits = 0;
+        std::vector<double> m_RenderPassCreationTimes;
+
+        std::unique_ptr<kat::VirtualTexture> m_VirtualTexture;
+        uint32_t m_PanFrame = 0;
+        bool m_ResidencyExceeded = false;
+    };
+
+} // namespace bench
@@ -0,0 +1,74 @@
+#include "bench/bench.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include <kat/alloc_counter.hpp>
+
+KAT_INSTALL_ALLOCATION_COUNTER()
+
+namespace {
+    void usage() {
+        std::cerr << "usage: katengine_bench [--frames N] [--warmup N] [--windows N] [--submits M] [--barriers B] [--scenario NAME] [--output FILE] [--validation]\n";
+    }
+} // namespace
+
+int main(int argc, char *argv[]) {
+    bench::Options options{};
+    bool validation = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage();
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--frames") options.frames = std::stoul(next());
+        else if (arg == "--warmup") options.warmupFrames = std::stoul(next());
+        else if (arg == "--windows") options.windows = std::stoul(next());
+        else if (arg == "--submits") options.submits = std::stoul(next());
+        else if (arg == "--barriers") options.barriers = std::stoul(next());
+        else if (arg == "--scenario") options.scenario = next();
+        else if (arg == "--output") options.output = next();
+        else if (arg == "--validation") validation = true;
+        else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    kat::init();
+
+    // validation and debug logging would dominate the numbers, keep them off unless asked for.
+    kat::setValidationLayersEnabled(validation);
+    kat::setLogLevel(spdlog::level::warn);
+    kat::setHeadless(true);
+
+    kat::startup();
+
+    std::vector<bench::Result> results;
+    for (const auto &scenario: bench::defaultScenarios(options)) {
+        if (!options.scenario.empty() && scenario.name != options.scenario) continue;
+
+        spdlog::warn("Running {}", scenario.name);
+        results.push_back(bench::run(scenario, options));
+    }
+
+    if (options.output.empty()) {
+        bench::writeReport(std::cout, results);
+    } else {
+        std::ofstream out(options.output);
+        bench::writeReport(out, results);
+    }
+
+    kat::globalState->wrapup();
+    kat::terminate();
+    return std::ranges::any_of(results, &bench::Result::failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
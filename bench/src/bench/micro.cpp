@@ -0,0 +1,655 @@
+/**
+ * Microbenchmarks for engine primitives.
+ *
+ * Every benchmark comes in pairs: <Name>_Baseline is the simplest hand-written version of the same work, <Name>_Kat goes through the engine.
+ * Compare the two with --benchmark_filter=<Name>, or keep the output of a run (--benchmark_out=file.json --benchmark_out_format=json)
+ * and compare it to a later one with Google Benchmark's tools/compare.py (`compare.py benchmarks old.json new.json`,
+ * or `compare.py filters katengine_microbench <Name>_Baseline <Name>_Kat` for one pair).
+ *
+ * Benchmarks that need a device start the engine headless on first use (lavapipe works), and are skipped if that fails.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <kat/asset_package.hpp>
+#include <kat/engine.hpp>
+#include <kat/render/async_compute.hpp>
+#include <kat/render/command_recorder.hpp>
+#include <kat/render/event_pool.hpp>
+#include <kat/render/render_pass.hpp>
+#include <kat/render/staging_ring.hpp>
+#include <kat/stack.hpp>
+#include <kat/vku.hpp>
+
+namespace {
+    bool requireDevice(benchmark::State &state) {
+        static const bool available = [] {
+            try {
+                kat::setHeadless(true);
+                kat::setLogLevel(spdlog::level::warn);
+                kat::startup();
+                return true;
+            } catch (const std::exception &e) {
+                spdlog::error("Failed to start the engine: {}", e.what());
+                return false;
+            }
+        }();
+
+        if (!available) state.SkipWithError("no vulkan device");
+        return available;
+    }
+
+    // ---- kat::stack ----
+
+    void StackAlloc_Baseline(benchmark::State &state) {
+        // bump allocation out of a fixed buffer, about as cheap as scratch memory gets.
+        const auto count = static_cast<size_t>(state.range(0));
+        alignas(std::max_align_t) std::array<std::byte, 64 * 1024> buffer;
+
+        for (auto _: state) {
+            size_t offset = 0;
+            for (size_t i = 0; i < count; i++) {
+                void *p = buffer.data() + offset;
+                offset += 64;
+                benchmark::DoNotOptimize(p);
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    }
+
+    void StackAlloc_Kat(benchmark::State &state) {
+        const auto count = static_cast<size_t>(state.range(0));
+
+        for (auto _: state) {
+            kat::stack st;
+            for (size_t i = 0; i < count; i++) {
+                void *p = st.malloc(64);
+                benchmark::DoNotOptimize(p);
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    }
+
+    // ---- DynamicStructureChain ----
+
+    using ChainStructure = vk::PhysicalDeviceVulkan11Features; // any sccompatible struct will do
+
+    void StructureChainPush_Baseline(benchmark::State &state) {
+        const auto count = static_cast<size_t>(state.range(0));
+        std::vector<ChainStructure> structures(count);
+
+        for (auto _: state) {
+            // link the chain by hand, keeping the tail around.
+            void *head = nullptr;
+            void **tail = &head;
+            for (auto &s: structures) {
+                s.pNext = nullptr;
+                *tail = &s;
+                tail = &s.pNext;
+            }
+            benchmark::DoNotOptimize(head);
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    }
+
+    void StructureChainPush_Kat(benchmark::State &state) {
+        const auto count = static_cast<size_t>(state.range(0));
+        std::vector<ChainStructure> structures(count);
+
+        for (auto _: state) {
+            kat::DynamicStructureChain chain;
+            for (auto &s: structures) {
+                s.pNext = nullptr;
+                chain.push(&s);
+            }
+            benchmark::DoNotOptimize(chain.get());
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    }
+
+    void EndOfChain_Baseline(benchmark::State &state) {
+        // the tail is known up front (what the chain would look like if it tracked it), so finding it is free.
+        const auto count = static_cast<size_t>(state.range(0));
+        std::vector<ChainStructure> structures(count);
+        for (size_t i = 0; i + 1 < count; i++) structures[i].pNext = &structures[i + 1];
+
+        auto *tail = reinterpret_cast<vk::BaseOutStructure *>(&structures.back());
+        for (auto _: state) {
+            benchmark::DoNotOptimize(tail);
+        }
+    }
+
+    void EndOfChain_Kat(benchmark::State &state) {
+        const auto count = static_cast<size_t>(state.range(0));
+        std::vector<ChainStructure> structures(count);
+        for (size_t i = 0; i + 1 < count; i++) structures[i].pNext = &structures[i + 1];
+
+        for (auto _: state) {
+            benchmark::DoNotOptimize(kat::endofchain(structures.data()));
+        }
+    }
+
+    // ---- vku::DependencyInfo::desc ----
+
+    kat::vku::DependencyInfo makeDependencyInfo(size_t imageBarriers) {
+        const kat::vku::MemoryStageReference transfer{vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite};
+        const kat::vku::MemoryStageReference fragment{vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderSampledRead};
+
+        kat::vku::DependencyInfo info{};
+        info.memoryBarriers.push_back(kat::vku::MemoryBarrier{transfer, fragment});
+        for (size_t i = 0; i < imageBarriers; i++) {
+            info.imageMemoryBarriers.push_back(kat::vku::ImageMemoryBarrier{transfer, fragment, vk::QueueFamilyIgnored, vk::QueueFamilyIgnored, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::Image{}, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)});
+        }
+        return info;
+    }
+
+    void DependencyInfoDesc_Baseline(benchmark::State &state) {
+        // same conversion into fixed arrays on the stack.
+        const auto info = makeDependencyInfo(static_cast<size_t>(state.range(0)));
+        std::array<vk::MemoryBarrier2, 4> mbs;
+        std::array<vk::ImageMemoryBarrier2, 64> imbs;
+
+        for (auto _: state) {
+            for (size_t i = 0; i < info.memoryBarriers.size(); i++) mbs[i] = info.memoryBarriers[i].desc();
+            for (size_t i = 0; i < info.imageMemoryBarriers.size(); i++) imbs[i] = info.imageMemoryBarriers[i].desc();
+
+            vk::DependencyInfo desc(info.dependencyFlags, static_cast<uint32_t>(info.memoryBarriers.size()), mbs.data(), 0, nullptr, static_cast<uint32_t>(info.imageMemoryBarriers.size()), imbs.data());
+            benchmark::DoNotOptimize(desc);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    void DependencyInfoDesc_Kat(benchmark::State &state) {
+        const auto info = makeDependencyInfo(static_cast<size_t>(state.range(0)));
+
+        for (auto _: state) {
+            kat::stack st;
+            vk::DependencyInfo desc = info.desc(st);
+            benchmark::DoNotOptimize(desc);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    // ---- split barriers ----
+
+    constexpr uint32_t SPLIT_BARRIER_BATCH = 64; // split barriers recorded per command buffer (resetting it isn't timed)
+
+    void SplitBarrierRecord_Baseline(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // one event, set, waited on and reset by hand with a prebuilt dependency info.
+        const auto &device = kat::globalState->device;
+        vk::CommandPool pool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, kat::globalState->mainFamily));
+        const vk::CommandBuffer cmd = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, 1))[0];
+        vk::Event event = kat::vku::createDeviceOnlyEvent();
+
+        const vk::MemoryBarrier2 barrier(vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderSampledRead);
+        const vk::DependencyInfo dependencyInfo({}, barrier);
+
+        cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        uint32_t recorded = 0;
+        for (auto _: state) {
+            cmd.setEvent2(event, dependencyInfo);
+            cmd.waitEvents2(event, dependencyInfo);
+            cmd.resetEvent2(event, vk::PipelineStageFlagBits2::eFragmentShader);
+
+            if (++recorded == SPLIT_BARRIER_BATCH) {
+                state.PauseTiming();
+                cmd.end();
+                cmd.reset();
+                cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+                recorded = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        cmd.end();
+        kat::destroy(event);
+        kat::destroy(pool);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void SplitBarrierRecord_Kat(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // an event per barrier from an EventPool, a new pool frame per command buffer. nothing is submitted, so recycling them is always safe.
+        const auto &device = kat::globalState->device;
+        vk::CommandPool pool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, kat::globalState->mainFamily));
+        const vk::CommandBuffer cmd = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, 1))[0];
+
+        kat::EventPool events;
+        const kat::vku::DependencyInfo dependencyInfo = makeDependencyInfo(0); // the same memory barrier as the baseline
+        kat::CommandRecorder recorder(cmd);
+
+        uint32_t frame = 0;
+        events.beginFrame(frame);
+        cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        uint32_t recorded = 0;
+        for (auto _: state) {
+            const kat::cmd::SplitBarrier barrier{events.acquire(), &dependencyInfo};
+            recorder.signal(barrier);
+            recorder.wait(barrier);
+
+            if (++recorded == SPLIT_BARRIER_BATCH) {
+                state.PauseTiming();
+                cmd.end();
+                cmd.reset();
+                cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+                events.beginFrame(++frame);
+                recorded = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        cmd.end();
+        kat::destroy(pool);
+        state.SetItemsProcessed(state.iterations());
+        state.counters["events"] = static_cast<double>(events.getEventCount());
+    }
+
+    // ---- RenderPass ----
+
+    constexpr vk::Format RENDER_PASS_FORMAT = vk::Format::eR8G8B8A8Unorm;
+
+    void RenderPassCreate_Baseline(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // the equivalent create info, built once.
+        const vk::AttachmentDescription2 attachment({}, RENDER_PASS_FORMAT, vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
+                                                    vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal);
+        const vk::AttachmentReference2 colorReference(0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor);
+        const vk::SubpassDescription2 subpass({}, vk::PipelineBindPoint::eGraphics, 0, {}, colorReference);
+        const vk::SubpassDependency2 dependency(vk::SubpassExternal, 0, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eColorAttachmentOutput, {}, vk::AccessFlagBits::eColorAttachmentWrite);
+        const vk::RenderPassCreateInfo2 createInfo({}, attachment, subpass, dependency);
+
+        for (auto _: state) {
+            vk::RenderPass renderPass = kat::globalState->device.createRenderPass2(createInfo);
+            kat::destroy(renderPass);
+        }
+    }
+
+    void RenderPassCreate_Kat(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        const kat::RenderPassInfo info(
+                {
+                        kat::AttachmentInfo{RENDER_PASS_FORMAT, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal, kat::LSO_STANDARD_CLEAR_STORE, kat::LSO_DONT_CARE, vk::SampleCountFlagBits::e1},
+                },
+                {
+                        kat::SubpassInfo{vk::PipelineBindPoint::eGraphics, 0, {}, {kat::AttachmentReference{0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor}}, {}, std::nullopt, {}, std::nullopt, std::nullopt, std::nullopt, std::nullopt},
+                },
+                {kat::SubpassDependency{kat::SubpassReference{vk::SubpassExternal, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlags()}, {0, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentWrite}}});
+
+        for (auto _: state) {
+            kat::RenderPass renderPass(info);
+            benchmark::DoNotOptimize(renderPass.get());
+        }
+    }
+
+    // ---- otc record + submit ----
+
+    constexpr size_t SUBMIT_BATCH = 64; // submissions between waiting for the gpu (which isn't timed)
+
+    void OTCSubmit_Baseline(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // pre-allocated command buffers and one fence per batch, submitted by hand.
+        const auto &device = kat::globalState->device;
+        vk::CommandPool pool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, kat::globalState->mainFamily));
+        auto commandBuffers = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, SUBMIT_BATCH));
+        vk::Fence fence = kat::vku::createFence();
+
+        static const vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+
+        size_t index = 0;
+        for (auto _: state) {
+            const auto &cmd = commandBuffers[index];
+            cmd.begin(beginInfo);
+            cmd.end();
+
+            vk::CommandBufferSubmitInfo cbsi(cmd);
+            kat::globalState->mainQueue.submit2(vk::SubmitInfo2({}, {}, cbsi), index == SUBMIT_BATCH - 1 ? fence : vk::Fence{});
+
+            if (++index == SUBMIT_BATCH) {
+                state.PauseTiming();
+                kat::vku::waitFence(fence);
+                kat::vku::resetFence(fence);
+                index = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        device.waitIdle();
+        kat::destroy(fence);
+        kat::destroy(pool);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void OTCSubmit_Kat(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        size_t index = 0;
+        for (auto _: state) {
+            kat::vku::otc([](const vk::CommandBuffer &) {});
+
+            if (++index == SUBMIT_BATCH) {
+                state.PauseTiming();
+                kat::globalState->device.waitIdle();
+                kat::renderloopCycle(); // retires the batch (no windows, so that's all it does)
+                index = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        kat::globalState->device.waitIdle();
+        kat::renderloopCycle();
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // ---- async compute submit ----
+
+    void ComputeSubmit_Baseline(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // pre-allocated command buffers, each submit signals the next value of a timeline semaphore of our own.
+        const auto &device = kat::globalState->device;
+        vk::CommandPool pool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, kat::globalState->computeFamily));
+        auto commandBuffers = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, SUBMIT_BATCH));
+        vk::Semaphore timeline = kat::vku::createTimelineSemaphore();
+
+        static const vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+
+        size_t index = 0;
+        uint64_t value = 0;
+        for (auto _: state) {
+            const auto &cmd = commandBuffers[index];
+            cmd.begin(beginInfo);
+            cmd.end();
+
+            const vk::CommandBufferSubmitInfo cbsi(cmd);
+            const vk::SemaphoreSubmitInfo signal(timeline, ++value, vk::PipelineStageFlagBits2::eAllCommands);
+            kat::globalState->computeQueue.submit2(vk::SubmitInfo2({}, {}, cbsi, signal));
+
+            if (++index == SUBMIT_BATCH) {
+                state.PauseTiming();
+                kat::vku::waitSemaphore(timeline, value);
+                for (const auto &c: commandBuffers) c.reset();
+                index = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        device.waitIdle();
+        kat::destroy(timeline);
+        kat::destroy(pool);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void ComputeSubmit_Kat(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        kat::AsyncCompute compute;
+
+        size_t index = 0;
+        uint64_t value = 0;
+        for (auto _: state) {
+            value = compute.submit([](kat::CommandRecorder &) {});
+
+            if (++index == SUBMIT_BATCH) {
+                state.PauseTiming();
+                kat::AsyncCompute::wait(value);
+                index = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations());
+        state.counters["dedicated"] = kat::AsyncCompute::isDedicated() ? 1.0 : 0.0;
+    }
+
+    // ---- device dispatch table ----
+
+    void FenceStatus_Baseline(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // through vulkan.hpp and the global dynamic dispatcher.
+        vk::Fence fence = kat::vku::createFenceSignaled();
+        for (auto _: state) {
+            benchmark::DoNotOptimize(kat::globalState->device.getFenceStatus(fence));
+        }
+
+        kat::destroy(fence);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void FenceStatus_Kat(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        vk::Fence fence = kat::vku::createFenceSignaled();
+        for (auto _: state) {
+            benchmark::DoNotOptimize(kat::vku::isFenceSignaled(fence));
+        }
+
+        kat::destroy(fence);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    constexpr uint32_t BARRIER_BATCH = 256; // barriers recorded per command buffer (resetting it isn't timed)
+
+    void PipelineBarrierRecord_Baseline(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        const auto &device = kat::globalState->device;
+        vk::CommandPool pool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, kat::globalState->mainFamily));
+        const vk::CommandBuffer cmd = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, 1))[0];
+
+        const vk::MemoryBarrier2 barrier(vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderRead);
+        const vk::DependencyInfo dependencyInfo({}, barrier);
+
+        cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        uint32_t recorded = 0;
+        for (auto _: state) {
+            cmd.pipelineBarrier2(dependencyInfo);
+
+            if (++recorded == BARRIER_BATCH) {
+                state.PauseTiming();
+                cmd.end();
+                cmd.reset();
+                cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+                recorded = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        cmd.end();
+        kat::destroy(pool);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void PipelineBarrierRecord_Kat(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // same work as the baseline, but through the device dispatch table (which is what CommandRecorder::pipelineBarrier() records with).
+        const auto &device = kat::globalState->device;
+        const auto &dispatch = kat::globalState->dispatch;
+        vk::CommandPool pool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, kat::globalState->mainFamily));
+        const vk::CommandBuffer cmd = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, 1))[0];
+
+        const vk::MemoryBarrier2 barrier(vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderRead);
+        const vk::DependencyInfo dependencyInfo({}, barrier);
+
+        cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        uint32_t recorded = 0;
+        for (auto _: state) {
+            dispatch.vkCmdPipelineBarrier2(static_cast<VkCommandBuffer>(cmd), reinterpret_cast<const VkDependencyInfo *>(&dependencyInfo));
+
+            if (++recorded == BARRIER_BATCH) {
+                state.PauseTiming();
+                cmd.end();
+                cmd.reset();
+                cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+                recorded = 0;
+                state.ResumeTiming();
+            }
+        }
+
+        cmd.end();
+        kat::destroy(pool);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // ---- asset package upload ----
+
+    constexpr uint32_t PACKAGE_ASSETS = 64;
+    constexpr size_t PACKAGE_ASSET_SIZE = 256 * 1024;
+
+    // a package of PACKAGE_ASSETS buffers, written to the temp directory on first use and removed at exit.
+    struct BenchPackage {
+        std::filesystem::path path;
+        std::unique_ptr<kat::AssetPackage> package;
+
+        BenchPackage() : path(std::filesystem::temp_directory_path() / "katengine_microbench.kpak") {
+            kat::AssetPackageWriter writer;
+            std::vector<std::byte> data(PACKAGE_ASSET_SIZE);
+            for (uint32_t i = 0; i < PACKAGE_ASSETS; i++) {
+                std::fill(data.begin(), data.end(), static_cast<std::byte>(i));
+                writer.add("buffer" + std::to_string(i), kat::AssetType::eBuffer, data);
+            }
+            writer.write(path);
+            package = std::make_unique<kat::AssetPackage>(path);
+        };
+
+        ~BenchPackage() {
+            package.reset();
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        };
+    };
+
+    const BenchPackage &benchPackage() {
+        static const BenchPackage package;
+        return package;
+    }
+
+    // a device local buffer every asset of the package fits into, one after another.
+    struct UploadDestination {
+        vk::Buffer buffer;
+        vk::DeviceMemory memory;
+
+        UploadDestination() {
+            buffer = kat::globalState->device.createBuffer(vk::BufferCreateInfo({}, PACKAGE_ASSETS * PACKAGE_ASSET_SIZE, vk::BufferUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive));
+            const auto requirements = kat::globalState->device.getBufferMemoryRequirements(buffer);
+            memory = kat::vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, kat::vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)));
+            kat::globalState->device.bindBufferMemory(buffer, memory, 0);
+        };
+
+        ~UploadDestination() {
+            kat::globalState->device.waitIdle();
+            kat::destroy(buffer);
+            kat::vku::freeMemory(memory);
+        };
+    };
+
+    void PackageUpload_Baseline(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        // the same package read with a stream into the staging ring, so the only difference is read() against copying out of the mapping.
+        const auto &bench = benchPackage();
+        const auto entries = bench.package->getEntries();
+        std::ifstream file(bench.path, std::ios::binary);
+        kat::StagingRing ring;
+        UploadDestination destination;
+
+        for (auto _: state) {
+            vk::DeviceSize offset = 0;
+            for (const auto &entry: entries) {
+                const auto allocation = ring.allocate(entry.size);
+                file.seekg(static_cast<std::streamoff>(entry.offset));
+                file.read(reinterpret_cast<char *>(allocation.data.data()), static_cast<std::streamsize>(entry.size));
+                ring.copyToBuffer(allocation, destination.buffer, offset);
+                offset += entry.size;
+            }
+            ring.wait(ring.submit());
+        }
+
+        if (!file) state.SkipWithError("failed to read the package");
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(PACKAGE_ASSETS * PACKAGE_ASSET_SIZE));
+    }
+
+    void PackageUpload_Kat(benchmark::State &state) {
+        if (!requireDevice(state)) return;
+
+        const auto &package = *benchPackage().package;
+        const auto entries = package.getEntries();
+        kat::StagingRing ring;
+        UploadDestination destination;
+
+        for (auto _: state) {
+            vk::DeviceSize offset = 0;
+            for (const auto &entry: entries) {
+                kat::uploadBuffer(ring, package, entry, destination.buffer, offset);
+                offset += entry.size;
+            }
+            ring.wait(ring.submit());
+        }
+
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(PACKAGE_ASSETS * PACKAGE_ASSET_SIZE));
+    }
+} // namespace
+
+BENCHMARK(StackAlloc_Baseline)->Arg(4)->Arg(32);
+BENCHMARK(StackAlloc_Kat)->Arg(4)->Arg(32);
+
+BENCHMARK(StructureChainPush_Baseline)->Arg(2)->Arg(8);
+BENCHMARK(StructureChainPush_Kat)->Arg(2)->Arg(8);
+
+BENCHMARK(EndOfChain_Baseline)->Arg(2)->Arg(8)->Arg(32);
+BENCHMARK(EndOfChain_Kat)->Arg(2)->Arg(8)->Arg(32);
+
+BENCHMARK(DependencyInfoDesc_Baseline)->Arg(1)->Arg(16);
+BENCHMARK(DependencyInfoDesc_Kat)->Arg(1)->Arg(16);
+
+BENCHMARK(SplitBarrierRecord_Baseline);
+BENCHMARK(SplitBarrierRecord_Kat);
+
+BENCHMARK(RenderPassCreate_Baseline);
+BENCHMARK(RenderPassCreate_Kat);
+
+BENCHMARK(OTCSubmit_Baseline);
+BENCHMARK(OTCSubmit_Kat);
+
+BENCHMARK(ComputeSubmit_Baseline);
+BENCHMARK(ComputeSubmit_Kat);
+
+BENCHMARK(FenceStatus_Baseline);
+BENCHMARK(FenceStatus_Kat);
+
+BENCHMARK(PipelineBarrierRecord_Baseline);
+BENCHMARK(PipelineBarrierRecord_Kat);
+
+BENCHMARK(PackageUpload_Baseline);
+BENCHMARK(PackageUpload_Kat);
+
+int main(int argc, char **argv) {
+    kat::init();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    if (kat::globalState->startupComplete) kat::globalState->wrapup();
+    kat::terminate();
+    return 0;
+}
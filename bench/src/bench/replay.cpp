@@ -0,0 +1,327 @@
+/**
+ * katengine_replay: re-issues a replay capture (see kat/replay.hpp) headless and reports how long every frame took compared to the capture.
+ *
+ * Render passes are replayed as clears of a scratch image of the captured extent, barriers as the same number of barriers on scratch
+ * resources, and semaphore waits/signals are paired up the way they were captured. Frames are paced with MAX_FRAMES_IN_FLIGHT fences, like the engine.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <kat/engine.hpp>
+#include <kat/render/command_recorder.hpp>
+#include <kat/render/render_pass.hpp>
+#include <kat/replay.hpp>
+
+#include "bench/bench.hpp"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr vk::Format TARGET_FORMAT = vk::Format::eR8G8B8A8Unorm;
+
+    struct Target {
+        vk::Image image;
+        vk::DeviceMemory memory;
+        vk::ImageView view;
+        vk::Framebuffer framebuffer;
+    };
+
+    class Replayer {
+      public:
+        Replayer() {
+            m_RenderPass = std::make_shared<kat::RenderPass>(kat::RenderPassInfo(
+                    {
+                            kat::AttachmentInfo{TARGET_FORMAT, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, kat::LSO_STANDARD_CLEAR_STORE, kat::LSO_DONT_CARE, vk::SampleCountFlagBits::e1},
+                    },
+                    {
+                            kat::SubpassInfo{vk::PipelineBindPoint::eGraphics, 0, {}, {kat::AttachmentReference{0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor}}, {}, std::nullopt, {}, std::nullopt, std::nullopt, std::nullopt, std::nullopt},
+                    },
+                    {kat::SubpassDependency{kat::SubpassReference{vk::SubpassExternal, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlags()}, {0, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentWrite}}}));
+
+            m_BarrierTarget = target(vk::Extent2D{64, 64});
+
+            auto bci = vk::BufferCreateInfo().setSize(64 * 1024).setUsage(vk::BufferUsageFlagBits::eTransferDst).setSharingMode(vk::SharingMode::eExclusive);
+            m_BarrierBuffer = kat::globalState->device.createBuffer(bci);
+            auto requirements = kat::globalState->device.getBufferMemoryRequirements(m_BarrierBuffer);
+            m_BarrierBufferMemory = kat::vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, kat::vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)));
+            kat::globalState->device.bindBufferMemory(m_BarrierBuffer, m_BarrierBufferMemory, 0);
+
+            for (auto &fence: m_Fences) fence = kat::vku::createFenceSignaled();
+
+            m_BeginInfo.clearValues.resize(1);
+        }
+
+        ~Replayer() {
+            kat::globalState->device.waitIdle();
+            kat::renderloopCycle(); // retire the last otc submissions
+
+            for (const auto &fence: m_Fences) kat::destroy(fence);
+            for (const auto &semaphore: m_FreeSemaphores) kat::destroy(semaphore);
+            for (const auto &semaphore: m_SignaledSemaphores) kat::destroy(semaphore);
+
+            for (const auto &[extent, t]: m_Targets) {
+                kat::destroy(t.framebuffer);
+                kat::destroy(t.view);
+                kat::destroy(t.image);
+                kat::vku::freeMemory(t.memory);
+            }
+
+            kat::destroy(m_BarrierBuffer);
+            kat::vku::freeMemory(m_BarrierBufferMemory);
+        }
+
+        // paced like the engine: waits for the frame that last used this frame index before re-issuing anything.
+        void replay(const kat::replay::Frame &frame) {
+            const uint32_t frameIndex = m_FrameCount++ % kat::MAX_FRAMES_IN_FLIGHT;
+            kat::vku::waitFence(m_Fences[frameIndex]);
+            kat::vku::resetFence(m_Fences[frameIndex]);
+
+            kat::renderloopCycle(); // no windows, so this only retires finished otc submissions
+
+            size_t lastSubmit = SIZE_MAX;
+            for (size_t i = 0; i < frame.ops.size(); i++) {
+                if (std::holds_alternative<kat::replay::Submit>(frame.ops[i])) lastSubmit = i;
+            }
+
+            for (size_t i = 0; i < frame.ops.size(); i++) {
+                if (const auto *submit = std::get_if<kat::replay::Submit>(&frame.ops[i])) {
+                    replaySubmit(*submit, i == lastSubmit ? m_Fences[frameIndex] : vk::Fence{});
+                } else {
+                    consumeSignaled(); // present
+                }
+            }
+
+            if (lastSubmit == SIZE_MAX) {
+                // nothing submitted, the fence still has to be signaled for the next time this frame index comes around.
+                kat::globalState->mainQueue.submit2(vk::SubmitInfo2{}, m_Fences[frameIndex]);
+            }
+
+            consumeSignaled(); // anything signaled but never waited on in the capture
+        }
+
+      private:
+        const Target &target(vk::Extent2D extent) {
+            const auto key = std::make_pair(extent.width, extent.height);
+            if (auto it = m_Targets.find(key); it != m_Targets.end()) return it->second;
+
+            const auto &device = kat::globalState->device;
+            Target t{};
+
+            auto ici = vk::ImageCreateInfo()
+                               .setImageType(vk::ImageType::e2D)
+                               .setFormat(TARGET_FORMAT)
+                               .setExtent(vk::Extent3D(extent, 1))
+                               .setMipLevels(1)
+                               .setArrayLayers(1)
+                               .setSamples(vk::SampleCountFlagBits::e1)
+                               .setTiling(vk::ImageTiling::eOptimal)
+                               .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst)
+                               .setSharingMode(vk::SharingMode::eExclusive)
+                               .setInitialLayout(vk::ImageLayout::eUndefined);
+            t.image = device.createImage(ici);
+
+            auto requirements = device.getImageMemoryRequirements(t.image);
+            t.memory = kat::vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, kat::vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)));
+            device.bindImageMemory(t.image, t.memory, 0);
+
+            t.view = device.createImageView(vk::ImageViewCreateInfo({}, t.image, vk::ImageViewType::e2D, TARGET_FORMAT, {}, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+            t.framebuffer = m_RenderPass->createCompatibleFramebuffer(t.view, vk::Extent3D(extent, 1));
+
+            return m_Targets.emplace(key, t).first->second;
+        }
+
+        vk::Semaphore acquireSemaphore() {
+            if (m_FreeSemaphores.empty()) return kat::vku::createSemaphore();
+
+            vk::Semaphore semaphore = m_FreeSemaphores.back();
+            m_FreeSemaphores.pop_back();
+            return semaphore;
+        }
+
+        // waits on every semaphore that was signaled and not waited on yet, which makes them reusable.
+        void consumeSignaled() {
+            if (m_SignaledSemaphores.empty()) return;
+
+            m_WaitInfos.clear();
+            for (const auto &semaphore: m_SignaledSemaphores) {
+                m_WaitInfos.emplace_back(semaphore, 0, vk::PipelineStageFlagBits2::eAllCommands);
+                m_FreeSemaphores.push_back(semaphore);
+            }
+            m_SignaledSemaphores.clear();
+
+            kat::globalState->mainQueue.submit2(vk::SubmitInfo2({}, m_WaitInfos));
+        }
+
+        void replaySubmit(const kat::replay::Submit &submit, vk::Fence fence) {
+            // multiple waits/signals per submit are folded into one, otc only has one of each.
+            kat::vku::OTCSync sync{};
+            sync.waitStage = vk::PipelineStageFlagBits2::eAllCommands;
+            sync.signalStage = vk::PipelineStageFlagBits2::eAllCommands;
+
+            if (submit.op.waitSemaphores > 0 && !m_SignaledSemaphores.empty()) {
+                sync.wait = m_SignaledSemaphores.front();
+                m_SignaledSemaphores.pop_front();
+            }
+
+            if (submit.op.signalSemaphores > 0) sync.signal = acquireSemaphore();
+
+            // the captured commands are replayed into the otc command buffer.
+            const auto *commands = &submit.commands;
+            auto record = [this, commands](const vk::CommandBuffer &cmd) {
+                kat::CommandRecorder recorder(cmd);
+                for (const auto &command: *commands) {
+                    if (const auto *begin = std::get_if<kat::replay::BeginRenderPassOp>(&command)) {
+                        const vk::Extent2D extent(std::max(begin->width, 1U), std::max(begin->height, 1U));
+                        m_BeginInfo.framebuffer = target(extent).framebuffer;
+                        m_BeginInfo.renderArea = vk::Rect2D({0, 0}, extent);
+                        recorder.beginRenderPass(m_RenderPass, m_BeginInfo);
+                    } else if (std::holds_alternative<kat::replay::EndRenderPassOp>(command)) {
+                        recorder.endRenderPass();
+                    } else if (const auto *barrier = std::get_if<kat::replay::BarrierOp>(&command)) {
+                        recorder.pipelineBarrier(barriers(*barrier));
+                    }
+                }
+            };
+
+            if (fence) {
+                kat::vku::otc(record, fence, sync);
+            } else {
+                kat::vku::otc(record, sync);
+            }
+
+            if (sync.wait) m_FreeSemaphores.push_back(sync.wait);
+            if (sync.signal) m_SignaledSemaphores.push_back(sync.signal);
+        }
+
+        const kat::vku::DependencyInfo &barriers(const kat::replay::BarrierOp &op) {
+            const kat::vku::MemoryStageReference all{vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite};
+
+            m_Barriers.memoryBarriers.assign(op.memoryBarriers, kat::vku::MemoryBarrier{all, all});
+            m_Barriers.bufferMemoryBarriers.assign(op.bufferBarriers, kat::vku::BufferMemoryBarrier{all, all, vk::QueueFamilyIgnored, vk::QueueFamilyIgnored, m_BarrierBuffer, {0, vk::WholeSize}});
+            m_Barriers.imageMemoryBarriers.assign(op.imageBarriers, kat::vku::ImageMemoryBarrier{all, all, vk::QueueFamilyIgnored, vk::QueueFamilyIgnored, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, m_BarrierTarget.image, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)});
+            return m_Barriers;
+        }
+
+        std::shared_ptr<kat::RenderPass> m_RenderPass;
+        std::map<std::pair<uint32_t, uint32_t>, Target> m_Targets;
+        Target m_BarrierTarget;
+        vk::Buffer m_BarrierBuffer;
+        vk::DeviceMemory m_BarrierBufferMemory;
+
+        kat::FrameSet<vk::Fence> m_Fences;
+        uint64_t m_FrameCount = 0;
+
+        std::vector<vk::Semaphore> m_FreeSemaphores;
+        std::deque<vk::Semaphore> m_SignaledSemaphores;
+        std::vector<vk::SemaphoreSubmitInfo> m_WaitInfos;
+
+        kat::cmd::RenderPassBeginInfo m_BeginInfo;
+        kat::vku::DependencyInfo m_Barriers;
+    };
+
+    void usage() {
+        std::cerr << "usage: katengine_replay CAPTURE [--loops N] [--output FILE] [--validation]\n";
+    }
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::string capturePath, outputPath;
+    uint32_t loops = 1;
+    bool validation = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if (arg == "--loops" && i + 1 < argc) loops = std::stoul(argv[++i]);
+        else if (arg == "--output" && i + 1 < argc) outputPath = argv[++i];
+        else if (arg == "--validation") validation = true;
+        else if (capturePath.empty() && !arg.starts_with("--")) capturePath = arg;
+        else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (capturePath.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    kat::init();
+    kat::setValidationLayersEnabled(validation);
+    kat::setLogLevel(spdlog::level::warn);
+    kat::setHeadless(true);
+    kat::startup();
+
+    std::vector<double> captured, replayed;
+    std::vector<uint64_t> frameNumbers;
+
+    {
+        Replayer replayer;
+        kat::replay::Frame frame;
+
+        for (uint32_t loop = 0; loop < loops; loop++) {
+            kat::replay::CaptureReader reader(capturePath);
+            if (!reader.isValid()) {
+                spdlog::error("{} isn't a replay capture (or was written by a newer version)", capturePath);
+                return EXIT_FAILURE;
+            }
+
+            if (loop == 0) spdlog::warn("Replaying capture from {}", reader.getHeader().deviceName);
+
+            auto last = Clock::now();
+            bool first = true;
+            while (reader.next(frame)) {
+                replayer.replay(frame);
+
+                const auto now = Clock::now();
+                if (!first) {
+                    replayed.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+                    captured.push_back(static_cast<double>(frame.op.nanoseconds) / 1000000.0);
+                    frameNumbers.push_back(frame.op.frame);
+                }
+                first = false; // the first frame has nothing before it to measure against
+                last = now;
+            }
+        }
+    }
+
+    // slowest replayed frames, the spikes worth looking at.
+    std::vector<size_t> order(replayed.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return replayed[a] > replayed[b]; });
+    order.resize(std::min<size_t>(order.size(), 10));
+
+    const auto capturedPercentiles = bench::percentiles(captured);
+    const auto replayedPercentiles = bench::percentiles(replayed);
+
+    std::ofstream file;
+    if (!outputPath.empty()) file.open(outputPath);
+    std::ostream &out = outputPath.empty() ? std::cout : file;
+
+    auto writePercentiles = [&](const bench::Percentiles &p) {
+        out << "{\"mean\": " << p.mean << ", \"p50\": " << p.p50 << ", \"p90\": " << p.p90 << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << "}";
+    };
+
+    out << "{\n  \"capture\": \"" << capturePath << "\",\n  \"device\": \"" << kat::globalState->physicalDeviceProperties.deviceName.data() << "\",\n";
+    out << "  \"frames\": " << replayed.size() << ",\n";
+    out << "  \"captured_frame_time_ms\": ";
+    writePercentiles(capturedPercentiles);
+    out << ",\n  \"replayed_frame_time_ms\": ";
+    writePercentiles(replayedPercentiles);
+    out << ",\n  \"slowest_frames\": [";
+    for (size_t i = 0; i < order.size(); i++) {
+        out << (i == 0 ? "\n" : ",\n") << "    {\"frame\": " << frameNumbers[order[i]] << ", \"replayed_ms\": " << replayed[order[i]] << ", \"captured_ms\": " << captured[order[i]] << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    kat::globalState->wrapup();
+    kat::terminate();
+    return EXIT_SUCCESS;
+}
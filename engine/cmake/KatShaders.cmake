@@ -0,0 +1,44 @@
+# kat_compile_shaders(<target> OUTPUT_DIR <dir> SOURCES <files...> [FLAGS <glslc flags...>])
+#
+# Compiles GLSL (.vert, .frag, .comp, ...) and HLSL (<name>.<stage>.hlsl, e.g. blit.frag.hlsl) to SPIR-V at build time with glslc.
+# Every source becomes <OUTPUT_DIR>/<file name>.spv, which kat::ShaderCache loads at runtime. Depfiles are used so includes trigger a rebuild.
+
+if (NOT Vulkan_GLSLC_EXECUTABLE)
+    find_program(Vulkan_GLSLC_EXECUTABLE glslc HINTS $ENV{VULKAN_SDK}/bin)
+endif ()
+
+function(kat_compile_shaders target)
+    cmake_parse_arguments(PARSE_ARGV 1 ARG "" "OUTPUT_DIR" "SOURCES;FLAGS")
+
+    if (NOT Vulkan_GLSLC_EXECUTABLE)
+        message(FATAL_ERROR "kat_compile_shaders: glslc not found (install the Vulkan SDK or set Vulkan_GLSLC_EXECUTABLE)")
+    endif ()
+    if (NOT ARG_OUTPUT_DIR)
+        set(ARG_OUTPUT_DIR ${CMAKE_CURRENT_BINARY_DIR}/shaders)
+    endif ()
+
+    set(outputs)
+    foreach (source IN LISTS ARG_SOURCES)
+        cmake_path(ABSOLUTE_PATH source BASE_DIRECTORY ${CMAKE_CURRENT_SOURCE_DIR} OUTPUT_VARIABLE source_path)
+        cmake_path(GET source_path FILENAME name)
+        set(output ${ARG_OUTPUT_DIR}/${name}.spv)
+
+        set(flags ${ARG_FLAGS})
+        if (name MATCHES "\\.([a-z]+)\\.hlsl$")
+            list(APPEND flags -x hlsl -fshader-stage=${CMAKE_MATCH_1})
+        endif ()
+
+        add_custom_command(
+                OUTPUT ${output}
+                COMMAND ${CMAKE_COMMAND} -E make_directory ${ARG_OUTPUT_DIR}
+                COMMAND ${Vulkan_GLSLC_EXECUTABLE} ${flags} --target-env=vulkan1.3 -MD -MF ${output}.d -o ${output} ${source_path}
+                MAIN_DEPENDENCY ${source_path}
+                DEPFILE ${output}.d
+                COMMENT "Compiling shader ${name}"
+                VERBATIM)
+        list(APPEND outputs ${output})
+    endforeach ()
+
+    add_custom_target(${target}_shaders DEPENDS ${outputs})
+    add_dependencies(${target} ${target}_shaders)
+endfunction()
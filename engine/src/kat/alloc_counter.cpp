@@ -0,0 +1,27 @@
+#include "alloc_counter.hpp"
+
+namespace kat::alloc {
+    namespace {
+        std::atomic<uint64_t> s_Count = 0;
+        std::atomic_bool s_Installed = false;
+        thread_local uint64_t t_Count = 0;
+    } // namespace
+
+    void record() noexcept {
+        s_Installed.store(true, std::memory_order_relaxed);
+        s_Count.fetch_add(1, std::memory_order_relaxed);
+        t_Count++;
+    }
+
+    bool installed() noexcept {
+        return s_Installed.load(std::memory_order_relaxed);
+    }
+
+    uint64_t count() noexcept {
+        return s_Count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t threadCount() noexcept {
+        return t_Count;
+    }
+} // namespace kat::alloc
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace kat::alloc {
+    /**
+     * Counters used to verify that hot paths (like the steady-state frame loop) don't touch the heap.
+     *
+     * The engine can't replace the global allocator on its own (it's a static library), so nothing is counted unless the executable
+     * installs the counting operator new with KAT_INSTALL_ALLOCATION_COUNTER() in exactly one of its source files.
+     */
+    void record() noexcept;
+
+    [[nodiscard]] bool installed() noexcept;
+
+    // allocations made by every thread since startup
+    [[nodiscard]] uint64_t count() noexcept;
+
+    // allocations made by the calling thread since startup
+    [[nodiscard]] uint64_t threadCount() noexcept;
+
+    /**
+     * Counts the allocations made by the current thread while it is alive.
+     */
+    class Scope {
+      public:
+        inline Scope() noexcept : m_Start(threadCount()){};
+
+        [[nodiscard]] inline uint64_t allocations() const noexcept { return threadCount() - m_Start; };
+
+      private:
+        uint64_t m_Start;
+    };
+} // namespace kat::alloc
+
+// clang-format off
+#define KAT_INSTALL_ALLOCATION_COUNTER()                                                                                   \
+    void *operator new(std::size_t size) {                                                                                 \
+        kat::alloc::record();                                                                                              \
+        if (void *p = std::malloc(size ? size : 1)) return p;                                                              \
+        throw std::bad_alloc();                                                                                            \
+    }                                                                                                                      \
+    void *operator new[](std::size_t size) { return ::operator new(size); }                                                \
+    void *operator new(std::size_t size, const std::nothrow_t &) noexcept {                                                \
+        kat::alloc::record();                                                                                              \
+        return std::malloc(size ? size : 1);                                                                               \
+    }                                                                                                                      \
+    void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept { return ::operator new(size, tag); }       \
+    void operator delete(void *p) noexcept { std::free(p); }                                                               \
+    void operator delete[](void *p) noexcept { std::free(p); }                                                             \
+    void operator delete(void *p, std::size_t) noexcept { std::free(p); }                                                  \
+    void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+// clang-format on
@@ -0,0 +1,128 @@
+#include "asset_loader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "kat/trace.hpp"
+
+namespace kat {
+    AssetLoader::AssetLoader(const AssetPackage &package, vk::DeviceSize stagingCapacity)
+        : m_Scheduler(*globalState->scheduler), m_Package(package), m_Ring(stagingCapacity), m_RingMutex(*globalState->scheduler) {}
+
+    Task<std::vector<std::byte>> AssetLoader::load(const AssetEntry &entry) {
+        co_await fetch(entry);
+
+        KAT_TRACE_ZONE("AssetLoader::load");
+        std::vector<std::byte> data(entry.size);
+        m_Package.read(entry, data);
+        co_return data;
+    }
+
+    Task<void> AssetLoader::read(const AssetEntry &entry, std::span<std::byte> destination) {
+        co_await fetch(entry);
+
+        KAT_TRACE_ZONE("AssetLoader::read");
+        m_Package.read(entry, destination);
+    }
+
+    Task<void> AssetLoader::uploadBuffer(const AssetEntry &entry, vk::Buffer destination, vk::DeviceSize destinationOffset) {
+        if (entry.size == 0) co_return;
+        co_await fetch(entry);
+
+        uint64_t value;
+        {
+            auto lock = co_await m_RingMutex.lock();
+            value = co_await record(stageBuffer(entry, destination, destinationOffset));
+        }
+
+        co_await m_Scheduler.wait(m_Ring.getTimeline(), value);
+    }
+
+    Task<void> AssetLoader::uploadTexture(const AssetEntry &entry, vk::Image destination, vk::ImageLayout finalLayout) {
+        co_await fetch(entry);
+
+        uint64_t value;
+        {
+            auto lock = co_await m_RingMutex.lock();
+            value = co_await record(stageTexture(entry, destination, finalLayout));
+        }
+
+        co_await m_Scheduler.wait(m_Ring.getTimeline(), value);
+    }
+
+    Task<void> AssetLoader::fetch(const AssetEntry &entry) {
+        co_await m_Scheduler.schedule();
+
+        KAT_TRACE_ZONE("AssetLoader::fetch");
+        m_Package.prefetch(entry);
+
+        // touch every page, so this worker waits for the disk instead of whoever decompresses (and holds the ring).
+        const auto stored = m_Package.getStored(entry);
+        volatile std::byte sink{};
+        for (size_t i = 0; i < stored.size(); i += 4096) sink = stored[i];
+    }
+
+    Task<uint64_t> AssetLoader::record(Task<void> copies) {
+        std::exception_ptr exception;
+        try {
+            co_await copies;
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        // uploads that already recorded into the batch rely on it being submitted, even if this one failed.
+        const uint64_t value = m_Ring.getRecordingValue();
+        if (!m_RingMutex.hasWaiters()) m_Ring.submit();
+
+        if (exception) std::rethrow_exception(exception);
+        co_return value;
+    }
+
+    Task<void> AssetLoader::stageBuffer(const AssetEntry &entry, vk::Buffer destination, vk::DeviceSize destinationOffset) {
+        if (entry.compression != AssetCompression::eNone) {
+            const auto allocation = co_await allocate(entry.size);
+            m_Package.read(entry, allocation.data);
+            m_Ring.copyToBuffer(allocation, destination, destinationOffset);
+            co_return;
+        }
+
+        // in pieces, see kat::uploadBuffer()
+        const auto stored = m_Package.getStored(entry);
+        const vk::DeviceSize piece = std::max<vk::DeviceSize>(m_Ring.getCapacity() / 4, 1);
+        for (vk::DeviceSize offset = 0; offset < stored.size(); offset += piece) {
+            const vk::DeviceSize size = std::min<vk::DeviceSize>(piece, stored.size() - offset);
+            const auto allocation = co_await allocate(size);
+            std::memcpy(allocation.data.data(), stored.data() + offset, size);
+            m_Ring.copyToBuffer(allocation, destination, destinationOffset + offset);
+        }
+    }
+
+    Task<void> AssetLoader::stageTexture(const AssetEntry &entry, vk::Image destination, vk::ImageLayout finalLayout) {
+        const auto regions = getTextureRegions(m_Package, entry);
+
+        const auto allocation = co_await allocate(entry.size); // the default alignment keeps the levels where the package put them
+        m_Package.read(entry, allocation.data);
+        m_Ring.copyToImage(allocation, destination, regions, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, entry.mipLevels, 0, 1), finalLayout);
+    }
+
+    Task<StagingRing::Allocation> AssetLoader::allocate(vk::DeviceSize size) {
+        while (true) {
+            if (auto allocation = m_Ring.tryAllocate(size)) co_return *allocation;
+            co_await m_Scheduler.wait(m_Ring.getTimeline(), m_Ring.getOldestValue());
+        }
+    }
+
+    Task<std::vector<std::byte>> readFile(Scheduler &scheduler, std::filesystem::path path) {
+        co_await scheduler.schedule();
+
+        KAT_TRACE_ZONE("readFile");
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) throw std::runtime_error("Failed to open " + path.string());
+
+        std::vector<std::byte> data(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()))) throw std::runtime_error("Failed to read " + path.string());
+        co_return data;
+    }
+} // namespace kat
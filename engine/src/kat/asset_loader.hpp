@@ -0,0 +1,70 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "kat/asset_package.hpp"
+#include "kat/render/staging_ring.hpp"
+#include "kat/scheduler.hpp"
+
+namespace kat {
+
+    /**
+     * Loads assets out of a package with coroutines, so hundreds of loads can be in flight without a thread (or a callback chain) each:
+     *
+     *     std::vector<Task<void>> loads;
+     *     for (...) loads.push_back(loader.uploadTexture(*package.find(name), image));
+     *     co_await globalState->scheduler->whenAll(std::move(loads)); // or scheduler->run() outside of a coroutine
+     *
+     * Every load first reads its payload on a worker, faulting the mapped pages in, so loads wait on the disk in parallel. Decompression runs on the
+     * workers too. Uploads decompress straight into the loader's StagingRing, one at a time since they share it, and the last one recorded before the
+     * ring is free submits the batch, so concurrent uploads share transfer submissions. If the ring is full, the upload awaits the oldest batch instead of
+     * blocking its worker. An upload finishes once its copies have, the destination is then usable by anything submitted to the main queue.
+     *
+     * Entries are referenced until the load finishes, which is fine for entries from getEntries()/find(). The package has to outlive the loader.
+     */
+    class AssetLoader {
+      public:
+        explicit AssetLoader(const AssetPackage &package, vk::DeviceSize stagingCapacity = 64ULL * 1024 * 1024);
+
+        // the decompressed payload.
+        Task<std::vector<std::byte>> load(const AssetEntry &entry);
+
+        // decompress into destination, which has to be entry.size bytes and outlive the task.
+        Task<void> read(const AssetEntry &entry, std::span<std::byte> destination);
+
+        // see kat::uploadBuffer()/kat::uploadTexture().
+        Task<void> uploadBuffer(const AssetEntry &entry, vk::Buffer destination, vk::DeviceSize destinationOffset = 0);
+        Task<void> uploadTexture(const AssetEntry &entry, vk::Image destination, vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+        [[nodiscard]] inline const AssetPackage &getPackage() const noexcept { return m_Package; };
+
+        AssetLoader(const AssetLoader &) = delete;
+        AssetLoader &operator=(const AssetLoader &) = delete;
+
+      private:
+        // continue on a worker once the payload is in memory.
+        Task<void> fetch(const AssetEntry &entry);
+
+        // with m_RingMutex held. records copies, then submits the batch unless another upload is about to add to it. returns the value it signals.
+        Task<uint64_t> record(Task<void> copies);
+
+        // the copies of uploadBuffer()/uploadTexture(), like kat::uploadBuffer()/kat::uploadTexture() but awaiting ring space.
+        Task<void> stageBuffer(const AssetEntry &entry, vk::Buffer destination, vk::DeviceSize destinationOffset);
+        Task<void> stageTexture(const AssetEntry &entry, vk::Image destination, vk::ImageLayout finalLayout);
+
+        // with m_RingMutex held. continues on a worker once the ring was full.
+        Task<StagingRing::Allocation> allocate(vk::DeviceSize size);
+
+        Scheduler &m_Scheduler;
+        const AssetPackage &m_Package;
+
+        StagingRing m_Ring;
+        AsyncMutex m_RingMutex;
+    };
+
+    // read a whole file on a worker of scheduler. throws std::runtime_error if it can't be read.
+    Task<std::vector<std::byte>> readFile(Scheduler &scheduler, std::filesystem::path path);
+
+} // namespace kat
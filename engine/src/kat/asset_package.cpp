@@ -0,0 +1,437 @@
+#include "asset_package.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef KATENGINE_LZ4
+#include <lz4.h>
+#endif
+#ifdef KATENGINE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "kat/render/staging_ring.hpp"
+#include "kat/trace.hpp"
+
+static_assert(std::endian::native == std::endian::little, "asset packages are little endian");
+
+namespace kat {
+    namespace {
+        constexpr uint64_t MIP_ALIGNMENT = 16; // texture levels start at multiples of this in the payload, which satisfies every copy offset rule
+        constexpr uint32_t MAX_TEXTURE_EXTENT = 65536; // texture entries beyond this (far past any device's limit) are treated as corrupt
+
+        uint64_t alignUp(uint64_t value, uint64_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        uint32_t texelSize(vk::Format format) {
+            switch (format) {
+                case vk::Format::eR8Unorm:
+                    return 1;
+                case vk::Format::eR8G8Unorm:
+                    return 2;
+                case vk::Format::eR8G8B8A8Unorm:
+                case vk::Format::eR8G8B8A8Srgb:
+                case vk::Format::eB8G8R8A8Unorm:
+                case vk::Format::eB8G8R8A8Srgb:
+                case vk::Format::eA2B10G10R10UnormPack32:
+                case vk::Format::eR32Sfloat:
+                    return 4;
+                case vk::Format::eR16G16B16A16Sfloat:
+                    return 8;
+                case vk::Format::eR32G32B32A32Sfloat:
+                    return 16;
+                default:
+                    throw std::runtime_error("Unsupported texture asset format " + vk::to_string(format));
+            }
+        }
+
+        // where each level starts in a texture payload, with the payload size as the last element. packed is the same without the alignment.
+        std::vector<uint64_t> mipOffsets(vk::Format format, uint32_t width, uint32_t height, uint32_t mipLevels, bool packed = false) {
+            const uint32_t texel = texelSize(format);
+
+            std::vector<uint64_t> offsets(mipLevels + 1);
+            uint64_t offset = 0;
+            for (uint32_t mip = 0; mip < mipLevels; mip++) {
+                offsets[mip] = offset;
+                offset += static_cast<uint64_t>(std::max(width >> mip, 1U)) * std::max(height >> mip, 1U) * texel;
+                if (!packed) offset = alignUp(offset, MIP_ALIGNMENT);
+            }
+            offsets[mipLevels] = offset;
+            return offsets;
+        }
+
+        const char *compressionName(AssetCompression compression) {
+            switch (compression) {
+                case AssetCompression::eNone:
+                    return "none";
+                case AssetCompression::eLZ4:
+                    return "LZ4";
+                case AssetCompression::eZstd:
+                    return "zstd";
+            }
+            return "unknown";
+        }
+    } // namespace
+
+    AssetPackage::AssetPackage(const std::filesystem::path &path) {
+        KAT_TRACE_ZONE("AssetPackage::open");
+
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) throw std::runtime_error("Failed to open asset package " + path.string());
+
+        m_Storage.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(m_Storage.data()), static_cast<std::streamsize>(m_Storage.size()));
+        m_Data = m_Storage.data();
+        m_Size = m_Storage.size();
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Failed to open asset package " + path.string());
+
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read asset package " + path.string());
+        }
+
+        m_Size = static_cast<size_t>(st.st_size);
+        void *mapping = ::mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) throw std::runtime_error("Failed to map asset package " + path.string());
+        m_Data = static_cast<const std::byte *>(mapping);
+#endif
+
+        try {
+            if (m_Size < sizeof(AssetPackageHeader)) throw std::runtime_error("Not an asset package: " + path.string());
+
+            AssetPackageHeader header{};
+            std::memcpy(&header, m_Data, sizeof(header));
+            if (header.magic != AssetPackageHeader::MAGIC) throw std::runtime_error("Not an asset package: " + path.string());
+            if (header.version != AssetPackageHeader::VERSION) throw std::runtime_error("Unsupported asset package version " + std::to_string(header.version) + ": " + path.string());
+
+            const uint64_t indexSize = static_cast<uint64_t>(header.entryCount) * sizeof(AssetEntry);
+            if (header.indexOffset % alignof(AssetEntry) != 0 || header.indexOffset > m_Size || indexSize > m_Size - header.indexOffset || header.namesOffset > m_Size ||
+                header.namesSize > m_Size - header.namesOffset) {
+                throw std::runtime_error("Corrupt asset package header: " + path.string());
+            }
+
+            m_Entries = std::span(reinterpret_cast<const AssetEntry *>(m_Data + header.indexOffset), header.entryCount);
+            m_Names = std::string_view(reinterpret_cast<const char *>(m_Data + header.namesOffset), header.namesSize);
+
+            for (size_t i = 0; i < m_Entries.size(); i++) {
+                const AssetEntry &entry = m_Entries[i];
+                if (entry.offset > m_Size || entry.storedSize > m_Size - entry.offset || entry.nameOffset > m_Names.size() || entry.nameLength > m_Names.size() - entry.nameOffset ||
+                    (i > 0 && m_Entries[i - 1].nameHash > entry.nameHash)) {
+                    throw std::runtime_error("Corrupt asset package index: " + path.string());
+                }
+
+                // read() copies size bytes of uncompressed entries straight out of the mapping.
+                if (entry.compression == AssetCompression::eNone && entry.size != entry.storedSize) throw std::runtime_error("Corrupt asset package index: " + path.string());
+
+                // bounded before anything computes mip offsets (or allocates for them) from the entry.
+                if (entry.type == AssetType::eTexture) {
+                    if (entry.width == 0 || entry.height == 0 || entry.width > MAX_TEXTURE_EXTENT || entry.height > MAX_TEXTURE_EXTENT || entry.mipLevels == 0 ||
+                        entry.mipLevels > static_cast<uint32_t>(std::bit_width(std::max(entry.width, entry.height)))) {
+                        throw std::runtime_error("Corrupt asset package index: " + path.string());
+                    }
+                }
+            }
+        } catch (...) {
+#ifndef _WIN32
+            ::munmap(const_cast<std::byte *>(m_Data), m_Size);
+#endif
+            throw;
+        }
+    }
+
+    AssetPackage::~AssetPackage() {
+#ifndef _WIN32
+        ::munmap(const_cast<std::byte *>(m_Data), m_Size);
+#endif
+    }
+
+    const AssetEntry *AssetPackage::find(std::string_view name) const noexcept {
+        const uint64_t hash = hashName(name);
+        auto it = std::ranges::lower_bound(m_Entries, hash, {}, &AssetEntry::nameHash);
+        for (; it != m_Entries.end() && it->nameHash == hash; ++it) {
+            if (getName(*it) == name) return &*it;
+        }
+        return nullptr;
+    }
+
+    std::string_view AssetPackage::getName(const AssetEntry &entry) const noexcept {
+        return m_Names.substr(entry.nameOffset, entry.nameLength);
+    }
+
+    std::span<const std::byte> AssetPackage::getStored(const AssetEntry &entry) const noexcept {
+        return {m_Data + entry.offset, static_cast<size_t>(entry.storedSize)};
+    }
+
+    void AssetPackage::read(const AssetEntry &entry, std::span<std::byte> destination) const {
+        if (destination.size() != entry.size) throw std::runtime_error("Asset read destination is " + std::to_string(destination.size()) + " bytes, the asset has " + std::to_string(entry.size));
+
+        const auto stored = getStored(entry);
+        switch (entry.compression) {
+            case AssetCompression::eNone:
+                std::memcpy(destination.data(), stored.data(), destination.size());
+                return;
+
+#ifdef KATENGINE_LZ4
+            case AssetCompression::eLZ4: {
+                if (stored.size() > INT32_MAX || destination.size() > INT32_MAX) throw std::runtime_error("LZ4 asset is too large: " + std::string(getName(entry)));
+                const int size = LZ4_decompress_safe(reinterpret_cast<const char *>(stored.data()), reinterpret_cast<char *>(destination.data()), static_cast<int>(stored.size()), static_cast<int>(destination.size()));
+                if (size < 0 || static_cast<size_t>(size) != destination.size()) throw std::runtime_error("Corrupt LZ4 asset: " + std::string(getName(entry)));
+                return;
+            }
+#endif
+
+#ifdef KATENGINE_ZSTD
+            case AssetCompression::eZstd: {
+                const size_t size = ZSTD_decompress(destination.data(), destination.size(), stored.data(), stored.size());
+                if (ZSTD_isError(size) || size != destination.size()) throw std::runtime_error("Corrupt zstd asset: " + std::string(getName(entry)));
+                return;
+            }
+#endif
+
+            default:
+                throw std::runtime_error(std::string("Asset compression ") + compressionName(entry.compression) + " isn't supported by this build: " + std::string(getName(entry)));
+        }
+    }
+
+    void AssetPackage::prefetch(const AssetEntry &entry) const noexcept {
+#ifndef _WIN32
+        // madvise wants a page aligned start
+        static const auto pageSize = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        const uint64_t start = entry.offset / pageSize * pageSize;
+        ::madvise(const_cast<std::byte *>(m_Data) + start, entry.offset + entry.storedSize - start, MADV_WILLNEED);
+#endif
+    }
+
+    bool AssetPackage::isSupported(AssetCompression compression) noexcept {
+        switch (compression) {
+            case AssetCompression::eNone:
+                return true;
+            case AssetCompression::eLZ4:
+#ifdef KATENGINE_LZ4
+                return true;
+#else
+                return false;
+#endif
+            case AssetCompression::eZstd:
+#ifdef KATENGINE_ZSTD
+                return true;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    uint64_t AssetPackage::hashName(std::string_view name) noexcept {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (const char c: name) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    AssetPackageWriter::AssetPackageWriter(uint32_t alignment) : m_Alignment(std::max(alignment, static_cast<uint32_t>(MIP_ALIGNMENT))) {
+        if (!std::has_single_bit(alignment)) throw std::runtime_error("Asset package alignment has to be a power of two");
+    }
+
+    void AssetPackageWriter::add(std::string_view name, AssetType type, std::span<const std::byte> data, AssetCompression compression, const AssetTextureInfo &texture) {
+        if (!m_Names.emplace(name).second) throw std::runtime_error("Asset " + std::string(name) + " is already in the package");
+        if (!AssetPackage::isSupported(compression)) throw std::runtime_error(std::string("Asset compression ") + compressionName(compression) + " isn't supported by this build");
+
+        Pending pending;
+        pending.name = name;
+
+        AssetEntry &entry = pending.entry;
+        entry = {};
+        entry.nameHash = AssetPackage::hashName(name);
+        entry.type = type;
+        entry.format = vk::Format::eUndefined;
+
+        // texture levels are realigned, everything else is stored as is
+        std::vector<std::byte> aligned;
+        if (type == AssetType::eTexture) {
+            const auto packed = mipOffsets(texture.format, texture.width, texture.height, texture.mipLevels, true);
+            if (data.size() != packed.back()) throw std::runtime_error("Texture asset " + std::string(name) + " doesn't match its format, extent and mip levels");
+
+            const auto offsets = mipOffsets(texture.format, texture.width, texture.height, texture.mipLevels);
+            aligned.resize(offsets.back());
+            for (uint32_t mip = 0; mip < texture.mipLevels; mip++) {
+                std::memcpy(aligned.data() + offsets[mip], data.data() + packed[mip], packed[mip + 1] - packed[mip]);
+            }
+            data = aligned;
+
+            entry.format = texture.format;
+            entry.width = texture.width;
+            entry.height = texture.height;
+            entry.mipLevels = texture.mipLevels;
+        }
+        entry.size = data.size();
+
+        switch (compression) {
+            case AssetCompression::eNone:
+                break;
+
+#ifdef KATENGINE_LZ4
+            case AssetCompression::eLZ4: {
+                if (data.size() > INT32_MAX) throw std::runtime_error("Asset " + std::string(name) + " is too large for LZ4");
+                pending.payload.resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(data.size()))));
+                const int size = LZ4_compress_default(reinterpret_cast<const char *>(data.data()), reinterpret_cast<char *>(pending.payload.data()), static_cast<int>(data.size()), static_cast<int>(pending.payload.size()));
+                if (size <= 0) throw std::runtime_error("LZ4 compression of " + std::string(name) + " failed");
+                pending.payload.resize(static_cast<size_t>(size));
+                break;
+            }
+#endif
+
+#ifdef KATENGINE_ZSTD
+            case AssetCompression::eZstd: {
+                // packaging is offline and decompression speed hardly depends on the level.
+                pending.payload.resize(ZSTD_compressBound(data.size()));
+                const size_t size = ZSTD_compress(pending.payload.data(), pending.payload.size(), data.data(), data.size(), 15);
+                if (ZSTD_isError(size)) throw std::runtime_error("zstd compression of " + std::string(name) + " failed: " + ZSTD_getErrorName(size));
+                pending.payload.resize(size);
+                break;
+            }
+#endif
+
+            default:
+                break;
+        }
+
+        if (compression == AssetCompression::eNone || pending.payload.size() >= data.size()) {
+            entry.compression = AssetCompression::eNone;
+            pending.payload.assign(data.begin(), data.end());
+        } else {
+            entry.compression = compression;
+        }
+        entry.storedSize = pending.payload.size();
+
+        m_Assets.push_back(std::move(pending));
+    }
+
+    void AssetPackageWriter::write(const std::filesystem::path &path) const {
+        std::vector<const Pending *> order;
+        order.reserve(m_Assets.size());
+        for (const auto &asset: m_Assets) order.push_back(&asset);
+        std::ranges::sort(order, {}, [](const Pending *p) { return p->entry.nameHash; });
+
+        AssetPackageHeader header{};
+        header.magic = AssetPackageHeader::MAGIC;
+        header.version = AssetPackageHeader::VERSION;
+        header.entryCount = static_cast<uint32_t>(order.size());
+        header.alignment = m_Alignment;
+        header.indexOffset = sizeof(AssetPackageHeader);
+        header.namesOffset = header.indexOffset + order.size() * sizeof(AssetEntry);
+
+        std::vector<AssetEntry> entries;
+        entries.reserve(order.size());
+        std::string names;
+
+        for (const Pending *asset: order) {
+            AssetEntry entry = asset->entry;
+            entry.nameOffset = static_cast<uint32_t>(names.size());
+            entry.nameLength = static_cast<uint32_t>(asset->name.size());
+            names += asset->name;
+            entries.push_back(entry);
+        }
+        header.namesSize = names.size();
+
+        uint64_t offset = header.namesOffset + header.namesSize;
+        for (AssetEntry &entry: entries) {
+            offset = alignUp(offset, m_Alignment);
+            entry.offset = offset;
+            offset += entry.storedSize;
+        }
+        header.fileSize = offset;
+
+        std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Failed to open " + path.string() + " for writing");
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(AssetEntry)));
+        out.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+        uint64_t written = header.namesOffset + header.namesSize;
+        static const std::vector<char> padding(4096, 0);
+        for (size_t i = 0; i < entries.size(); i++) {
+            while (written < entries[i].offset) {
+                const auto n = static_cast<std::streamsize>(std::min<uint64_t>(entries[i].offset - written, padding.size()));
+                out.write(padding.data(), n);
+                written += static_cast<uint64_t>(n);
+            }
+
+            const auto &payload = order[i]->payload;
+            out.write(reinterpret_cast<const char *>(payload.data()), static_cast<std::streamsize>(payload.size()));
+            written += payload.size();
+        }
+
+        if (!out) throw std::runtime_error("Failed to write " + path.string());
+    }
+
+    void uploadBuffer(StagingRing &ring, const AssetPackage &package, const AssetEntry &entry, vk::Buffer destination, vk::DeviceSize destinationOffset) {
+        KAT_TRACE_ZONE("uploadBuffer");
+        if (entry.size == 0) return;
+        package.prefetch(entry);
+
+        if (entry.compression != AssetCompression::eNone) {
+            const auto allocation = ring.allocate(entry.size);
+            package.read(entry, allocation.data);
+            ring.copyToBuffer(allocation, destination, destinationOffset);
+            return;
+        }
+
+        // uncompressed data goes from the mapping into the ring in pieces, so it doesn't have to fit and earlier pieces upload while later ones page in.
+        const auto stored = package.getStored(entry);
+        const vk::DeviceSize piece = std::max<vk::DeviceSize>(ring.getCapacity() / 4, 1);
+        for (vk::DeviceSize offset = 0; offset < stored.size(); offset += piece) {
+            const vk::DeviceSize size = std::min<vk::DeviceSize>(piece, stored.size() - offset);
+            const auto allocation = ring.allocate(size);
+            std::memcpy(allocation.data.data(), stored.data() + offset, size);
+            ring.copyToBuffer(allocation, destination, destinationOffset + offset);
+        }
+    }
+
+    void uploadTexture(StagingRing &ring, const AssetPackage &package, const AssetEntry &entry, vk::Image destination, vk::ImageLayout finalLayout) {
+        KAT_TRACE_ZONE("uploadTexture");
+        const auto regions = getTextureRegions(package, entry);
+
+        package.prefetch(entry);
+
+        const auto allocation = ring.allocate(entry.size, MIP_ALIGNMENT);
+        package.read(entry, allocation.data);
+        ring.copyToImage(allocation, destination, regions, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, entry.mipLevels, 0, 1), finalLayout);
+    }
+
+    std::vector<vk::BufferImageCopy> getTextureRegions(const AssetPackage &package, const AssetEntry &entry) {
+        if (entry.type != AssetType::eTexture) throw std::runtime_error("Asset " + std::string(package.getName(entry)) + " isn't a texture");
+
+        const auto offsets = mipOffsets(entry.format, entry.width, entry.height, entry.mipLevels);
+        if (offsets.back() != entry.size) throw std::runtime_error("Texture asset " + std::string(package.getName(entry)) + " doesn't match its format, extent and mip levels");
+
+        std::vector<vk::BufferImageCopy> regions(entry.mipLevels);
+        for (uint32_t mip = 0; mip < entry.mipLevels; mip++) {
+            regions[mip].bufferOffset = offsets[mip];
+            regions[mip].imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mip, 0, 1);
+            regions[mip].imageExtent = vk::Extent3D(std::max(entry.width >> mip, 1U), std::max(entry.height >> mip, 1U), 1);
+        }
+        return regions;
+    }
+} // namespace kat
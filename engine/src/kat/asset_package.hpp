@@ -0,0 +1,169 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace kat {
+
+    class StagingRing;
+
+    enum class AssetType : uint32_t {
+        eBlob = 0,
+        eBuffer = 1,
+        eTexture = 2, // mip levels one after another, each starting at a multiple of 16 bytes, uncompressed formats only
+    };
+
+    enum class AssetCompression : uint32_t {
+        eNone = 0,
+        eLZ4 = 1,
+        eZstd = 2,
+    };
+
+    struct AssetTextureInfo {
+        vk::Format format = vk::Format::eUndefined;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 1;
+    };
+
+    /**
+     * Packages (.kpak) are little endian: the header, then the index (one AssetEntry per asset, sorted by name hash), then the names, then the payloads,
+     * each starting at a multiple of the package's alignment (the page size by default), so payloads can be read straight out of a mapping of the file.
+     */
+    struct AssetPackageHeader {
+        static constexpr uint32_t MAGIC = 0x4B41504BU; // "KPAK"
+        static constexpr uint32_t VERSION = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t alignment;
+        uint64_t indexOffset;
+        uint64_t namesOffset;
+        uint64_t namesSize;
+        uint64_t fileSize;
+        uint8_t reserved[16];
+    };
+    static_assert(sizeof(AssetPackageHeader) == 64);
+
+    struct AssetEntry {
+        uint64_t nameHash; // 64 bit FNV-1a of the name
+        uint32_t nameOffset;
+        uint32_t nameLength;
+
+        uint64_t offset;     // of the payload, from the start of the file
+        uint64_t storedSize; // in the file
+        uint64_t size;       // after decompression
+
+        AssetType type;
+        AssetCompression compression;
+
+        // textures only
+        vk::Format format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+    };
+    static_assert(sizeof(AssetEntry) == 64);
+
+    /**
+     * A read-only asset package, memory mapped (read into memory on Windows).
+     *
+     * Payloads are never copied out of the mapping except into their destination: read() copies (or decompresses) straight into caller provided memory,
+     * and uploadBuffer()/uploadTexture() use a staging ring allocation as that destination. The kernel pages the file in as it's read, prefetch() starts
+     * that early so the disk stays busy while earlier assets are being copied.
+     *
+     * LZ4 and zstd entries need the engine to be built with the respective library (see isSupported()), reading them otherwise throws. Thread safe.
+     */
+    class AssetPackage {
+      public:
+        // throws std::runtime_error if the file can't be read or isn't a valid package.
+        explicit AssetPackage(const std::filesystem::path &path);
+        ~AssetPackage();
+
+        [[nodiscard]] const AssetEntry *find(std::string_view name) const noexcept;
+
+        [[nodiscard]] inline std::span<const AssetEntry> getEntries() const noexcept { return m_Entries; };
+
+        [[nodiscard]] std::string_view getName(const AssetEntry &entry) const noexcept;
+
+        // the payload as stored, compressed or not.
+        [[nodiscard]] std::span<const std::byte> getStored(const AssetEntry &entry) const noexcept;
+
+        /**
+         * Copy or decompress the payload into destination, which has to be entry.size bytes.
+         * Throws std::runtime_error if the compression isn't supported or the payload is corrupt.
+         */
+        void read(const AssetEntry &entry, std::span<std::byte> destination) const;
+
+        // hint that the payload will be read soon (madvise(MADV_WILLNEED)).
+        void prefetch(const AssetEntry &entry) const noexcept;
+
+        [[nodiscard]] static bool isSupported(AssetCompression compression) noexcept;
+
+        [[nodiscard]] static uint64_t hashName(std::string_view name) noexcept;
+
+        AssetPackage(const AssetPackage &) = delete;
+        AssetPackage &operator=(const AssetPackage &) = delete;
+
+      private:
+        const std::byte *m_Data = nullptr;
+        size_t m_Size = 0;
+#ifdef _WIN32
+        std::vector<std::byte> m_Storage;
+#endif
+
+        std::span<const AssetEntry> m_Entries;
+        std::string_view m_Names;
+    };
+
+    /**
+     * Builds packages, for tools. Compression happens in add().
+     */
+    class AssetPackageWriter {
+      public:
+        explicit AssetPackageWriter(uint32_t alignment = 4096);
+
+        /**
+         * Throws std::runtime_error if the name is already in the package, or the compression isn't supported by this build.
+         * Compressed payloads that don't end up smaller are stored uncompressed. Texture data is tightly packed, add() aligns the mip levels.
+         */
+        void add(std::string_view name, AssetType type, std::span<const std::byte> data, AssetCompression compression = AssetCompression::eNone, const AssetTextureInfo &texture = {});
+
+        // throws std::runtime_error if the file can't be written.
+        void write(const std::filesystem::path &path) const;
+
+      private:
+        struct Pending {
+            std::string name;
+            AssetEntry entry;
+            std::vector<std::byte> payload;
+        };
+
+        uint32_t m_Alignment;
+        std::vector<Pending> m_Assets;
+        std::unordered_set<std::string> m_Names;
+    };
+
+    /**
+     * Upload a buffer (or blob) asset into destination through ring. Uncompressed payloads larger than the ring are uploaded in pieces,
+     * compressed ones have to fit. The ring isn't submitted.
+     */
+    void uploadBuffer(StagingRing &ring, const AssetPackage &package, const AssetEntry &entry, vk::Buffer destination, vk::DeviceSize destinationOffset = 0);
+
+    /**
+     * Upload every mip level of a texture asset into destination, which has to match the entry's format, extent and mip count, and ends up in finalLayout.
+     * The payload has to fit into the ring. The ring isn't submitted.
+     */
+    void uploadTexture(StagingRing &ring, const AssetPackage &package, const AssetEntry &entry, vk::Image destination, vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    // the copies uploadTexture() records, with buffer offsets relative to the start of the payload. throws std::runtime_error if entry isn't a texture.
+    std::vector<vk::BufferImageCopy> getTextureRegions(const AssetPackage &package, const AssetEntry &entry);
+
+} // namespace kat
@@ -0,0 +1,93 @@
+#include "capabilities.hpp"
+
+#include <string_view>
+
+// feature (Capabilities member), the struct of DeviceFeatureChain it lives in, and its member there.
+#define KAT_REQUIRED_FEATURES(X)                                              \
+    X(synchronization2, vk::PhysicalDeviceVulkan13Features, synchronization2) \
+    X(timelineSemaphore, vk::PhysicalDeviceVulkan12Features, timelineSemaphore)
+
+#define KAT_OPTIONAL_FEATURES(X)                                                                                                   \
+    X(fillModeNonSolid, vk::PhysicalDeviceFeatures2, features.fillModeNonSolid)                                                    \
+    X(geometryShader, vk::PhysicalDeviceFeatures2, features.geometryShader)                                                        \
+    X(tessellationShader, vk::PhysicalDeviceFeatures2, features.tessellationShader)                                                \
+    X(wideLines, vk::PhysicalDeviceFeatures2, features.wideLines)                                                                  \
+    X(largePoints, vk::PhysicalDeviceFeatures2, features.largePoints)                                                              \
+    X(multiDrawIndirect, vk::PhysicalDeviceFeatures2, features.multiDrawIndirect)                                                  \
+    X(drawIndirectFirstInstance, vk::PhysicalDeviceFeatures2, features.drawIndirectFirstInstance)                                  \
+    X(samplerAnisotropy, vk::PhysicalDeviceFeatures2, features.samplerAnisotropy)                                                  \
+    X(pipelineStatisticsQuery, vk::PhysicalDeviceFeatures2, features.pipelineStatisticsQuery)                                      \
+    X(sparseBinding, vk::PhysicalDeviceFeatures2, features.sparseBinding)                                                          \
+    X(sparseResidencyImage2D, vk::PhysicalDeviceFeatures2, features.sparseResidencyImage2D)                                        \
+    X(variablePointers, vk::PhysicalDeviceVulkan11Features, variablePointers)                                                      \
+    X(variablePointersStorageBuffer, vk::PhysicalDeviceVulkan11Features, variablePointersStorageBuffer)                            \
+    X(shaderDrawParameters, vk::PhysicalDeviceVulkan11Features, shaderDrawParameters)                                              \
+    X(bufferDeviceAddress, vk::PhysicalDeviceVulkan12Features, bufferDeviceAddress)                                                \
+    X(descriptorIndexing, vk::PhysicalDeviceVulkan12Features, descriptorIndexing)                                                  \
+    X(uniformBufferStandardLayout, vk::PhysicalDeviceVulkan12Features, uniformBufferStandardLayout)                                \
+    X(dynamicRendering, vk::PhysicalDeviceVulkan13Features, dynamicRendering)                                                      \
+    X(inlineUniformBlock, vk::PhysicalDeviceVulkan13Features, inlineUniformBlock)                                                  \
+    X(extendedDynamicState3PolygonMode, vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT, extendedDynamicState3PolygonMode)
+
+namespace kat {
+    Capabilities Capabilities::query(vk::PhysicalDevice physicalDevice) {
+        Capabilities caps;
+
+        for (const auto &ext: physicalDevice.enumerateDeviceExtensionProperties()) {
+            const std::string_view name(ext.extensionName.data());
+            if (name == VK_KHR_SWAPCHAIN_EXTENSION_NAME) caps.swapchain = true;
+            if (name == VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) caps.extendedDynamicState3 = true;
+        }
+
+        // extension structs may only be chained if the extension is supported.
+        DeviceFeatureChain chain;
+        if (!caps.extendedDynamicState3) chain.unlink<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>();
+        physicalDevice.getFeatures2(&chain.get<vk::PhysicalDeviceFeatures2>());
+
+#define KAT_QUERY_FEATURE(name, type, member) caps.name = chain.get<type>().member;
+        KAT_REQUIRED_FEATURES(KAT_QUERY_FEATURE)
+        KAT_OPTIONAL_FEATURES(KAT_QUERY_FEATURE)
+#undef KAT_QUERY_FEATURE
+
+        return caps;
+    }
+
+    const char *Capabilities::missingRequired() const noexcept {
+#define KAT_CHECK_FEATURE(name, type, member) \
+    if (!name) return #name;
+        KAT_REQUIRED_FEATURES(KAT_CHECK_FEATURE)
+#undef KAT_CHECK_FEATURE
+        return nullptr;
+    }
+
+    std::vector<std::string> Capabilities::missingOptional() const {
+        std::vector<std::string> missing;
+
+#define KAT_CHECK_FEATURE(name, type, member) \
+    if (!name) missing.emplace_back(#name);
+        KAT_OPTIONAL_FEATURES(KAT_CHECK_FEATURE)
+#undef KAT_CHECK_FEATURE
+
+        if (!extendedDynamicState3) missing.emplace_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+        return missing;
+    }
+
+    DeviceFeatureChain Capabilities::enabledFeatures() const {
+        DeviceFeatureChain chain;
+
+#define KAT_ENABLE_FEATURE(name, type, member) chain.get<type>().member = name;
+        KAT_REQUIRED_FEATURES(KAT_ENABLE_FEATURE)
+        KAT_OPTIONAL_FEATURES(KAT_ENABLE_FEATURE)
+#undef KAT_ENABLE_FEATURE
+
+        if (!extendedDynamicState3) chain.unlink<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>();
+        return chain;
+    }
+
+    std::vector<const char *> Capabilities::enabledExtensions() const {
+        std::vector<const char *> extensions;
+        if (swapchain) extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        if (extendedDynamicState3) extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+        return extensions;
+    }
+} // namespace kat
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace kat {
+
+    using DeviceFeatureChain = vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan11Features, vk::PhysicalDeviceVulkan12Features,
+                                                  vk::PhysicalDeviceVulkan13Features, vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>;
+
+    /**
+     * What the device supports of the features and extensions the engine can use. Everything supported is enabled on the device (see enabledFeatures()),
+     * so subsystems check these to pick a fast path or a fallback instead of assuming a feature is there.
+     *
+     * The engine itself branches on swapchain, pipelineStatisticsQuery (GpuProfiler) and sparseTextures() (VirtualTexture). The other optional features
+     * are the ones startup used to require, they are still enabled where supported so applications can keep relying on them after checking.
+     *
+     * The engine's own capabilities are in globalState->capabilities after startup().
+     */
+    struct Capabilities {
+        // required, a device without these isn't usable at all (see missingRequired()).
+        bool synchronization2 = false;
+        bool timelineSemaphore = false;
+
+        // optional features
+        bool fillModeNonSolid = false;
+        bool geometryShader = false;
+        bool tessellationShader = false;
+        bool wideLines = false;
+        bool largePoints = false;
+        bool multiDrawIndirect = false;
+        bool drawIndirectFirstInstance = false;
+        bool samplerAnisotropy = false;
+        bool pipelineStatisticsQuery = false;
+        bool sparseBinding = false;
+        bool sparseResidencyImage2D = false;
+
+        bool variablePointers = false;
+        bool variablePointersStorageBuffer = false;
+        bool shaderDrawParameters = false;
+
+        bool bufferDeviceAddress = false;
+        bool descriptorIndexing = false;
+        bool uniformBufferStandardLayout = false;
+
+        bool dynamicRendering = false;
+        bool inlineUniformBlock = false;
+
+        bool extendedDynamicState3PolygonMode = false; // needs VK_EXT_extended_dynamic_state3
+
+        // optional extensions
+        bool swapchain = false;              // VK_KHR_swapchain
+        bool extendedDynamicState3 = false;  // VK_EXT_extended_dynamic_state3
+
+        // partially resident 2d images, see VirtualTexture (kat/render/virtual_texture.hpp). a queue that can bind them is in GlobalState::sparseQueue.
+        [[nodiscard]] inline bool sparseTextures() const noexcept { return sparseBinding && sparseResidencyImage2D; };
+
+        static Capabilities query(vk::PhysicalDevice physicalDevice);
+
+        // the first required feature that is missing, or nullptr.
+        [[nodiscard]] const char *missingRequired() const noexcept;
+
+        // names of the optional features (and VK_EXT_extended_dynamic_state3) that are missing, for logging.
+        [[nodiscard]] std::vector<std::string> missingOptional() const;
+
+        /**
+         * The feature chain to create the device with: every feature that is supported, nothing else.
+         * The extended dynamic state 3 struct is unlinked if the extension isn't supported.
+         */
+        [[nodiscard]] DeviceFeatureChain enabledFeatures() const;
+
+        /**
+         * Device extensions to enable.
+         */
+        [[nodiscard]] std::vector<const char *> enabledExtensions() const;
+    };
+
+} // namespace kat
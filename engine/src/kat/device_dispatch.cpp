@@ -0,0 +1,43 @@
+#include "device_dispatch.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace kat {
+    namespace {
+        template<typename PFN>
+        PFN loadFunction(PFN_vkGetDeviceProcAddr getDeviceProcAddr, VkDevice device, const char *name, bool required = true) {
+            auto function = reinterpret_cast<PFN>(getDeviceProcAddr(device, name));
+            if (!function && required) throw std::runtime_error(std::string("Missing device function ") + name);
+            return function;
+        }
+    } // namespace
+
+    void DeviceDispatch::load(PFN_vkGetDeviceProcAddr getDeviceProcAddr, vk::Device device) {
+        const auto d = static_cast<VkDevice>(device);
+
+        vkQueueSubmit2 = loadFunction<PFN_vkQueueSubmit2>(getDeviceProcAddr, d, "vkQueueSubmit2");
+        vkGetFenceStatus = loadFunction<PFN_vkGetFenceStatus>(getDeviceProcAddr, d, "vkGetFenceStatus");
+        vkWaitForFences = loadFunction<PFN_vkWaitForFences>(getDeviceProcAddr, d, "vkWaitForFences");
+        vkResetFences = loadFunction<PFN_vkResetFences>(getDeviceProcAddr, d, "vkResetFences");
+        vkGetSemaphoreCounterValue = loadFunction<PFN_vkGetSemaphoreCounterValue>(getDeviceProcAddr, d, "vkGetSemaphoreCounterValue");
+        vkWaitSemaphores = loadFunction<PFN_vkWaitSemaphores>(getDeviceProcAddr, d, "vkWaitSemaphores");
+
+        vkAcquireNextImageKHR = loadFunction<PFN_vkAcquireNextImageKHR>(getDeviceProcAddr, d, "vkAcquireNextImageKHR", false);
+        vkQueuePresentKHR = loadFunction<PFN_vkQueuePresentKHR>(getDeviceProcAddr, d, "vkQueuePresentKHR", false);
+
+        vkBeginCommandBuffer = loadFunction<PFN_vkBeginCommandBuffer>(getDeviceProcAddr, d, "vkBeginCommandBuffer");
+        vkEndCommandBuffer = loadFunction<PFN_vkEndCommandBuffer>(getDeviceProcAddr, d, "vkEndCommandBuffer");
+        vkCmdPipelineBarrier2 = loadFunction<PFN_vkCmdPipelineBarrier2>(getDeviceProcAddr, d, "vkCmdPipelineBarrier2");
+        vkCmdBeginRenderPass2 = loadFunction<PFN_vkCmdBeginRenderPass2>(getDeviceProcAddr, d, "vkCmdBeginRenderPass2");
+        vkCmdEndRenderPass2 = loadFunction<PFN_vkCmdEndRenderPass2>(getDeviceProcAddr, d, "vkCmdEndRenderPass2");
+        vkCmdSetEvent2 = loadFunction<PFN_vkCmdSetEvent2>(getDeviceProcAddr, d, "vkCmdSetEvent2");
+        vkCmdResetEvent2 = loadFunction<PFN_vkCmdResetEvent2>(getDeviceProcAddr, d, "vkCmdResetEvent2");
+        vkCmdWaitEvents2 = loadFunction<PFN_vkCmdWaitEvents2>(getDeviceProcAddr, d, "vkCmdWaitEvents2");
+        vkCmdBindPipeline = loadFunction<PFN_vkCmdBindPipeline>(getDeviceProcAddr, d, "vkCmdBindPipeline");
+        vkCmdBindDescriptorSets = loadFunction<PFN_vkCmdBindDescriptorSets>(getDeviceProcAddr, d, "vkCmdBindDescriptorSets");
+        vkCmdPushConstants = loadFunction<PFN_vkCmdPushConstants>(getDeviceProcAddr, d, "vkCmdPushConstants");
+        vkCmdDispatch = loadFunction<PFN_vkCmdDispatch>(getDeviceProcAddr, d, "vkCmdDispatch");
+        vkCmdDispatchIndirect = loadFunction<PFN_vkCmdDispatchIndirect>(getDeviceProcAddr, d, "vkCmdDispatchIndirect");
+    }
+} // namespace kat
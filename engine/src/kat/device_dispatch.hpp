@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+namespace kat {
+
+    /**
+     * Device-level entry points of the hot path (submits, fences, acquire/present, the commands CommandRecorder records), loaded straight from
+     * vkGetDeviceProcAddr for the engine's device.
+     *
+     * vulkan.hpp's default dispatcher already holds device-level pointers after init(device), but every call goes through the wrappers: a reference to the
+     * global loader (which holds hundreds of entries, so these end up spread over many cache lines), result checking with exceptions, and ResultValue returns.
+     * These are plain C calls through one small table instead. Everything else keeps using vulkan.hpp.
+     */
+    struct DeviceDispatch {
+        PFN_vkQueueSubmit2 vkQueueSubmit2 = nullptr;
+        PFN_vkGetFenceStatus vkGetFenceStatus = nullptr;
+        PFN_vkWaitForFences vkWaitForFences = nullptr;
+        PFN_vkResetFences vkResetFences = nullptr;
+        PFN_vkGetSemaphoreCounterValue vkGetSemaphoreCounterValue = nullptr;
+        PFN_vkWaitSemaphores vkWaitSemaphores = nullptr;
+
+        PFN_vkAcquireNextImageKHR vkAcquireNextImageKHR = nullptr; // null without VK_KHR_swapchain
+        PFN_vkQueuePresentKHR vkQueuePresentKHR = nullptr;         // null without VK_KHR_swapchain
+
+        PFN_vkBeginCommandBuffer vkBeginCommandBuffer = nullptr;
+        PFN_vkEndCommandBuffer vkEndCommandBuffer = nullptr;
+        PFN_vkCmdPipelineBarrier2 vkCmdPipelineBarrier2 = nullptr;
+        PFN_vkCmdBeginRenderPass2 vkCmdBeginRenderPass2 = nullptr;
+        PFN_vkCmdEndRenderPass2 vkCmdEndRenderPass2 = nullptr;
+        PFN_vkCmdSetEvent2 vkCmdSetEvent2 = nullptr;
+        PFN_vkCmdResetEvent2 vkCmdResetEvent2 = nullptr;
+        PFN_vkCmdWaitEvents2 vkCmdWaitEvents2 = nullptr;
+        PFN_vkCmdBindPipeline vkCmdBindPipeline = nullptr;
+        PFN_vkCmdBindDescriptorSets vkCmdBindDescriptorSets = nullptr;
+        PFN_vkCmdPushConstants vkCmdPushConstants = nullptr;
+        PFN_vkCmdDispatch vkCmdDispatch = nullptr;
+        PFN_vkCmdDispatchIndirect vkCmdDispatchIndirect = nullptr;
+
+        void load(PFN_vkGetDeviceProcAddr getDeviceProcAddr, vk::Device device);
+    };
+
+} // namespace kat
@@ -0,0 +1,189 @@
+#include "device_selection.hpp"
+
+#include "kat/capabilities.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
+
+#include <GLFW/glfw3.h>
+#include <spdlog/spdlog.h>
+
+namespace kat {
+    namespace {
+        std::string formatUuid(const std::array<uint8_t, VK_UUID_SIZE> &uuid) {
+            static constexpr char digits[] = "0123456789abcdef";
+
+            std::string s;
+            for (size_t i = 0; i < uuid.size(); i++) {
+                if (i == 4 || i == 6 || i == 8 || i == 10) s += '-';
+                s += digits[uuid[i] >> 4];
+                s += digits[uuid[i] & 0xf];
+            }
+            return s;
+        }
+
+        // lowercase, without dashes (so UUIDs can be given either way).
+        std::string normalize(std::string_view s, bool stripDashes) {
+            std::string out;
+            for (char c: s) {
+                if (stripDashes && c == '-') continue;
+                out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            return out;
+        }
+
+        bool matchesOverride(const PhysicalDeviceCandidate &candidate, const std::string &override) {
+            if (normalize(candidate.uuid, true) == normalize(override, true)) return true;
+            return normalize(candidate.name, false).find(normalize(override, false)) != std::string::npos;
+        }
+
+        int64_t typeScore(vk::PhysicalDeviceType type) {
+            switch (type) {
+                case vk::PhysicalDeviceType::eDiscreteGpu:
+                    return 1000;
+                case vk::PhysicalDeviceType::eIntegratedGpu:
+                    return 500;
+                case vk::PhysicalDeviceType::eVirtualGpu:
+                    return 250;
+                case vk::PhysicalDeviceType::eCpu:
+                    return 50;
+                default:
+                    return 0;
+            }
+        }
+
+        PhysicalDeviceCandidate evaluate(vk::Instance instance, vk::PhysicalDevice physicalDevice, bool presentationWanted) {
+            const auto propertiesChain = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+            const auto &properties = propertiesChain.get<vk::PhysicalDeviceProperties2>().properties;
+
+            PhysicalDeviceCandidate candidate;
+            candidate.physicalDevice = physicalDevice;
+            candidate.name = properties.deviceName.data();
+            candidate.uuid = formatUuid(propertiesChain.get<vk::PhysicalDeviceIDProperties>().deviceUUID);
+            candidate.type = properties.deviceType;
+
+            const auto reject = [&](std::string reason) {
+                candidate.suitable = false;
+                candidate.notes = {std::move(reason)};
+                return candidate;
+            };
+
+            if (properties.apiVersion < vk::ApiVersion13) {
+                return reject(fmt::format("Vulkan {}.{} (1.3 required)", VK_API_VERSION_MAJOR(properties.apiVersion), VK_API_VERSION_MINOR(properties.apiVersion)));
+            }
+
+            const auto capabilities = Capabilities::query(physicalDevice);
+            if (const char *feature = capabilities.missingRequired()) return reject(fmt::format("missing feature {}", feature));
+
+            const auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+            bool graphics = false, present = false, dedicatedTransfer = false, dedicatedCompute = false;
+            for (uint32_t i = 0; i < queueFamilies.size(); i++) {
+                const auto flags = queueFamilies[i].queueFlags;
+                if (flags & vk::QueueFlagBits::eGraphics) {
+                    graphics = true;
+                    if (presentationWanted && glfwGetPhysicalDevicePresentationSupport(instance, physicalDevice, i)) present = true;
+                } else if (flags & vk::QueueFlagBits::eCompute) {
+                    dedicatedCompute = true;
+                } else if (flags & vk::QueueFlagBits::eTransfer) {
+                    dedicatedTransfer = true;
+                }
+            }
+
+            if (!graphics) return reject("no graphics queue family");
+
+            candidate.score += typeScore(candidate.type);
+            candidate.notes.push_back(fmt::format("{} +{}", vk::to_string(candidate.type), typeScore(candidate.type)));
+
+            if (presentationWanted) {
+                // still usable without presentation (only headless windows), but only as a last resort.
+                if (!present || !capabilities.swapchain) {
+                    candidate.score -= 2000;
+                    candidate.notes.emplace_back("can't present -2000");
+                }
+            }
+
+            // each missing optional feature means a slower fallback somewhere.
+            const auto missingOptional = static_cast<int64_t>(capabilities.missingOptional().size());
+            if (missingOptional > 0) {
+                candidate.score -= 20 * missingOptional;
+                candidate.notes.push_back(fmt::format("{} optional features missing -{}", missingOptional, 20 * missingOptional));
+            }
+
+            if (dedicatedTransfer) {
+                candidate.score += 50;
+                candidate.notes.emplace_back("dedicated transfer queue +50");
+            }
+
+            if (dedicatedCompute) {
+                candidate.score += 50;
+                candidate.notes.emplace_back("dedicated compute queue +50");
+            }
+
+            vk::DeviceSize largestHeap = 0;
+            const auto memoryProperties = physicalDevice.getMemoryProperties();
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+                if (memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) largestHeap = std::max(largestHeap, memoryProperties.memoryHeaps[i].size);
+            }
+
+            // 16 points per GiB, capped at 16 GiB so memory never outweighs the device type.
+            const auto heapMiB = static_cast<int64_t>(largestHeap >> 20);
+            const int64_t heapScore = std::min<int64_t>(heapMiB, 16 * 1024) / 64;
+            candidate.score += heapScore;
+            candidate.notes.push_back(fmt::format("{} MiB device local +{}", heapMiB, heapScore));
+
+            return candidate;
+        }
+    } // namespace
+
+    std::vector<PhysicalDeviceCandidate> rankPhysicalDevices(vk::Instance instance, bool presentationWanted) {
+        std::vector<PhysicalDeviceCandidate> candidates;
+        for (const auto &physicalDevice: instance.enumeratePhysicalDevices()) candidates.push_back(evaluate(instance, physicalDevice, presentationWanted));
+
+        // stable, so equally scored devices keep the driver's order.
+        std::ranges::stable_sort(candidates, [](const auto &a, const auto &b) {
+            if (a.suitable != b.suitable) return a.suitable;
+            return a.score > b.score;
+        });
+        return candidates;
+    }
+
+    vk::PhysicalDevice selectPhysicalDevice(vk::Instance instance, bool presentationWanted, const std::string &override) {
+        const auto candidates = rankPhysicalDevices(instance, presentationWanted);
+
+        for (const auto &candidate: candidates) {
+            std::string notes;
+            for (const auto &note: candidate.notes) notes += (notes.empty() ? "" : ", ") + note;
+
+            if (candidate.suitable) {
+                spdlog::info("Physical device {} ({}): score {} ({})", candidate.name, candidate.uuid, candidate.score, notes);
+            } else {
+                spdlog::info("Physical device {} ({}): rejected, {}", candidate.name, candidate.uuid, notes);
+            }
+        }
+
+        if (!override.empty()) {
+            auto it = std::ranges::find_if(candidates, [&](const auto &c) { return c.suitable && matchesOverride(c, override); });
+            if (it == candidates.end()) it = std::ranges::find_if(candidates, [&](const auto &c) { return matchesOverride(c, override); });
+
+            if (it == candidates.end()) {
+                spdlog::warn("No physical device matches the override \"{}\", ignoring it", override);
+            } else if (!it->suitable) {
+                spdlog::warn("Physical device {} matches the override \"{}\", but can't be used ({}), ignoring the override", it->name, override, it->notes.front());
+            } else {
+                spdlog::info("Selected physical device {} (override \"{}\")", it->name, override);
+                return it->physicalDevice;
+            }
+        }
+
+        if (candidates.empty() || !candidates.front().suitable) {
+            spdlog::critical("No suitable physical device.");
+            throw std::runtime_error("No suitable physical device");
+        }
+
+        spdlog::info("Selected physical device {} (highest score)", candidates.front().name);
+        return candidates.front().physicalDevice;
+    }
+} // namespace kat
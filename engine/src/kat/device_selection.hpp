@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace kat {
+
+    struct PhysicalDeviceCandidate {
+        vk::PhysicalDevice physicalDevice;
+        std::string name;
+        std::string uuid; // deviceUUID as 8-4-4-4-12 hex
+        vk::PhysicalDeviceType type;
+
+        bool suitable = true;
+        int64_t score = 0;
+
+        // what the score is made of, or why the device was rejected (only the first reason is recorded).
+        std::vector<std::string> notes;
+    };
+
+    /**
+     * Score every physical device, best first. Unsuitable devices (below Vulkan 1.3, missing a required capability, see Capabilities::missingRequired(), or without a graphics queue) come last.
+     *
+     * Device type weighs the most (discrete > integrated > virtual > cpu), then presentation support (if presentationWanted), missing optional capabilities,
+     * dedicated transfer and compute queue families, and the size of the largest device local heap.
+     */
+    std::vector<PhysicalDeviceCandidate> rankPhysicalDevices(vk::Instance instance, bool presentationWanted);
+
+    /**
+     * Pick the physical device to use, logging every candidate with its score (or why it was rejected).
+     *
+     * If override isn't empty, the first suitable device whose UUID matches it (dashes and case are ignored), or whose name contains it (case insensitive),
+     * is used instead of the best scoring one. An override that matches nothing is logged and ignored.
+     *
+     * Throws std::runtime_error if no device is suitable.
+     */
+    vk::PhysicalDevice selectPhysicalDevice(vk::Instance instance, bool presentationWanted, const std::string &override = "");
+
+} // namespace kat
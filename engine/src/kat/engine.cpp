@@ -1,5 +1,14 @@
 #include "kat/engine.hpp"
 
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+
+#include "kat/replay.hpp"
+#include "kat/scheduler.hpp"
+#include "kat/trace.hpp"
+
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE;
 
 namespace kat {
@@ -11,25 +20,36 @@ namespace kat {
             const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
             void *pUserData) {
 
-        auto mt = static_cast<vk::DebugUtilsMessageTypeFlagsEXT>(messageType);
-
-        std::string mts = vk::to_string(mt);
-
+        spdlog::level::level_enum level;
         switch (messageSeverity) {
             case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-                globalState->validationLogger->debug("{} {}", mts, pCallbackData->pMessage);
+                level = spdlog::level::debug;
                 break;
             case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
-                globalState->validationLogger->info("{} {}", mts, pCallbackData->pMessage);
+                level = spdlog::level::info;
                 break;
             case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-                globalState->validationLogger->warn("{} {}", mts, pCallbackData->pMessage);
+                level = spdlog::level::warn;
                 break;
             case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
-                globalState->validationLogger->error("{} {}", mts, pCallbackData->pMessage);
+                level = spdlog::level::err;
                 break;
             default:
-                break;
+                return VK_FALSE;
+        }
+
+        // check everything that can drop the message before formatting anything.
+        if (!globalState->validationLogger->should_log(level)) return VK_FALSE;
+
+        // id 0 is shared by unrelated messages (loader messages, etc.), so those aren't rate limited.
+        uint64_t suppressed = 0;
+        if (pCallbackData->messageIdNumber != 0 && !globalState->validationRateLimiter.allow(pCallbackData->messageIdNumber, suppressed)) return VK_FALSE;
+
+        auto mt = static_cast<vk::DebugUtilsMessageTypeFlagsEXT>(messageType);
+        globalState->validationLogger->log(level, "{} {}", vk::to_string(mt), pCallbackData->pMessage);
+
+        if (suppressed > 0) {
+            globalState->validationLogger->log(level, "(suppressed {} repeats of {})", suppressed, pCallbackData->pMessageIdName ? pCallbackData->pMessageIdName : "this message");
         }
 
         return false;
@@ -46,20 +66,103 @@ namespace kat {
 
     void setApiDumpEnabled(bool enabled) { globalState->enableApiDump = enabled; }
 
+    void setPresentStrategy(PresentStrategy strategy) { globalState->presentStrategy = strategy; }
+
+    void setHeadless(bool headless) { globalState->headless = headless; }
+
+    void setPhysicalDeviceOverride(const std::string &nameOrUuid) { globalState->physicalDeviceOverride = nameOrUuid; }
+
+    void setTraceOutput(const std::string &path) { globalState->traceOutputPath = path; }
+
+    void setLogLevel(spdlog::level::level_enum level) { globalState->mainLogger->set_level(level); }
+
+    void setValidationLogLevel(spdlog::level::level_enum level) { globalState->validationLogger->set_level(level); }
+
+    void setValidationRateLimit(uint32_t burst, std::chrono::milliseconds window) { globalState->validationRateLimiter.configure(burst, window); }
+
+    // the sinks a logger writes to, looking through an AsyncSink if there is one.
+    std::vector<spdlog::sink_ptr> baseSinks(const std::shared_ptr<spdlog::logger> &logger) {
+        const auto &sinks = logger->sinks();
+        if (sinks.size() == 1) {
+            if (auto async = std::dynamic_pointer_cast<AsyncSink>(sinks[0])) return async->getSinks();
+        }
+        return sinks;
+    }
+
+    std::shared_ptr<spdlog::logger> rewrapLogger(const std::shared_ptr<spdlog::logger> &logger, bool async, const AsyncLogOptions &options) {
+        auto sinks = baseSinks(logger);
+
+        std::shared_ptr<spdlog::logger> result;
+        if (async) {
+            result = std::make_shared<spdlog::logger>(logger->name(), std::make_shared<AsyncSink>(std::move(sinks), options));
+            result->flush_on(spdlog::level::err); // errors are written before the call returns, in case we're about to crash.
+        } else {
+            result = std::make_shared<spdlog::logger>(logger->name(), sinks.begin(), sinks.end());
+        }
+
+        result->set_level(logger->level());
+        return result;
+    }
+
+    void setAsyncLogging(bool enabled, const AsyncLogOptions &options) {
+        globalState->mainLogger = rewrapLogger(globalState->mainLogger, enabled, options);
+        globalState->validationLogger = rewrapLogger(globalState->validationLogger, enabled, options);
+        spdlog::set_default_logger(globalState->mainLogger);
+    }
+
+    void setReplayCapture(const std::string &path) { globalState->replayCapturePath = path; }
+
+    void setPipelineCachePath(const std::string &path) { globalState->pipelineCachePath = path; }
+
+    void addStartupTask(const char *name, std::function<void()> task) { globalState->startupTasks.emplace_back(name, std::move(task)); }
+
+    void setSchedulerThreads(uint32_t count) { globalState->schedulerThreadCount = count; }
+
+    void setMetricsExport(std::chrono::milliseconds interval, const std::string &path) {
+        globalState->metricsExportInterval = interval;
+        globalState->metricsExportPath = path;
+    }
+
     void init() {
         if (!globalState)
             globalState = new GlobalState();
     }
 
     void startup() {
+        startup({});
+    }
+
+    std::vector<std::tuple<WindowId, Window *>> startup(const std::vector<WindowCreateInfo> &windows) {
         if (!globalState) {
             init();
         }
 
-        if (globalState->startupComplete)
-            return;
+        std::vector<std::tuple<WindowId, Window *>> created;
+        if (globalState->startupComplete) {
+            for (const auto &info: windows) created.push_back(Window::create(info.title, info.size, info.options));
+            return created;
+        }
+
+        // native windows open on this thread (GLFW only creates windows on the main thread) while the device is created on another one.
+        std::vector<Window::NativeWindow> natives;
+        globalState->startup([&]() {
+            auto step = globalState->startupTimeline.step("openNativeWindows");
+            for (const auto &info: windows) {
+                natives.push_back(Window::wantsNativeWindow(info.options) ? Window::openNativeWindow(info.title, info.size, info.options) : Window::NativeWindow{});
+            }
+        });
+        globalState->startupComplete = true;
 
-        globalState->startup();
+        for (size_t i = 0; i < windows.size(); i++) {
+            auto step = globalState->startupTimeline.step("createWindow");
+            created.push_back(Window::create(windows[i].title, windows[i].size, windows[i].options, natives[i]));
+        }
+
+        globalState->startupTimeline.finish();
+        globalState->startupTimeline.log(*globalState->mainLogger);
+        if (globalState->metricsExportInterval.count() > 0 && !globalState->metricsExportPath.empty()) globalState->startupTimeline.append(globalState->metricsExportPath);
+
+        return created;
     }
 
     void terminate() {
@@ -80,95 +183,222 @@ namespace kat {
     }
 
     GlobalState::GlobalState() {
-        sharedFileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>("logs/combined.log", SIZE_MAX, 30, true);
-        stdoutSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        // loading the vulkan library doesn't depend on anything else here.
+        auto loader = std::async(std::launch::async, [this]() {
+            auto step = startupTimeline.step("loadVulkan");
+            vk::defaultDispatchLoaderDynamic.init();
+        });
 
-        mainLogger = createEasyLogger("main", this);
-        validationLogger = createEasyLogger("validation", this);
+        {
+            auto step = startupTimeline.step("createLoggers");
+
+            sharedFileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>("logs/combined.log", SIZE_MAX, 30, true);
+            stdoutSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
 
-        mainLogger->set_level(spdlog::level::debug);
-        validationLogger->set_level(spdlog::level::debug);
+            mainLogger = createEasyLogger("main", this);
+            validationLogger = createEasyLogger("validation", this);
 
-        spdlog::set_default_logger(mainLogger);
+            mainLogger->set_level(defaultLogLevel);
+            validationLogger->set_level(defaultLogLevel);
 
-        glfwInit();
-        vk::defaultDispatchLoaderDynamic.init();
+            spdlog::set_default_logger(mainLogger);
+        }
+
+        {
+            auto step = startupTimeline.step("initGlfw");
+            glfwAvailable = glfwInit() == GLFW_TRUE;
+        }
+
+        if (!glfwAvailable) {
+            mainLogger->warn("Failed to initialize GLFW, only headless windows will be available");
+        }
+
+        loader.get();
     }
 
+    void destroyAllDeferred();
+    void destroyRetiredNativeWindows();
+
     GlobalState::~GlobalState() {
+        if (device) {
+            // anything deferred after wrapup (or without one).
+            device.waitIdle();
+            scheduler.reset();
+            destroyAllDeferred();
+            destroyRetiredNativeWindows();
+        }
+
+        for (const auto &fence: otcFreeFences) {
+            destroy(fence);
+            metrics.liveFences.sub();
+        }
+        otcFreeFences.clear();
+
         {
             std::lock_guard lk(mutOTCPool);
-            destroy(otcPool);
+            destroy(otcPool); // also frees otcFreeCommandBuffers, and any that are still in otcl
+            metrics.liveCommandBuffers.set(0);
+            otcFreeCommandBuffers.clear();
         }
         destroy(transferPool);
         destroy(mainPool);
 
+        safeDestroy(pipelineCache);
+        safeDestroy(computeTimeline);
+
         destroy(device);
         safeDestroy(debugMessenger);
         destroy(instance);
     }
 
-    void otclc() {
-        vk::Fence wait;
-        bool managed;
-        vk::CommandBuffer cmdb;
-        std::shared_ptr<void> ptr;
-
-        // we still have a *little bit of thread safety* so we don't fuck ourselves.
+    // the submission has finished, recycle what it used.
+    void recycleOTC(const OTCEntry &entry) {
         {
-            std::lock_guard guard(globalState->mutOTCL);
-            if (globalState->otcl.empty()) return; // continue;
-            std::tie(wait, managed, cmdb, ptr) = globalState->otcl.front();
-            globalState->otcl.pop();
+            std::lock_guard lk(globalState->mutOTCPool);
+            globalState->otcFreeCommandBuffers.push_back(entry.cmdb); // reset implicitly by the next begin()
         }
 
-        if (globalState->device.getFenceStatus(wait) == vk::Result::eNotReady) {
+        if (entry.managed) {
+            vku::resetFence(entry.fence);
             std::lock_guard guard(globalState->mutOTCL);
-            globalState->otcl.emplace(wait, managed, cmdb, ptr);
-        } else {
+            globalState->otcFreeFences.push_back(entry.fence);
+        }
+
+        if (entry.continuation) {
             {
-                std::lock_guard lk(globalState->mutOTCPool);
-                globalState->device.freeCommandBuffers(globalState->otcPool, cmdb);
+                std::lock_guard guard(globalState->mutOTCL);
+                globalState->otclContinuations--;
             }
-            if (managed) {
-                destroy(wait);
+            globalState->scheduler->resume(entry.continuation);
+        }
+    }
+
+    void otclc() {
+        KAT_TRACE_ZONE("otclc");
+
+        // a signaled fence means everything submitted to the queue before it has finished too, so everything up to the newest signaled entry is retired.
+        // unmanaged fences (e.g. a frame's inFlightFence) may have been reset and reused by their owner already, so they can't hold up the entries behind them,
+        // only an unsignaled managed fence ends the scan.
+        // the render loop and the scheduler's wait thread both retire otcs, the scan and the pops happen under one lock so they can't take the same entries.
+        thread_local std::vector<OTCEntry> finished; // keeps its capacity
+        {
+            std::lock_guard guard(globalState->mutOTCL);
+
+            size_t count = 0;
+            for (size_t i = 0; i < globalState->otcl.size(); i++) {
+                const OTCEntry &entry = globalState->otcl[i];
+                if (!entry.fence || vku::isFenceSignaled(entry.fence)) count = i + 1; // no fence: it was destroyed after its work had finished
+                else if (entry.managed) break;
             }
+
+            for (size_t i = 0; i < count; i++) finished.push_back(globalState->otcl.pop());
+            globalState->metrics.otclQueueLength.set(static_cast<int64_t>(globalState->otcl.size()));
         }
+
+        for (const auto &entry: finished) recycleOTC(entry);
+        finished.clear();
     }
 
+    // the device must be idle, so every entry has finished. unmanaged fences may have been reset without being submitted again, so they aren't checked.
     void otclcFinal() {
-        vk::Fence wait;
-        bool managed;
-        vk::CommandBuffer cmdb;
-        std::shared_ptr<void> ptr;
+        while (true) {
+            OTCEntry entry;
 
-        while (!globalState->otcl.empty()) {
-            // we still have a *little bit of thread safety* so we don't fuck ourselves.
             {
                 std::lock_guard guard(globalState->mutOTCL);
-                if (globalState->otcl.empty()) return; // continue;
-                std::tie(wait, managed, cmdb, ptr) = globalState->otcl.front();
-                globalState->otcl.pop();
+                if (globalState->otcl.empty()) return;
+                entry = globalState->otcl.pop();
+                globalState->metrics.otclQueueLength.set(static_cast<int64_t>(globalState->otcl.size()));
             }
 
-            if (globalState->device.getFenceStatus(wait) == vk::Result::eNotReady) {
-                std::lock_guard guard(globalState->mutOTCL);
-                globalState->otcl.emplace(wait, managed, cmdb, ptr);
-            } else {
-                {
-                    std::lock_guard lk(globalState->mutOTCPool);
-                    globalState->device.freeCommandBuffers(globalState->otcPool, cmdb);
-                }
-                if (managed) {
-                    destroy(wait);
-                }
-            }
+            recycleOTC(entry);
         }
     }
 
-    void GlobalState::startup() {
+    namespace {
+        std::vector<uint8_t> readPipelineCacheFile(const std::string &path) {
+            std::vector<uint8_t> data;
+            if (path.empty()) return data;
+
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) return data;
+
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!file) data.clear();
+            return data;
+        }
+
+        // whether the cache data was written by this driver for this device, anything else would be thrown away by the driver anyway (or worse).
+        bool isPipelineCacheCompatible(const std::vector<uint8_t> &data, const vk::PhysicalDeviceProperties &properties) {
+            VkPipelineCacheHeaderVersionOne header{};
+            if (data.size() < sizeof(header)) return false;
+            std::memcpy(&header, data.data(), sizeof(header));
+
+            return header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+                   std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+        }
+    } // namespace
+
+    void GlobalState::startup(const std::function<void()> &whileCreatingDevice) {
         spdlog::info("Starting up engine");
 
+        // futures from std::async join on destruction, so nothing outlives a failed startup.
+        auto pipelineCacheData = std::async(std::launch::async, [this]() {
+            auto step = startupTimeline.step("readPipelineCache");
+            return readPipelineCacheFile(pipelineCachePath);
+        });
+
+        std::vector<std::future<void>> tasks;
+        for (auto &[name, task]: startupTasks) {
+            tasks.push_back(std::async(std::launch::async, [this, name = name, task = std::move(task)]() {
+                auto step = startupTimeline.step(name);
+                task();
+            }));
+        }
+        startupTasks.clear();
+
+        {
+            auto step = startupTimeline.step("createInstance");
+            createInstance();
+        }
+
+        auto deviceCreation = std::async(std::launch::async, [this]() {
+            trace::setThreadName("startup");
+            auto step = startupTimeline.step("createDevice");
+            createDevice();
+        });
+
+        if (whileCreatingDevice) whileCreatingDevice();
+        deviceCreation.get();
+
+        {
+            auto data = pipelineCacheData.get();
+            auto step = startupTimeline.step("createPipelineCache");
+
+            if (!data.empty() && !isPipelineCacheCompatible(data, physicalDeviceProperties)) {
+                spdlog::info("Pipeline cache {} is from another device or driver, starting with an empty one", pipelineCachePath);
+                data.clear();
+            }
+
+            pipelineCache = device.createPipelineCache(vk::PipelineCacheCreateInfo({}, data.size(), data.data()));
+            if (!data.empty()) spdlog::debug("Loaded {} bytes of pipeline cache from {}", data.size(), pipelineCachePath);
+        }
+
+        for (auto &task: tasks) task.get();
+
+        if (!replayCapturePath.empty() && replay::beginCapture(replayCapturePath, physicalDeviceProperties.deviceName.data())) {
+            spdlog::info("Capturing frames for replay to {}", replayCapturePath);
+        }
+
+        {
+            auto step = startupTimeline.step("createScheduler");
+            scheduler = std::make_unique<Scheduler>(schedulerThreadCount);
+        }
+    }
+
+    void GlobalState::createInstance() {
         vk::ApplicationInfo appInfo{};
         appInfo.setApiVersion(vk::ApiVersion13)
                 .setApplicationVersion(vk::makeApiVersion(appVersion.revision, appVersion.major, appVersion.minor, appVersion.patch))
@@ -178,11 +408,31 @@ namespace kat {
 
         vk::InstanceCreateInfo instanceCreateInfo{};
 
-        uint32_t count;
-        const char **requiredExtensions = glfwGetRequiredInstanceExtensions(&count);
+        const bool presentationWanted = glfwAvailable && !headless;
 
         std::vector<const char *> instanceExtensions;
-        instanceExtensions.assign(requiredExtensions, requiredExtensions + count);
+        if (presentationWanted) {
+            uint32_t count = 0;
+            const char **requiredExtensions = glfwGetRequiredInstanceExtensions(&count);
+            if (requiredExtensions) instanceExtensions.assign(requiredExtensions, requiredExtensions + count);
+        }
+
+        {
+            bool surfaceAvailable = false;
+            bool headlessSurfaceAvailable = false;
+            for (const auto &ext: vk::enumerateInstanceExtensionProperties()) {
+                if (std::string_view(ext.extensionName.data()) == VK_KHR_SURFACE_EXTENSION_NAME) surfaceAvailable = true;
+                if (std::string_view(ext.extensionName.data()) == VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME) headlessSurfaceAvailable = true;
+            }
+
+            headlessSurfaceSupported = surfaceAvailable && headlessSurfaceAvailable;
+            if (headlessSurfaceSupported) {
+                if (std::find_if(instanceExtensions.begin(), instanceExtensions.end(), [](const char *e) { return std::string_view(e) == VK_KHR_SURFACE_EXTENSION_NAME; }) == instanceExtensions.end()) {
+                    instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+                }
+                instanceExtensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+            }
+        }
 
         std::vector<const char *> instanceLayers{};
 
@@ -217,24 +467,34 @@ namespace kat {
         if (enableValidationLayers) {
             debugMessenger = instance.createDebugUtilsMessengerEXT(debugUtilsMessengerCreateInfoExt);
         }
+    }
 
-        physicalDevice = instance.enumeratePhysicalDevices()[0];
+    void GlobalState::createDevice() {
+        const bool presentationWanted = glfwAvailable && !headless;
 
-        auto properties = physicalDevice.getProperties();
+        physicalDevice = selectPhysicalDevice(instance, presentationWanted, physicalDeviceOverride);
 
-        spdlog::info("Using physical device: {}", properties.deviceName.data());
-        {
-            auto queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+        physicalDeviceProperties = physicalDevice.getProperties();
+        memoryProperties = physicalDevice.getMemoryProperties();
 
+        spdlog::info("Using physical device: {}", physicalDeviceProperties.deviceName.data());
+        const auto queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+        {
             std::optional<uint32_t> optimalTransferExclusive;
             std::optional<uint32_t> optimalTransferNonExclusive;
             std::optional<uint32_t> transferExclusive;
             std::optional<uint32_t> transferNonExclusive;
             std::optional<uint32_t> mainf;
+            std::optional<uint32_t> graphicsOnly; // fallback for when nothing can present (or we don't need to)
+            std::optional<uint32_t> computeExclusive; // compute without graphics, runs alongside the main queue
 
             uint32_t index = 0;
             for (const auto &qfp: queueFamilyProperties) {
-                if (qfp.queueFlags & vk::QueueFlagBits::eGraphics && glfwGetPhysicalDevicePresentationSupport(instance, physicalDevice, index) && !mainf.has_value()) {
+                if (qfp.queueFlags & vk::QueueFlagBits::eGraphics && !graphicsOnly.has_value()) {
+                    graphicsOnly = index;
+                }
+
+                if (qfp.queueFlags & vk::QueueFlagBits::eGraphics && presentationWanted && glfwGetPhysicalDevicePresentationSupport(instance, physicalDevice, index) && !mainf.has_value()) {
                     mainf = index;
                 }
 
@@ -248,9 +508,20 @@ namespace kat {
                     transferNonExclusive = index;
                 }
 
-                if (mainf.has_value() && optimalTransferExclusive.has_value()) {
+                if (qfp.queueFlags & vk::QueueFlagBits::eCompute && !(qfp.queueFlags & vk::QueueFlagBits::eGraphics) && !computeExclusive.has_value()) {
+                    computeExclusive = index;
+                }
+
+                if (mainf.has_value() && optimalTransferExclusive.has_value() && computeExclusive.has_value()) {
                     break;
                 }
+
+                index++;
+            }
+
+            if (!mainf.has_value() && graphicsOnly.has_value()) {
+                if (presentationWanted) spdlog::warn("No queue family supports presentation, only headless windows will be available");
+                mainf = graphicsOnly;
             }
 
             if (!mainf.has_value()) {
@@ -261,81 +532,243 @@ namespace kat {
             mainFamily = mainf.value();
 
             transferFamily = optimalTransferExclusive.value_or(optimalTransferNonExclusive.value_or(transferExclusive.value_or(transferNonExclusive.value_or(mainFamily))));
-        }
 
-        spdlog::debug("Main Queue Family: {}, Transfer Family: {}", mainFamily, transferFamily);
+            // without a compute-only family, compute work goes to the main queue (the main family always supports compute).
+            computeFamily = computeExclusive.value_or(mainFamily);
+        }
 
-        bool queueFamiliesSame = mainFamily == transferFamily;
+        spdlog::debug("Main Queue Family: {}, Transfer Family: {}, Compute Family: {}", mainFamily, transferFamily, computeFamily);
+
+        // the transfer queue shares the main queue if their families are the same. compute gets its own queue if it isn't on the main family,
+        // sharing the transfer family's only queue if it has to.
+        uint32_t computeQueueIndex = 0;
+        std::vector<uint32_t> queueCounts(queueFamilyProperties.size(), 0);
+        queueCounts[mainFamily] = 1;
+        if (transferFamily != mainFamily) queueCounts[transferFamily] = 1;
+        if (computeFamily != mainFamily) {
+            if (queueCounts[computeFamily] < queueFamilyProperties[computeFamily].queueCount) queueCounts[computeFamily]++;
+            computeQueueIndex = queueCounts[computeFamily] - 1;
+        }
 
         std::vector<vk::DeviceQueueCreateInfo> dqcis;
-        std::array<float, 1> queuePriorities = {1.0f};
-        dqcis.emplace_back(vk::DeviceQueueCreateFlags{}, mainFamily, queuePriorities);
-
-        if (!queueFamiliesSame) {
-            dqcis.emplace_back(vk::DeviceQueueCreateFlags{}, transferFamily, queuePriorities);
-        }
-
-        vk::PhysicalDeviceFeatures2 features2{};
-        features2.features.fillModeNonSolid = true;
-        features2.features.geometryShader = true;
-        features2.features.tessellationShader = true;
-        features2.features.wideLines = true;
-        features2.features.largePoints = true;
-        features2.features.multiDrawIndirect = true;
-        features2.features.drawIndirectFirstInstance = true;
-        features2.features.samplerAnisotropy = true;
-
-        vk::PhysicalDeviceVulkan11Features v11f{};
-        v11f.variablePointers = true;
-        v11f.variablePointersStorageBuffer = true;
-        v11f.shaderDrawParameters = true;
-
-        vk::PhysicalDeviceVulkan12Features v12f{};
-        v12f.bufferDeviceAddress = true;
-        v12f.descriptorIndexing = true;
-        v12f.timelineSemaphore = true;
-        v12f.uniformBufferStandardLayout = true;
-
-        vk::PhysicalDeviceVulkan13Features v13f{};
-        v13f.dynamicRendering = true;
-        v13f.synchronization2 = true;
-        v13f.inlineUniformBlock = true;
-
-        vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT eds3f{};
-        eds3f.extendedDynamicState3PolygonMode = true;
-
-        features2.pNext = &v11f;
-        v11f.pNext = &v12f;
-        v12f.pNext = &v13f;
-        v13f.pNext = &eds3f;
-
-        std::vector<const char *> extensions = {
-                VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-                VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
-        };
-
-        device = physicalDevice.createDevice(vk::DeviceCreateInfo({}, dqcis, {}, extensions, nullptr, &features2));
+        const std::array<float, 2> queuePriorities = {1.0f, 1.0f};
+        for (uint32_t family = 0; family < queueCounts.size(); family++) {
+            if (queueCounts[family] > 0) dqcis.emplace_back(vk::DeviceQueueCreateFlags{}, family, queueCounts[family], queuePriorities.data());
+        }
+
+        capabilities = Capabilities::query(physicalDevice);
+        if (const auto missing = capabilities.missingOptional(); !missing.empty()) {
+            std::string names;
+            for (const auto &name: missing) names += (names.empty() ? "" : ", ") + name;
+            spdlog::info("Unsupported optional features (using fallbacks): {}", names);
+        }
+
+        if (!capabilities.swapchain) spdlog::warn("{} isn't supported, only headless windows will be available", VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+        // everything supported is enabled, subsystems check capabilities to pick their paths.
+        const auto features = capabilities.enabledFeatures();
+        const auto extensions = capabilities.enabledExtensions();
+
+        device = physicalDevice.createDevice(vk::DeviceCreateInfo({}, dqcis, {}, extensions, nullptr, &features.get<vk::PhysicalDeviceFeatures2>()));
         spdlog::info("Created logical device");
 
         vk::defaultDispatchLoaderDynamic.init(device);
+        dispatch.load(vk::defaultDispatchLoaderDynamic.vkGetDeviceProcAddr, device);
 
         mainQueue = device.getQueue(mainFamily, 0);
         transferQueue = device.getQueue(transferFamily, 0);
+        computeQueue = device.getQueue(computeFamily, computeQueueIndex);
+
+        // sparse binds prefer the transfer queue, so they don't wait behind rendering (queue selection already prefers transfer families that can bind).
+        if (capabilities.sparseBinding) {
+            if (queueFamilyProperties[transferFamily].queueFlags & vk::QueueFlagBits::eSparseBinding) {
+                sparseQueue = transferQueue;
+            } else if (queueFamilyProperties[mainFamily].queueFlags & vk::QueueFlagBits::eSparseBinding) {
+                sparseQueue = mainQueue;
+            }
+        }
 
         mainPool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, mainFamily));
         transferPool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, transferFamily));
 
         otcPool = device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, mainFamily));
+
+        computeTimeline = vku::createTimelineSemaphore();
+
+        if (computeFamily != mainFamily) spdlog::info("Using a dedicated compute queue family ({})", computeFamily);
+    }
+
+    void GlobalState::savePipelineCache() {
+        if (pipelineCachePath.empty() || !pipelineCache) return;
+
+        const auto data = device.getPipelineCacheData(pipelineCache);
+
+        std::error_code ec;
+        const std::filesystem::path path(pipelineCachePath);
+        if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), ec);
+
+        // write next to it and rename, so a crash mid-write can't leave a truncated cache behind.
+        const std::string temporary = pipelineCachePath + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!file) {
+                spdlog::warn("Failed to write pipeline cache {}", pipelineCachePath);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temporary, path, ec);
+        if (ec) spdlog::warn("Failed to write pipeline cache {}: {}", pipelineCachePath, ec.message());
+    }
+
+    void exportMetrics() {
+        if (globalState->metricsExportPath.empty()) {
+            globalState->metrics.log(*globalState->mainLogger);
+        } else if (!globalState->metrics.append(globalState->metricsExportPath)) {
+            globalState->mainLogger->warn("Failed to write metrics to {}", globalState->metricsExportPath);
+        }
+    }
+
+    void enqueueDeferredDestroy(const DeferredDestroy &entry) {
+        std::lock_guard lk(globalState->mutDeferred);
+        globalState->deferredObjects.push_back(entry);
+    }
+
+    void deferDestroyAfter(vk::Semaphore timeline, uint64_t value) {
+        std::lock_guard lk(globalState->mutDeferred);
+        globalState->deferredWaits.emplace_back(timeline, value, vk::PipelineStageFlagBits2::eAllCommands);
+    }
+
+    void deferDestroyOTCFence(vk::Fence fence) {
+        if (!fence) return;
+        enqueueDeferredDestroy(DeferredDestroy{toRawHandle(fence), 0, +[](uint64_t handle, uint64_t) {
+            const auto fence = fromRawHandle<vk::Fence>(handle);
+            {
+                // the bucket has signaled, so whatever was submitted with the fence has finished. otclc() retires entries without a fence.
+                std::lock_guard guard(globalState->mutOTCL);
+                for (size_t i = 0; i < globalState->otcl.size(); i++) {
+                    auto &entry = globalState->otcl[i];
+                    if (!entry.managed && entry.fence == fence) entry.fence = vk::Fence{};
+                }
+            }
+            globalState->device.destroy(fence);
+        }});
+    }
+
+    // waits of the bucket being closed, only touched by the render loop. swapped with deferredWaits so neither allocates in steady state.
+    std::vector<vk::SemaphoreSubmitInfo> deferredWaitScratch;
+
+    void destroyDeferredBucket(std::vector<DeferredDestroy> &objects) {
+        for (const auto &object: objects) object.destroy(object.handle, object.owner);
+        objects.clear();
+    }
+
+    namespace vku {
+        vk::Fence acquireOTCFence();
+    } // namespace vku
+
+    void collectDeferredDestroys() {
+        KAT_TRACE_ZONE("collectDeferredDestroys");
+
+        // buckets are closed in submission order, so they signal in order too.
+        while (!globalState->deferredBuckets.empty() && vku::isFenceSignaled(globalState->deferredBuckets.front().fence)) {
+            DeferredBucket bucket = globalState->deferredBuckets.pop();
+            destroyDeferredBucket(bucket.objects);
+
+            vku::resetFence(bucket.fence);
+            {
+                std::lock_guard lk(globalState->mutOTCL);
+                globalState->otcFreeFences.push_back(bucket.fence);
+            }
+
+            globalState->deferredFreeLists.push_back(std::move(bucket.objects));
+        }
+
+        DeferredBucket bucket;
+        if (!globalState->deferredFreeLists.empty()) {
+            bucket.objects = std::move(globalState->deferredFreeLists.back());
+            globalState->deferredFreeLists.pop_back();
+        }
+
+        {
+            std::lock_guard lk(globalState->mutDeferred);
+            if (globalState->deferredObjects.empty() && globalState->deferredWaits.empty()) {
+                globalState->deferredFreeLists.push_back(std::move(bucket.objects));
+                return;
+            }
+            bucket.objects.swap(globalState->deferredObjects);
+            deferredWaitScratch.swap(globalState->deferredWaits);
+        }
+
+        // an empty submission's fence signals once all work submitted before it has finished.
+        // work on a separate compute queue isn't covered by that, so it also waits for the compute timeline.
+        uint64_t computeValue = 0;
+        if (globalState->computeQueue != globalState->mainQueue) {
+            std::lock_guard lk(globalState->mutComputeQueue);
+            computeValue = globalState->computeTimelineValue;
+        }
+        if (computeValue > 0) deferredWaitScratch.emplace_back(globalState->computeTimeline, computeValue, vk::PipelineStageFlagBits2::eAllCommands);
+
+        bucket.fence = vku::acquireOTCFence();
+        if (!deferredWaitScratch.empty()) {
+            vku::queueSubmit(globalState->mainQueue, vk::SubmitInfo2({}, deferredWaitScratch), bucket.fence);
+            deferredWaitScratch.clear();
+        } else {
+            std::lock_guard lk(globalState->mutMainQueue);
+            globalState->dispatch.vkQueueSubmit2(static_cast<VkQueue>(globalState->mainQueue), 0, nullptr, static_cast<VkFence>(bucket.fence));
+        }
+        globalState->deferredBuckets.push(std::move(bucket));
+    }
+
+    // the device must be idle.
+    void destroyAllDeferred() {
+        while (!globalState->deferredBuckets.empty()) {
+            DeferredBucket bucket = globalState->deferredBuckets.pop();
+            destroyDeferredBucket(bucket.objects);
+
+            vku::resetFence(bucket.fence);
+            std::lock_guard lk(globalState->mutOTCL);
+            globalState->otcFreeFences.push_back(bucket.fence);
+        }
+
+        std::lock_guard lk(globalState->mutDeferred);
+        destroyDeferredBucket(globalState->deferredObjects);
+        globalState->deferredWaits.clear();
     }
 
     void GlobalState::wrapup() {
         device.waitIdle();
         otclcFinal();
+
+        if (scheduler) {
+            // tasks resumed while draining can submit more work, which has to finish before they can be resumed again.
+            while (scheduler->drain()) {
+                device.waitIdle();
+                otclcFinal();
+            }
+            scheduler.reset();
+        }
+        destroyAllDeferred();
+        destroyRetiredNativeWindows();
+
+        savePipelineCache();
+
+        if (metricsExportInterval.count() > 0) exportMetrics();
+
+        replay::endCapture();
+
+        if (!traceOutputPath.empty()) {
+            if (trace::writeChromeTrace(traceOutputPath)) spdlog::info("Wrote cpu trace to {}", traceOutputPath);
+        }
     }
 
     void run() {
+        trace::setThreadName(globalState->seperateRenderAndUpdateThreads ? "event" : "main");
+
         if (globalState->seperateRenderAndUpdateThreads) {
             std::jthread renderThread = std::jthread(+[](){
+                trace::setThreadName("render");
                 while (globalState->activeWindowCount > 0) {
                     renderloopCycle();
                 }
@@ -357,55 +790,196 @@ namespace kat {
         globalState->wrapup();
     }
 
+    // stores the time between construction and destruction (in milliseconds) into target.
+    class CpuTimer {
+      public:
+        explicit CpuTimer(std::atomic<double> &target) : m_Target(target), m_Start(std::chrono::steady_clock::now()) {}
+
+        ~CpuTimer() {
+            m_Target.store(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count(), std::memory_order_relaxed);
+        }
+
+      private:
+        std::atomic<double> &m_Target;
+        std::chrono::steady_clock::time_point m_Start;
+    };
+
     void eventloopCycle() {
-        glfwPollEvents();
+        KAT_TRACE_ZONE("eventloopCycle");
+        CpuTimer timer(globalState->eventloopCpuTime);
+
+        if (globalState->glfwAvailable) glfwPollEvents();
+        flushWindowRemovals();
+    }
+
+    void destroyRetiredNativeWindows() {
+        std::lock_guard lk(globalState->mutRetiredNativeWindows);
+        for (GLFWwindow *window: globalState->retiredNativeWindows) glfwDestroyWindow(window);
+        globalState->retiredNativeWindows.clear();
+    }
+
+    void flushWindowRemovals() {
+        destroyRetiredNativeWindows();
+
+        bool pending;
+        {
+            std::lock_guard lk(globalState->mutPendingWindowRemovals);
+            pending = !globalState->pendingWindowRemovals.empty();
+        }
+
+        if (pending) {
+            std::lock_guard windowsLock(globalState->mutWindows);
+            std::lock_guard lk(globalState->mutPendingWindowRemovals);
+            for (const auto &id: globalState->pendingWindowRemovals) {
+                auto *window = globalState->activeWindows.get(id);
+                if (!window) continue;
+
+                // snapshots up to the current cycle may still contain it.
+                globalState->retiringWindows.emplace_back(globalState->renderCycle, std::move(*window));
+                globalState->activeWindows.erase(id);
+            }
+            globalState->pendingWindowRemovals.clear();
+        }
+
+        if (globalState->retiringWindows.empty()) return;
+
+        const uint64_t finished = globalState->finishedRenderCycle.load(std::memory_order_acquire);
+        std::erase_if(globalState->retiringWindows, [&](const auto &entry) { return entry.first <= finished; });
     }
 
-    struct PI_ {
-        vk::SwapchainKHR swapchain;
-        uint32_t imageIndex;
-        vk::Semaphore sem;
+    // persistent scratch storage for batched presents, cleared every cycle but never shrunk so the steady-state loop doesn't allocate.
+    struct PresentScratch {
+        std::vector<Window *> windows;
+        std::vector<vk::SwapchainKHR> swapchains;
+        std::vector<uint32_t> imageIndices;
+        std::vector<vk::Semaphore> semaphores;
+        std::vector<vk::Result> results;
+
+        void clear() {
+            windows.clear();
+            swapchains.clear();
+            imageIndices.clear();
+            semaphores.clear();
+            results.clear();
+        }
     };
 
-    std::vector<PI_> pinfos;
+    PresentScratch presentScratch;
+    std::vector<Window *> renderSnapshot; // windows rendered this cycle, same as presentScratch
+
+    void renderWindows(std::span<Window *const> windows);
+
+    void doWindowRender(Window &window) {
+        if (window.acquireFrame()) {
+            const auto &resources = window.getCurrentFrameResources();
+            window.getWindowHandler()->onRender(window, resources);
+
+            if (!window.hasSwapchain()) {
+                window.present(); // nothing to batch for engine-owned images
+                window.nextFrame();
+                return;
+            }
+
+            presentScratch.windows.push_back(&window);
+            presentScratch.swapchains.push_back(window.getSwapchain());
+            presentScratch.imageIndices.push_back(resources.imageIndex);
+            presentScratch.semaphores.push_back(resources.sync->renderFinishedSemaphore);
+            presentScratch.results.push_back(vk::Result::eSuccess);
+
+            window.nextFrame();
+        }
+    }
+
+    // returns false if the window wasn't ready for a new frame (so it was skipped this cycle).
+    bool doIndependentWindowRender(Window &window) {
+        if (!window.acquireFrame(0)) return false;
+
+        const auto &resources = window.getCurrentFrameResources();
+        window.getWindowHandler()->onRender(window, resources);
+        window.present();
 
-    void doWindowRender(const std::shared_ptr<Window> &window) {
-        if (window->acquireFrame()) {
-            const auto &resources = window->getCurrentFrameResources();
-            window->getWindowHandler()->onRender(window, resources);
-            pinfos.push_back(PI_{.swapchain = window->getSwapchain(), .imageIndex = resources.imageIndex, .sem = resources.sync->renderFinishedSemaphore});
+        window.nextFrame();
+        return true;
+    }
+
+    // records the frame time, and exports metrics if the export interval has passed.
+    void updateFrameMetrics() {
+        static std::chrono::steady_clock::time_point lastCycle{};
+        static std::chrono::steady_clock::time_point lastExport = std::chrono::steady_clock::now();
+
+        const auto now = std::chrono::steady_clock::now();
+        if (lastCycle.time_since_epoch().count() != 0) {
+            globalState->metrics.frameTime.record(now - lastCycle);
+            replay::recordFrame(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastCycle).count()));
+        }
+        lastCycle = now;
 
-            window->nextFrame();
+        if (globalState->metricsExportInterval.count() > 0 && now - lastExport >= globalState->metricsExportInterval) {
+            KAT_TRACE_ZONE("exportMetrics");
+            exportMetrics();
+            globalState->metrics.resetHistograms();
+            lastExport = now;
         }
     }
 
     void renderloopCycle() {
-        otclc(); // instead of doing this off-thread, do it locally so we don't overlap pool usage (easier).
+        KAT_TRACE_ZONE("renderloopCycle");
+        CpuTimer timer(globalState->renderloopCpuTime);
+
+        updateFrameMetrics();
 
-        pinfos.clear();
+        // the scheduler's wait thread runs otclc() too while coroutines await otcs. it scans and pops otcl under mutOTCL, so each entry is recycled once,
+        // and fences passed to otc() are detached from otcl before they are destroyed (deferDestroyOTCFence()), so neither caller checks a destroyed one.
+        otclc();
 
-        for (const auto &window: globalState->activeWindows) {
-            doWindowRender(window.second);
+        // acquiring and presenting can block, so only the snapshot is taken under the lock. removed windows are kept alive until this cycle has finished.
+        uint64_t cycle;
+        {
+            std::lock_guard windowsLock(globalState->mutWindows);
+
+            globalState->onFrameBoundary();
+            collectDeferredDestroys();
+
+            renderSnapshot.clear();
+            for (const auto &window: globalState->activeWindows) renderSnapshot.push_back(window.get());
+            cycle = ++globalState->renderCycle;
         }
 
-        std::vector<vk::SwapchainKHR> storage0;
-        std::vector<uint32_t> storage1;
-        std::vector<vk::Semaphore> storage2;
+        renderWindows(renderSnapshot);
+        globalState->finishedRenderCycle.store(cycle, std::memory_order_release);
+    }
+
+    void renderWindows(std::span<Window *const> windows) {
+        if (globalState->presentStrategy == PresentStrategy::eIndependent) {
+            bool anyRendered = false;
+            for (Window *window: windows) {
+                anyRendered |= doIndependentWindowRender(*window);
+            }
 
-        for (const auto pi: pinfos) {
-            storage0.push_back(pi.swapchain);
-            storage1.push_back(pi.imageIndex);
-            storage2.push_back(pi.sem);
+            // nobody was ready, don't spin the core at full speed while we wait on the gpu/presentation engine.
+            if (!anyRendered) std::this_thread::yield();
+            return;
         }
 
-        if (pinfos.empty()) return;
+        presentScratch.clear();
+
+        for (Window *window: windows) {
+            doWindowRender(*window);
+        }
+
+        if (presentScratch.windows.empty()) return;
 
         vk::PresentInfoKHR present{};
-        present.setSwapchains(storage0);
-        present.setImageIndices(storage1);
-        present.setWaitSemaphores(storage2);
+        present.setSwapchains(presentScratch.swapchains);
+        present.setImageIndices(presentScratch.imageIndices);
+        present.setWaitSemaphores(presentScratch.semaphores);
+        present.setResults(presentScratch.results);
+
+        vku::present(present);
 
-        [[maybe_unused]] auto _ = globalState->mainQueue.presentKHR(present);
+        for (size_t i = 0; i < presentScratch.windows.size(); i++) {
+            presentScratch.windows[i]->handlePresentResult(presentScratch.results[i]);
+        }
     }
 
     namespace vku {
@@ -414,6 +988,11 @@ namespace kat {
             return globalState->device.createSemaphore(sci);
         }
 
+        vk::Semaphore createTimelineSemaphore(uint64_t initialValue) {
+            const vk::SemaphoreTypeCreateInfo stci(vk::SemaphoreType::eTimeline, initialValue);
+            return globalState->device.createSemaphore(vk::SemaphoreCreateInfo({}, &stci));
+        }
+
         vk::Fence createFence() {
             static const vk::FenceCreateInfo fci{};
             return globalState->device.createFence(fci);
@@ -434,24 +1013,137 @@ namespace kat {
             return globalState->device.createEvent(eci);
         }
 
+        uint32_t findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags properties) {
+            const auto &memoryProperties = globalState->memoryProperties;
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+                if ((typeBits & (1U << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                    return i;
+                }
+            }
+
+            throw std::runtime_error("No suitable memory type");
+        }
+
+        vk::DeviceMemory allocateMemory(const vk::MemoryAllocateInfo &allocateInfo) {
+            vk::DeviceMemory memory = globalState->device.allocateMemory(allocateInfo);
+
+            std::lock_guard lk(globalState->mutMemoryAllocations);
+            globalState->memoryAllocationSizes[memory] = allocateInfo.allocationSize;
+            globalState->metrics.deviceMemoryUsage.add(static_cast<int64_t>(allocateInfo.allocationSize));
+            return memory;
+        }
+
+        void freeMemory(vk::DeviceMemory memory) {
+            if (!memory) return;
+
+            {
+                std::lock_guard lk(globalState->mutMemoryAllocations);
+                if (auto it = globalState->memoryAllocationSizes.find(memory); it != globalState->memoryAllocationSizes.end()) {
+                    globalState->metrics.deviceMemoryUsage.sub(static_cast<int64_t>(it->second));
+                    globalState->memoryAllocationSizes.erase(it);
+                }
+            }
+
+            globalState->device.freeMemory(memory);
+        }
+
+        void deferFreeMemory(vk::DeviceMemory memory) {
+            if (!memory) return;
+            enqueueDeferredDestroy(DeferredDestroy{toRawHandle(memory), 0, +[](uint64_t handle, uint64_t) { freeMemory(fromRawHandle<vk::DeviceMemory>(handle)); }});
+        }
+
+        void deferFreeCommandBuffer(vk::CommandPool pool, vk::CommandBuffer commandBuffer) {
+            if (!commandBuffer) return;
+            enqueueDeferredDestroy(DeferredDestroy{toRawHandle(commandBuffer), toRawHandle(pool), +[](uint64_t handle, uint64_t owner) {
+                globalState->device.freeCommandBuffers(fromRawHandle<vk::CommandPool>(owner), fromRawHandle<vk::CommandBuffer>(handle));
+            }});
+        }
+
         void waitFence(const vk::Fence &fence) {
-            auto _ = globalState->device.waitForFences(fence, true, UINT64_MAX);
+            const auto f = static_cast<VkFence>(fence);
+            const VkResult result = globalState->dispatch.vkWaitForFences(static_cast<VkDevice>(globalState->device), 1, &f, VK_TRUE, UINT64_MAX);
+            if (result == VK_ERROR_DEVICE_LOST) throw std::runtime_error("Device lost");
+            if (result != VK_SUCCESS) throw std::runtime_error("Fence wait failed: " + vk::to_string(static_cast<vk::Result>(result)));
+        }
+
+        bool waitFence(const vk::Fence &fence, uint64_t timeout) {
+            if (timeout == 0) return isFenceSignaled(fence);
+
+            const auto f = static_cast<VkFence>(fence);
+            const VkResult result = globalState->dispatch.vkWaitForFences(static_cast<VkDevice>(globalState->device), 1, &f, VK_TRUE, timeout);
+            if (result == VK_ERROR_DEVICE_LOST) throw std::runtime_error("Device lost");
+            return result == VK_SUCCESS;
         }
 
         void resetFence(vk::Fence fence) {
-            globalState->device.resetFences(fence);
+            const auto f = static_cast<VkFence>(fence);
+            const VkResult result = globalState->dispatch.vkResetFences(static_cast<VkDevice>(globalState->device), 1, &f);
+            if (result != VK_SUCCESS) throw std::runtime_error("Fence reset failed: " + vk::to_string(static_cast<vk::Result>(result)));
+        }
+
+        bool isFenceSignaled(vk::Fence fence) {
+            const VkResult result = globalState->dispatch.vkGetFenceStatus(static_cast<VkDevice>(globalState->device), static_cast<VkFence>(fence));
+            if (result == VK_ERROR_DEVICE_LOST) throw std::runtime_error("Device lost");
+            return result == VK_SUCCESS;
+        }
+
+        void queueSubmit(vk::Queue queue, const vk::SubmitInfo2 &submitInfo, vk::Fence fence) {
+            std::unique_lock<std::mutex> lk;
+            if (queue == globalState->mainQueue) lk = std::unique_lock(globalState->mutMainQueue);
+
+            const VkResult result = globalState->dispatch.vkQueueSubmit2(static_cast<VkQueue>(queue), 1, reinterpret_cast<const VkSubmitInfo2 *>(&submitInfo), static_cast<VkFence>(fence));
+            if (result != VK_SUCCESS) throw std::runtime_error("Queue submit failed: " + vk::to_string(static_cast<vk::Result>(result)));
+        }
+
+        uint64_t getSemaphoreValue(vk::Semaphore semaphore) {
+            uint64_t value = 0;
+            const VkResult result = globalState->dispatch.vkGetSemaphoreCounterValue(static_cast<VkDevice>(globalState->device), static_cast<VkSemaphore>(semaphore), &value);
+            if (result == VK_ERROR_DEVICE_LOST) throw std::runtime_error("Device lost");
+            return value;
         }
 
-        void otc(const std::function<void(const vk::CommandBuffer &)> &f, OTCSync sync, const std::shared_ptr<void> &ptr) {
+        bool waitSemaphore(vk::Semaphore semaphore, uint64_t value, uint64_t timeout) {
+            const auto s = static_cast<VkSemaphore>(semaphore);
+            const VkSemaphoreWaitInfo waitInfo{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, nullptr, 0, 1, &s, &value};
+            const VkResult result = globalState->dispatch.vkWaitSemaphores(static_cast<VkDevice>(globalState->device), &waitInfo, timeout);
+            if (result == VK_ERROR_DEVICE_LOST) throw std::runtime_error("Device lost");
+            return result == VK_SUCCESS;
+        }
+
+        // takes a recycled command buffer if there is one, the caller must hold mutOTCPool.
+        vk::CommandBuffer acquireOTCCommandBuffer() {
+            if (!globalState->otcFreeCommandBuffers.empty()) {
+                vk::CommandBuffer cmdb = globalState->otcFreeCommandBuffers.back();
+                globalState->otcFreeCommandBuffers.pop_back();
+                return cmdb;
+            }
+
+            // pointer overload, the vector-returning one allocates.
             vk::CommandBuffer cmdb;
+            vk::CommandBufferAllocateInfo allocateInfo(globalState->otcPool, vk::CommandBufferLevel::ePrimary, 1);
+            if (globalState->device.allocateCommandBuffers(&allocateInfo, &cmdb) != vk::Result::eSuccess) {
+                throw std::runtime_error("Failed to allocate otc command buffer");
+            }
+            globalState->metrics.liveCommandBuffers.add();
+            return cmdb;
+        }
+
+        vk::Fence acquireOTCFence() {
             {
-                std::lock_guard lk(globalState->mutOTCPool);
-                cmdb = globalState->device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(globalState->otcPool, vk::CommandBufferLevel::ePrimary, 1))[0];
-                cmdb.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-                f(cmdb);
-                cmdb.end();
+                std::lock_guard lock(globalState->mutOTCL);
+                if (!globalState->otcFreeFences.empty()) {
+                    vk::Fence fence = globalState->otcFreeFences.back();
+                    globalState->otcFreeFences.pop_back();
+                    return fence;
+                }
             }
 
+            globalState->metrics.liveFences.add();
+            return createFence();
+        }
+
+        // shared by otc and submit(), recordTime only matters for replay captures.
+        void submitCommandBuffer(vk::CommandBuffer cmdb, vk::Fence fence, const OTCSync &sync, std::chrono::nanoseconds recordTime) {
             vk::SubmitInfo2 si{};
 
             vk::CommandBufferSubmitInfo cbsi{};
@@ -460,64 +1152,97 @@ namespace kat {
 
             vk::SemaphoreSubmitInfo waitInfo{};
             waitInfo.setSemaphore(sync.wait);
+            waitInfo.setValue(sync.waitValue);
             waitInfo.setStageMask(sync.waitStage);
 
             vk::SemaphoreSubmitInfo signalInfo{};
             signalInfo.setSemaphore(sync.signal);
-            waitInfo.setStageMask(sync.signalStage);
-
-            // todo: support timeline semaphores
+            signalInfo.setValue(sync.signalValue);
+            signalInfo.setStageMask(sync.signalStage);
 
-            si.setWaitSemaphoreInfos(waitInfo).setSignalSemaphoreInfos(signalInfo);
+            // null semaphores can't be submitted, leave them out.
+            if (sync.wait) si.setWaitSemaphoreInfos(waitInfo);
+            if (sync.signal) si.setSignalSemaphoreInfos(signalInfo);
             si.setCommandBufferInfos(cbsi);
 
-            vk::Fence fence = createFence();
-
-            // eventually ill probably have to wrap a mutex around this queue too (so it can be used multithreaded)
-            globalState->mainQueue.submit2(si, fence);
-
             {
-                std::lock_guard lock(globalState->mutOTCL);
-                globalState->otcl.emplace(fence, true, cmdb, ptr);
+                KAT_TRACE_ZONE("submit");
+                vku::queueSubmit(globalState->mainQueue, si, fence);
             }
+
+            replay::recordSubmit(static_cast<uint64_t>(recordTime.count()), sync.wait ? 1 : 0, sync.signal ? 1 : 0, static_cast<bool>(fence));
         }
 
-        void otc(const std::function<void(const vk::CommandBuffer &)> &f, vk::Fence fence, OTCSync sync, const std::shared_ptr<void> &ptr) {
-            vk::CommandBuffer cmdb;
+        void submit(vk::CommandBuffer commandBuffer, vk::Fence fence, const OTCSync &sync) {
+            submitCommandBuffer(commandBuffer, fence, sync, std::chrono::nanoseconds(0));
+        }
+
+        void submit(vk::Queue queue, vk::CommandBuffer commandBuffer, vk::Fence fence, std::span<const vk::SemaphoreSubmitInfo> waits, std::span<const vk::SemaphoreSubmitInfo> signals) {
+            const vk::CommandBufferSubmitInfo cbsi(commandBuffer);
+            const vk::SubmitInfo2 si({}, waits, cbsi, signals);
+
             {
-                std::lock_guard lk(globalState->mutOTCPool);
-                cmdb = globalState->device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(globalState->otcPool, vk::CommandBufferLevel::ePrimary, 1))[0];
-                cmdb.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-                f(cmdb);
-                cmdb.end();
+                KAT_TRACE_ZONE("submit");
+                queueSubmit(queue, si, fence);
             }
 
-            vk::SubmitInfo2 si{};
+            replay::recordSubmit(0, static_cast<uint32_t>(waits.size()), static_cast<uint32_t>(signals.size()), static_cast<bool>(fence));
+        }
 
-            vk::CommandBufferSubmitInfo cbsi{};
-            cbsi.commandBuffer = cmdb;
-            cbsi.deviceMask = 0U;
+        void bindSparse(const vk::BindSparseInfo &bindInfo, vk::Fence fence) {
+            if (!globalState->sparseQueue) throw std::runtime_error("No queue supports sparse binding");
 
-            vk::SemaphoreSubmitInfo waitInfo{};
-            waitInfo.setSemaphore(sync.wait);
-            waitInfo.setStageMask(sync.waitStage);
+            auto lk = lockQueue(globalState->sparseQueue);
+            if (globalState->sparseQueue == globalState->mainQueue) lk = std::unique_lock(globalState->mutMainQueue);
 
-            vk::SemaphoreSubmitInfo signalInfo{};
-            signalInfo.setSemaphore(sync.signal);
-            waitInfo.setStageMask(sync.signalStage);
+            KAT_TRACE_ZONE("bindSparse");
+            globalState->sparseQueue.bindSparse(bindInfo, fence);
+        }
 
-            // todo: support timeline semaphores
+        std::unique_lock<std::mutex> lockQueue(vk::Queue queue) {
+            if (queue == globalState->computeQueue) return std::unique_lock(globalState->mutComputeQueue);
+            if (queue == globalState->mainQueue) return {};
+            return std::unique_lock(globalState->mutTransferQueue); // the transfer queue is the only other one there is
+        }
 
-            si.setWaitSemaphoreInfos(waitInfo).setSignalSemaphoreInfos(signalInfo);
-            si.setCommandBufferInfos(cbsi);
+        void submitOTC(const RecordFunction &f, vk::Fence fence, bool managed, const OTCSync &sync, const std::shared_ptr<void> &ptr, std::coroutine_handle<> continuation = {}) {
+            KAT_TRACE_ZONE("otc");
+            static const vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 
-            // eventually ill probably have to wrap a mutex around this queue too (so it can be used multithreaded)
-            globalState->mainQueue.submit2(si, fence);
+            vk::CommandBuffer cmdb;
+            const auto recordStart = std::chrono::steady_clock::now();
+            {
+                std::lock_guard lk(globalState->mutOTCPool);
+                cmdb = acquireOTCCommandBuffer();
+                cmdb.begin(beginInfo);
+                f(cmdb);
+                cmdb.end();
+            }
+            const auto recordTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - recordStart);
 
             {
+                // otcl has to be in submission order (see otclc()), so the entry is pushed before anyone else can submit.
                 std::lock_guard lock(globalState->mutOTCL);
-                globalState->otcl.emplace(fence, false, cmdb, ptr);
+                submitCommandBuffer(cmdb, fence, sync, recordTime);
+                globalState->otcl.push(OTCEntry{fence, managed, cmdb, ptr, continuation});
+                if (continuation) globalState->otclContinuations++;
+                globalState->metrics.otclQueueLength.set(static_cast<int64_t>(globalState->otcl.size()));
             }
+
+            // the wait thread may be blocked without polling, and nothing else retires otcs while the render loop isn't running.
+            if (continuation) globalState->scheduler->notifyPoll();
+        }
+
+        void otc(const RecordFunction &f, OTCSync sync, const std::shared_ptr<void> &ptr) {
+            submitOTC(f, acquireOTCFence(), true, sync, ptr);
+        }
+
+        void otc(const RecordFunction &f, vk::Fence fence, OTCSync sync, const std::shared_ptr<void> &ptr) {
+            submitOTC(f, fence, false, sync, ptr);
+        }
+
+        void otc(const RecordFunction &f, std::coroutine_handle<> continuation, OTCSync sync) {
+            submitOTC(f, acquireOTCFence(), true, sync, {}, continuation);
         }
 
         bool getEventStatus(const vk::Event &event) {
@@ -531,5 +1256,18 @@ namespace kat {
         void resetEvent(const vk::Event &event) {
             globalState->device.resetEvent(event);
         }
+
+        vk::Result present(const vk::PresentInfoKHR &presentInfo) {
+            KAT_TRACE_ZONE("present");
+            std::lock_guard lk(globalState->mutMainQueue);
+
+            const auto start = std::chrono::steady_clock::now();
+
+            // straight through the dispatch table, out of date/lost surfaces are expected during normal operation (resizing, closing windows) and just returned.
+            const auto result = static_cast<vk::Result>(globalState->dispatch.vkQueuePresentKHR(static_cast<VkQueue>(globalState->mainQueue), reinterpret_cast<const VkPresentInfoKHR *>(&presentInfo)));
+
+            replay::recordPresent(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()), presentInfo.swapchainCount, static_cast<int32_t>(result));
+            return result;
+        }
     } // namespace vku
 } // namespace kat
@@ -1,12 +1,16 @@
 #pragma once
 
 #include <condition_variable>
+#include <coroutine>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <queue>
 #include <set>
+#include <span>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -23,6 +27,16 @@
 
 #include "kat/window.hpp"
 
+#include "kat/capabilities.hpp"
+#include "kat/device_dispatch.hpp"
+#include "kat/device_selection.hpp"
+
+#include "kat/inplace_function.hpp"
+#include "kat/log.hpp"
+#include "kat/metrics.hpp"
+#include "kat/ring_queue.hpp"
+#include "kat/slot_map.hpp"
+#include "kat/startup_timeline.hpp"
 #include "kat/vku.hpp"
 
 
@@ -38,6 +52,10 @@
 
 #define KAT_IS_DEBUG KAT_DEBUG_SWITCH(true, false)
 
+#ifndef KATENGINE_TRACING
+#define KATENGINE_TRACING KAT_DEBUG_SWITCH(1, 0)
+#endif
+
 #if KATENGINE_UNCHECKED_DESTROY
 #define KAT_DESTROY_SAFE_CHECK(o) if (o)
 #else
@@ -46,20 +64,74 @@
 
 namespace kat {
     class Window;
+    class Scheduler;
 
     struct Version {
         int major, minor, patch, revision = 0;
     };
 
+    enum class PresentStrategy {
+        eBatched,     // every window that rendered this cycle is presented with a single presentKHR call.
+        eIndependent, // every window presents on its own as soon as it's done, windows that aren't ready yet are skipped instead of waited on.
+    };
+
+    // an object queued with deferDestroy(), type erased so buckets are plain arrays.
+    struct DeferredDestroy {
+        uint64_t handle;
+        uint64_t owner; // e.g. the pool for pool allocated objects, 0 if unused
+        void (*destroy)(uint64_t handle, uint64_t owner);
+    };
+
+    struct DeferredBucket {
+        vk::Fence fence; // signaled once everything submitted to the main queue before the bucket was closed has finished
+        std::vector<DeferredDestroy> objects;
+    };
+
+    struct OTCEntry {
+        vk::Fence fence;           // waited on before the command buffer is recycled
+        bool managed = false;      // if false, the fence isn't recycled (assume that the fence is used elsewhere)
+        vk::CommandBuffer cmdb;
+        std::shared_ptr<void> ptr; // can be used for lifetime preservation.
+        std::coroutine_handle<> continuation; // resumed on the scheduler once the fence has signaled, if set
+    };
+
     struct GlobalState {
         std::string appName = "Application";
         Version appVersion = Version{0, 1, 0};
 
+        // from init() until the end of startup(), see kat/startup_timeline.hpp.
+        StartupTimeline startupTimeline;
+
         bool enableApiDump = false;
         bool enableValidationLayers = false;
 
+        // headless mode: no GLFW windows or surfaces are created, and startup doesn't require a queue family that can present.
+        bool headless = false;
+
+        // if set, startup uses the physical device with this UUID or name instead of the best scoring one (see kat/device_selection.hpp).
+        std::string physicalDeviceOverride;
+
+        bool glfwAvailable = false;            // glfwInit() succeeded (it won't on machines without a display)
+        bool headlessSurfaceSupported = false; // VK_EXT_headless_surface is enabled on the instance
+
         bool startupComplete = false;
 
+        // if set, the cpu trace (see kat/trace.hpp) is written here as Chrome trace JSON during wrapup.
+        std::string traceOutputPath;
+
+        // if set, every frame is captured here for katengine_replay (see kat/replay.hpp), from the end of startup until wrapup.
+        std::string replayCapturePath;
+
+        // if set, pipelineCache is loaded from here during startup (while the instance and device are created) and saved back during wrapup.
+        std::string pipelineCachePath;
+
+        // runs coroutines (see kat/scheduler.hpp), from the end of startup until wrapup. 0 worker threads means one less than there are cores.
+        std::unique_ptr<Scheduler> scheduler;
+        uint32_t schedulerThreadCount = 0;
+
+        // run on their own threads during startup, see addStartupTask().
+        std::vector<std::pair<const char *, std::function<void()>>> startupTasks;
+
         spdlog::level::level_enum defaultLogLevel = KAT_DEBUG_SWITCH(spdlog::level::debug, spdlog::level::info);
 
         std::shared_ptr<spdlog::sinks::stdout_color_sink_mt> stdoutSink;
@@ -67,22 +139,81 @@ namespace kat {
         std::shared_ptr<spdlog::logger> mainLogger;
         std::shared_ptr<spdlog::logger> validationLogger;
 
+        // the same validation message id is only logged a few times per second, repeats are counted instead.
+        MessageRateLimiter validationRateLimiter{5, std::chrono::seconds(1)};
+
         std::atomic<uint32_t> activeWindowCount = 0;
-        std::unordered_map<size_t, std::shared_ptr<Window>> activeWindows;
-        std::atomic<size_t> nextWindowId;
+
+        // the render loop takes a snapshot of the registry under mutWindows at the start of every cycle, and renders it without holding the lock.
+        // windows are closed from the event loop, which only queues them up in pendingWindowRemovals (see flushWindowRemovals()).
+        SlotMap<std::unique_ptr<Window>> activeWindows;
+        std::mutex mutWindows;
+        uint64_t renderCycle = 0; // snapshots taken so far, guarded by mutWindows
+
+        std::vector<WindowId> pendingWindowRemovals;
+        std::mutex mutPendingWindowRemovals;
+
+        // windows removed from the registry, destroyed by the event loop once every render cycle that might have them in its snapshot has finished.
+        std::vector<std::pair<uint64_t, std::unique_ptr<Window>>> retiringWindows; // (renderCycle when removed, window), event loop only
+        std::atomic<uint64_t> finishedRenderCycle = 0;
+
+        // native windows of destroyed Windows, handed back by deferred destruction once their surfaces are gone. the event loop destroys them (glfw wants that on its thread).
+        std::vector<GLFWwindow *> retiredNativeWindows;
+        std::mutex mutRetiredNativeWindows;
 
         bool seperateRenderAndUpdateThreads = false;
 
+        PresentStrategy presentStrategy = PresentStrategy::eBatched;
+
+        // called from the render loop at the start of every cycle, before any window renders (with mutWindows held).
+        // the place to swap resources that frames in flight might still be using.
+        eventpp::CallbackList<void()> onFrameBoundary;
+
+        // cpu time spent in the last eventloopCycle()/renderloopCycle(), in milliseconds.
+        std::atomic<double> eventloopCpuTime = 0.0;
+        std::atomic<double> renderloopCpuTime = 0.0;
+
+        EngineMetrics metrics;
+
+        // if metricsExportInterval isn't zero, metrics are reported (and the histograms reset) from the render loop every interval.
+        // reports go to the main logger, or are appended to metricsExportPath as JSON lines if it is set.
+        std::chrono::milliseconds metricsExportInterval{0};
+        std::string metricsExportPath;
+
         vk::Instance instance;
         vk::DebugUtilsMessengerEXT debugMessenger;
         vk::PhysicalDevice physicalDevice;
+        vk::PhysicalDeviceProperties physicalDeviceProperties;
+        vk::PhysicalDeviceMemoryProperties memoryProperties;
         vk::Device device;
 
+        // optional features and extensions, everything supported is enabled on device.
+        Capabilities capabilities;
+
+        // pass this to pipeline creation, it is persisted if pipelineCachePath is set.
+        vk::PipelineCache pipelineCache;
+
+        // hot path entry points of device, see kat/device_dispatch.hpp.
+        DeviceDispatch dispatch;
+
         uint32_t mainFamily;
         uint32_t transferFamily;
+        uint32_t computeFamily; // a compute-only family if there is one, otherwise mainFamily
 
         vk::Queue mainQueue;
-        vk::Queue transferQueue;
+        vk::Queue transferQueue; // same as mainQueue if transferFamily is mainFamily, see StagingRing (kat/render/staging_ring.hpp)
+        vk::Queue computeQueue; // same as mainQueue if computeFamily is mainFamily, see AsyncCompute (kat/render/async_compute.hpp)
+
+        // every compute queue submission signals the next value, so deferred destruction can wait for compute work too.
+        vk::Semaphore computeTimeline;
+        uint64_t computeTimelineValue = 0; // last value submitted, guarded by mutComputeQueue
+        std::mutex mutComputeQueue;        // held while submitting to computeQueue
+
+        // null if neither the transfer nor the main family can bind sparse memory (or the device doesn't support sparse binding). use vku::bindSparse().
+        vk::Queue sparseQueue;
+
+        std::mutex mutTransferQueue; // held while submitting to transferQueue (unless it is computeQueue), see vku::lockQueue()
+        std::mutex mutMainQueue;     // taken by vku::queueSubmit() and vku::present() for mainQueue, otcs are submitted from any thread
 
         vk::CommandPool mainPool;
         vk::CommandPool transferPool;
@@ -92,8 +223,16 @@ namespace kat {
         std::mutex mutOTCPool;
         std::mutex mutOTCL;
 
-        // the shared ptr can be used for lifetime preservation.
-        std::queue<std::tuple<vk::Fence, bool, vk::CommandBuffer, std::shared_ptr<void>>> otcl; // first fence is waited on, if second is false then the fence isn't destroyed (assume that the fence is used elsewhere);
+        RingQueue<OTCEntry> otcl{64};
+        uint32_t otclContinuations = 0; // entries in otcl with a continuation, guarded by mutOTCL
+
+        // retired otc command buffers and fences, reused instead of being freed so steady-state otc submits don't allocate.
+        std::vector<vk::CommandBuffer> otcFreeCommandBuffers; // guarded by mutOTCPool
+        std::vector<vk::Fence> otcFreeFences;                 // guarded by mutOTCL
+
+        // sizes of allocations made through vku::allocateMemory, for the device memory gauge.
+        std::unordered_map<vk::DeviceMemory, vk::DeviceSize> memoryAllocationSizes;
+        std::mutex mutMemoryAllocations;
 
         //        std::jthread otclCleaner;
 
@@ -102,8 +241,18 @@ namespace kat {
 
         std::atomic_bool otclcStop = false;
 
+        // objects passed to deferDestroy() since the last frame boundary.
+        std::vector<DeferredDestroy> deferredObjects; // guarded by mutDeferred
+        std::vector<vk::SemaphoreSubmitInfo> deferredWaits; // timeline values the next bucket waits for (see deferDestroyAfter()), guarded by mutDeferred
+        std::mutex mutDeferred;
+
+        // closed buckets, oldest first. only touched by the render loop (and wrapup).
+        RingQueue<DeferredBucket> deferredBuckets{MAX_FRAMES_IN_FLIGHT * 2};
+        std::vector<std::vector<DeferredDestroy>> deferredFreeLists; // emptied bucket storage, reused so steady-state deferral doesn't allocate
+
         friend void init();
         friend void startup();
+        friend std::vector<std::tuple<WindowId, Window *>> startup(const std::vector<WindowCreateInfo> &windows);
         friend void terminate();
 
         void wrapup();
@@ -115,7 +264,11 @@ namespace kat {
         ~GlobalState();
 
       private:
-        void startup();
+        // whileCreatingDevice runs on the calling thread while the device is created on another one.
+        void startup(const std::function<void()> &whileCreatingDevice = {});
+        void createInstance();
+        void createDevice();
+        void savePipelineCache();
     };
 
     extern GlobalState *globalState;
@@ -125,9 +278,71 @@ namespace kat {
     void setValidationLayersEnabled(bool enabled);
     void setApiDumpEnabled(bool enabled);
 
+    void setPresentStrategy(PresentStrategy strategy);
+
+    void setLogLevel(spdlog::level::level_enum level);
+    void setValidationLogLevel(spdlog::level::level_enum level);
+
+    // burst = 0 disables rate limiting.
+    void setValidationRateLimit(uint32_t burst, std::chrono::milliseconds window);
+
+    /**
+     * Move logging off the calling threads: messages are queued (bounded, lock free) and written by a background thread.
+     *
+     * Replaces mainLogger/validationLogger, so call it before startup() and don't hold on to the old loggers.
+     * Errors and above are still flushed synchronously.
+     */
+    void setAsyncLogging(bool enabled, const AsyncLogOptions &options = {});
+
+    void setTraceOutput(const std::string &path);
+
+    void setReplayCapture(const std::string &path);
+
+    void setMetricsExport(std::chrono::milliseconds interval, const std::string &path = "");
+
+    /**
+     * Run without a display (must be set before startup()).
+     *
+     * Every window becomes a headless render target, and startup works on devices (or drivers like lavapipe) without presentation support.
+     */
+    void setHeadless(bool headless);
+
+    /**
+     * Use a specific physical device instead of the best scoring one (must be set before startup()).
+     *
+     * Matches the device UUID (as logged during startup), or any part of the device name (case insensitive), e.g. "llvmpipe".
+     */
+    void setPhysicalDeviceOverride(const std::string &nameOrUuid);
+
+    /**
+     * Persist the pipeline cache (globalState->pipelineCache) at path between runs (must be set before startup()).
+     *
+     * The file is read while the instance and device are created, and only used if it was written by the same driver for the same device.
+     */
+    void setPipelineCachePath(const std::string &path);
+
+    /**
+     * Run task on its own thread during startup(), alongside instance and device creation (must be called before startup()).
+     *
+     * For work that doesn't need the device, like reading or mapping assets. startup() waits for every task, rethrowing their exceptions.
+     * name shows up in the startup timeline, use a string literal.
+     */
+    void addStartupTask(const char *name, std::function<void()> task);
+
+    // worker threads of globalState->scheduler (must be set before startup()), 0 for one less than there are cores.
+    void setSchedulerThreads(uint32_t count);
+
     void init();
     void startup();
 
+    /**
+     * Start the engine and create windows with it.
+     *
+     * The native windows open on the calling thread (which has to be the main thread) while the device is created on another one,
+     * then the windows are finished (swapchains and so on) once the device is ready. If the engine was already started, the windows are just created.
+     */
+    std::vector<std::tuple<WindowId, Window *>> startup(const std::vector<WindowCreateInfo> &windows);
+
     void terminate();
 
     template<typename T>
@@ -185,11 +400,78 @@ namespace kat {
         if (object) globalState->device.destroy(object);
     }
 
+    template<typename T>
+    inline uint64_t toRawHandle(const T &object) {
+        using C = typename T::CType;
+        if constexpr (std::is_pointer_v<C>) {
+            return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(static_cast<C>(object)));
+        } else {
+            return static_cast<uint64_t>(static_cast<C>(object));
+        }
+    }
+
+    template<typename T>
+    inline T fromRawHandle(uint64_t handle) {
+        using C = typename T::CType;
+        if constexpr (std::is_pointer_v<C>) {
+            return T(reinterpret_cast<C>(static_cast<uintptr_t>(handle)));
+        } else {
+            return T(static_cast<C>(handle));
+        }
+    }
+
+    void enqueueDeferredDestroy(const DeferredDestroy &entry);
+
+    /**
+     * Destroy an object once the gpu is done with everything submitted to the main queue so far, without waiting for it.
+     *
+     * Objects are collected until the next frame boundary, where they are closed into a bucket with a fence behind all work submitted up to that point.
+     * The render loop destroys a bucket (in the order objects were queued) once its fence has signaled, wrapup() destroys whatever is left.
+     * Null handles are ignored. Thread safe.
+     *
+     * The fence covers the main queue, and the compute queue (through computeTimeline). Work on the transfer and sparse binding queues isn't covered,
+     * there is no engine-wide timeline for them: pass the owner's own timeline to deferDestroyAfter() first (VirtualTexture does so for its binds),
+     * or wait on it (StagingRing).
+     */
+    template<device_destructible T>
+    inline void deferDestroy(const T &object) {
+        if (!object) return;
+        enqueueDeferredDestroy(DeferredDestroy{toRawHandle(object), 0, +[](uint64_t handle, uint64_t) { globalState->device.destroy(fromRawHandle<T>(handle)); }});
+    }
+
+    template<instance_destructible T>
+    inline void deferDestroy(const T &object) {
+        if (!object) return;
+        enqueueDeferredDestroy(DeferredDestroy{toRawHandle(object), 0, +[](uint64_t handle, uint64_t) { globalState->instance.destroy(fromRawHandle<T>(handle)); }});
+    }
+
+    /**
+     * Make the objects deferred from now on also wait for a timeline semaphore value, for work deferDestroy()'s fence doesn't cover.
+     * The wait goes into the next bucket, buckets are destroyed in order. The semaphore itself can be deferred right after. Thread safe.
+     */
+    void deferDestroyAfter(vk::Semaphore timeline, uint64_t value);
+
+    /**
+     * deferDestroy() for a fence that was passed to vku::otc() (e.g. a frame's inFlightFence). Once its bucket has signaled, otcs that are still queued
+     * with the fence are detached from it before it is destroyed, so otclc() never checks a destroyed fence. Thread safe.
+     */
+    void deferDestroyOTCFence(vk::Fence fence);
+
+    // closes the current deferred bucket and destroys the ones whose fences have signaled. called by the render loop at every frame boundary.
+    void collectDeferredDestroys();
+
+    // recycles otc command buffers (and resumes their continuations) whose fences have signaled. called by the render loop, and by the scheduler while
+    // coroutines wait on otcs. thread safe.
+    void otclc();
+
     void run();
 
     void eventloopCycle();
     void renderloopCycle();
 
+    // destroys every window closed since the last call. waits for the render loop to reach a frame boundary if there is anything to destroy.
+    void flushWindowRemovals();
+
 
     template<typename T>
     concept sccompatible = ((std::same_as<std::remove_cvref_t<decltype(T::sType)>, vk::StructureType> ||
@@ -256,25 +538,91 @@ namespace kat {
 
     namespace vku {
         vk::Semaphore createSemaphore();
+        vk::Semaphore createTimelineSemaphore(uint64_t initialValue = 0);
         vk::Fence createFence();
         vk::Fence createFenceSignaled();
         vk::Event createEvent();
         vk::Event createDeviceOnlyEvent();
 
+        [[nodiscard]] uint32_t findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags properties);
+
+        // allocateMemory/freeMemory keep GlobalState::metrics.deviceMemoryUsage up to date, use them instead of the device functions.
+        [[nodiscard]] vk::DeviceMemory allocateMemory(const vk::MemoryAllocateInfo &allocateInfo);
+        void freeMemory(vk::DeviceMemory memory);
+
+        // freeMemory() once the gpu is done with the memory, see deferDestroy().
+        void deferFreeMemory(vk::DeviceMemory memory);
+
+        // free a command buffer back to its pool once the gpu is done with it. the pool is used from whichever thread collects deferred objects (the render loop).
+        void deferFreeCommandBuffer(vk::CommandPool pool, vk::CommandBuffer commandBuffer);
+
+        // through the device dispatch table. throw std::runtime_error if the device was lost (or the wait/reset fails), waitFence with a timeout returns false on timeout.
         void waitFence(const vk::Fence &fence);
+        [[nodiscard]] bool waitFence(const vk::Fence &fence, uint64_t timeout);
         void resetFence(vk::Fence fence);
 
+        // getFenceStatus through the device dispatch table. throws std::runtime_error if the device was lost.
+        [[nodiscard]] bool isFenceSignaled(vk::Fence fence);
+
+        // submit2 through the device dispatch table. throws std::runtime_error if the submit fails.
+        void queueSubmit(vk::Queue queue, const vk::SubmitInfo2 &submitInfo, vk::Fence fence = {});
+
+        // current value of a timeline semaphore.
+        [[nodiscard]] uint64_t getSemaphoreValue(vk::Semaphore semaphore);
+
+        // wait until a timeline semaphore reaches value, returns false on timeout. throws std::runtime_error if the device was lost.
+        bool waitSemaphore(vk::Semaphore semaphore, uint64_t value, uint64_t timeout = UINT64_MAX);
+
         [[nodiscard]] bool getEventStatus(const vk::Event& event);
         void setEvent(const vk::Event& event);
         void resetEvent(const vk::Event& event);
 
+        /**
+         * Present on the main queue without throwing on out of date/lost surfaces.
+         *
+         * If presentInfo has pResults set, the per-swapchain results are valid even if the returned result is an error.
+         */
+        vk::Result present(const vk::PresentInfoKHR &presentInfo);
+
         struct OTCSync {
             vk::Semaphore signal, wait;
             vk::PipelineStageFlags2 waitStage = vk::PipelineStageFlagBits2::eTopOfPipe;
             vk::PipelineStageFlags2 signalStage = vk::PipelineStageFlagBits2::eBottomOfPipe;
+
+            // only used with timeline semaphores (ignored for binary ones).
+            uint64_t waitValue = 0;
+            uint64_t signalValue = 0;
         };
 
-        void otc(const std::function<void(const vk::CommandBuffer &)> &f, OTCSync sync = {}, const std::shared_ptr<void> &ptr = {});
-        void otc(const std::function<void(const vk::CommandBuffer &)> &f, vk::Fence fence, OTCSync sync = {}, const std::shared_ptr<void> &ptr = {});
+        /**
+         * Submit a recorded command buffer to the main queue, with the same semaphore handling as otc (null semaphores are left out).
+         */
+        void submit(vk::CommandBuffer commandBuffer, vk::Fence fence, const OTCSync &sync = {});
+
+        /**
+         * Submit a recorded command buffer to any queue, with any number of (binary or timeline) semaphore waits and signals.
+         */
+        void submit(vk::Queue queue, vk::CommandBuffer commandBuffer, vk::Fence fence, std::span<const vk::SemaphoreSubmitInfo> waits, std::span<const vk::SemaphoreSubmitInfo> signals);
+
+        /**
+         * Sparse memory binding on GlobalState::sparseQueue, locked against other submissions to the same queue from other threads.
+         * Binds aren't ordered with submissions, use semaphores (or wait for them on the host) before using the memory.
+         */
+        void bindSparse(const vk::BindSparseInfo &bindInfo, vk::Fence fence = {});
+
+        /**
+         * Lock the mutex that guards submissions to a queue other threads may submit to as well (computeQueue, transferQueue, sparseQueue).
+         * Queues that are the same vk::Queue share one mutex. For the main queue the returned lock is empty, queueSubmit() and present() lock it themselves.
+         */
+        [[nodiscard]] std::unique_lock<std::mutex> lockQueue(vk::Queue queue);
+
+        // recording callback for otc, stored inline so passing a lambda doesn't allocate.
+        using RecordFunction = InplaceFunction<void(const vk::CommandBuffer &), 64>;
+
+        void otc(const RecordFunction &f, OTCSync sync = {}, const std::shared_ptr<void> &ptr = {});
+        void otc(const RecordFunction &f, vk::Fence fence, OTCSync sync = {}, const std::shared_ptr<void> &ptr = {});
+
+        // resumes continuation on globalState->scheduler once the command buffer has finished, co_await otcAsync() (kat/scheduler.hpp) instead of calling this.
+        void otc(const RecordFunction &f, std::coroutine_handle<> continuation, OTCSync sync = {});
     } // namespace vku
 } // namespace kat
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace kat {
+
+    template<typename Signature, size_t Capacity = 64>
+    class InplaceFunction;
+
+    /**
+     * A std::function replacement which stores the callable inside of itself instead of on the heap.
+     *
+     * Callables which don't fit into Capacity bytes are rejected at compile time, so constructing one of these never allocates.
+     * This is meant for the hot paths (like recording lambdas passed to vku::otc) where a std::function would allocate every call.
+     */
+    template<typename R, typename... Args, size_t Capacity>
+    class InplaceFunction<R(Args...), Capacity> {
+        struct VTable {
+            R (*invoke)(const void *storage, Args &&...args);
+            void (*copy)(void *dst, const void *src);
+            void (*move)(void *dst, void *src) noexcept;
+            void (*destroy)(void *storage) noexcept;
+        };
+
+        template<typename F>
+        static constexpr VTable vtableFor = {
+                +[](const void *storage, Args &&...args) -> R { return (*static_cast<F *>(const_cast<void *>(storage)))(std::forward<Args>(args)...); },
+                +[](void *dst, const void *src) { new (dst) F(*static_cast<const F *>(src)); },
+                +[](void *dst, void *src) noexcept { new (dst) F(std::move(*static_cast<F *>(src))); },
+                +[](void *storage) noexcept { static_cast<F *>(storage)->~F(); },
+        };
+
+      public:
+        inline InplaceFunction() noexcept = default;
+
+        inline InplaceFunction(std::nullptr_t) noexcept {};
+
+        template<typename F>
+            requires(!std::same_as<std::remove_cvref_t<F>, InplaceFunction> && std::is_invocable_r_v<R, std::remove_cvref_t<F> &, Args...>)
+        inline InplaceFunction(F &&f) {
+            using T = std::remove_cvref_t<F>;
+            static_assert(sizeof(T) <= Capacity, "callable is too large for this InplaceFunction, capture less (or by reference) or raise the capacity");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "callable is over-aligned for InplaceFunction");
+            static_assert(std::is_nothrow_move_constructible_v<T>, "callable must be nothrow move constructible");
+
+            new (m_Storage) T(std::forward<F>(f));
+            m_VTable = &vtableFor<T>;
+        };
+
+        inline InplaceFunction(const InplaceFunction &other) {
+            if (other.m_VTable) {
+                other.m_VTable->copy(m_Storage, other.m_Storage);
+                m_VTable = other.m_VTable;
+            }
+        };
+
+        inline InplaceFunction(InplaceFunction &&other) noexcept {
+            if (other.m_VTable) {
+                other.m_VTable->move(m_Storage, other.m_Storage);
+                m_VTable = other.m_VTable;
+            }
+        };
+
+        inline InplaceFunction &operator=(const InplaceFunction &other) {
+            if (this != &other) {
+                InplaceFunction temp(other);
+                *this = std::move(temp);
+            }
+            return *this;
+        };
+
+        inline InplaceFunction &operator=(InplaceFunction &&other) noexcept {
+            if (this != &other) {
+                reset();
+                if (other.m_VTable) {
+                    other.m_VTable->move(m_Storage, other.m_Storage);
+                    m_VTable = other.m_VTable;
+                }
+            }
+            return *this;
+        };
+
+        inline ~InplaceFunction() {
+            reset();
+        };
+
+        inline void reset() noexcept {
+            if (m_VTable) {
+                m_VTable->destroy(m_Storage);
+                m_VTable = nullptr;
+            }
+        };
+
+        inline R operator()(Args... args) const {
+            return m_VTable->invoke(m_Storage, std::forward<Args>(args)...);
+        };
+
+        [[nodiscard]] inline explicit operator bool() const noexcept { return m_VTable != nullptr; };
+
+      private:
+        alignas(std::max_align_t) std::byte m_Storage[Capacity];
+        const VTable *m_VTable = nullptr;
+    };
+
+} // namespace kat
@@ -0,0 +1,212 @@
+#include "log.hpp"
+
+#include <bit>
+
+namespace kat {
+    AsyncSink::AsyncSink(std::vector<spdlog::sink_ptr> sinks, const AsyncLogOptions &options) : m_Sinks(std::move(sinks)), m_OverflowPolicy(options.overflowPolicy) {
+        const size_t size = std::bit_ceil(std::max<size_t>(options.queueSize, 2));
+        m_Cells = std::make_unique<Cell[]>(size);
+        m_Mask = size - 1;
+
+        for (size_t i = 0; i < size; i++) {
+            m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        m_Flusher = std::jthread([this](const std::stop_token &stopToken) { flusherLoop(stopToken); });
+    }
+
+    AsyncSink::~AsyncSink() {
+        m_Flusher.request_stop();
+        m_Published.fetch_add(1, std::memory_order_release);
+        m_Published.notify_one();
+        m_Flusher.join(); // drains whatever is still queued first
+    }
+
+    template<typename Fill>
+    bool AsyncSink::tryEnqueue(Fill &&fill) {
+        size_t position = m_EnqueuePosition.load(std::memory_order_relaxed);
+        Cell *cell;
+
+        while (true) {
+            cell = &m_Cells[position & m_Mask];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (diff == 0) {
+                if (m_EnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                position = m_EnqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        fill(cell->record);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool AsyncSink::tryDequeue(Record *&record, size_t &position) {
+        position = m_DequeuePosition.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell &cell = m_Cells[position & m_Mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+            if (diff == 0) {
+                if (m_DequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    record = &cell.record;
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty (or the next slot is still being written)
+            } else {
+                position = m_DequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void AsyncSink::release(size_t position) {
+        // the record keeps its string buffers so the next message written into the slot can reuse them.
+        m_Cells[position & m_Mask].sequence.store(position + m_Mask + 1, std::memory_order_release);
+    }
+
+    void AsyncSink::log(const spdlog::details::log_msg &msg) {
+        auto fill = [&](Record &r) {
+            r.time = msg.time;
+            r.level = msg.level;
+            r.threadId = msg.thread_id;
+            r.loggerName.assign(msg.logger_name.data(), msg.logger_name.size());
+            r.payload.assign(msg.payload.data(), msg.payload.size());
+            r.flush = false;
+        };
+
+        if (!tryEnqueue(fill)) {
+            if (m_OverflowPolicy == AsyncOverflowPolicy::eDrop) {
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            while (!tryEnqueue(fill)) std::this_thread::yield();
+        }
+
+        m_Published.fetch_add(1, std::memory_order_release);
+        m_Published.notify_one();
+    }
+
+    void AsyncSink::flush() {
+        uint64_t ticket;
+        {
+            // tickets have to be enqueued in order, the flusher completes them in queue order.
+            std::unique_lock lk(m_FlushMutex);
+
+            // flush requests are never dropped, they wait for the flusher to make room. it doesn't once it is stopping, the destructor flushes anyway.
+            // the timeout covers slots freed between a failed enqueue and the wait.
+            while (!tryEnqueue([](Record &r) { r.flush = true; })) {
+                if (m_Flusher.get_stop_token().stop_requested()) return;
+                m_Space.wait_for(lk, std::chrono::milliseconds(1));
+            }
+            ticket = ++m_FlushRequests;
+        }
+
+        m_Published.fetch_add(1, std::memory_order_release);
+        m_Published.notify_one();
+
+        uint64_t flushed = m_Flushed.load(std::memory_order_acquire);
+        while (flushed < ticket) {
+            m_Flushed.wait(flushed, std::memory_order_acquire);
+            flushed = m_Flushed.load(std::memory_order_acquire);
+        }
+    }
+
+    void AsyncSink::set_pattern(const std::string &pattern) {
+        for (const auto &sink: m_Sinks) sink->set_pattern(pattern);
+    }
+
+    void AsyncSink::set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) {
+        for (const auto &sink: m_Sinks) sink->set_formatter(sink_formatter->clone());
+    }
+
+    uint64_t AsyncSink::getDroppedCount() const noexcept {
+        return m_Dropped.load(std::memory_order_relaxed);
+    }
+
+    void AsyncSink::flusherLoop(const std::stop_token &stopToken) {
+        while (true) {
+            const uint64_t seen = m_Published.load(std::memory_order_acquire);
+
+            Record *record;
+            size_t position;
+            while (tryDequeue(record, position)) {
+                if (record->flush) {
+                    for (const auto &sink: m_Sinks) sink->flush();
+                    release(position);
+
+                    m_Flushed.fetch_add(1, std::memory_order_release);
+                    m_Flushed.notify_all();
+                    continue;
+                }
+
+                spdlog::details::log_msg msg(record->time, spdlog::source_loc{}, record->loggerName, record->level, record->payload);
+                msg.thread_id = record->threadId;
+
+                for (const auto &sink: m_Sinks) {
+                    if (sink->should_log(msg.level)) sink->log(msg);
+                }
+
+                release(position);
+            }
+            m_Space.notify_all();
+
+            const uint64_t dropped = m_Dropped.load(std::memory_order_relaxed);
+            if (dropped != m_ReportedDropped) {
+                const std::string payload = fmt::format("Log queue was full, dropped {} messages", dropped - m_ReportedDropped);
+                spdlog::details::log_msg msg("log", spdlog::level::warn, payload);
+                for (const auto &sink: m_Sinks) {
+                    if (sink->should_log(msg.level)) sink->log(msg);
+                }
+                m_ReportedDropped = dropped;
+            }
+
+            if (stopToken.stop_requested()) {
+                for (const auto &sink: m_Sinks) sink->flush();
+                return;
+            }
+
+            m_Published.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    bool MessageRateLimiter::allow(int32_t id, uint64_t &suppressed) {
+        suppressed = 0;
+        const auto now = std::chrono::steady_clock::now();
+
+        std::lock_guard lk(m_Mutex);
+        if (m_Burst == 0) return true;
+
+        auto &entry = m_Entries[id];
+
+        if (entry.count == 0 || now - entry.windowStart >= m_Window) {
+            entry.windowStart = now;
+            entry.count = 0;
+        }
+
+        if (entry.count >= m_Burst) {
+            entry.suppressed++;
+            return false;
+        }
+
+        entry.count++;
+        suppressed = entry.suppressed;
+        entry.suppressed = 0;
+        return true;
+    }
+
+    void MessageRateLimiter::configure(uint32_t burst, std::chrono::milliseconds window) {
+        std::lock_guard lk(m_Mutex);
+        m_Burst = burst;
+        m_Window = window;
+        m_Entries.clear();
+    }
+} // namespace kat
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/sink.h>
+
+namespace kat {
+
+    enum class AsyncOverflowPolicy {
+        eDrop,  // messages logged while the queue is full are dropped (and counted), logging never blocks.
+        eBlock, // the logging thread spins until the flusher makes room.
+    };
+
+    struct AsyncLogOptions {
+        size_t queueSize = 8192; // messages, rounded up to a power of two
+        AsyncOverflowPolicy overflowPolicy = AsyncOverflowPolicy::eDrop;
+    };
+
+    /**
+     * spdlog sink that hands messages to a background flusher thread through a bounded lock-free queue (Vyukov MPMC).
+     *
+     * Logging threads only copy the message into a queue slot, so they never contend on the wrapped sinks' mutexes or wait on file io.
+     * Slots keep their string buffers between uses, so once the queue has warmed up logging doesn't allocate either.
+     */
+    class AsyncSink final : public spdlog::sinks::sink {
+      public:
+        AsyncSink(std::vector<spdlog::sink_ptr> sinks, const AsyncLogOptions &options = {});
+        ~AsyncSink() override;
+
+        void log(const spdlog::details::log_msg &msg) override;
+
+        // blocks until everything logged before the call has been written and the wrapped sinks are flushed.
+        void flush() override;
+
+        void set_pattern(const std::string &pattern) override;
+        void set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) override;
+
+        [[nodiscard]] uint64_t getDroppedCount() const noexcept;
+
+        [[nodiscard]] inline const std::vector<spdlog::sink_ptr> &getSinks() const noexcept { return m_Sinks; };
+
+        AsyncSink(const AsyncSink &) = delete;
+        AsyncSink &operator=(const AsyncSink &) = delete;
+
+      private:
+        struct Record {
+            spdlog::log_clock::time_point time;
+            spdlog::level::level_enum level;
+            size_t threadId;
+            std::string loggerName;
+            std::string payload;
+            bool flush;
+        };
+
+        struct Cell {
+            std::atomic<size_t> sequence;
+            Record record;
+        };
+
+        template<typename Fill>
+        bool tryEnqueue(Fill &&fill);
+        bool tryDequeue(Record *&record, size_t &position);
+        void release(size_t position);
+
+        void flusherLoop(const std::stop_token &stopToken);
+
+        std::vector<spdlog::sink_ptr> m_Sinks;
+        AsyncOverflowPolicy m_OverflowPolicy;
+
+        std::unique_ptr<Cell[]> m_Cells;
+        size_t m_Mask;
+
+        alignas(64) std::atomic<size_t> m_EnqueuePosition = 0;
+        alignas(64) std::atomic<size_t> m_DequeuePosition = 0;
+
+        // bumped on every enqueue, the flusher sleeps on it while the queue is empty.
+        alignas(64) std::atomic<uint64_t> m_Published = 0;
+        std::atomic<uint64_t> m_Flushed = 0; // flush requests completed by the flusher
+        uint64_t m_FlushRequests = 0;        // guarded by m_FlushMutex
+        std::mutex m_FlushMutex;
+        std::condition_variable m_Space; // the flusher freed slots, flush() waits on it while the queue is full
+
+        std::atomic<uint64_t> m_Dropped = 0;
+        uint64_t m_ReportedDropped = 0; // flusher only
+
+        std::jthread m_Flusher;
+    };
+
+    /**
+     * Suppresses repeats of the same message id (e.g. validation messages that fire every frame).
+     *
+     * The first `burst` occurrences of an id per window pass, the rest are counted and reported once the next one passes.
+     */
+    class MessageRateLimiter {
+      public:
+        MessageRateLimiter(uint32_t burst, std::chrono::milliseconds window) : m_Burst(burst), m_Window(window) {}
+
+        // returns false if the message should be dropped. suppressed is set to the number of repeats dropped since the last one that passed.
+        bool allow(int32_t id, uint64_t &suppressed);
+
+        void configure(uint32_t burst, std::chrono::milliseconds window);
+
+      private:
+        struct Entry {
+            std::chrono::steady_clock::time_point windowStart;
+            uint32_t count;
+            uint64_t suppressed;
+        };
+
+        std::mutex m_Mutex;
+        std::unordered_map<int32_t, Entry> m_Entries;
+        uint32_t m_Burst;
+        std::chrono::milliseconds m_Window;
+    };
+
+} // namespace kat
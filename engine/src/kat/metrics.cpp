@@ -0,0 +1,126 @@
+#include "metrics.hpp"
+
+#include <cmath>
+#include <fstream>
+
+namespace kat {
+    namespace {
+        constexpr double BUCKETS_PER_DOUBLING = 4.0;
+
+        size_t bucketFor(double microseconds) noexcept {
+            if (!(microseconds > 1.0)) return 0; // also catches nan
+            const auto bucket = static_cast<size_t>(std::log2(microseconds) * BUCKETS_PER_DOUBLING);
+            return std::min(bucket, Histogram::BUCKET_COUNT - 1);
+        }
+
+        // upper bound of a bucket, in milliseconds
+        double bucketLimit(size_t bucket) noexcept {
+            return std::exp2(static_cast<double>(bucket + 1) / BUCKETS_PER_DOUBLING) / 1000.0;
+        }
+
+        void atomicMin(std::atomic<uint64_t> &target, uint64_t value) noexcept {
+            uint64_t current = target.load(std::memory_order_relaxed);
+            while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+        }
+
+        void atomicMax(std::atomic<uint64_t> &target, uint64_t value) noexcept {
+            uint64_t current = target.load(std::memory_order_relaxed);
+            while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+        }
+
+        void logHistogram(spdlog::logger &logger, const char *name, const HistogramSnapshot &s) {
+            logger.info("{}: n={} mean={:.3f}ms min={:.3f}ms p50={:.3f}ms p90={:.3f}ms p99={:.3f}ms max={:.3f}ms", name, s.count, s.mean, s.min, s.p50, s.p90, s.p99, s.max);
+        }
+
+        void writeHistogram(std::ostream &out, const char *name, const HistogramSnapshot &s) {
+            out << "\"" << name << "\":{\"count\":" << s.count << ",\"mean\":" << s.mean << ",\"min\":" << s.min << ",\"p50\":" << s.p50
+                << ",\"p90\":" << s.p90 << ",\"p99\":" << s.p99 << ",\"max\":" << s.max << "}";
+        }
+    } // namespace
+
+    void Histogram::record(double milliseconds) noexcept {
+        const double clamped = std::max(milliseconds, 0.0);
+        const auto nanoseconds = static_cast<uint64_t>(clamped * 1000000.0);
+
+        m_Buckets[bucketFor(clamped * 1000.0)].fetch_add(1, std::memory_order_relaxed);
+        m_Count.fetch_add(1, std::memory_order_relaxed);
+        m_SumNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        atomicMin(m_MinNanoseconds, nanoseconds);
+        atomicMax(m_MaxNanoseconds, nanoseconds);
+    }
+
+    HistogramSnapshot Histogram::snapshot() const noexcept {
+        std::array<uint64_t, BUCKET_COUNT> buckets{};
+        uint64_t total = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            buckets[i] = m_Buckets[i].load(std::memory_order_relaxed);
+            total += buckets[i];
+        }
+
+        HistogramSnapshot s{};
+        s.count = total;
+        if (total == 0) return s;
+
+        s.mean = static_cast<double>(m_SumNanoseconds.load(std::memory_order_relaxed)) / static_cast<double>(m_Count.load(std::memory_order_relaxed)) / 1000000.0;
+        s.min = static_cast<double>(m_MinNanoseconds.load(std::memory_order_relaxed)) / 1000000.0;
+        s.max = static_cast<double>(m_MaxNanoseconds.load(std::memory_order_relaxed)) / 1000000.0;
+
+        auto percentile = [&](double p) {
+            const auto rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKET_COUNT; i++) {
+                seen += buckets[i];
+                if (seen >= rank) return std::min(bucketLimit(i), s.max);
+            }
+            return s.max;
+        };
+
+        s.p50 = percentile(0.50);
+        s.p90 = percentile(0.90);
+        s.p99 = percentile(0.99);
+        return s;
+    }
+
+    void Histogram::reset() noexcept {
+        for (auto &b: m_Buckets) b.store(0, std::memory_order_relaxed);
+        m_Count.store(0, std::memory_order_relaxed);
+        m_SumNanoseconds.store(0, std::memory_order_relaxed);
+        m_MinNanoseconds.store(UINT64_MAX, std::memory_order_relaxed);
+        m_MaxNanoseconds.store(0, std::memory_order_relaxed);
+    }
+
+    void EngineMetrics::log(spdlog::logger &logger) const {
+        logHistogram(logger, "frame time", frameTime.snapshot());
+        logHistogram(logger, "acquire wait", acquireWait.snapshot());
+        logHistogram(logger, "fence wait", fenceWait.snapshot());
+        logger.info("otcl queue length: {}, live command buffers: {}, live fences: {}, swapchain recreations: {}, device memory: {} bytes",
+                    otclQueueLength.get(), liveCommandBuffers.get(), liveFences.get(), swapchainRecreations.get(), deviceMemoryUsage.get());
+    }
+
+    bool EngineMetrics::append(const std::string &path) const {
+        std::ofstream out(path, std::ios::out | std::ios::app);
+        if (!out) return false;
+
+        const auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        out << "{\"timestamp\":" << timestamp << ",";
+        writeHistogram(out, "frameTime", frameTime.snapshot());
+        out << ",";
+        writeHistogram(out, "acquireWait", acquireWait.snapshot());
+        out << ",";
+        writeHistogram(out, "fenceWait", fenceWait.snapshot());
+        out << ",\"otclQueueLength\":" << otclQueueLength.get()
+            << ",\"liveCommandBuffers\":" << liveCommandBuffers.get()
+            << ",\"liveFences\":" << liveFences.get()
+            << ",\"swapchainRecreations\":" << swapchainRecreations.get()
+            << ",\"deviceMemoryUsage\":" << deviceMemoryUsage.get() << "}\n";
+
+        return static_cast<bool>(out);
+    }
+
+    void EngineMetrics::resetHistograms() noexcept {
+        frameTime.reset();
+        acquireWait.reset();
+        fenceWait.reset();
+    }
+} // namespace kat
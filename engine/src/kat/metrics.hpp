@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+namespace kat {
+
+    struct HistogramSnapshot {
+        uint64_t count;
+        double mean, min, max; // milliseconds
+        double p50, p90, p99;  // milliseconds, accurate to the bucket size (~19%)
+    };
+
+    /**
+     * Lock-free histogram of durations in milliseconds.
+     *
+     * Values are bucketed logarithmically (4 buckets per doubling, from 1us to ~16s), so recording is a couple of relaxed atomic adds.
+     */
+    class Histogram {
+      public:
+        static constexpr size_t BUCKET_COUNT = 96;
+
+        void record(double milliseconds) noexcept;
+
+        template<typename Rep, typename Period>
+        inline void record(std::chrono::duration<Rep, Period> duration) noexcept {
+            record(std::chrono::duration<double, std::milli>(duration).count());
+        };
+
+        [[nodiscard]] HistogramSnapshot snapshot() const noexcept;
+
+        void reset() noexcept;
+
+      private:
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_Buckets{};
+        std::atomic<uint64_t> m_Count = 0;
+        std::atomic<uint64_t> m_SumNanoseconds = 0;
+        std::atomic<uint64_t> m_MinNanoseconds = UINT64_MAX;
+        std::atomic<uint64_t> m_MaxNanoseconds = 0;
+    };
+
+    class Gauge {
+      public:
+        inline void set(int64_t value) noexcept { m_Value.store(value, std::memory_order_relaxed); };
+
+        inline void add(int64_t value = 1) noexcept { m_Value.fetch_add(value, std::memory_order_relaxed); };
+
+        inline void sub(int64_t value = 1) noexcept { m_Value.fetch_sub(value, std::memory_order_relaxed); };
+
+        [[nodiscard]] inline int64_t get() const noexcept { return m_Value.load(std::memory_order_relaxed); };
+
+      private:
+        std::atomic<int64_t> m_Value = 0;
+    };
+
+    /**
+     * Engine-wide runtime metrics (see GlobalState::metrics). Everything can be read at any time from any thread.
+     */
+    struct EngineMetrics {
+        Histogram frameTime;   // time between the starts of two render loop cycles
+        Histogram acquireWait; // time spent in acquireNextImageKHR
+        Histogram fenceWait;   // time spent waiting for a frame's inFlightFence before it can be reused
+
+        Gauge otclQueueLength;      // otc submissions waiting for their fence
+        Gauge liveCommandBuffers;   // otc command buffers allocated from the otc pool (in flight and recycled)
+        Gauge liveFences;           // fences created for otc submissions (in flight and recycled)
+        Gauge swapchainRecreations; // total since startup
+        Gauge deviceMemoryUsage;    // bytes allocated through vku::allocateMemory
+
+        void log(spdlog::logger &logger) const;
+
+        // appends one JSON object per call (JSON lines), returns false if the file couldn't be written.
+        bool append(const std::string &path) const;
+
+        void resetHistograms() noexcept;
+    };
+
+} // namespace kat
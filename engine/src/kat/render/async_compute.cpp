@@ -0,0 +1,83 @@
+#include "async_compute.hpp"
+
+#include "kat/trace.hpp"
+
+namespace kat {
+    AsyncCompute::AsyncCompute() {
+        m_Pool = globalState->device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, globalState->computeFamily));
+    }
+
+    AsyncCompute::~AsyncCompute() {
+        if (m_LastValue != 0) wait(m_LastValue);
+        kat::destroy(m_Pool); // frees the command buffers with it
+    }
+
+    uint64_t AsyncCompute::submit(const RecordFunction &record, std::span<const Wait> waits) {
+        KAT_TRACE_ZONE("AsyncCompute::submit");
+
+        vk::CommandBuffer commandBuffer = acquireCommandBuffer();
+
+        CommandRecorder recorder(commandBuffer);
+        recorder.beginPrimary(cmd::BeginOptions{.oneTimeSubmit = true});
+        record(recorder);
+        recorder->end();
+
+        m_WaitInfos.clear();
+        for (const auto &w: waits) m_WaitInfos.emplace_back(w.semaphore, w.value, w.stage);
+
+        uint64_t value;
+        {
+            // values have to reach the queue in increasing order, so allocation and submission happen under the same lock.
+            // the value is only taken once the submit went through, deferred destruction would otherwise wait for one that is never signaled.
+            std::lock_guard lk(globalState->mutComputeQueue);
+            value = globalState->computeTimelineValue + 1;
+
+            const vk::SemaphoreSubmitInfo signal(globalState->computeTimeline, value, vk::PipelineStageFlagBits2::eAllCommands);
+            vku::submit(globalState->computeQueue, commandBuffer, {}, m_WaitInfos, {&signal, 1});
+            globalState->computeTimelineValue = value;
+        }
+
+        m_InFlight.push(InFlight{value, commandBuffer});
+        m_LastValue = value;
+        return value;
+    }
+
+    vk::SemaphoreSubmitInfo AsyncCompute::waitInfo(uint64_t value, vk::PipelineStageFlags2 stage) {
+        return {globalState->computeTimeline, value, stage};
+    }
+
+    bool AsyncCompute::isComplete(uint64_t value) {
+        return vku::getSemaphoreValue(globalState->computeTimeline) >= value;
+    }
+
+    bool AsyncCompute::wait(uint64_t value, uint64_t timeout) {
+        return vku::waitSemaphore(globalState->computeTimeline, value, timeout);
+    }
+
+    bool AsyncCompute::isDedicated() {
+        return globalState->computeQueue != globalState->mainQueue;
+    }
+
+    vk::CommandBuffer AsyncCompute::acquireCommandBuffer() {
+        if (!m_InFlight.empty()) {
+            const uint64_t completed = vku::getSemaphoreValue(globalState->computeTimeline);
+            while (!m_InFlight.empty() && m_InFlight.front().value <= completed) {
+                m_Free.push_back(m_InFlight.pop().commandBuffer);
+            }
+        }
+
+        if (!m_Free.empty()) {
+            vk::CommandBuffer commandBuffer = m_Free.back();
+            m_Free.pop_back();
+            commandBuffer.reset();
+            return commandBuffer;
+        }
+
+        vk::CommandBuffer commandBuffer;
+        vk::CommandBufferAllocateInfo allocateInfo(m_Pool, vk::CommandBufferLevel::ePrimary, 1);
+        if (globalState->device.allocateCommandBuffers(&allocateInfo, &commandBuffer) != vk::Result::eSuccess) {
+            throw std::runtime_error("Failed to allocate compute command buffer");
+        }
+        return commandBuffer;
+    }
+} // namespace kat
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "kat/engine.hpp"
+#include "kat/render/command_recorder.hpp"
+
+namespace kat {
+
+    /**
+     * Compute work on GlobalState::computeQueue, which is a dedicated compute family when the device has one, so culling, simulation or
+     * post-processing runs alongside graphics work instead of after it on the main queue.
+     *
+     * Every submission signals the engine-wide compute timeline semaphore (GlobalState::computeTimeline) with a new value, which is returned.
+     * Graphics submissions that consume the results wait for that value (see waitInfo()), and compute work can wait on other timeline or binary
+     * semaphores in turn, so the queues only synchronize where they actually depend on each other. deferDestroy() also waits for compute work.
+     *
+     * With a dedicated family, resources that are written on one queue and read on the other either need VK_SHARING_MODE_CONCURRENT,
+     * or a queue family ownership transfer (a release barrier on one queue and a matching acquire barrier on the other).
+     *
+     * Command buffers come from the object's own pool and are reused once the timeline has passed them. Use each AsyncCompute from one thread,
+     * and if !isDedicated() only from the thread that submits frames, since computeQueue is then the main queue.
+     */
+    class AsyncCompute {
+      public:
+        using RecordFunction = InplaceFunction<void(CommandRecorder &), 64>;
+
+        struct Wait {
+            vk::Semaphore semaphore;
+            uint64_t value = 0; // ignored for binary semaphores
+            vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eComputeShader;
+        };
+
+        AsyncCompute();
+        ~AsyncCompute(); // waits for the work submitted through this object
+
+        /**
+         * Record and submit compute work, which starts once every wait is satisfied.
+         *
+         * @return The compute timeline value that is reached when the work has finished.
+         */
+        uint64_t submit(const RecordFunction &record, std::span<const Wait> waits = {});
+
+        // wait on this in a graphics submission to consume results of the work that returned value.
+        [[nodiscard]] static vk::SemaphoreSubmitInfo waitInfo(uint64_t value, vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eAllCommands);
+
+        [[nodiscard]] static bool isComplete(uint64_t value);
+
+        // blocks until the compute timeline reaches value, returns false on timeout.
+        static bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+        // false if compute work shares the main queue (the device has no compute-only family), in which case it still works but doesn't overlap.
+        [[nodiscard]] static bool isDedicated();
+
+        AsyncCompute(const AsyncCompute &) = delete;
+        AsyncCompute &operator=(const AsyncCompute &) = delete;
+
+      private:
+        struct InFlight {
+            uint64_t value = 0;
+            vk::CommandBuffer commandBuffer;
+        };
+
+        vk::CommandBuffer acquireCommandBuffer();
+
+        vk::CommandPool m_Pool;
+        RingQueue<InFlight> m_InFlight{8};
+        std::vector<vk::CommandBuffer> m_Free;
+        uint64_t m_LastValue = 0;
+
+        std::vector<vk::SemaphoreSubmitInfo> m_WaitInfos; // scratch
+    };
+
+} // namespace kat
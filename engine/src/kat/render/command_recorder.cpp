@@ -1,5 +1,7 @@
 #include "command_recorder.hpp"
 
+#include "kat/replay.hpp"
+
 namespace kat {
     CommandRecorder::CommandRecorder(vk::CommandBuffer commandBuffer) : m_CommandBuffer(commandBuffer) {
     }
@@ -20,14 +22,103 @@ namespace kat {
     }
 
     void CommandRecorder::beginRenderPass(const std::shared_ptr<kat::RenderPass> &renderPass, const cmd::RenderPassBeginInfo &renderPassBeginInfo) {
-        m_CommandBuffer.beginRenderPass2(vk::RenderPassBeginInfo(renderPass->get(), renderPassBeginInfo.framebuffer, renderPassBeginInfo.renderArea, renderPassBeginInfo.clearValues), vk::SubpassBeginInfo(renderPassBeginInfo.subpassContents));
+        const vk::RenderPassBeginInfo beginInfo(renderPass->get(), renderPassBeginInfo.framebuffer, renderPassBeginInfo.renderArea, renderPassBeginInfo.clearValues);
+        const vk::SubpassBeginInfo subpassInfo(renderPassBeginInfo.subpassContents);
+        globalState->dispatch.vkCmdBeginRenderPass2(raw(), reinterpret_cast<const VkRenderPassBeginInfo *>(&beginInfo), reinterpret_cast<const VkSubpassBeginInfo *>(&subpassInfo));
+        replay::recordBeginRenderPass(renderPassBeginInfo.renderArea.extent.width, renderPassBeginInfo.renderArea.extent.height, static_cast<uint32_t>(renderPassBeginInfo.clearValues.size()));
     }
 
     void CommandRecorder::endRenderPass() {
-        m_CommandBuffer.endRenderPass2(vk::SubpassEndInfo());
+        const vk::SubpassEndInfo endInfo;
+        globalState->dispatch.vkCmdEndRenderPass2(raw(), reinterpret_cast<const VkSubpassEndInfo *>(&endInfo));
+        replay::recordEndRenderPass();
     }
 
     void CommandRecorder::executeCommands(const std::vector<vk::CommandBuffer> &commandBuffers) {
         m_CommandBuffer.executeCommands(commandBuffers);
     }
+
+    void CommandRecorder::pipelineBarrier(const vku::DependencyInfo &dependencyInfo) {
+        kat::stack stack;
+        const vk::DependencyInfo desc = dependencyInfo.desc(stack);
+        globalState->dispatch.vkCmdPipelineBarrier2(raw(), reinterpret_cast<const VkDependencyInfo *>(&desc));
+        replay::recordBarrier(static_cast<uint32_t>(dependencyInfo.memoryBarriers.size()), static_cast<uint32_t>(dependencyInfo.bufferMemoryBarriers.size()), static_cast<uint32_t>(dependencyInfo.imageMemoryBarriers.size()));
+    }
+
+    void CommandRecorder::bindPipeline(vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline) {
+        globalState->dispatch.vkCmdBindPipeline(raw(), static_cast<VkPipelineBindPoint>(bindPoint), static_cast<VkPipeline>(pipeline));
+    }
+
+    void CommandRecorder::bindDescriptorSets(vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet, std::span<const vk::DescriptorSet> descriptorSets,
+                                             std::span<const uint32_t> dynamicOffsets) {
+        globalState->dispatch.vkCmdBindDescriptorSets(raw(), static_cast<VkPipelineBindPoint>(bindPoint), static_cast<VkPipelineLayout>(layout), firstSet,
+                                                      static_cast<uint32_t>(descriptorSets.size()), reinterpret_cast<const VkDescriptorSet *>(descriptorSets.data()),
+                                                      static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+    }
+
+    void CommandRecorder::pushConstants(vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void *data) {
+        globalState->dispatch.vkCmdPushConstants(raw(), static_cast<VkPipelineLayout>(layout), static_cast<VkShaderStageFlags>(stages), offset, size, data);
+    }
+
+    void CommandRecorder::dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+        globalState->dispatch.vkCmdDispatch(raw(), groupCountX, groupCountY, groupCountZ);
+    }
+
+    void CommandRecorder::dispatchIndirect(vk::Buffer buffer, vk::DeviceSize offset) {
+        globalState->dispatch.vkCmdDispatchIndirect(raw(), static_cast<VkBuffer>(buffer), offset);
+    }
+
+    void CommandRecorder::setEvent(const vk::Event &event, const vku::DependencyInfo &dependencyInfo) {
+        kat::stack stack;
+        const vk::DependencyInfo desc = dependencyInfo.desc(stack);
+        globalState->dispatch.vkCmdSetEvent2(raw(), static_cast<VkEvent>(event), reinterpret_cast<const VkDependencyInfo *>(&desc));
+    }
+
+    void CommandRecorder::resetEvent(const vk::Event &event, vk::PipelineStageFlags2 stageFlags) {
+        globalState->dispatch.vkCmdResetEvent2(raw(), static_cast<VkEvent>(event), static_cast<VkPipelineStageFlags2>(stageFlags));
+    }
+
+    void CommandRecorder::waitEvents(const std::vector<vk::Event> &events, const vku::DependencyInfo &dependencyInfo) {
+        if (events.empty()) return;
+
+        kat::stack stack;
+        const vk::DependencyInfo desc = dependencyInfo.desc(stack);
+
+        // waitEvents2 takes one dependency info per event.
+        auto *infos = stack.smalloc<vk::DependencyInfo>(events.size());
+        for (size_t i = 0; i < events.size(); i++) infos[i] = desc;
+
+        globalState->dispatch.vkCmdWaitEvents2(raw(), static_cast<uint32_t>(events.size()), reinterpret_cast<const VkEvent *>(events.data()), reinterpret_cast<const VkDependencyInfo *>(infos));
+        replay::recordBarrier(static_cast<uint32_t>(dependencyInfo.memoryBarriers.size()), static_cast<uint32_t>(dependencyInfo.bufferMemoryBarriers.size()), static_cast<uint32_t>(dependencyInfo.imageMemoryBarriers.size()));
+    }
+
+    void CommandRecorder::signal(const cmd::SplitBarrier &barrier) {
+        setEvent(barrier.event, *barrier.dependencyInfo);
+    }
+
+    void CommandRecorder::wait(const cmd::SplitBarrier &barrier, bool reset) {
+        kat::stack stack;
+        const vk::DependencyInfo desc = barrier.dependencyInfo->desc(stack);
+        globalState->dispatch.vkCmdWaitEvents2(raw(), 1, reinterpret_cast<const VkEvent *>(&barrier.event), reinterpret_cast<const VkDependencyInfo *>(&desc));
+        replay::recordBarrier(static_cast<uint32_t>(barrier.dependencyInfo->memoryBarriers.size()), static_cast<uint32_t>(barrier.dependencyInfo->bufferMemoryBarriers.size()), static_cast<uint32_t>(barrier.dependencyInfo->imageMemoryBarriers.size()));
+
+        if (reset) {
+            // after the waiting stages, so the reset can't overtake the wait.
+            vk::PipelineStageFlags2 stages = barrier.dependencyInfo->destinationStages();
+            if (!stages) stages = vk::PipelineStageFlagBits2::eAllCommands;
+            resetEvent(barrier.event, stages);
+        }
+    }
+
+    void CommandRecorder::beginProfileScope(GpuProfiler &profiler, const char *name, vk::PipelineStageFlags2 stage) {
+        profiler.beginScope(m_CommandBuffer, name, stage);
+    }
+
+    void CommandRecorder::endProfileScope(GpuProfiler &profiler, vk::PipelineStageFlags2 stage) {
+        profiler.endScope(m_CommandBuffer, stage);
+    }
+
+    GpuProfileScope CommandRecorder::profileScope(GpuProfiler &profiler, const char *name) {
+        return GpuProfileScope(profiler, m_CommandBuffer, name);
+    }
 } // namespace kat
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <span>
+#include <type_traits>
+
 #include "kat/engine.hpp"
+#include "kat/render/gpu_profiler.hpp"
 #include "kat/render/render_pass.hpp"
 
 namespace kat {
@@ -24,6 +28,18 @@ namespace kat {
 
             vk::SubpassContents subpassContents = vk::SubpassContents::eInline;
         };
+
+        /**
+         * A dependency split in two halves: signal() it right after the producer, wait() on it right before the consumer,
+         * and whatever is recorded in between doesn't have to wait for the producer.
+         *
+         * Both halves use the same dependency info, which has to outlive recording them. Build it once and point barriers at it,
+         * so making a barrier on the recording path doesn't allocate. Get the event from an EventPool.
+         */
+        struct SplitBarrier {
+            vk::Event event;
+            const vku::DependencyInfo *dependencyInfo;
+        };
     } // namespace cmd
 
     class CommandRecorder {
@@ -41,10 +57,41 @@ namespace kat {
 
         void setEvent(const vk::Event &event, const vku::DependencyInfo &dependencyInfo = {});
         void resetEvent(const vk::Event &event, vk::PipelineStageFlags2 stageFlags);
+
+        // every event has to have been set with the same dependency info.
         void waitEvents(const std::vector<vk::Event> &events, const vku::DependencyInfo &dependencyInfo = {});
 
         void pipelineBarrier(const vku::DependencyInfo &dependencyInfo = {});
 
+        void bindPipeline(vk::PipelineBindPoint bindPoint, vk::Pipeline pipeline);
+        void bindDescriptorSets(vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet, std::span<const vk::DescriptorSet> descriptorSets,
+                                std::span<const uint32_t> dynamicOffsets = {});
+
+        void pushConstants(vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void *data);
+
+        template<typename T>
+        inline void pushConstants(vk::PipelineLayout layout, vk::ShaderStageFlags stages, const T &value, uint32_t offset = 0) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            pushConstants(layout, stages, offset, sizeof(T), &value);
+        };
+
+        // compute dispatches, work that can run concurrently with graphics belongs on AsyncCompute (kat/render/async_compute.hpp).
+        void dispatch(uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+        void dispatchIndirect(vk::Buffer buffer, vk::DeviceSize offset = 0);
+
+        void signal(const cmd::SplitBarrier &barrier);
+
+        /**
+         * Wait on a split barrier, then (by default) reset its event on the gpu so it can be signaled again (device-only events can't be reset from the host).
+         */
+        void wait(const cmd::SplitBarrier &barrier, bool reset = true);
+
+        void beginProfileScope(GpuProfiler &profiler, const char *name, vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eTopOfPipe);
+        void endProfileScope(GpuProfiler &profiler, vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eBottomOfPipe);
+
+        // measures gpu time until the returned scope is destroyed.
+        [[nodiscard]] GpuProfileScope profileScope(GpuProfiler &profiler, const char *name);
+
         inline const vk::CommandBuffer *operator->() const noexcept { return &m_CommandBuffer; };
 
         inline const vk::CommandBuffer &operator*() const noexcept { return m_CommandBuffer; };
@@ -52,6 +99,9 @@ namespace kat {
         [[nodiscard]] inline const vk::CommandBuffer &get() const noexcept { return m_CommandBuffer; };
 
       private:
+        // the hot recording calls go through the device dispatch table (see kat/device_dispatch.hpp), which takes the C handle.
+        [[nodiscard]] inline VkCommandBuffer raw() const noexcept { return static_cast<VkCommandBuffer>(m_CommandBuffer); };
+
         vk::CommandBuffer m_CommandBuffer;
     };
 
@@ -0,0 +1,34 @@
+#include "event_pool.hpp"
+
+namespace kat {
+    EventPool::~EventPool() {
+        for (const auto &event: m_Free) kat::deferDestroy(event);
+
+        for (const auto &frame: m_InUse) {
+            for (const auto &event: frame) kat::deferDestroy(event);
+        }
+    }
+
+    void EventPool::beginFrame(uint32_t frameIndex) {
+        m_Frame = frameIndex % MAX_FRAMES_IN_FLIGHT;
+
+        // the last use of this frame index has retired.
+        auto &retired = m_InUse[m_Frame];
+        m_Free.insert(m_Free.end(), retired.begin(), retired.end());
+        retired.clear();
+    }
+
+    vk::Event EventPool::acquire() {
+        vk::Event event;
+        if (!m_Free.empty()) {
+            event = m_Free.back();
+            m_Free.pop_back();
+        } else {
+            event = vku::createDeviceOnlyEvent();
+            m_EventCount++;
+        }
+
+        m_InUse[m_Frame].push_back(event);
+        return event;
+    }
+} // namespace kat
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "kat/engine.hpp"
+
+namespace kat {
+
+    /**
+     * Recycles device-only events (for split barriers, see cmd::SplitBarrier) per frame in flight.
+     *
+     * Call beginFrame() once per frame, after that frame's inFlightFence has been waited on (i.e. in onRender, with resources.frameIndex).
+     * Events acquired during a frame are reused MAX_FRAMES_IN_FLIGHT frames later, so they have to be back in the unsignaled state by the end of the frame
+     * they were acquired in (CommandRecorder::wait() resets them by default). Only use the events in submissions that signal the frame's inFlightFence or complete before it.
+     *
+     * Not thread safe, use one pool per recording thread.
+     */
+    class EventPool {
+      public:
+        EventPool() = default;
+        ~EventPool();
+
+        void beginFrame(uint32_t frameIndex);
+
+        [[nodiscard]] vk::Event acquire();
+
+        [[nodiscard]] inline size_t getEventCount() const noexcept { return m_EventCount; };
+
+        EventPool(const EventPool &) = delete;
+        EventPool &operator=(const EventPool &) = delete;
+
+      private:
+        FrameSet<std::vector<vk::Event>> m_InUse;
+        std::vector<vk::Event> m_Free;
+        uint32_t m_Frame = 0;
+        size_t m_EventCount = 0;
+    };
+
+} // namespace kat
@@ -0,0 +1,244 @@
+#include "frame_capture.hpp"
+
+namespace kat {
+    namespace {
+        uint32_t bytesPerPixel(vk::Format format) {
+            switch (format) {
+                case vk::Format::eR8G8B8A8Unorm:
+                case vk::Format::eR8G8B8A8Srgb:
+                case vk::Format::eB8G8R8A8Unorm:
+                case vk::Format::eB8G8R8A8Srgb:
+                case vk::Format::eA2B10G10R10UnormPack32:
+                case vk::Format::eA2R10G10B10UnormPack32:
+                case vk::Format::eB10G11R11UfloatPack32:
+                    return 4;
+                case vk::Format::eR16G16B16A16Sfloat:
+                case vk::Format::eR16G16B16A16Unorm:
+                    return 8;
+                case vk::Format::eR32G32B32A32Sfloat:
+                    return 16;
+                default:
+                    throw std::runtime_error("Unsupported frame capture format " + vk::to_string(format));
+            }
+        }
+    } // namespace
+
+    FrameCapture::FrameCapture(vk::Extent2D maxExtent, vk::Format format, Consumer consumer, const FrameCaptureOptions &options)
+        : m_MaxExtent(maxExtent), m_Format(format), m_BytesPerPixel(bytesPerPixel(format)), m_Consumer(std::move(consumer)), m_SlotCount(std::max(options.ringSize, 1U)), m_Ready(options.ringSize) {
+        m_BufferSize = static_cast<vk::DeviceSize>(maxExtent.width) * maxExtent.height * m_BytesPerPixel;
+        m_Slots = std::make_unique<Slot[]>(m_SlotCount);
+
+        for (uint32_t i = 0; i < m_SlotCount; i++) {
+            auto &slot = m_Slots[i];
+            slot.buffer = globalState->device.createBuffer(vk::BufferCreateInfo({}, m_BufferSize, vk::BufferUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive));
+
+            auto requirements = globalState->device.getBufferMemoryRequirements(slot.buffer);
+
+            // cached memory is much faster to read from on the cpu, but it usually isn't coherent.
+            uint32_t memoryType;
+            try {
+                memoryType = vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached);
+            } catch (const std::runtime_error &) {
+                memoryType = vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+            }
+            m_Coherent = static_cast<bool>(globalState->memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+
+            slot.memory = vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, memoryType));
+            globalState->device.bindBufferMemory(slot.buffer, slot.memory, 0);
+            slot.mapped = static_cast<std::byte *>(globalState->device.mapMemory(slot.memory, 0, VK_WHOLE_SIZE));
+        }
+
+        if (options.asyncConsumer) {
+            m_ConsumerThread = std::jthread([this](const std::stop_token &stopToken) { consumerLoop(stopToken); });
+        }
+    }
+
+    FrameCapture::~FrameCapture() {
+        if (m_ConsumerThread.joinable()) {
+            m_ConsumerThread.request_stop();
+            m_ConsumerThread.join();
+        }
+
+        // frames the consumer thread didn't get to, then the ones still in flight (their buffers can't be pulled out from under the gpu anyway).
+        // the consumer thread is gone, so they are delivered here.
+        while (!m_Ready.empty()) deliver(m_Ready.pop());
+        for (uint32_t n = 0; n < m_SlotCount; n++) {
+            const uint32_t i = (m_NextSlot + n) % m_SlotCount;
+            if (m_Slots[i].state == SlotState::ePending) {
+                vku::waitFence(m_Slots[i].fence);
+                complete(i);
+            }
+        }
+
+        for (uint32_t i = 0; i < m_SlotCount; i++) {
+            auto &slot = m_Slots[i];
+            globalState->device.unmapMemory(slot.memory);
+            kat::destroy(slot.buffer);
+            vku::freeMemory(slot.memory);
+        }
+    }
+
+    bool FrameCapture::record(const vk::CommandBuffer &cmd, const WindowFrameResources &resources, vk::Extent2D extent, vk::ImageLayout layout) {
+        return record(cmd, resources.image, extent, layout, resources.sync->inFlightFence);
+    }
+
+    bool FrameCapture::record(const vk::CommandBuffer &cmd, vk::Image image, vk::Extent2D extent, vk::ImageLayout layout, vk::Fence completionFence) {
+        const uint64_t frameNumber = m_FrameCounter++;
+
+        // a fence is only reused once the work it tracked is done, so anything still waiting on this one has finished.
+        for (uint32_t i = 0; i < m_SlotCount; i++) {
+            if (m_Slots[i].state == SlotState::ePending && m_Slots[i].fence == completionFence) complete(i);
+        }
+
+        poll();
+
+        if (extent.width > m_MaxExtent.width || extent.height > m_MaxExtent.height) {
+            m_DroppedFrames++;
+            return false;
+        }
+
+        auto &slot = m_Slots[m_NextSlot];
+        if (slot.state != SlotState::eFree) {
+            // the consumer is falling behind, drop the frame rather than stall.
+            m_DroppedFrames++;
+            return false;
+        }
+
+        slot.fence = completionFence;
+        slot.frameNumber = frameNumber;
+        slot.extent = extent;
+        slot.state = SlotState::ePending;
+        m_NextSlot = (m_NextSlot + 1) % m_SlotCount;
+
+        const vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+        vk::ImageMemoryBarrier2 toTransfer{};
+        toTransfer.image = image;
+        toTransfer.srcStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+        toTransfer.srcAccessMask = vk::AccessFlagBits2::eMemoryWrite;
+        toTransfer.dstStageMask = vk::PipelineStageFlagBits2::eCopy;
+        toTransfer.dstAccessMask = vk::AccessFlagBits2::eTransferRead;
+        toTransfer.oldLayout = layout;
+        toTransfer.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.subresourceRange = range;
+
+        cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, toTransfer));
+
+        vk::BufferImageCopy region(0, 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), vk::Offset3D(0, 0, 0), vk::Extent3D(extent, 1));
+        cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, slot.buffer, region);
+
+        vk::ImageMemoryBarrier2 toOriginal{};
+        toOriginal.image = image;
+        toOriginal.srcStageMask = vk::PipelineStageFlagBits2::eCopy;
+        toOriginal.srcAccessMask = vk::AccessFlagBits2::eNone;
+        toOriginal.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+        toOriginal.dstAccessMask = vk::AccessFlagBits2::eNone;
+        toOriginal.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+        toOriginal.newLayout = layout;
+        toOriginal.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toOriginal.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toOriginal.subresourceRange = range;
+
+        vk::BufferMemoryBarrier2 toHost{};
+        toHost.buffer = slot.buffer;
+        toHost.srcStageMask = vk::PipelineStageFlagBits2::eCopy;
+        toHost.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+        toHost.dstStageMask = vk::PipelineStageFlagBits2::eHost;
+        toHost.dstAccessMask = vk::AccessFlagBits2::eHostRead;
+        toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.offset = 0;
+        toHost.size = VK_WHOLE_SIZE;
+
+        cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, toHost, toOriginal));
+
+        return true;
+    }
+
+    void FrameCapture::poll() {
+        // oldest first (m_NextSlot is the oldest slot, since slots are handed out round robin).
+        for (uint32_t n = 0; n < m_SlotCount; n++) {
+            const uint32_t i = (m_NextSlot + n) % m_SlotCount;
+            if (m_Slots[i].state == SlotState::ePending && vku::isFenceSignaled(m_Slots[i].fence)) {
+                complete(i);
+            }
+        }
+    }
+
+    void FrameCapture::flush() {
+        for (uint32_t n = 0; n < m_SlotCount; n++) {
+            const uint32_t i = (m_NextSlot + n) % m_SlotCount;
+            if (m_Slots[i].state == SlotState::ePending) {
+                vku::waitFence(m_Slots[i].fence);
+                complete(i);
+            }
+        }
+
+        // let the consumer thread drain too
+        if (m_ConsumerThread.joinable()) {
+            std::unique_lock lk(m_ReadyMutex);
+            m_ReadyCondition.wait(lk, [this] { return m_Ready.empty(); });
+        }
+    }
+
+    uint64_t FrameCapture::getDroppedFrameCount() const noexcept {
+        return m_DroppedFrames;
+    }
+
+    void FrameCapture::complete(uint32_t slotIndex) {
+        auto &slot = m_Slots[slotIndex];
+        slot.state = SlotState::eConsuming;
+
+        if (!m_Coherent) {
+            globalState->device.invalidateMappedMemoryRanges(vk::MappedMemoryRange(slot.memory, 0, VK_WHOLE_SIZE));
+        }
+
+        if (m_ConsumerThread.joinable()) {
+            {
+                std::lock_guard lk(m_ReadyMutex);
+                m_Ready.push(slotIndex);
+            }
+            m_ReadyCondition.notify_all();
+        } else {
+            deliver(slotIndex);
+        }
+    }
+
+    void FrameCapture::deliver(uint32_t slotIndex) {
+        auto &slot = m_Slots[slotIndex];
+
+        if (m_Consumer) {
+            CapturedFrame frame{};
+            frame.data = slot.mapped;
+            frame.rowPitch = slot.extent.width * m_BytesPerPixel;
+            frame.size = static_cast<size_t>(frame.rowPitch) * slot.extent.height;
+            frame.extent = slot.extent;
+            frame.format = m_Format;
+            frame.frameNumber = slot.frameNumber;
+            m_Consumer(frame);
+        }
+
+        slot.state = SlotState::eFree;
+    }
+
+    void FrameCapture::consumerLoop(const std::stop_token &stopToken) {
+        while (true) {
+            uint32_t slotIndex;
+            {
+                std::unique_lock lk(m_ReadyMutex);
+                if (!m_ReadyCondition.wait(lk, stopToken, [this] { return !m_Ready.empty(); })) return;
+                slotIndex = m_Ready.front();
+            }
+
+            deliver(slotIndex);
+
+            {
+                std::lock_guard lk(m_ReadyMutex);
+                m_Ready.pop();
+            }
+            m_ReadyCondition.notify_all();
+        }
+    }
+} // namespace kat
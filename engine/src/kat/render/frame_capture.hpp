@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "kat/engine.hpp"
+
+namespace kat {
+
+    struct CapturedFrame {
+        const std::byte *data;
+        size_t size;
+        uint32_t rowPitch; // bytes between the start of two rows (tightly packed)
+
+        vk::Extent2D extent;
+        vk::Format format;
+
+        uint64_t frameNumber; // counts every recorded capture (including dropped ones), starting at 0
+    };
+
+    struct FrameCaptureOptions {
+        // number of readback buffers. more buffers means a slow consumer can fall further behind before frames get dropped.
+        uint32_t ringSize = MAX_FRAMES_IN_FLIGHT + 2;
+
+        // deliver frames on a dedicated consumer (encoder) thread instead of on whatever thread calls poll().
+        bool asyncConsumer = false;
+    };
+
+    /**
+     * Copies rendered images (swapchain or engine-owned) into a ring of host-visible buffers without stalling the frame loop.
+     *
+     * record() adds the copy to the frame's own command buffer, the frame is handed to the consumer once the fence that frame is submitted with signals.
+     * Finished frames are picked up by poll() (and record(), since reusing a fence means the work it tracked has finished).
+     * If every buffer is still in use the capture is dropped instead of waiting.
+     *
+     * The consumer must be done with CapturedFrame::data when it returns, the buffer is reused afterwards.
+     */
+    class FrameCapture {
+      public:
+        using Consumer = std::function<void(const CapturedFrame &)>;
+
+        FrameCapture(vk::Extent2D maxExtent, vk::Format format, Consumer consumer, const FrameCaptureOptions &options = {});
+        ~FrameCapture(); // delivers the remaining captures on the calling thread, waiting for those still in flight like flush()
+
+        /**
+         * Record a copy of the current frame's image.
+         *
+         * @param layout The layout the image is in when the copy executes, it is returned to this layout afterwards.
+         * @return false if the capture was dropped (no free buffer, or the image is larger than maxExtent).
+         */
+        bool record(const vk::CommandBuffer &cmd, const WindowFrameResources &resources, vk::Extent2D extent, vk::ImageLayout layout);
+
+        /**
+         * Record a copy of an arbitrary color image. The command buffer has to be submitted with completionFence.
+         */
+        bool record(const vk::CommandBuffer &cmd, vk::Image image, vk::Extent2D extent, vk::ImageLayout layout, vk::Fence completionFence);
+
+        // hand every finished capture to the consumer (or the consumer thread).
+        void poll();
+
+        // wait for every pending capture and deliver it. the device has to be done with (or about to finish) the submitted frames.
+        void flush();
+
+        [[nodiscard]] uint64_t getDroppedFrameCount() const noexcept;
+
+        FrameCapture(const FrameCapture &) = delete;
+        FrameCapture &operator=(const FrameCapture &) = delete;
+
+      private:
+        enum class SlotState : uint32_t {
+            eFree,
+            ePending,   // copy recorded, waiting for the gpu
+            eConsuming, // handed to the consumer
+        };
+
+        struct Slot {
+            vk::Buffer buffer;
+            vk::DeviceMemory memory;
+            std::byte *mapped = nullptr;
+
+            std::atomic<SlotState> state = SlotState::eFree;
+            vk::Fence fence;
+            uint64_t frameNumber = 0;
+            vk::Extent2D extent;
+        };
+
+        void complete(uint32_t slotIndex);
+        void deliver(uint32_t slotIndex);
+        void consumerLoop(const std::stop_token &stopToken);
+
+        vk::Extent2D m_MaxExtent;
+        vk::Format m_Format;
+        uint32_t m_BytesPerPixel;
+        vk::DeviceSize m_BufferSize;
+        bool m_Coherent;
+
+        Consumer m_Consumer;
+
+        std::unique_ptr<Slot[]> m_Slots;
+        uint32_t m_SlotCount;
+        uint32_t m_NextSlot = 0;
+
+        uint64_t m_FrameCounter = 0;
+        std::atomic<uint64_t> m_DroppedFrames = 0;
+
+        std::mutex m_ReadyMutex;
+        std::condition_variable_any m_ReadyCondition;
+        RingQueue<uint32_t> m_Ready;
+        std::jthread m_ConsumerThread;
+    };
+
+} // namespace kat
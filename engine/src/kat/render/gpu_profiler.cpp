@@ -0,0 +1,166 @@
+#include "gpu_profiler.hpp"
+
+namespace kat {
+    namespace {
+        constexpr vk::QueryPipelineStatisticFlags PIPELINE_STATISTICS = vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices |
+                                                                        vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+                                                                        vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+                                                                        vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+                                                                        vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations |
+                                                                        vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+
+        constexpr uint32_t PIPELINE_STATISTICS_COUNT = 6; // number of bits in PIPELINE_STATISTICS, results are written in bit order
+    } // namespace
+
+    GpuProfiler::GpuProfiler(const GpuProfilerOptions &options) : m_Options(options) {
+        const auto queueFamilies = globalState->physicalDevice.getQueueFamilyProperties();
+        const uint32_t validBits = queueFamilies[globalState->mainFamily].timestampValidBits;
+
+        m_Supported = validBits > 0;
+        m_Statistics = m_Supported && options.pipelineStatistics && globalState->capabilities.pipelineStatisticsQuery;
+        m_TimestampPeriod = globalState->physicalDeviceProperties.limits.timestampPeriod;
+        m_TimestampMask = validBits >= 64 ? ~0ULL : ((1ULL << validBits) - 1);
+
+        if (!m_Supported) {
+            spdlog::warn("Main queue family doesn't support timestamps, gpu profiling is disabled");
+            return;
+        }
+
+        if (options.pipelineStatistics && !m_Statistics) {
+            spdlog::warn("Pipeline statistics queries aren't supported, only collecting timings");
+        }
+
+        for (auto &frame: m_Frames) {
+            frame.timestamps = globalState->device.createQueryPool(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, options.maxScopes * 2));
+            if (m_Statistics) {
+                frame.statistics = globalState->device.createQueryPool(vk::QueryPoolCreateInfo({}, vk::QueryType::ePipelineStatistics, options.maxScopes, PIPELINE_STATISTICS));
+            }
+
+            frame.names.resize(options.maxScopes);
+            frame.depths.resize(options.maxScopes);
+            frame.statisticsQuery.resize(options.maxScopes);
+        }
+
+        m_OpenScopes.reserve(options.maxScopeDepth);
+        m_TimestampData.resize(options.maxScopes * 2);
+        m_StatisticsData.resize(options.maxScopes * PIPELINE_STATISTICS_COUNT);
+        m_Latest.reserve(options.maxScopes);
+    }
+
+    GpuProfiler::~GpuProfiler() {
+        for (auto &frame: m_Frames) {
+            kat::safeDestroy(frame.timestamps);
+            kat::safeDestroy(frame.statistics);
+        }
+    }
+
+    void GpuProfiler::beginFrame(const vk::CommandBuffer &cmd, uint32_t frameIndex) {
+        if (!m_Supported) return;
+
+        m_Current = &m_Frames[frameIndex % MAX_FRAMES_IN_FLIGHT];
+        collect(*m_Current);
+
+        cmd.resetQueryPool(m_Current->timestamps, 0, m_Options.maxScopes * 2);
+        if (m_Statistics) cmd.resetQueryPool(m_Current->statistics, 0, m_Options.maxScopes);
+
+        m_Current->scopeCount = 0;
+        m_Current->statisticsCount = 0;
+        m_Current->recorded = true;
+
+        m_OpenScopes.clear();
+        m_OverflowDepth = 0;
+    }
+
+    void GpuProfiler::beginScope(const vk::CommandBuffer &cmd, const char *name, vk::PipelineStageFlags2 stage) {
+        if (!m_Current) return;
+
+        if (m_OverflowDepth > 0 || m_Current->scopeCount >= m_Options.maxScopes || m_OpenScopes.size() >= m_Options.maxScopeDepth) {
+            m_OverflowDepth++;
+            return;
+        }
+
+        const uint32_t scope = m_Current->scopeCount++;
+        m_Current->names[scope] = name;
+        m_Current->depths[scope] = static_cast<uint32_t>(m_OpenScopes.size());
+        m_Current->statisticsQuery[scope] = -1;
+
+        cmd.writeTimestamp2(stage, m_Current->timestamps, scope * 2);
+
+        // pipeline statistics queries can't nest, so only top level scopes get them.
+        if (m_Statistics && m_OpenScopes.empty()) {
+            const uint32_t query = m_Current->statisticsCount++;
+            cmd.beginQuery(m_Current->statistics, query, vk::QueryControlFlags{});
+            m_Current->statisticsQuery[scope] = static_cast<int32_t>(query);
+        }
+
+        m_OpenScopes.push_back(scope);
+    }
+
+    void GpuProfiler::endScope(const vk::CommandBuffer &cmd, vk::PipelineStageFlags2 stage) {
+        if (!m_Current) return;
+
+        if (m_OverflowDepth > 0) {
+            m_OverflowDepth--;
+            return;
+        }
+
+        if (m_OpenScopes.empty()) return;
+
+        const uint32_t scope = m_OpenScopes.back();
+        m_OpenScopes.pop_back();
+
+        if (m_Current->statisticsQuery[scope] >= 0) {
+            cmd.endQuery(m_Current->statistics, static_cast<uint32_t>(m_Current->statisticsQuery[scope]));
+        }
+
+        cmd.writeTimestamp2(stage, m_Current->timestamps, scope * 2 + 1);
+    }
+
+    GpuFrameReport GpuProfiler::getLatestReport() const noexcept {
+        return GpuFrameReport{
+                .scopes = std::span<const GpuScopeTiming>(m_Latest),
+                .eventloopCpuTime = globalState->eventloopCpuTime.load(std::memory_order_relaxed),
+                .renderloopCpuTime = globalState->renderloopCpuTime.load(std::memory_order_relaxed),
+        };
+    }
+
+    bool GpuProfiler::isSupported() const noexcept {
+        return m_Supported;
+    }
+
+    void GpuProfiler::collect(FrameQueries &frame) {
+        if (!frame.recorded) return;
+        frame.recorded = false;
+
+        m_Latest.clear();
+        if (frame.scopeCount == 0) return;
+
+        // the frame's fence has retired, so these are available unless a scope was never closed (or the frame was never submitted).
+        vk::Result r = globalState->device.getQueryPoolResults(frame.timestamps, 0, frame.scopeCount * 2, frame.scopeCount * 2 * sizeof(uint64_t), m_TimestampData.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if (r != vk::Result::eSuccess) return;
+
+        bool haveStatistics = false;
+        if (frame.statisticsCount > 0) {
+            constexpr size_t stride = PIPELINE_STATISTICS_COUNT * sizeof(uint64_t);
+            haveStatistics = globalState->device.getQueryPoolResults(frame.statistics, 0, frame.statisticsCount, frame.statisticsCount * stride, m_StatisticsData.data(), stride, vk::QueryResultFlagBits::e64) == vk::Result::eSuccess;
+        }
+
+        for (uint32_t scope = 0; scope < frame.scopeCount; scope++) {
+            const uint64_t begin = m_TimestampData[scope * 2] & m_TimestampMask;
+            const uint64_t end = m_TimestampData[scope * 2 + 1] & m_TimestampMask;
+            const uint64_t ticks = (end - begin) & m_TimestampMask; // handles the counter wrapping around
+
+            GpuScopeTiming timing{};
+            timing.name = frame.names[scope];
+            timing.depth = frame.depths[scope];
+            timing.milliseconds = static_cast<double>(ticks) * m_TimestampPeriod / 1000000.0;
+
+            if (haveStatistics && frame.statisticsQuery[scope] >= 0) {
+                const uint64_t *s = &m_StatisticsData[static_cast<size_t>(frame.statisticsQuery[scope]) * PIPELINE_STATISTICS_COUNT];
+                timing.statistics = GpuPipelineStatistics{s[0], s[1], s[2], s[3], s[4], s[5]};
+            }
+
+            m_Latest.push_back(timing);
+        }
+    }
+} // namespace kat
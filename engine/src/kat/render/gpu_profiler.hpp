@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <span>
+
+#include "kat/engine.hpp"
+
+namespace kat {
+
+    struct GpuPipelineStatistics {
+        uint64_t inputAssemblyVertices;
+        uint64_t inputAssemblyPrimitives;
+        uint64_t vertexShaderInvocations;
+        uint64_t clippingPrimitives;
+        uint64_t fragmentShaderInvocations;
+        uint64_t computeShaderInvocations;
+    };
+
+    struct GpuScopeTiming {
+        const char *name;
+        uint32_t depth; // nesting depth, 0 for top level scopes
+        double milliseconds;
+
+        std::optional<GpuPipelineStatistics> statistics; // only for top level scopes, and only if enabled and supported
+    };
+
+    struct GpuFrameReport {
+        std::span<const GpuScopeTiming> scopes;
+
+        // cpu time of the engine loops when the report was collected (not of the frame the gpu timings are from)
+        double eventloopCpuTime;
+        double renderloopCpuTime;
+    };
+
+    struct GpuProfilerOptions {
+        uint32_t maxScopes = 64;           // per frame, scopes past this are silently not measured
+        bool pipelineStatistics = false;   // also collect pipeline statistics for top level scopes (if the device supports it)
+        uint32_t maxScopeDepth = 16;
+    };
+
+    /**
+     * Measures gpu time of scopes in command buffers with timestamp queries.
+     *
+     * Each frame in flight gets its own query pool. beginFrame() has to be recorded at the start of the frame's first command buffer (outside of any render pass),
+     * and reads back the results from the last time that frame index was used. The frame's fence has retired by then, so this never waits on the gpu.
+     * Results show up MAX_FRAMES_IN_FLIGHT frames after they were recorded.
+     *
+     * Scope names must outlive the profiler (use string literals).
+     */
+    class GpuProfiler {
+      public:
+        explicit GpuProfiler(const GpuProfilerOptions &options = {});
+        ~GpuProfiler();
+
+        void beginFrame(const vk::CommandBuffer &cmd, uint32_t frameIndex);
+
+        void beginScope(const vk::CommandBuffer &cmd, const char *name, vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eTopOfPipe);
+        void endScope(const vk::CommandBuffer &cmd, vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eBottomOfPipe);
+
+        /**
+         * Latest completed frame. Only valid until the next beginFrame().
+         */
+        [[nodiscard]] GpuFrameReport getLatestReport() const noexcept;
+
+        [[nodiscard]] bool isSupported() const noexcept;
+
+        GpuProfiler(const GpuProfiler &) = delete;
+        GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+      private:
+        struct FrameQueries {
+            vk::QueryPool timestamps;
+            vk::QueryPool statistics;
+
+            std::vector<const char *> names;
+            std::vector<uint32_t> depths;
+            std::vector<int32_t> statisticsQuery; // index into the statistics pool, -1 if there is none
+            uint32_t scopeCount = 0;
+            uint32_t statisticsCount = 0;
+            bool recorded = false;
+        };
+
+        void collect(FrameQueries &frame);
+
+        GpuProfilerOptions m_Options;
+        bool m_Supported;
+        bool m_Statistics;
+        double m_TimestampPeriod; // nanoseconds per tick
+        uint64_t m_TimestampMask;
+
+        FrameSet<FrameQueries> m_Frames;
+        FrameQueries *m_Current = nullptr;
+
+        // scopes that are open in the frame being recorded
+        std::vector<uint32_t> m_OpenScopes;
+        uint32_t m_OverflowDepth = 0; // open scopes that weren't measured (past maxScopes or maxScopeDepth), always the innermost ones
+
+        std::vector<uint64_t> m_TimestampData;
+        std::vector<uint64_t> m_StatisticsData;
+        std::vector<GpuScopeTiming> m_Latest;
+    };
+
+    /**
+     * Scope guard for GpuProfiler::beginScope/endScope.
+     */
+    class GpuProfileScope {
+      public:
+        inline GpuProfileScope(GpuProfiler &profiler, const vk::CommandBuffer &cmd, const char *name) : m_Profiler(profiler), m_CommandBuffer(cmd) {
+            m_Profiler.beginScope(m_CommandBuffer, name);
+        };
+
+        inline ~GpuProfileScope() {
+            m_Profiler.endScope(m_CommandBuffer);
+        };
+
+        GpuProfileScope(const GpuProfileScope &) = delete;
+        GpuProfileScope &operator=(const GpuProfileScope &) = delete;
+
+      private:
+        GpuProfiler &m_Profiler;
+        vk::CommandBuffer m_CommandBuffer;
+    };
+
+} // namespace kat
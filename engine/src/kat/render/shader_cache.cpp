@@ -0,0 +1,178 @@
+#include "shader_cache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fstream>
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kat {
+    namespace {
+        // 64 bit word-at-a-time hash, SPIR-V is always a whole number of words.
+        uint64_t hashCode(std::span<const uint32_t> code) noexcept {
+            uint64_t h = 0xcbf29ce484222325ULL ^ code.size();
+            for (uint32_t word: code) {
+                h ^= word;
+                h *= 0x100000001b3ULL;
+                h ^= h >> 29;
+            }
+            return h;
+        }
+
+        vk::ShaderStageFlagBits firstStage(vk::ShaderStageFlags stages) {
+            const auto bits = static_cast<VkShaderStageFlags>(stages);
+            return static_cast<vk::ShaderStageFlagBits>(bits & (~bits + 1));
+        }
+
+        // read-only view of a file, unmapped when it goes out of scope.
+        class MappedFile {
+          public:
+            explicit MappedFile(const std::filesystem::path &path) {
+#ifdef _WIN32
+                std::ifstream file(path, std::ios::binary | std::ios::ate);
+                if (!file) throw std::runtime_error("Failed to open shader " + path.string());
+
+                m_Data.resize(static_cast<size_t>(file.tellg()) / sizeof(uint32_t));
+                file.seekg(0);
+                file.read(reinterpret_cast<char *>(m_Data.data()), static_cast<std::streamsize>(m_Data.size() * sizeof(uint32_t)));
+                m_Code = m_Data;
+#else
+                const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) throw std::runtime_error("Failed to open shader " + path.string());
+
+                struct stat st {};
+                if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+                    ::close(fd);
+                    throw std::runtime_error("Failed to read shader " + path.string());
+                }
+
+                m_Size = static_cast<size_t>(st.st_size);
+                m_Mapping = ::mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (m_Mapping == MAP_FAILED) throw std::runtime_error("Failed to map shader " + path.string());
+
+                m_Code = std::span(static_cast<const uint32_t *>(m_Mapping), m_Size / sizeof(uint32_t));
+#endif
+            };
+
+            ~MappedFile() {
+#ifndef _WIN32
+                if (m_Mapping != MAP_FAILED) ::munmap(m_Mapping, m_Size);
+#endif
+            };
+
+            [[nodiscard]] inline std::span<const uint32_t> getCode() const noexcept { return m_Code; };
+
+            MappedFile(const MappedFile &) = delete;
+            MappedFile &operator=(const MappedFile &) = delete;
+
+          private:
+            std::span<const uint32_t> m_Code;
+#ifdef _WIN32
+            std::vector<uint32_t> m_Data;
+#else
+            void *m_Mapping = MAP_FAILED;
+            size_t m_Size = 0;
+#endif
+        };
+
+        void destroyShader(Shader *shader) {
+            kat::safeDestroy(shader->module);
+            delete shader;
+        }
+    } // namespace
+
+    ShaderCache::~ShaderCache() {
+        clear();
+    }
+
+    std::string ShaderCache::pathKey(const std::filesystem::path &path) {
+        std::error_code ec;
+        auto canonical = std::filesystem::weakly_canonical(path, ec);
+        return (ec ? path : canonical).string();
+    }
+
+    std::shared_ptr<const Shader> ShaderCache::load(const std::filesystem::path &path) {
+        const std::string key = pathKey(path);
+
+        {
+            std::lock_guard lk(m_Mutex);
+            if (auto it = m_Paths.find(key); it != m_Paths.end()) return it->second;
+        }
+
+        // map outside the lock, only module creation needs it.
+        const MappedFile file(path);
+
+        std::lock_guard lk(m_Mutex);
+        if (auto it = m_Paths.find(key); it != m_Paths.end()) return it->second; // raced with another load of the same path
+
+        auto shader = std::const_pointer_cast<Shader>(loadLocked(file.getCode()));
+        m_Paths.emplace(key, shader);
+        return shader;
+    }
+
+    std::shared_ptr<const Shader> ShaderCache::reload(const std::filesystem::path &path) {
+        const std::string key = pathKey(path);
+        const MappedFile file(path);
+
+        std::lock_guard lk(m_Mutex);
+        auto shader = std::const_pointer_cast<Shader>(loadLocked(file.getCode()));
+        m_Paths.insert_or_assign(key, shader);
+        return shader;
+    }
+
+    std::shared_ptr<const Shader> ShaderCache::load(std::span<const uint32_t> code) {
+        std::lock_guard lk(m_Mutex);
+        return loadLocked(code);
+    }
+
+    std::shared_ptr<const Shader> ShaderCache::loadLocked(std::span<const uint32_t> code) {
+        const uint64_t hash = hashCode(code);
+        for (auto [it, end] = m_Modules.equal_range(hash); it != end; ++it) {
+            if (std::ranges::equal(it->second->code, code)) return it->second;
+        }
+
+        auto reflection = ShaderReflection::reflect(code);
+        if (!reflection.stages) throw std::runtime_error("SPIR-V module has no entry point");
+
+        const auto stage = firstStage(reflection.stages);
+        const auto module = globalState->device.createShaderModule(vk::ShaderModuleCreateInfo({}, code.size_bytes(), code.data()));
+
+        std::shared_ptr<Shader> shader(new Shader{module, stage, std::move(reflection), hash, std::vector<uint32_t>(code.begin(), code.end())}, destroyShader);
+        m_Modules.emplace(hash, shader);
+        return shader;
+    }
+
+    size_t ShaderCache::evictUnused() {
+        std::lock_guard lk(m_Mutex);
+
+        // several paths can share a module, those references don't count as uses.
+        std::unordered_map<const Shader *, long> pathReferences;
+        for (const auto &[path, shader]: m_Paths) pathReferences[shader.get()]++;
+
+        const auto unused = [&](const std::shared_ptr<Shader> &shader) {
+            return shader.use_count() == 1 + pathReferences[shader.get()];
+        };
+
+        std::erase_if(m_Paths, [&](const auto &entry) { return unused(entry.second); });
+        return std::erase_if(m_Modules, [&](const auto &entry) { return entry.second.use_count() == 1; });
+    }
+
+    void ShaderCache::clear() {
+        std::lock_guard lk(m_Mutex);
+        m_Paths.clear();
+        m_Modules.clear();
+    }
+
+    size_t ShaderCache::size() const {
+        std::lock_guard lk(m_Mutex);
+        return m_Modules.size();
+    }
+} // namespace kat
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "kat/engine.hpp"
+#include "kat/render/shader_reflection.hpp"
+
+namespace kat {
+
+    struct Shader {
+        vk::ShaderModule module;
+        vk::ShaderStageFlagBits stage;
+        ShaderReflection reflection;
+        uint64_t hash;              // of the SPIR-V words
+        std::vector<uint32_t> code; // the SPIR-V words, compared on hash matches so a collision can't hand out the wrong module
+
+        [[nodiscard]] inline vk::PipelineShaderStageCreateInfo getStageInfo() const {
+            return {{}, stage, module, reflection.entryPoint.c_str()};
+        };
+    };
+
+    /**
+     * Loads precompiled SPIR-V (see kat_compile_shaders in cmake/KatShaders.cmake) and owns the resulting shader modules.
+     *
+     * Files are memory mapped and the module is created straight from the mapping. Modules are deduplicated by content hash,
+     * so the same SPIR-V loaded from several paths (or loaded again after its path entry was evicted) only creates one vk::ShaderModule.
+     * Reflection happens once per unique module.
+     *
+     * Thread safe. Shaders stay alive while the cache or any returned pointer holds them, modules are destroyed by evictUnused(), clear(), or the destructor,
+     * so make sure no pipeline is still being created from them at that point.
+     */
+    class ShaderCache {
+      public:
+        ShaderCache() = default;
+        ~ShaderCache();
+
+        /**
+         * Load a shader from a .spv file. Throws std::runtime_error if the file can't be read or isn't valid SPIR-V.
+         */
+        std::shared_ptr<const Shader> load(const std::filesystem::path &path);
+
+        /**
+         * Same as load(), for SPIR-V that is already in memory (e.g. embedded in the executable).
+         */
+        std::shared_ptr<const Shader> load(std::span<const uint32_t> code);
+
+        /**
+         * Read the file again even if the path was loaded before (e.g. after it was recompiled). Shaders returned by earlier loads stay valid.
+         */
+        std::shared_ptr<const Shader> reload(const std::filesystem::path &path);
+
+        /**
+         * Destroy modules that nothing outside the cache references anymore. Returns the number of destroyed modules.
+         */
+        size_t evictUnused();
+
+        /**
+         * Drop everything. Modules still referenced from outside are destroyed once their last reference goes away.
+         */
+        void clear();
+
+        [[nodiscard]] size_t size() const;
+
+        ShaderCache(const ShaderCache &) = delete;
+        ShaderCache &operator=(const ShaderCache &) = delete;
+
+      private:
+        static std::string pathKey(const std::filesystem::path &path);
+
+        std::shared_ptr<const Shader> loadLocked(std::span<const uint32_t> code);
+
+        mutable std::mutex m_Mutex;
+        std::unordered_multimap<uint64_t, std::shared_ptr<Shader>> m_Modules; // by content hash, collisions are told apart by Shader::code
+        std::unordered_map<std::string, std::shared_ptr<Shader>> m_Paths;        // canonical path -> module
+    };
+
+} // namespace kat
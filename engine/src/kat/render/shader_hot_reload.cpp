@@ -0,0 +1,382 @@
+#include "shader_hot_reload.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#include "kat/trace.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+#ifndef KATENGINE_GLSLC
+#define KATENGINE_GLSLC "glslc"
+#endif
+
+namespace kat {
+    namespace {
+        std::string canonicalString(const std::filesystem::path &path) {
+            std::error_code ec;
+            auto canonical = std::filesystem::weakly_canonical(path, ec);
+            return (ec ? path : canonical).string();
+        }
+
+        // runs args[0] (looked up in PATH) and collects what it writes to stdout and stderr. returns the exit code, -1 if it couldn't be started.
+        int runProcess(const std::vector<std::string> &args, std::string &output) {
+#ifdef _WIN32
+            // _popen goes through cmd.exe, the arguments are quoted for it.
+            std::string command;
+            for (const auto &arg: args) command += '"' + arg + "\" ";
+            command += "2>&1";
+
+            FILE *pipe = _popen(command.c_str(), "r");
+            if (!pipe) return -1;
+
+            char buffer[512];
+            while (std::fgets(buffer, sizeof(buffer), pipe)) output += buffer;
+            return _pclose(pipe);
+#else
+            // no shell in between, so paths and flags are passed through as they are.
+            int fds[2];
+            if (::pipe(fds) != 0) return -1;
+            for (const int fd: fds) ::fcntl(fd, F_SETFD, FD_CLOEXEC); // only the duplicates below end up in the child
+
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+            std::vector<char *> argv;
+            argv.reserve(args.size() + 1);
+            for (const auto &arg: args) argv.push_back(const_cast<char *>(arg.c_str()));
+            argv.push_back(nullptr);
+
+            pid_t pid;
+            const int error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+            posix_spawn_file_actions_destroy(&actions);
+            ::close(fds[1]);
+            if (error != 0) {
+                ::close(fds[0]);
+                return -1;
+            }
+
+            char buffer[512];
+            while (true) {
+                const ssize_t length = ::read(fds[0], buffer, sizeof(buffer));
+                if (length > 0) {
+                    output.append(buffer, static_cast<size_t>(length));
+                } else if (length == 0 || errno != EINTR) {
+                    break;
+                }
+            }
+            ::close(fds[0]);
+
+            int status;
+            while (::waitpid(pid, &status, 0) < 0) {
+                if (errno != EINTR) return -1;
+            }
+            return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+        }
+
+        // files in a watched directory that never trigger a recompile (our own outputs, editor swap/backup files).
+        bool isIgnored(const std::string &name) {
+            return name.empty() || name.front() == '.' || name.back() == '~' || name.ends_with(".spv") || name.ends_with(".d") || name.ends_with(".swp");
+        }
+
+        void destroyObjects(const PipelineObjects &objects) {
+            kat::deferDestroy(objects.pipeline);
+            kat::deferDestroy(objects.layout);
+        }
+    } // namespace
+
+    HotPipeline::~HotPipeline() {
+        destroyObjects(m_Objects);
+    }
+
+    ShaderHotReloader::ShaderHotReloader(ShaderCache &cache) : m_Cache(cache) {
+#ifdef __linux__
+        m_NotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_NotifyFd < 0) spdlog::warn("inotify unavailable, shader hot reload will poll for changes");
+#endif
+
+        m_FrameBoundaryHandle = globalState->onFrameBoundary.append([this]() { onFrameBoundary(); });
+        m_Thread = std::jthread([this](std::stop_token stop) { threadMain(stop); });
+    }
+
+    ShaderHotReloader::~ShaderHotReloader() {
+        globalState->onFrameBoundary.remove(m_FrameBoundaryHandle);
+
+        m_Thread.request_stop();
+        if (m_Thread.joinable()) m_Thread.join();
+
+#ifdef __linux__
+        if (m_NotifyFd >= 0) ::close(m_NotifyFd);
+#endif
+
+        for (const auto &pending: m_Pending) destroyObjects(pending.objects);
+    }
+
+    void ShaderHotReloader::watch(const std::filesystem::path &source, const std::filesystem::path &output, const std::vector<std::string> &flags) {
+        std::error_code ec;
+        WatchedSource watched{std::filesystem::path(canonicalString(source)), output, flags, std::filesystem::last_write_time(source, ec)};
+
+        std::lock_guard lk(m_Mutex);
+
+#ifdef __linux__
+        const auto directory = watched.source.parent_path();
+        watched.notified = std::ranges::any_of(m_WatchedDirectories, [&](const auto &entry) { return entry.second == directory; });
+        if (m_NotifyFd >= 0 && !watched.notified) {
+            const int wd = inotify_add_watch(m_NotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (wd < 0) {
+                spdlog::warn("Failed to watch {} for shader changes, polling its sources instead", directory.string());
+            } else {
+                m_WatchedDirectories.emplace_back(wd, directory);
+                watched.notified = true;
+            }
+        }
+#endif
+
+        m_Sources.push_back(std::move(watched));
+    }
+
+    std::shared_ptr<HotPipeline> ShaderHotReloader::createPipeline(const std::vector<std::filesystem::path> &shaderPaths, PipelineBuilder builder) {
+        std::shared_ptr<HotPipeline> pipeline(new HotPipeline());
+        pipeline->m_Builder = std::move(builder);
+
+        for (const auto &path: shaderPaths) {
+            pipeline->m_ShaderPaths.push_back(canonicalString(path));
+            pipeline->m_Shaders.push_back(m_Cache.load(path));
+        }
+
+        pipeline->m_Objects = pipeline->m_Builder(pipeline->m_Shaders);
+
+        std::lock_guard lk(m_Mutex);
+        m_Pipelines.push_back(pipeline);
+        return pipeline;
+    }
+
+    size_t ShaderHotReloader::getPendingCount() const {
+        std::lock_guard lk(m_Mutex);
+        return m_Pending.size();
+    }
+
+    void ShaderHotReloader::threadMain(std::stop_token stop) {
+        trace::setThreadName("shader reload");
+
+        std::vector<std::string> changedOutputs;
+        while (!stop.stop_requested()) {
+            const auto changed = collectChanges(stop);
+            if (changed.empty()) continue;
+
+            changedOutputs.clear();
+            for (const auto &source: changed) {
+                if (compile(source)) changedOutputs.push_back(canonicalString(source.output));
+            }
+
+            if (!changedOutputs.empty()) rebuild(changedOutputs);
+        }
+    }
+
+    std::vector<ShaderHotReloader::WatchedSource> ShaderHotReloader::collectChanges(std::stop_token stop) {
+        std::vector<WatchedSource> changed;
+        bool waited = false;
+
+#ifdef __linux__
+        if (m_NotifyFd >= 0) {
+            waited = true;
+
+            pollfd pfd{m_NotifyFd, POLLIN, 0};
+            if (::poll(&pfd, 1, 100) > 0) {
+                // editors tend to save in several steps, give them a moment and take everything in one go.
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+                std::vector<std::filesystem::path> files;
+                alignas(inotify_event) char buffer[4096];
+                ssize_t length;
+                while ((length = ::read(m_NotifyFd, buffer, sizeof(buffer))) > 0) {
+                    for (ssize_t offset = 0; offset < length;) {
+                        const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                        offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                        if (event->len == 0) continue;
+                        const std::string name = event->name;
+                        if (isIgnored(name)) continue;
+
+                        std::lock_guard lk(m_Mutex);
+                        for (const auto &[wd, directory]: m_WatchedDirectories) {
+                            if (wd == event->wd) files.push_back(directory / name);
+                        }
+                    }
+                }
+
+                std::lock_guard lk(m_Mutex);
+                for (const auto &source: m_Sources) {
+                    if (!source.notified) continue;
+
+                    const bool affected = std::ranges::any_of(files, [&](const auto &file) {
+                        if (file == source.source) return true;
+
+                        // not a watched source itself, so probably something they include.
+                        const bool isSource = std::ranges::any_of(m_Sources, [&](const auto &s) { return s.source == file; });
+                        return !isSource && file.parent_path() == source.source.parent_path();
+                    });
+
+                    if (affected) changed.push_back(source);
+                }
+            }
+        }
+#endif
+
+        if (!waited) {
+            for (int i = 0; i < 5 && !stop.stop_requested(); i++) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+
+        // polling, for sources inotify doesn't cover. only sees changes to the sources themselves.
+        std::lock_guard lk(m_Mutex);
+        for (auto &source: m_Sources) {
+            if (source.notified) continue;
+
+            std::error_code ec;
+            const auto lastWrite = std::filesystem::last_write_time(source.source, ec);
+            if (ec || lastWrite == source.lastWrite) continue;
+
+            source.lastWrite = lastWrite;
+            changed.push_back(source);
+        }
+
+        return changed;
+    }
+
+    bool ShaderHotReloader::compile(const WatchedSource &source) {
+        KAT_TRACE_ZONE("compileShader");
+
+        std::error_code ec;
+        std::filesystem::create_directories(source.output.parent_path(), ec);
+
+        std::vector<std::string> args{KATENGINE_GLSLC};
+        args.insert(args.end(), source.flags.begin(), source.flags.end());
+
+        const std::string name = source.source.filename().string();
+        if (name.ends_with(".hlsl")) {
+            // name.<stage>.hlsl
+            const std::string stem = source.source.stem().string();
+            const auto dot = stem.rfind('.');
+            if (dot != std::string::npos) {
+                args.emplace_back("-x");
+                args.emplace_back("hlsl");
+                args.push_back("-fshader-stage=" + stem.substr(dot + 1));
+            }
+        }
+
+        args.emplace_back("--target-env=vulkan1.3");
+        args.emplace_back("-o");
+        args.push_back(source.output.string());
+        args.push_back(source.source.string());
+
+        std::string output;
+        const int status = runProcess(args, output);
+        if (status < 0) {
+            spdlog::error("Failed to run {} for {}", KATENGINE_GLSLC, name);
+            return false;
+        }
+        if (status != 0) {
+            spdlog::error("Failed to compile {}, keeping the old version:\n{}", name, output);
+            return false;
+        }
+
+        spdlog::info("Recompiled {}", name);
+        return true;
+    }
+
+    void ShaderHotReloader::rebuild(const std::vector<std::string> &changedOutputs) {
+        KAT_TRACE_ZONE("rebuildPipelines");
+
+        std::vector<std::string> reloaded;
+        for (const auto &output: changedOutputs) {
+            try {
+                m_Cache.reload(output);
+                reloaded.push_back(output);
+            } catch (const std::exception &e) {
+                spdlog::error("Failed to reload {}: {}", output, e.what());
+            }
+        }
+
+        std::vector<std::shared_ptr<HotPipeline>> affected;
+        {
+            std::lock_guard lk(m_Mutex);
+            std::erase_if(m_Pipelines, [](const auto &p) { return p.expired(); });
+
+            for (const auto &weak: m_Pipelines) {
+                auto pipeline = weak.lock();
+                if (!pipeline) continue;
+
+                const bool uses = std::ranges::any_of(pipeline->m_ShaderPaths, [&](const auto &path) { return std::ranges::find(reloaded, path) != reloaded.end(); });
+                if (uses) affected.push_back(std::move(pipeline));
+            }
+        }
+
+        for (const auto &pipeline: affected) {
+            PendingSwap swap{pipeline, {}, {}};
+
+            try {
+                for (const auto &path: pipeline->m_ShaderPaths) swap.shaders.push_back(m_Cache.load(path));
+                swap.objects = pipeline->m_Builder(swap.shaders);
+            } catch (const std::exception &e) {
+                spdlog::error("Failed to rebuild pipeline, keeping the old one: {}", e.what());
+                continue;
+            }
+
+            std::lock_guard lk(m_Mutex);
+
+            // a newer build of the same pipeline replaces one that hasn't been swapped in yet (which nothing has used).
+            auto it = std::ranges::find_if(m_Pending, [&](const auto &p) { return p.pipeline.lock() == pipeline; });
+            if (it != m_Pending.end()) {
+                destroyObjects(it->objects);
+                *it = std::move(swap);
+            } else {
+                m_Pending.push_back(std::move(swap));
+            }
+        }
+
+        if (!affected.empty()) spdlog::info("Rebuilt {} pipeline(s), swapping them in at the next frame", affected.size());
+    }
+
+    void ShaderHotReloader::onFrameBoundary() {
+        std::vector<PendingSwap> pending;
+        {
+            std::unique_lock lk(m_Mutex, std::try_to_lock); // never make a frame wait on the reload thread, try again next frame
+            if (!lk.owns_lock() || m_Pending.empty()) return;
+            pending.swap(m_Pending);
+        }
+
+        for (auto &swap: pending) {
+            auto pipeline = swap.pipeline.lock();
+            if (!pipeline) {
+                destroyObjects(swap.objects);
+                continue;
+            }
+
+            // frames in flight may still be using the old pipeline.
+            destroyObjects(pipeline->m_Objects);
+
+            pipeline->m_Objects = swap.objects;
+            pipeline->m_Shaders = std::move(swap.shaders);
+            pipeline->m_Generation++;
+        }
+
+        // the replaced shaders are only referenced by the cache now (unless something else still uses them), their pipelines no longer need the modules.
+        m_Cache.evictUnused();
+    }
+} // namespace kat
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "kat/engine.hpp"
+#include "kat/render/shader_cache.hpp"
+
+namespace kat {
+
+    struct PipelineObjects {
+        vk::Pipeline pipeline;
+        vk::PipelineLayout layout; // optional, leave it null if the layout isn't owned by the pipeline (otherwise every build has to create a new one)
+    };
+
+    // builds a pipeline from its shaders (in the order they were passed to ShaderHotReloader::createPipeline). may run on the reload thread.
+    using PipelineBuilder = std::function<PipelineObjects(std::span<const std::shared_ptr<const Shader>> shaders)>;
+
+    /**
+     * A pipeline that is rebuilt when one of its shaders is recompiled.
+     *
+     * The pipeline only changes at frame boundaries, so look it up again every frame instead of holding on to the handle.
+     */
+    class HotPipeline {
+      public:
+        ~HotPipeline(); // the objects are destroyed with deferDestroy()
+
+        [[nodiscard]] inline vk::Pipeline getPipeline() const noexcept { return m_Objects.pipeline; };
+
+        [[nodiscard]] inline vk::PipelineLayout getLayout() const noexcept { return m_Objects.layout; };
+
+        [[nodiscard]] inline std::span<const std::shared_ptr<const Shader>> getShaders() const noexcept { return m_Shaders; };
+
+        // incremented every time a rebuilt pipeline is swapped in.
+        [[nodiscard]] inline uint32_t getGeneration() const noexcept { return m_Generation; };
+
+        HotPipeline(const HotPipeline &) = delete;
+        HotPipeline &operator=(const HotPipeline &) = delete;
+
+      private:
+        HotPipeline() = default;
+
+        friend class ShaderHotReloader;
+
+        std::vector<std::string> m_ShaderPaths; // .spv files, immutable after creation
+        PipelineBuilder m_Builder;
+
+        // only touched by the render loop (and the creating thread)
+        PipelineObjects m_Objects;
+        std::vector<std::shared_ptr<const Shader>> m_Shaders;
+        uint32_t m_Generation = 0;
+    };
+
+    /**
+     * Watches shader sources, recompiles them with glslc when they change, and rebuilds the pipelines that use them.
+     *
+     * Watching, compiling and pipeline creation happen on a background thread. Finished pipelines are swapped in at the next frame boundary
+     * (see GlobalState::onFrameBoundary), and the replaced ones go through deferDestroy(), so nothing waits on the gpu.
+     * A shader that fails to compile, or a pipeline that fails to build, is logged and the old pipeline stays in use.
+     *
+     * Uses inotify on Linux, where changes to other files in a watched directory (includes) recompile every watched source in that directory.
+     * Elsewhere (and for directories inotify can't watch) the sources' modification times are polled, and only changes to the sources themselves are picked up.
+     * glslc is started directly, without a shell. Modules the swapped out pipelines used are evicted from the cache once nothing else references them.
+     *
+     * Destroy the reloader after the render loop has finished (after run()).
+     */
+    class ShaderHotReloader {
+      public:
+        explicit ShaderHotReloader(ShaderCache &cache);
+        ~ShaderHotReloader();
+
+        /**
+         * Watch a GLSL/HLSL source, compiling it to output when it changes. HLSL sources need the stage in their name (name.frag.hlsl), like kat_compile_shaders.
+         */
+        void watch(const std::filesystem::path &source, const std::filesystem::path &output, const std::vector<std::string> &flags = {});
+
+        /**
+         * Load the shaders and build the pipeline right away (throws if that fails), then keep it up to date.
+         */
+        std::shared_ptr<HotPipeline> createPipeline(const std::vector<std::filesystem::path> &shaderPaths, PipelineBuilder builder);
+
+        // number of pipelines waiting to be swapped in.
+        [[nodiscard]] size_t getPendingCount() const;
+
+        ShaderHotReloader(const ShaderHotReloader &) = delete;
+        ShaderHotReloader &operator=(const ShaderHotReloader &) = delete;
+
+      private:
+        struct WatchedSource {
+            std::filesystem::path source, output;
+            std::vector<std::string> flags;
+            std::filesystem::file_time_type lastWrite; // only used when polling
+            bool notified = false;                     // its directory is watched with inotify, otherwise it is polled
+        };
+
+        struct PendingSwap {
+            std::weak_ptr<HotPipeline> pipeline;
+            PipelineObjects objects;
+            std::vector<std::shared_ptr<const Shader>> shaders;
+        };
+
+        void threadMain(std::stop_token stop);
+        std::vector<WatchedSource> collectChanges(std::stop_token stop);
+        bool compile(const WatchedSource &source);
+        void rebuild(const std::vector<std::string> &changedOutputs);
+
+        void onFrameBoundary();
+
+        ShaderCache &m_Cache;
+
+        mutable std::mutex m_Mutex;
+        std::vector<WatchedSource> m_Sources;                 // guarded by m_Mutex
+        std::vector<std::weak_ptr<HotPipeline>> m_Pipelines;  // guarded by m_Mutex
+        std::vector<PendingSwap> m_Pending;                   // guarded by m_Mutex
+
+        int m_NotifyFd = -1;
+        std::vector<std::pair<int, std::filesystem::path>> m_WatchedDirectories; // guarded by m_Mutex
+
+        eventpp::CallbackList<void()>::Handle m_FrameBoundaryHandle;
+        std::jthread m_Thread;
+    };
+
+} // namespace kat
@@ -0,0 +1,328 @@
+#include "shader_reflection.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace kat {
+    namespace {
+        // the handful of SPIR-V enums we need (see the SPIR-V specification, section 3).
+        namespace spv {
+            constexpr uint32_t MAGIC = 0x07230203;
+
+            enum Op : uint16_t {
+                OpEntryPoint = 15,
+                OpTypeInt = 21,
+                OpTypeFloat = 22,
+                OpTypeVector = 23,
+                OpTypeMatrix = 24,
+                OpTypeImage = 25,
+                OpTypeSampler = 26,
+                OpTypeSampledImage = 27,
+                OpTypeArray = 28,
+                OpTypeRuntimeArray = 29,
+                OpTypeStruct = 30,
+                OpTypePointer = 32,
+                OpConstant = 43,
+                OpVariable = 59,
+                OpDecorate = 71,
+                OpMemberDecorate = 72,
+                OpTypeAccelerationStructureKHR = 5341,
+            };
+
+            enum Decoration : uint32_t {
+                Block = 2,
+                BufferBlock = 3,
+                ArrayStride = 6,
+                MatrixStride = 7,
+                Binding = 33,
+                DescriptorSet = 34,
+                Offset = 35,
+            };
+
+            enum StorageClass : uint32_t {
+                UniformConstant = 0,
+                Uniform = 2,
+                PushConstant = 9,
+                StorageBuffer = 12,
+            };
+
+            enum Dim : uint32_t {
+                Buffer = 5,
+                SubpassData = 6,
+            };
+        } // namespace spv
+
+        vk::ShaderStageFlags stageOf(uint32_t executionModel) {
+            switch (executionModel) {
+                case 0: return vk::ShaderStageFlagBits::eVertex;
+                case 1: return vk::ShaderStageFlagBits::eTessellationControl;
+                case 2: return vk::ShaderStageFlagBits::eTessellationEvaluation;
+                case 3: return vk::ShaderStageFlagBits::eGeometry;
+                case 4: return vk::ShaderStageFlagBits::eFragment;
+                case 5: return vk::ShaderStageFlagBits::eCompute;
+                case 5313: return vk::ShaderStageFlagBits::eRaygenKHR;
+                case 5314: return vk::ShaderStageFlagBits::eIntersectionKHR;
+                case 5315: return vk::ShaderStageFlagBits::eAnyHitKHR;
+                case 5316: return vk::ShaderStageFlagBits::eClosestHitKHR;
+                case 5317: return vk::ShaderStageFlagBits::eMissKHR;
+                case 5318: return vk::ShaderStageFlagBits::eCallableKHR;
+                case 5364: return vk::ShaderStageFlagBits::eTaskEXT;
+                case 5365: return vk::ShaderStageFlagBits::eMeshEXT;
+                default: return {};
+            }
+        }
+
+        struct Type {
+            uint16_t op = 0;
+            std::vector<uint32_t> operands; // everything after the result id
+        };
+
+        struct Decorations {
+            std::optional<uint32_t> set, binding, arrayStride, matrixStride;
+            bool block = false, bufferBlock = false;
+        };
+
+        struct Module {
+            std::unordered_map<uint32_t, Type> types;
+            std::unordered_map<uint32_t, uint32_t> constants; // low word only, enough for array lengths
+            std::unordered_map<uint32_t, Decorations> decorations;
+            std::unordered_map<uint64_t, uint32_t> memberOffsets;       // (struct << 32 | member) -> offset
+            std::unordered_map<uint64_t, uint32_t> memberMatrixStrides; // (struct << 32 | member) -> stride
+
+            struct Variable {
+                uint32_t id, pointerType, storageClass;
+            };
+            std::vector<Variable> variables;
+
+            [[nodiscard]] const Type *type(uint32_t id) const {
+                auto it = types.find(id);
+                return it == types.end() ? nullptr : &it->second;
+            }
+
+            [[nodiscard]] const Decorations &decoration(uint32_t id) const {
+                static const Decorations none{};
+                auto it = decorations.find(id);
+                return it == decorations.end() ? none : it->second;
+            }
+
+            // size in bytes of a type in a push constant block (explicit layout).
+            [[nodiscard]] uint32_t sizeOf(uint32_t id, uint32_t matrixStride = 0) const {
+                const Type *t = type(id);
+                if (!t) return 0;
+
+                switch (t->op) {
+                    case spv::OpTypeInt:
+                    case spv::OpTypeFloat:
+                        return t->operands[0] / 8;
+                    case spv::OpTypeVector:
+                        return sizeOf(t->operands[0]) * t->operands[1];
+                    case spv::OpTypeMatrix:
+                        return (matrixStride ? matrixStride : sizeOf(t->operands[0])) * t->operands[1];
+                    case spv::OpTypeArray: {
+                        const uint32_t length = constants.contains(t->operands[1]) ? constants.at(t->operands[1]) : 0;
+                        const uint32_t stride = decoration(id).arrayStride.value_or(sizeOf(t->operands[0], matrixStride));
+                        return length * stride;
+                    }
+                    case spv::OpTypeStruct: {
+                        uint32_t size = 0;
+                        for (uint32_t m = 0; m < t->operands.size(); m++) {
+                            const uint64_t key = (uint64_t(id) << 32) | m;
+                            const uint32_t offset = memberOffsets.contains(key) ? memberOffsets.at(key) : size;
+                            const uint32_t stride = memberMatrixStrides.contains(key) ? memberMatrixStrides.at(key) : 0;
+                            size = std::max(size, offset + sizeOf(t->operands[m], stride));
+                        }
+                        return size;
+                    }
+                    default:
+                        return 0;
+                }
+            }
+
+            [[nodiscard]] std::optional<vk::DescriptorType> descriptorType(uint32_t typeId, uint32_t storageClass) const {
+                const Type *t = type(typeId);
+                if (!t) return std::nullopt;
+
+                switch (t->op) {
+                    case spv::OpTypeSampler:
+                        return vk::DescriptorType::eSampler;
+                    case spv::OpTypeSampledImage:
+                        return vk::DescriptorType::eCombinedImageSampler;
+                    case spv::OpTypeImage: {
+                        const uint32_t dim = t->operands[1], sampled = t->operands[5];
+                        if (dim == spv::SubpassData) return vk::DescriptorType::eInputAttachment;
+                        if (dim == spv::Buffer) return sampled == 2 ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+                        return sampled == 2 ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+                    }
+                    case spv::OpTypeAccelerationStructureKHR:
+                        return vk::DescriptorType::eAccelerationStructureKHR;
+                    case spv::OpTypeStruct:
+                        if (storageClass == spv::StorageBuffer || decoration(typeId).bufferBlock) return vk::DescriptorType::eStorageBuffer;
+                        return vk::DescriptorType::eUniformBuffer;
+                    default:
+                        return std::nullopt;
+                }
+            }
+        };
+    } // namespace
+
+    ShaderReflection ShaderReflection::reflect(std::span<const uint32_t> code) {
+        if (code.size() < 5 || code[0] != spv::MAGIC) throw std::runtime_error("Not a SPIR-V module");
+
+        Module module;
+        ShaderReflection reflection;
+        bool haveEntryPoint = false;
+
+        for (size_t i = 5; i < code.size();) {
+            const uint16_t op = code[i] & 0xFFFF;
+            const uint32_t wordCount = code[i] >> 16;
+            if (wordCount == 0 || i + wordCount > code.size()) throw std::runtime_error("Malformed SPIR-V module");
+
+            const uint32_t *w = &code[i + 1]; // operands
+            const uint32_t n = wordCount - 1;
+
+            switch (op) {
+                case spv::OpEntryPoint:
+                    if (!haveEntryPoint && n >= 3) {
+                        reflection.stages = stageOf(w[0]);
+                        reflection.entryPoint = std::string(reinterpret_cast<const char *>(&w[2]), strnlen(reinterpret_cast<const char *>(&w[2]), (n - 2) * 4));
+                        haveEntryPoint = true;
+                    }
+                    break;
+                case spv::OpTypeInt:
+                case spv::OpTypeFloat:
+                case spv::OpTypeVector:
+                case spv::OpTypeMatrix:
+                case spv::OpTypeImage:
+                case spv::OpTypeSampler:
+                case spv::OpTypeSampledImage:
+                case spv::OpTypeArray:
+                case spv::OpTypeRuntimeArray:
+                case spv::OpTypeStruct:
+                case spv::OpTypePointer:
+                case spv::OpTypeAccelerationStructureKHR:
+                    if (n >= 1) module.types[w[0]] = Type{op, std::vector<uint32_t>(w + 1, w + n)};
+                    break;
+                case spv::OpConstant:
+                    if (n >= 3) module.constants[w[1]] = w[2];
+                    break;
+                case spv::OpVariable:
+                    if (n >= 3) module.variables.push_back({w[1], w[0], w[2]});
+                    break;
+                case spv::OpDecorate:
+                    if (n >= 2) {
+                        auto &d = module.decorations[w[0]];
+                        switch (w[1]) {
+                            case spv::Block: d.block = true; break;
+                            case spv::BufferBlock: d.bufferBlock = true; break;
+                            case spv::ArrayStride: if (n >= 3) d.arrayStride = w[2]; break;
+                            case spv::MatrixStride: if (n >= 3) d.matrixStride = w[2]; break;
+                            case spv::Binding: if (n >= 3) d.binding = w[2]; break;
+                            case spv::DescriptorSet: if (n >= 3) d.set = w[2]; break;
+                            default: break;
+                        }
+                    }
+                    break;
+                case spv::OpMemberDecorate:
+                    if (n >= 4) {
+                        const uint64_t key = (uint64_t(w[0]) << 32) | w[1];
+                        if (w[2] == spv::Offset) module.memberOffsets[key] = w[3];
+                        if (w[2] == spv::MatrixStride) module.memberMatrixStrides[key] = w[3];
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            i += wordCount;
+        }
+
+        for (const auto &variable: module.variables) {
+            const Type *pointer = module.type(variable.pointerType);
+            if (!pointer || pointer->op != spv::OpTypePointer) continue;
+            uint32_t pointee = pointer->operands[1];
+
+            if (variable.storageClass == spv::PushConstant) {
+                const uint32_t size = module.sizeOf(pointee);
+                if (size > 0) reflection.pushConstantRanges.emplace_back(reflection.stages, 0, size);
+                continue;
+            }
+
+            if (variable.storageClass != spv::UniformConstant && variable.storageClass != spv::Uniform && variable.storageClass != spv::StorageBuffer) continue;
+
+            // arrays of descriptors
+            uint32_t count = 1;
+            if (const Type *t = module.type(pointee); t && (t->op == spv::OpTypeArray || t->op == spv::OpTypeRuntimeArray)) {
+                if (t->op == spv::OpTypeArray) count = module.constants.contains(t->operands[1]) ? module.constants.at(t->operands[1]) : 1;
+                pointee = t->operands[0];
+            }
+
+            const auto &d = module.decoration(variable.id);
+            if (!d.binding) continue;
+
+            const auto type = module.descriptorType(pointee, variable.storageClass);
+            if (!type) continue;
+
+            reflection.bindings.push_back(DescriptorBindingInfo{d.set.value_or(0), *d.binding, *type, count, reflection.stages});
+        }
+
+        std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const auto &a, const auto &b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+
+        return reflection;
+    }
+
+    ShaderReflection ShaderReflection::merge(std::span<const ShaderReflection *const> reflections) {
+        ShaderReflection merged;
+
+        for (const auto *r: reflections) {
+            merged.stages |= r->stages;
+
+            for (const auto &b: r->bindings) {
+                auto it = std::find_if(merged.bindings.begin(), merged.bindings.end(), [&](const auto &m) { return m.set == b.set && m.binding == b.binding; });
+                if (it == merged.bindings.end()) {
+                    merged.bindings.push_back(b);
+                } else {
+                    it->stages |= b.stages;
+                    it->count = std::max(it->count, b.count);
+                }
+            }
+
+            merged.pushConstantRanges.insert(merged.pushConstantRanges.end(), r->pushConstantRanges.begin(), r->pushConstantRanges.end());
+        }
+
+        std::sort(merged.bindings.begin(), merged.bindings.end(), [](const auto &a, const auto &b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+
+        return merged;
+    }
+
+    uint32_t ShaderReflection::getSetCount() const noexcept {
+        return bindings.empty() ? 0 : bindings.back().set + 1;
+    }
+
+    std::vector<vk::DescriptorSetLayout> ShaderReflection::createDescriptorSetLayouts() const {
+        std::vector<vk::DescriptorSetLayout> layouts;
+        layouts.reserve(getSetCount());
+
+        std::vector<vk::DescriptorSetLayoutBinding> setBindings;
+        for (uint32_t set = 0; set < getSetCount(); set++) {
+            setBindings.clear();
+            for (const auto &b: bindings) {
+                if (b.set == set) setBindings.emplace_back(b.binding, b.type, b.count, b.stages);
+            }
+
+            layouts.push_back(globalState->device.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo({}, setBindings)));
+        }
+
+        return layouts;
+    }
+
+    vk::PipelineLayout ShaderReflection::createPipelineLayout(std::span<const vk::DescriptorSetLayout> setLayouts) const {
+        return globalState->device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, static_cast<uint32_t>(setLayouts.size()), setLayouts.data(), static_cast<uint32_t>(pushConstantRanges.size()), pushConstantRanges.data()));
+    }
+} // namespace kat
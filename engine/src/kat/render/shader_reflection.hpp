@@ -0,0 +1,51 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "kat/engine.hpp"
+
+namespace kat {
+
+    struct DescriptorBindingInfo {
+        uint32_t set;
+        uint32_t binding;
+        vk::DescriptorType type;
+        uint32_t count; // 1 for runtime sized arrays
+        vk::ShaderStageFlags stages;
+    };
+
+    /**
+     * Resource interface of one or more shader stages, read straight from the SPIR-V.
+     *
+     * Only what's needed to build set and pipeline layouts is reflected (descriptor bindings and push constant ranges).
+     */
+    struct ShaderReflection {
+        vk::ShaderStageFlags stages;
+        std::string entryPoint = "main";
+
+        std::vector<DescriptorBindingInfo> bindings; // sorted by set, then binding
+        std::vector<vk::PushConstantRange> pushConstantRanges;
+
+        /**
+         * Reflect a SPIR-V module. Throws std::runtime_error if the code isn't valid SPIR-V.
+         */
+        static ShaderReflection reflect(std::span<const uint32_t> code);
+
+        /**
+         * Combine the interfaces of several stages (e.g. vertex + fragment), bindings used by more than one stage get both stage flags.
+         */
+        static ShaderReflection merge(std::span<const ShaderReflection *const> reflections);
+
+        [[nodiscard]] uint32_t getSetCount() const noexcept;
+
+        /**
+         * Create one layout per set index up to getSetCount() (sets without bindings get an empty layout). The caller owns the layouts.
+         */
+        [[nodiscard]] std::vector<vk::DescriptorSetLayout> createDescriptorSetLayouts() const;
+
+        [[nodiscard]] vk::PipelineLayout createPipelineLayout(std::span<const vk::DescriptorSetLayout> setLayouts) const;
+    };
+
+} // namespace kat
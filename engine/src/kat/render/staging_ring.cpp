@@ -0,0 +1,255 @@
+#include "staging_ring.hpp"
+
+#include "kat/trace.hpp"
+
+namespace kat {
+    namespace {
+        vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    } // namespace
+
+    StagingRing::StagingRing(vk::DeviceSize capacity) : m_Capacity(capacity) {
+        m_Buffer = globalState->device.createBuffer(vk::BufferCreateInfo({}, capacity, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive));
+
+        const auto requirements = globalState->device.getBufferMemoryRequirements(m_Buffer);
+
+        // written sequentially by the cpu, so write combined memory is fine. coherent saves the flush.
+        uint32_t memoryType;
+        try {
+            memoryType = vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        } catch (const std::runtime_error &) {
+            memoryType = vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible);
+        }
+        m_Coherent = static_cast<bool>(globalState->memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+
+        m_Memory = vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, memoryType));
+        globalState->device.bindBufferMemory(m_Buffer, m_Memory, 0);
+        m_Mapped = static_cast<std::byte *>(globalState->device.mapMemory(m_Memory, 0, VK_WHOLE_SIZE));
+
+        m_SeparateFamily = globalState->transferQueue != globalState->mainQueue;
+        m_Pool = globalState->device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient, globalState->transferFamily));
+        m_Timeline = vku::createTimelineSemaphore();
+    }
+
+    StagingRing::~StagingRing() {
+        if (m_Current) submit();
+        if (m_Value > 0) wait(m_Value);
+
+        kat::destroy(m_Pool);
+        globalState->device.unmapMemory(m_Memory);
+        kat::destroy(m_Buffer);
+        vku::freeMemory(m_Memory);
+
+        // main queue otcs may still be waiting on it
+        kat::deferDestroy(m_Timeline);
+    }
+
+    StagingRing::Allocation StagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+        while (true) {
+            if (auto allocation = tryAllocate(size, alignment)) return *allocation;
+
+            KAT_TRACE_ZONE("StagingRing::wait");
+            retire(true);
+        }
+    }
+
+    std::optional<StagingRing::Allocation> StagingRing::tryAllocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+        if (size > m_Capacity) throw std::runtime_error("Staging allocation of " + std::to_string(size) + " bytes doesn't fit into the ring (" + std::to_string(m_Capacity) + " bytes)");
+
+        retire(false);
+
+        // nothing in use, start over at the beginning so large allocations don't have to wrap.
+        if (m_InFlight.empty() && !m_Current) {
+            m_Head = 0;
+            m_Tail = 0;
+        }
+        const bool full = m_Head == m_Tail && (!m_InFlight.empty() || m_Current);
+
+        std::optional<vk::DeviceSize> offset;
+        if (!full) {
+            const vk::DeviceSize aligned = alignUp(m_Head, alignment);
+            if (m_Head >= m_Tail) {
+                if (aligned + size <= m_Capacity) {
+                    offset = aligned;
+                } else if (size <= m_Tail) {
+                    offset = 0; // wrap, the rest of the ring is skipped
+                }
+            } else if (aligned + size <= m_Tail) {
+                offset = aligned;
+            }
+        }
+
+        if (!offset.has_value()) {
+            // out of space. the current batch is in the way if nothing else is in flight.
+            if (m_InFlight.empty()) submit();
+            return std::nullopt;
+        }
+
+        if (!m_Current) begin();
+        m_Head = *offset + size;
+        return Allocation{std::span(m_Mapped + *offset, size), *offset};
+    }
+
+    void StagingRing::copyToBuffer(const Allocation &source, vk::Buffer destination, vk::DeviceSize destinationOffset) {
+        const vk::BufferCopy region(source.offset, destinationOffset, source.data.size());
+        m_Current.copyBuffer(m_Buffer, destination, region);
+
+        if (m_SeparateFamily) {
+            vk::BufferMemoryBarrier2 acquire{};
+            acquire.buffer = destination;
+            acquire.offset = destinationOffset;
+            acquire.size = source.data.size();
+            m_BufferAcquires.push_back(acquire);
+        }
+    }
+
+    void StagingRing::copyToImage(const Allocation &source, vk::Image destination, std::span<const vk::BufferImageCopy> regions, const vk::ImageSubresourceRange &range, vk::ImageLayout finalLayout) {
+        vk::ImageMemoryBarrier2 toTransfer{};
+        toTransfer.image = destination;
+        toTransfer.srcStageMask = vk::PipelineStageFlagBits2::eNone;
+        toTransfer.srcAccessMask = vk::AccessFlagBits2::eNone;
+        toTransfer.dstStageMask = vk::PipelineStageFlagBits2::eCopy;
+        toTransfer.dstAccessMask = vk::AccessFlagBits2::eTransferWrite;
+        toTransfer.oldLayout = vk::ImageLayout::eUndefined;
+        toTransfer.newLayout = vk::ImageLayout::eTransferDstOptimal;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.subresourceRange = range;
+        m_Current.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, toTransfer));
+
+        m_Regions.assign(regions.begin(), regions.end());
+        for (auto &region: m_Regions) region.bufferOffset += source.offset;
+        m_Current.copyBufferToImage(m_Buffer, destination, vk::ImageLayout::eTransferDstOptimal, m_Regions);
+
+        vk::ImageMemoryBarrier2 toFinal{};
+        toFinal.image = destination;
+        toFinal.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        toFinal.newLayout = finalLayout;
+        toFinal.subresourceRange = range;
+
+        if (m_SeparateFamily) {
+            // the transition happens as part of the ownership transfer, recorded in submit()
+            m_ImageAcquires.push_back(toFinal);
+            return;
+        }
+
+        toFinal.srcStageMask = vk::PipelineStageFlagBits2::eCopy;
+        toFinal.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+        toFinal.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+        toFinal.dstAccessMask = vk::AccessFlagBits2::eMemoryRead;
+        toFinal.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toFinal.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        m_Current.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, toFinal));
+    }
+
+    uint64_t StagingRing::submit() {
+        if (!m_Current) return 0;
+        KAT_TRACE_ZONE("StagingRing::submit");
+
+        if (m_SeparateFamily) {
+            // release everything to the main family, the acquires below have to match these exactly.
+            for (auto &barrier: m_BufferAcquires) {
+                barrier.srcQueueFamilyIndex = globalState->transferFamily;
+                barrier.dstQueueFamilyIndex = globalState->mainFamily;
+            }
+            for (auto &barrier: m_ImageAcquires) {
+                barrier.srcQueueFamilyIndex = globalState->transferFamily;
+                barrier.dstQueueFamilyIndex = globalState->mainFamily;
+            }
+
+            std::vector<vk::BufferMemoryBarrier2> bufferReleases = m_BufferAcquires;
+            std::vector<vk::ImageMemoryBarrier2> imageReleases = m_ImageAcquires;
+            for (auto &barrier: bufferReleases) {
+                barrier.srcStageMask = vk::PipelineStageFlagBits2::eCopy;
+                barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+            }
+            for (auto &barrier: imageReleases) {
+                barrier.srcStageMask = vk::PipelineStageFlagBits2::eCopy;
+                barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+            }
+            if (!bufferReleases.empty() || !imageReleases.empty()) m_Current.pipelineBarrier2(vk::DependencyInfo({}, {}, bufferReleases, imageReleases));
+        } else {
+            // same queue, later submissions only need the copies to be visible.
+            const vk::MemoryBarrier2 visible(vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferWrite, vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead);
+            m_Current.pipelineBarrier2(vk::DependencyInfo({}, visible, {}, {}));
+        }
+
+        m_Current.end();
+
+        if (!m_Coherent) globalState->device.flushMappedMemoryRanges(vk::MappedMemoryRange(m_Memory, 0, VK_WHOLE_SIZE));
+
+        const uint64_t value = ++m_Value;
+        {
+            const vk::SemaphoreSubmitInfo signal(m_Timeline, value, vk::PipelineStageFlagBits2::eAllCommands);
+            const auto lk = vku::lockQueue(globalState->transferQueue);
+            vku::submit(globalState->transferQueue, m_Current, {}, {}, {&signal, 1});
+        }
+
+        m_InFlight.push(Batch{value, m_Head, m_Current});
+        m_Current = nullptr;
+
+        if (m_SeparateFamily) {
+            // main queue submissions after this one are ordered behind the batch through the barrier, which chains with the semaphore wait.
+            vku::otc(
+                    [this](const vk::CommandBuffer &cmd) {
+                        for (auto &barrier: m_BufferAcquires) {
+                            barrier.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+                            barrier.dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite;
+                        }
+                        for (auto &barrier: m_ImageAcquires) {
+                            barrier.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+                            barrier.dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite;
+                        }
+
+                        const vk::MemoryBarrier2 after(vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eNone, vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eNone);
+                        cmd.pipelineBarrier2(vk::DependencyInfo({}, after, m_BufferAcquires, m_ImageAcquires));
+                    },
+                    vku::OTCSync{.wait = m_Timeline, .waitStage = vk::PipelineStageFlagBits2::eAllCommands, .waitValue = value});
+
+            m_BufferAcquires.clear();
+            m_ImageAcquires.clear();
+        }
+
+        return value;
+    }
+
+    bool StagingRing::isComplete(uint64_t value) const {
+        return vku::getSemaphoreValue(m_Timeline) >= value;
+    }
+
+    void StagingRing::wait(uint64_t value) const {
+        vku::waitSemaphore(m_Timeline, value);
+    }
+
+    void StagingRing::begin() {
+        if (!m_FreeCommandBuffers.empty()) {
+            m_Current = m_FreeCommandBuffers.back();
+            m_FreeCommandBuffers.pop_back();
+        } else {
+            vk::CommandBufferAllocateInfo allocateInfo(m_Pool, vk::CommandBufferLevel::ePrimary, 1);
+            if (globalState->device.allocateCommandBuffers(&allocateInfo, &m_Current) != vk::Result::eSuccess) {
+                throw std::runtime_error("Failed to allocate staging command buffer");
+            }
+        }
+
+        static const vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        m_Current.begin(beginInfo); // resets it implicitly
+    }
+
+    void StagingRing::retire(bool block) {
+        if (m_InFlight.empty()) return;
+
+        uint64_t completed = vku::getSemaphoreValue(m_Timeline);
+        if (block && completed < m_InFlight.front().value) {
+            wait(m_InFlight.front().value);
+            completed = m_InFlight.front().value;
+        }
+
+        while (!m_InFlight.empty() && m_InFlight.front().value <= completed) {
+            const Batch batch = m_InFlight.pop();
+            m_Tail = batch.end;
+            m_FreeCommandBuffers.push_back(batch.commandBuffer);
+        }
+    }
+} // namespace kat
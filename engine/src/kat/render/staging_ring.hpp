@@ -0,0 +1,110 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "kat/engine.hpp"
+
+namespace kat {
+
+    /**
+     * Uploads through one persistently mapped, host-visible ring buffer on GlobalState::transferQueue, so loading doesn't compete with rendering
+     * on the main queue and doesn't allocate per upload.
+     *
+     * allocate() hands out a range of the mapping to write the data into directly (e.g. straight from a memory mapped file), the copy* functions record
+     * copies from it into a batch, and submit() sends the batch to the transfer queue. If the ring is full, allocate() submits the current batch if needed
+     * and waits for the oldest one to finish. tryAllocate() doesn't wait, so coroutines can await getTimeline() reaching getOldestValue() instead.
+     *
+     * Destinations are usable by anything submitted to the main queue after submit() returns: it also submits a small otc to the main queue that waits for
+     * the batch, and, if the transfer queue is from another family, acquires ownership of the destinations (their sharing mode can stay exclusive).
+     *
+     * Use a StagingRing from one thread at a time (AssetLoader shares one between coroutines with an AsyncMutex).
+     */
+    class StagingRing {
+      public:
+        struct Allocation {
+            std::span<std::byte> data;
+            vk::DeviceSize offset; // in the ring buffer
+        };
+
+        explicit StagingRing(vk::DeviceSize capacity = 64ULL * 1024 * 1024);
+        ~StagingRing(); // waits for every submitted batch
+
+        /**
+         * Reserve size bytes, valid until the batch they are used in is submitted. Throws std::runtime_error if size is larger than the ring.
+         * Record the copy before allocating again, a full ring submits the current batch.
+         */
+        Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+        // allocate() without waiting: if the ring is full, submits the current batch if needed and returns nothing. space frees up once getOldestValue() is reached.
+        std::optional<Allocation> tryAllocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+        void copyToBuffer(const Allocation &source, vk::Buffer destination, vk::DeviceSize destinationOffset = 0);
+
+        /**
+         * Copy into an image, which is transitioned from eUndefined (its previous contents are discarded) and ends up in finalLayout.
+         * bufferOffset of the regions is relative to source.
+         */
+        void copyToImage(const Allocation &source, vk::Image destination, std::span<const vk::BufferImageCopy> regions, const vk::ImageSubresourceRange &range,
+                         vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+        /**
+         * Submit everything recorded since the last submit.
+         *
+         * @return The value of getTimeline() that signals once the copies have finished, 0 if nothing was recorded.
+         */
+        uint64_t submit();
+
+        [[nodiscard]] inline vk::Semaphore getTimeline() const noexcept { return m_Timeline; };
+
+        // the value the batch being recorded will signal once submitted, or the last submitted value if nothing is being recorded.
+        [[nodiscard]] inline uint64_t getRecordingValue() const noexcept { return m_Current ? m_Value + 1 : m_Value; };
+        // the value the oldest batch in flight signals, the last submitted value if none is.
+        [[nodiscard]] inline uint64_t getOldestValue() const noexcept { return m_InFlight.empty() ? m_Value : m_InFlight.front().value; };
+        [[nodiscard]] bool isComplete(uint64_t value) const;
+        void wait(uint64_t value) const;
+
+        [[nodiscard]] inline vk::DeviceSize getCapacity() const noexcept { return m_Capacity; };
+
+        StagingRing(const StagingRing &) = delete;
+        StagingRing &operator=(const StagingRing &) = delete;
+
+      private:
+        struct Batch {
+            uint64_t value;
+            vk::DeviceSize end; // ring offset one past the last byte the batch uses
+            vk::CommandBuffer commandBuffer;
+        };
+
+        void begin();
+        void retire(bool block);
+
+        vk::DeviceSize m_Capacity;
+        vk::Buffer m_Buffer;
+        vk::DeviceMemory m_Memory;
+        std::byte *m_Mapped = nullptr;
+        bool m_Coherent = true;
+
+        // bytes from m_Tail (start of the oldest batch in flight) up to m_Head (next free byte) are in use, wrapping around.
+        // head == tail is an empty ring if no batch is in flight or being recorded, a full one otherwise.
+        vk::DeviceSize m_Head = 0;
+        vk::DeviceSize m_Tail = 0;
+
+        bool m_SeparateFamily; // transfer and main queue families differ, ownership has to be transferred
+        vk::CommandPool m_Pool;
+        vk::CommandBuffer m_Current; // recording, null if nothing was allocated since the last submit
+        std::vector<vk::CommandBuffer> m_FreeCommandBuffers;
+        RingQueue<Batch> m_InFlight{8};
+
+        vk::Semaphore m_Timeline;
+        uint64_t m_Value = 0;
+
+        // acquire barriers for the main queue, matching the releases recorded into m_Current
+        std::vector<vk::BufferMemoryBarrier2> m_BufferAcquires;
+        std::vector<vk::ImageMemoryBarrier2> m_ImageAcquires;
+
+        std::vector<vk::BufferImageCopy> m_Regions; // scratch
+    };
+
+} // namespace kat
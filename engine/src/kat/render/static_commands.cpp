@@ -0,0 +1,60 @@
+#include "static_commands.hpp"
+
+#include "kat/trace.hpp"
+
+namespace kat {
+    StaticCommandCache::StaticCommandCache() {
+        m_Pool = globalState->device.createCommandPool(vk::CommandPoolCreateInfo({}, globalState->mainFamily));
+    }
+
+    StaticCommandCache::~StaticCommandCache() {
+        invalidate();
+        kat::deferDestroy(m_Pool); // after the frees above, deferred objects are destroyed in order
+    }
+
+    vk::CommandBuffer StaticCommandCache::get(uint32_t slot, uint64_t key, const RecordFunction &record) {
+        if (slot >= m_Entries.size()) m_Entries.resize(slot + 1);
+
+        Entry &entry = m_Entries[slot];
+        const bool capturing = replay::isCapturing();
+        if (entry.commandBuffer && entry.key == key && entry.captured == capturing) {
+            m_ReuseCount++;
+            replay::appendRecordedCommands(entry.commands);
+            return entry.commandBuffer;
+        }
+
+        KAT_TRACE_ZONE("recordStaticCommands");
+
+        // the old recording may still be executing, so it is replaced instead of re-recorded.
+        vku::deferFreeCommandBuffer(m_Pool, entry.commandBuffer);
+
+        vk::CommandBufferAllocateInfo allocateInfo(m_Pool, vk::CommandBufferLevel::ePrimary, 1);
+        if (globalState->device.allocateCommandBuffers(&allocateInfo, &entry.commandBuffer) != vk::Result::eSuccess) {
+            throw std::runtime_error("Failed to allocate static command buffer");
+        }
+        entry.key = key;
+        entry.captured = capturing;
+
+        // keep this recording's commands apart from whatever else is pending for the next submit.
+        const replay::RecordedCommands earlier = replay::takeRecordedCommands();
+
+        CommandRecorder recorder(entry.commandBuffer);
+        recorder.beginPrimary(cmd::BeginOptions{.simultaneousUse = true});
+        record(recorder);
+        recorder->end();
+
+        entry.commands = replay::takeRecordedCommands();
+        replay::appendRecordedCommands(earlier);
+        replay::appendRecordedCommands(entry.commands);
+
+        m_RecordCount++;
+        return entry.commandBuffer;
+    }
+
+    void StaticCommandCache::invalidate() {
+        for (auto &entry: m_Entries) {
+            vku::deferFreeCommandBuffer(m_Pool, entry.commandBuffer);
+            entry = {};
+        }
+    }
+} // namespace kat
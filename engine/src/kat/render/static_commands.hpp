@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "kat/engine.hpp"
+#include "kat/render/command_recorder.hpp"
+#include "kat/replay.hpp"
+
+namespace kat {
+
+    /**
+     * Hash of everything the content of a static command buffer depends on (render pass, framebuffer, extent, pipelines and their generations, ...).
+     */
+    class DependencyKey {
+      public:
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        inline DependencyKey &add(const T &value) noexcept {
+            unsigned char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            for (unsigned char b: bytes) {
+                m_Hash ^= b;
+                m_Hash *= 0x100000001b3ULL;
+            }
+            return *this;
+        };
+
+        [[nodiscard]] inline uint64_t get() const noexcept { return m_Hash; };
+
+      private:
+        uint64_t m_Hash = 0xcbf29ce484222325ULL;
+    };
+
+    /**
+     * Command buffers that are recorded once and submitted again every frame, until what they depend on changes.
+     *
+     * Each slot (usually a swapchain image index) holds one command buffer recorded with simultaneousUse, so it can be resubmitted while an earlier
+     * submission is still executing. When the key of a slot changes, a new command buffer is recorded and the old one is freed with deferFreeCommandBuffer().
+     *
+     * Recordings are made from the thread calling get() and the command buffers are freed by the render loop, so only use this from the render loop.
+     * While a replay capture is running, the commands of each recording are kept and added to the next submit every time it is returned.
+     */
+    class StaticCommandCache {
+      public:
+        using RecordFunction = InplaceFunction<void(CommandRecorder &), 64>;
+
+        StaticCommandCache();
+        ~StaticCommandCache();
+
+        /**
+         * The command buffer of a slot, (re-)recording it with record if the slot is empty or was recorded with a different key.
+         *
+         * record is called between begin() and end(), submit the result with vku::submit().
+         */
+        [[nodiscard]] vk::CommandBuffer get(uint32_t slot, uint64_t key, const RecordFunction &record);
+
+        // forget every recording (they are re-recorded on the next get()).
+        void invalidate();
+
+        [[nodiscard]] inline uint64_t getRecordCount() const noexcept { return m_RecordCount; };
+
+        [[nodiscard]] inline uint64_t getReuseCount() const noexcept { return m_ReuseCount; };
+
+        StaticCommandCache(const StaticCommandCache &) = delete;
+        StaticCommandCache &operator=(const StaticCommandCache &) = delete;
+
+      private:
+        struct Entry {
+            vk::CommandBuffer commandBuffer;
+            uint64_t key = 0;
+
+            replay::RecordedCommands commands;
+            bool captured = false; // recorded while a replay capture was running, otherwise commands is empty
+        };
+
+        vk::CommandPool m_Pool;
+        std::vector<Entry> m_Entries;
+
+        uint64_t m_RecordCount = 0;
+        uint64_t m_ReuseCount = 0;
+    };
+
+} // namespace kat
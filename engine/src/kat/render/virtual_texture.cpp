@@ -0,0 +1,673 @@
+#include "virtual_texture.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#include "kat/trace.hpp"
+
+namespace kat {
+    namespace {
+        uint32_t texelSize(vk::Format format) {
+            switch (format) {
+                case vk::Format::eR8Unorm:
+                    return 1;
+                case vk::Format::eR8G8Unorm:
+                    return 2;
+                case vk::Format::eR8G8B8A8Unorm:
+                case vk::Format::eR8G8B8A8Srgb:
+                case vk::Format::eB8G8R8A8Unorm:
+                case vk::Format::eB8G8R8A8Srgb:
+                case vk::Format::eA2B10G10R10UnormPack32:
+                    return 4;
+                case vk::Format::eR16G16B16A16Sfloat:
+                    return 8;
+                case vk::Format::eR32G32B32A32Sfloat:
+                    return 16;
+                default:
+                    throw std::runtime_error("Unsupported virtual texture format " + vk::to_string(format));
+            }
+        }
+
+        constexpr vk::ImageUsageFlags IMAGE_USAGE = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+
+        bool sparseFormatSupported(vk::Format format) {
+            const auto properties = globalState->physicalDevice.getSparseImageFormatProperties(format, vk::ImageType::e2D, vk::SampleCountFlagBits::e1, IMAGE_USAGE, vk::ImageTiling::eOptimal);
+            return std::ranges::any_of(properties, [](const auto &p) { return static_cast<bool>(p.aspectMask & vk::ImageAspectFlagBits::eColor); });
+        }
+
+        uint32_t divideRoundingUp(uint32_t a, uint32_t b) {
+            return (a + b - 1) / b;
+        }
+    } // namespace
+
+    VirtualTexture::VirtualTexture(const VirtualTextureOptions &options, Loader loader) : m_Options(options), m_Loader(std::move(loader)), m_TexelSize(texelSize(options.format)) {
+        if (options.extent.width == 0 || options.extent.height == 0) throw std::runtime_error("Virtual texture extent is empty");
+
+        const uint32_t fullChain = std::bit_width(std::max(options.extent.width, options.extent.height));
+        m_Options.mipLevels = std::clamp(options.mipLevels, 1U, fullChain);
+        m_Options.stagingPages = std::max(options.stagingPages, 1U);
+
+        const bool sparse = !options.forceAtlas && globalState->capabilities.sparseTextures() && globalState->sparseQueue && sparseFormatSupported(options.format);
+        if (sparse) {
+            createSparse();
+        } else {
+            if (!options.forceAtlas) spdlog::info("Sparse residency isn't available for {}, using a tiled atlas for virtual textures", vk::to_string(options.format));
+            createAtlas();
+        }
+
+        const auto subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1);
+        m_ImageView = globalState->device.createImageView(vk::ImageViewCreateInfo({}, m_Image, vk::ImageViewType::e2D, options.format, {}, subresourceRange));
+
+        // the image stays in eGeneral, so copies into it never have to transition mip levels that are being sampled.
+        vku::otc([image = m_Image, subresourceRange](const vk::CommandBuffer &cmd) {
+            vk::ImageMemoryBarrier2 barrier{};
+            barrier.image = image;
+            barrier.srcStageMask = vk::PipelineStageFlagBits2::eNone;
+            barrier.srcAccessMask = vk::AccessFlagBits2::eNone;
+            barrier.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
+            barrier.dstAccessMask = vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eShaderSampledRead;
+            barrier.oldLayout = vk::ImageLayout::eUndefined;
+            barrier.newLayout = vk::ImageLayout::eGeneral;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange = subresourceRange;
+            cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, barrier));
+        });
+
+        const vk::DeviceSize tableSize = static_cast<vk::DeviceSize>(m_Pages.size()) * sizeof(uint32_t);
+        for (auto &frame: m_Frames) {
+            frame.pageTable = createMappedBuffer(tableSize, vk::BufferUsageFlagBits::eStorageBuffer, false);
+            frame.feedback = createMappedBuffer(tableSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, true);
+            std::memset(frame.pageTable.mapped, 0, tableSize);
+        }
+        m_PageTable.resize(m_Pages.size(), 0);
+
+        m_Staging = createMappedBuffer(m_StagingPageSize * m_Options.stagingPages, vk::BufferUsageFlagBits::eTransferSrc, false);
+        for (uint32_t i = m_Options.stagingPages; i > 0; i--) m_FreeStaging.push_back(i - 1);
+
+        m_StreamThread = std::jthread([this](const std::stop_token &stopToken) { streamLoop(stopToken); });
+
+        // the pinned levels are the fallback for everything else, load them right away (coarsest first).
+        for (uint32_t mip = m_Options.mipLevels; mip > m_PinnedFirstMip; mip--) {
+            const Level &level = m_Levels[mip - 1];
+            for (uint32_t i = 0; i < level.pagesX * level.pagesY; i++) request(level.firstPage + i);
+        }
+    }
+
+    VirtualTexture::~VirtualTexture() {
+        m_StreamThread.request_stop();
+        m_StreamThread.join();
+
+        // binds aren't covered by the deferred destruction fence, so everything below waits for the last one as well.
+        if (m_BindValue > 0) kat::deferDestroyAfter(m_BindTimeline, m_BindValue);
+        kat::deferDestroy(m_BindTimeline);
+
+        for (auto &frame: m_Frames) {
+            destroyMappedBuffer(frame.pageTable);
+            destroyMappedBuffer(frame.feedback);
+        }
+        destroyMappedBuffer(m_Staging);
+
+        kat::deferDestroy(m_ImageView);
+        kat::deferDestroy(m_Image);
+        vku::deferFreeMemory(m_Memory);
+        if (m_MipTailMemory) vku::deferFreeMemory(m_MipTailMemory);
+    }
+
+    void VirtualTexture::createSparse() {
+        m_Sparse = true;
+        m_BindOnStreamThread = globalState->sparseQueue != globalState->mainQueue;
+
+        vk::ImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.flags = vk::ImageCreateFlagBits::eSparseBinding | vk::ImageCreateFlagBits::eSparseResidency;
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = m_Options.format;
+        imageCreateInfo.extent = vk::Extent3D(m_Options.extent, 1);
+        imageCreateInfo.mipLevels = m_Options.mipLevels;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
+        imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
+        imageCreateInfo.usage = IMAGE_USAGE;
+        imageCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+        imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
+        m_Image = globalState->device.createImage(imageCreateInfo);
+
+        const auto requirements = globalState->device.getImageMemoryRequirements(m_Image);
+        const auto sparseRequirements = globalState->device.getImageSparseMemoryRequirements(m_Image);
+        const auto color = std::ranges::find_if(sparseRequirements, [](const auto &r) { return static_cast<bool>(r.formatProperties.aspectMask & vk::ImageAspectFlagBits::eColor); });
+        if (color == sparseRequirements.end()) throw std::runtime_error("Sparse image has no color aspect requirements");
+
+        m_PageExtent = vk::Extent2D(color->formatProperties.imageGranularity.width, color->formatProperties.imageGranularity.height);
+        m_SlotSize = requirements.alignment; // the sparse block size
+        m_MipTailFirstLod = std::min(color->imageMipTailFirstLod, m_Options.mipLevels);
+        createLevels();
+
+        const vk::DeviceSize mipTailSize = m_MipTailFirstLod < m_Options.mipLevels ? color->imageMipTailSize : 0;
+        const auto slotCount = static_cast<uint32_t>(m_Options.memoryBudget > mipTailSize ? (m_Options.memoryBudget - mipTailSize) / m_SlotSize : 0);
+        createSlots(slotCount);
+
+        const uint32_t memoryType = vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        m_Memory = vku::allocateMemory(vk::MemoryAllocateInfo(slotCount * m_SlotSize, memoryType));
+
+        m_BindTimeline = vku::createTimelineSemaphore();
+
+        // the mip tail is bound once, as a whole.
+        if (mipTailSize > 0) {
+            m_MipTailMemory = vku::allocateMemory(vk::MemoryAllocateInfo(mipTailSize, memoryType));
+
+            const vk::SparseMemoryBind tailBind(color->imageMipTailOffset, mipTailSize, m_MipTailMemory, 0);
+            const vk::SparseImageOpaqueMemoryBindInfo opaqueBindInfo(m_Image, tailBind);
+
+            const uint64_t value = ++m_BindValue;
+            vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &value;
+
+            vk::BindSparseInfo bindInfo{};
+            bindInfo.setImageOpaqueBinds(opaqueBindInfo);
+            bindInfo.signalSemaphoreCount = 1;
+            bindInfo.pSignalSemaphores = &m_BindTimeline;
+            bindInfo.pNext = &timelineInfo;
+
+            vku::bindSparse(bindInfo);
+            vku::waitSemaphore(m_BindTimeline, value);
+        }
+
+        m_StagingPageSize = static_cast<vk::DeviceSize>(m_PageExtent.width) * m_PageExtent.height * m_TexelSize;
+        if (m_MipTailFirstLod < m_Options.mipLevels) {
+            // tail levels are uploaded whole, and the first one can be larger than a page if it isn't aligned to the granularity.
+            const vk::Extent2D tail = m_Levels[m_MipTailFirstLod].extent;
+            m_StagingPageSize = std::max(m_StagingPageSize, static_cast<vk::DeviceSize>(tail.width) * tail.height * m_TexelSize);
+        }
+        m_StagingPageSize = (m_StagingPageSize + 15) & ~vk::DeviceSize(15);
+
+        spdlog::debug("Sparse virtual texture {}x{}, {} mips, {}x{} pages, {} slots", m_Options.extent.width, m_Options.extent.height, m_Options.mipLevels, m_PageExtent.width, m_PageExtent.height, slotCount);
+    }
+
+    void VirtualTexture::createAtlas() {
+        m_Sparse = false;
+
+        m_PageExtent = m_Options.atlasPageExtent;
+        m_SlotSize = static_cast<vk::DeviceSize>(m_PageExtent.width) * m_PageExtent.height * m_TexelSize;
+        m_MipTailFirstLod = m_Options.mipLevels; // no mip tail, the small levels are pages like every other
+        createLevels();
+
+        // a roughly square atlas of as many pages as fit into the budget (and the maximum image size).
+        const uint32_t maxDimension = globalState->physicalDeviceProperties.limits.maxImageDimension2D;
+        const auto budgetSlots = static_cast<uint32_t>(std::min<vk::DeviceSize>(m_Options.memoryBudget / m_SlotSize, UINT32_MAX));
+        const uint32_t columns = std::clamp(static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(budgetSlots)))), 1U, maxDimension / m_PageExtent.width);
+        const uint32_t rows = std::min(budgetSlots / columns, maxDimension / m_PageExtent.height);
+        m_AtlasExtent = vk::Extent2D(columns, rows);
+        createSlots(columns * rows);
+
+        vk::ImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = m_Options.format;
+        imageCreateInfo.extent = vk::Extent3D(columns * m_PageExtent.width, rows * m_PageExtent.height, 1);
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
+        imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
+        imageCreateInfo.usage = IMAGE_USAGE;
+        imageCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+        imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
+        m_Image = globalState->device.createImage(imageCreateInfo);
+
+        const auto requirements = globalState->device.getImageMemoryRequirements(m_Image);
+        m_Memory = vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)));
+        globalState->device.bindImageMemory(m_Image, m_Memory, 0);
+
+        m_StagingPageSize = (m_SlotSize + 15) & ~vk::DeviceSize(15);
+
+        spdlog::debug("Atlas virtual texture {}x{}, {} mips, {}x{} pages, {}x{} slots", m_Options.extent.width, m_Options.extent.height, m_Options.mipLevels, m_PageExtent.width, m_PageExtent.height, columns, rows);
+    }
+
+    void VirtualTexture::createLevels() {
+        uint32_t pageCount = 0;
+        m_Levels.resize(m_Options.mipLevels);
+        for (uint32_t mip = 0; mip < m_Options.mipLevels; mip++) {
+            Level &level = m_Levels[mip];
+            level.extent = vk::Extent2D(std::max(m_Options.extent.width >> mip, 1U), std::max(m_Options.extent.height >> mip, 1U));
+            if (mip >= m_MipTailFirstLod) {
+                // mip tail levels are one page each
+                level.pagesX = 1;
+                level.pagesY = 1;
+            } else {
+                level.pagesX = divideRoundingUp(level.extent.width, m_PageExtent.width);
+                level.pagesY = divideRoundingUp(level.extent.height, m_PageExtent.height);
+            }
+            level.firstPage = pageCount;
+            pageCount += level.pagesX * level.pagesY;
+        }
+
+        // pinned: the mip tail, or else every level from the first one that fits into a single page (at least the last level).
+        m_PinnedFirstMip = m_Options.mipLevels - 1;
+        while (m_PinnedFirstMip > 0 && m_Levels[m_PinnedFirstMip - 1].pagesX * m_Levels[m_PinnedFirstMip - 1].pagesY == 1) m_PinnedFirstMip--;
+        m_PinnedFirstMip = std::min(m_PinnedFirstMip, m_MipTailFirstLod);
+
+        m_Pages.resize(pageCount);
+        for (uint32_t mip = 0; mip < m_Options.mipLevels; mip++) {
+            const Level &level = m_Levels[mip];
+            for (uint32_t y = 0; y < level.pagesY; y++) {
+                for (uint32_t x = 0; x < level.pagesX; x++) {
+                    Page &page = m_Pages[level.firstPage + y * level.pagesX + x];
+                    page.page = VirtualPage{mip, x, y};
+                    page.pinned = mip >= m_PinnedFirstMip;
+                }
+            }
+        }
+    }
+
+    void VirtualTexture::createSlots(uint32_t slotCount) {
+        uint32_t pinnedSlots = 0;
+        for (uint32_t mip = m_PinnedFirstMip; mip < m_MipTailFirstLod; mip++) pinnedSlots += m_Levels[mip].pagesX * m_Levels[mip].pagesY;
+
+        // the pinned pages plus at least one page of each finer level.
+        if (slotCount < pinnedSlots + m_PinnedFirstMip) {
+            throw std::runtime_error("Virtual texture memory budget is too small (" + std::to_string(slotCount) + " pages, needs at least " + std::to_string(pinnedSlots + m_PinnedFirstMip) + ")");
+        }
+
+        m_Slots.resize(slotCount);
+        m_FreeSlots.reserve(slotCount);
+        for (uint32_t i = slotCount; i > 0; i--) m_FreeSlots.push_back(i - 1);
+    }
+
+    VirtualTexture::MappedBuffer VirtualTexture::createMappedBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, bool readback) {
+        MappedBuffer buffer;
+        buffer.buffer = globalState->device.createBuffer(vk::BufferCreateInfo({}, size, usage, vk::SharingMode::eExclusive));
+
+        const auto requirements = globalState->device.getBufferMemoryRequirements(buffer.buffer);
+
+        // readback prefers cached memory (like FrameCapture), everything else is written by the host and wants coherent memory.
+        uint32_t memoryType;
+        try {
+            memoryType = vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | (readback ? vk::MemoryPropertyFlagBits::eHostCached : vk::MemoryPropertyFlagBits::eHostCoherent));
+        } catch (const std::runtime_error &) {
+            memoryType = vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        }
+        buffer.coherent = static_cast<bool>(globalState->memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+
+        buffer.memory = vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, memoryType));
+        globalState->device.bindBufferMemory(buffer.buffer, buffer.memory, 0);
+        buffer.mapped = static_cast<std::byte *>(globalState->device.mapMemory(buffer.memory, 0, VK_WHOLE_SIZE));
+        return buffer;
+    }
+
+    void VirtualTexture::destroyMappedBuffer(MappedBuffer &buffer) {
+        if (!buffer.buffer) return;
+        globalState->device.unmapMemory(buffer.memory);
+        kat::deferDestroy(buffer.buffer);
+        vku::deferFreeMemory(buffer.memory);
+        buffer = {};
+    }
+
+    vk::Extent2D VirtualTexture::pageExtent(const VirtualPage &page) const noexcept {
+        const Level &level = m_Levels[page.mip];
+        if (page.mip >= m_MipTailFirstLod) return level.extent;
+        return {std::min(m_PageExtent.width, level.extent.width - page.x * m_PageExtent.width), std::min(m_PageExtent.height, level.extent.height - page.y * m_PageExtent.height)};
+    }
+
+    uint32_t VirtualTexture::parentPage(uint32_t pageIndex) const noexcept {
+        const VirtualPage &page = m_Pages[pageIndex].page;
+        if (page.mip + 1 >= m_Options.mipLevels) return NO_PAGE;
+
+        const Level &parent = m_Levels[page.mip + 1];
+        return parent.firstPage + std::min(page.y / 2, parent.pagesY - 1) * parent.pagesX + std::min(page.x / 2, parent.pagesX - 1);
+    }
+
+    void VirtualTexture::update(const vk::CommandBuffer &cmd, uint32_t frameIndex) {
+        KAT_TRACE_ZONE("VirtualTexture::update");
+
+        m_FrameNumber++;
+        m_Current = &m_Frames[frameIndex % MAX_FRAMES_IN_FLIGHT];
+
+        // slots and staging pages whose last use has finished on the gpu
+        std::erase_if(m_RetiringSlots, [this](uint32_t slot) {
+            if (m_Slots[slot].freeAfter > m_FrameNumber) return false;
+            m_FreeSlots.push_back(slot);
+            return true;
+        });
+
+        bool stagingFreed = false;
+        {
+            std::lock_guard lk(m_Mutex);
+            std::erase_if(m_RetiringStaging, [&](const auto &entry) {
+                if (entry.second > m_FrameNumber) return false;
+                m_FreeStaging.push_back(entry.first);
+                stagingFreed = true;
+                return true;
+            });
+        }
+        if (stagingFreed) m_Condition.notify_all();
+
+        readFeedback(*m_Current);
+
+        // coarse pages first, they cover more of the screen and everything finer falls back to them.
+        std::ranges::sort(m_Wanted, [this](uint32_t a, uint32_t b) { return m_Pages[a].page.mip > m_Pages[b].page.mip; });
+        uint32_t requested = 0;
+        for (const uint32_t page: m_Wanted) {
+            if (requested >= m_Options.maxRequestsPerFrame) break;
+            if (m_Pages[page].state != PageState::eAbsent) continue; // ancestors can be wanted more than once
+
+            // evictions count against the limit too, the page is requested again once the evicted slot is free.
+            if (request(page) == RequestResult::eFull) break;
+            requested++;
+        }
+
+        completeUploads(cmd);
+
+        FrameData &frame = *m_Current;
+        const size_t tableSize = m_PageTable.size() * sizeof(uint32_t);
+        std::memcpy(frame.pageTable.mapped, m_PageTable.data(), tableSize);
+        if (!frame.pageTable.coherent) globalState->device.flushMappedMemoryRanges(vk::MappedMemoryRange(frame.pageTable.memory, 0, VK_WHOLE_SIZE));
+
+        // feedback starts out empty every frame
+        cmd.fillBuffer(frame.feedback.buffer, 0, VK_WHOLE_SIZE, 0);
+
+        vk::BufferMemoryBarrier2 cleared{};
+        cleared.buffer = frame.feedback.buffer;
+        cleared.srcStageMask = vk::PipelineStageFlagBits2::eClear;
+        cleared.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+        cleared.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader;
+        cleared.dstAccessMask = vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eShaderStorageRead;
+        cleared.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        cleared.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        cleared.offset = 0;
+        cleared.size = VK_WHOLE_SIZE;
+
+        cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, cleared, {}));
+        frame.recorded = true;
+    }
+
+    void VirtualTexture::finishFeedback(const vk::CommandBuffer &cmd) {
+        if (!m_Current) return;
+
+        vk::BufferMemoryBarrier2 toHost{};
+        toHost.buffer = m_Current->feedback.buffer;
+        toHost.srcStageMask = vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader;
+        toHost.srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite;
+        toHost.dstStageMask = vk::PipelineStageFlagBits2::eHost;
+        toHost.dstAccessMask = vk::AccessFlagBits2::eHostRead;
+        toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.offset = 0;
+        toHost.size = VK_WHOLE_SIZE;
+
+        cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, toHost, {}));
+    }
+
+    VirtualTextureStats VirtualTexture::getStats() const noexcept {
+        return VirtualTextureStats{
+                .residentPages = m_ResidentPages,
+                .mipTailPages = m_MipTailPages,
+                .pendingPages = m_PendingPages,
+                .slotCount = static_cast<uint32_t>(m_Slots.size()),
+                .uploadedPages = m_UploadedPages,
+                .evictedPages = m_EvictedPages,
+                .rejectedRequests = m_RejectedRequests,
+        };
+    }
+
+    void VirtualTexture::readFeedback(FrameData &frame) {
+        m_Wanted.clear();
+        if (!frame.recorded) return;
+
+        if (!frame.feedback.coherent) globalState->device.invalidateMappedMemoryRanges(vk::MappedMemoryRange(frame.feedback.memory, 0, VK_WHOLE_SIZE));
+        const auto *feedback = reinterpret_cast<const uint32_t *>(frame.feedback.mapped);
+
+        for (uint32_t i = 0; i < m_Pages.size(); i++) {
+            if (feedback[i] == 0) continue;
+
+            // the page and everything it falls back to is in use. stop at the first ancestor that was already marked this frame.
+            for (uint32_t page = i; page != NO_PAGE; page = parentPage(page)) {
+                Page &p = m_Pages[page];
+                if (p.lastRequested == m_FrameNumber && page != i) break;
+                p.lastRequested = m_FrameNumber;
+                if (p.state == PageState::eAbsent) m_Wanted.push_back(page);
+            }
+        }
+    }
+
+    VirtualTexture::RequestResult VirtualTexture::request(uint32_t pageIndex) {
+        Page &page = m_Pages[pageIndex];
+
+        Upload upload{};
+        upload.page = pageIndex;
+        upload.slot = NO_SLOT;
+        upload.unbindPage = NO_PAGE;
+
+        // mip tail pages are always bound, everything else needs a slot.
+        if (page.page.mip < m_MipTailFirstLod) {
+            if (m_FreeSlots.empty()) return evict() ? RequestResult::eEvicted : RequestResult::eFull;
+
+            upload.slot = m_FreeSlots.back();
+            m_FreeSlots.pop_back();
+
+            Slot &slot = m_Slots[upload.slot];
+            slot.page = pageIndex;
+
+            if (m_Sparse) {
+                // the page's binding moves to this slot, so the slot it may still be bound to from before doesn't have to unbind it anymore.
+                if (slot.boundPage != pageIndex) upload.unbindPage = slot.boundPage;
+                if (upload.unbindPage != NO_PAGE) m_Pages[upload.unbindPage].boundSlot = NO_SLOT;
+                if (page.boundSlot != NO_SLOT) m_Slots[page.boundSlot].boundPage = NO_PAGE;
+
+                slot.boundPage = pageIndex;
+                page.boundSlot = upload.slot;
+            }
+        }
+
+        page.state = PageState::ePending;
+        page.slot = upload.slot;
+        m_PendingPages++;
+
+        {
+            std::lock_guard lk(m_Mutex);
+            m_Requests.push(upload);
+        }
+        m_Condition.notify_all();
+        return RequestResult::eQueued;
+    }
+
+    bool VirtualTexture::evict() {
+        // evict the least recently requested page that isn't wanted by any frame in flight. its slot is only reusable once those frames have finished,
+        // so whatever needed the slot is requested again a few frames later.
+        uint32_t victim = NO_SLOT;
+        uint64_t oldest = m_FrameNumber > MAX_FRAMES_IN_FLIGHT ? m_FrameNumber - MAX_FRAMES_IN_FLIGHT : 0;
+        for (uint32_t i = 0; i < m_Slots.size(); i++) {
+            const uint32_t pageIndex = m_Slots[i].page;
+            if (pageIndex == NO_PAGE) continue;
+
+            const Page &page = m_Pages[pageIndex];
+            if (page.state != PageState::eResident || page.pinned || page.lastRequested >= oldest) continue;
+
+            oldest = page.lastRequested;
+            victim = i;
+        }
+
+        if (victim == NO_SLOT) {
+            m_RejectedRequests++;
+            return false;
+        }
+
+        Slot &slot = m_Slots[victim];
+        Page &page = m_Pages[slot.page];
+        page.state = PageState::eAbsent;
+        page.slot = NO_SLOT;
+        m_PageTable[slot.page] = 0;
+
+        slot.page = NO_PAGE;
+        slot.freeAfter = m_FrameNumber + MAX_FRAMES_IN_FLIGHT;
+        m_RetiringSlots.push_back(victim);
+
+        m_ResidentPages--;
+        m_EvictedPages++;
+        return true;
+    }
+
+    void VirtualTexture::completeUploads(const vk::CommandBuffer &cmd) {
+        {
+            std::lock_guard lk(m_Mutex);
+            m_Uploads.insert(m_Uploads.end(), m_Finished.begin(), m_Finished.end());
+            m_Finished.clear();
+        }
+        if (m_Uploads.empty()) return;
+
+        // binds on the main queue happen here instead of on the streaming thread, so they don't contend with the render loop's submissions.
+        if (m_Sparse && !m_BindOnStreamThread) {
+            m_Binding.clear();
+            for (auto &upload: m_Uploads) {
+                if (upload.slot != NO_SLOT && upload.bindValue == 0) m_Binding.push_back(&upload);
+            }
+            if (!m_Binding.empty()) bindPages(m_Binding);
+        }
+
+        const uint64_t bound = m_Sparse ? vku::getSemaphoreValue(m_BindTimeline) : 0;
+        bool copied = false;
+
+        std::erase_if(m_Uploads, [&](const Upload &upload) {
+            Page &page = m_Pages[upload.page];
+
+            if (!upload.loaded) {
+                spdlog::warn("Virtual texture page (mip {}, {}, {}) couldn't be loaded{}", page.page.mip, page.page.x, page.page.y, page.pinned ? ", lower mips have nothing to fall back to" : "");
+
+                // nothing was copied, the slot and staging page can be reused right away (a sparse slot stays bound to the page until then).
+                if (upload.slot != NO_SLOT) {
+                    m_Slots[upload.slot].page = NO_PAGE;
+                    m_FreeSlots.push_back(upload.slot);
+                }
+                {
+                    std::lock_guard lk(m_Mutex);
+                    m_FreeStaging.push_back(upload.staging);
+                }
+                m_Condition.notify_all();
+
+                page.state = PageState::eFailed;
+                page.slot = NO_SLOT;
+                m_PendingPages--;
+                return true;
+            }
+
+            // sparse pages can only be written once their memory is bound
+            if (m_Sparse && upload.slot != NO_SLOT && (upload.bindValue == 0 || upload.bindValue > bound)) return false;
+
+            copyPage(cmd, upload);
+            copied = true;
+
+            page.state = PageState::eResident;
+            m_PageTable[upload.page] = PAGE_RESIDENT | (m_Sparse ? 0 : upload.slot);
+            m_RetiringStaging.emplace_back(upload.staging, m_FrameNumber + MAX_FRAMES_IN_FLIGHT);
+
+            m_PendingPages--;
+            m_ResidentPages++;
+            if (upload.slot == NO_SLOT) m_MipTailPages++;
+            m_UploadedPages++;
+            return true;
+        });
+
+        if (copied) {
+            vk::MemoryBarrier2 toShaders{};
+            toShaders.srcStageMask = vk::PipelineStageFlagBits2::eCopy;
+            toShaders.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+            toShaders.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader;
+            toShaders.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead;
+
+            cmd.pipelineBarrier2(vk::DependencyInfo({}, toShaders, {}, {}));
+        }
+    }
+
+    void VirtualTexture::bindPages(std::span<Upload *const> uploads) {
+        KAT_TRACE_ZONE("VirtualTexture::bindPages");
+
+        const auto imageBind = [this](uint32_t pageIndex, vk::DeviceMemory memory, vk::DeviceSize offset) {
+            const VirtualPage &page = m_Pages[pageIndex].page;
+            const vk::Offset3D imageOffset(static_cast<int32_t>(page.x * m_PageExtent.width), static_cast<int32_t>(page.y * m_PageExtent.height), 0);
+            return vk::SparseImageMemoryBind(vk::ImageSubresource(vk::ImageAspectFlagBits::eColor, page.mip, 0), imageOffset, vk::Extent3D(pageExtent(page), 1), memory, offset);
+        };
+
+        // a slot's memory may only be bound to one page, so the page it held before is unbound in the same operation.
+        std::vector<vk::SparseImageMemoryBind> binds;
+        binds.reserve(uploads.size() * 2);
+        for (const Upload *upload: uploads) {
+            if (upload->unbindPage != NO_PAGE) binds.push_back(imageBind(upload->unbindPage, {}, 0));
+            binds.push_back(imageBind(upload->page, m_Memory, upload->slot * m_SlotSize));
+        }
+
+        const vk::SparseImageMemoryBindInfo imageBindInfo(m_Image, binds);
+
+        const uint64_t value = ++m_BindValue;
+        vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &value;
+
+        vk::BindSparseInfo bindInfo{};
+        bindInfo.setImageBinds(imageBindInfo);
+        bindInfo.signalSemaphoreCount = 1;
+        bindInfo.pSignalSemaphores = &m_BindTimeline;
+        bindInfo.pNext = &timelineInfo;
+
+        vku::bindSparse(bindInfo);
+
+        for (Upload *upload: uploads) upload->bindValue = value;
+    }
+
+    void VirtualTexture::copyPage(const vk::CommandBuffer &cmd, const Upload &upload) {
+        const VirtualPage &page = m_Pages[upload.page].page;
+
+        vk::BufferImageCopy region{};
+        region.bufferOffset = upload.staging * m_StagingPageSize;
+        region.imageExtent = vk::Extent3D(pageExtent(page), 1);
+
+        if (m_Sparse) {
+            region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, page.mip, 0, 1);
+            region.imageOffset = vk::Offset3D(static_cast<int32_t>(page.x * m_PageExtent.width), static_cast<int32_t>(page.y * m_PageExtent.height), 0);
+        } else {
+            region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+            region.imageOffset = vk::Offset3D(static_cast<int32_t>(upload.slot % m_AtlasExtent.width * m_PageExtent.width), static_cast<int32_t>(upload.slot / m_AtlasExtent.width * m_PageExtent.height), 0);
+        }
+
+        cmd.copyBufferToImage(m_Staging.buffer, m_Image, vk::ImageLayout::eGeneral, region);
+    }
+
+    void VirtualTexture::streamLoop(const std::stop_token &stopToken) {
+        trace::setThreadName("virtual texture");
+
+        while (true) {
+            Upload upload;
+            {
+                std::unique_lock lk(m_Mutex);
+                if (!m_Condition.wait(lk, stopToken, [this] { return !m_Requests.empty() && !m_FreeStaging.empty(); })) return;
+                upload = m_Requests.pop();
+                upload.staging = m_FreeStaging.back();
+                m_FreeStaging.pop_back();
+            }
+
+            const VirtualPage &page = m_Pages[upload.page].page;
+            const vk::Extent2D extent = pageExtent(page);
+            const std::span texels(m_Staging.mapped + upload.staging * m_StagingPageSize, static_cast<size_t>(extent.width) * extent.height * m_TexelSize);
+
+            {
+                KAT_TRACE_ZONE("loadPage");
+                try {
+                    upload.loaded = m_Loader(page, extent, texels);
+                } catch (const std::exception &e) {
+                    spdlog::error("Virtual texture loader threw: {}", e.what());
+                    upload.loaded = false;
+                }
+            }
+
+            // failed pages are bound anyway, the bookkeeping on the render thread assumes every handed out slot is.
+            if (m_Sparse && m_BindOnStreamThread && upload.slot != NO_SLOT) {
+                Upload *uploads[] = {&upload};
+                bindPages(uploads);
+            }
+
+            {
+                std::lock_guard lk(m_Mutex);
+                m_Finished.push_back(upload);
+            }
+        }
+    }
+} // namespace kat
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "kat/engine.hpp"
+
+namespace kat {
+
+    struct VirtualPage {
+        uint32_t mip;
+        uint32_t x, y; // in pages of that mip level
+    };
+
+    struct VirtualTextureOptions {
+        vk::Format format = vk::Format::eR8G8B8A8Unorm;
+        vk::Extent2D extent;
+        uint32_t mipLevels = 1;
+
+        // device memory for pages, the texture never uses more than this (the atlas fallback also needs it to fit in one image).
+        vk::DeviceSize memoryBudget = 64ULL * 1024 * 1024;
+
+        vk::Extent2D atlasPageExtent = {128, 128}; // the sparse path uses the format's sparse block size instead
+        uint32_t stagingPages = 16;                // pages that can be loaded ahead of being copied into the texture
+        uint32_t maxRequestsPerFrame = 64;         // new pages handed to the streaming thread per update()
+
+        bool forceAtlas = false; // use the tiled atlas even if the device supports sparse residency
+    };
+
+    struct VirtualTextureStats {
+        uint32_t residentPages;
+        uint32_t mipTailPages; // resident pages of the sparse mip tail, they don't take a slot
+        uint32_t pendingPages; // requested, not resident yet
+        uint32_t slotCount;    // pages that fit into the memory budget
+        uint64_t uploadedPages;
+        uint64_t evictedPages;
+        uint64_t rejectedRequests; // requests dropped because every slot was in use
+    };
+
+    /**
+     * A texture that only keeps the pages (tiles of a mip level) that are actually sampled in device memory, within a fixed budget,
+     * so texture memory stays bounded no matter how large the content is.
+     *
+     * With sparse residency (Capabilities::sparseTextures(), a queue that can bind sparse memory, and a format that supports it), the image is created
+     * sparse and pages are bound to slots of one budget sized allocation with vkQueueBindSparse, and shaders sample it directly.
+     * Otherwise pages go into the slots of a regular atlas image, and shaders translate coordinates through the page table.
+     * The smallest mip levels (the sparse mip tail, or every level that fits into one page) are loaded up front and never evicted, so there is always
+     * something to fall back to.
+     *
+     * Each frame:
+     *  - shaders write a non-zero value into the feedback buffer for every page they want (the finest page at the lod they sample, at pageIndex()),
+     *    and look up residency in the page table (pageIndex() as well), falling back to coarser mips until a resident page is found.
+     *    page table entries are PAGE_RESIDENT | atlas slot (the slot is 0 for sparse textures), or 0.
+     *  - update() is recorded at the start of the frame (outside of render passes), after the frame's fence was waited on. it reads back what that
+     *    frame index requested last time, queues missing pages for the streaming thread, records copies of finished pages and evicts the least
+     *    recently requested pages when the budget is full.
+     *  - finishFeedback() is recorded after the last pass that writes feedback.
+     *
+     * Page contents come from the loader, which runs on the streaming thread. It fills tightly packed texels of the page (edge pages can be smaller than
+     * getPageExtent()), and returns false if the page can't be loaded (it is not requested again). Bilinear filtering doesn't cross pages in the atlas,
+     * so pages should be authored with a border if seams matter.
+     *
+     * The image stays in eGeneral, sample it with that layout. update() and finishFeedback() must be called from the render loop.
+     */
+    class VirtualTexture {
+      public:
+        using Loader = std::function<bool(const VirtualPage &page, vk::Extent2D extent, std::span<std::byte> texels)>;
+
+        static constexpr uint32_t PAGE_RESIDENT = 0x80000000U;
+
+        VirtualTexture(const VirtualTextureOptions &options, Loader loader);
+        ~VirtualTexture();
+
+        void update(const vk::CommandBuffer &cmd, uint32_t frameIndex);
+
+        // makes this frame's feedback writes visible to the host, which reads them back MAX_FRAMES_IN_FLIGHT frames later.
+        void finishFeedback(const vk::CommandBuffer &cmd);
+
+        [[nodiscard]] inline bool isSparse() const noexcept { return m_Sparse; };
+
+        [[nodiscard]] inline vk::Image getImage() const noexcept { return m_Image; };
+        [[nodiscard]] inline vk::ImageView getImageView() const noexcept { return m_ImageView; };
+
+        // uint32_t per page, in pageIndex() order. each frame index has its own, bind the one update() was called with.
+        [[nodiscard]] inline vk::Buffer getPageTable(uint32_t frameIndex) const noexcept { return m_Frames[frameIndex % MAX_FRAMES_IN_FLIGHT].pageTable.buffer; };
+        [[nodiscard]] inline vk::Buffer getFeedbackBuffer(uint32_t frameIndex) const noexcept { return m_Frames[frameIndex % MAX_FRAMES_IN_FLIGHT].feedback.buffer; };
+
+        [[nodiscard]] inline vk::Extent2D getPageExtent() const noexcept { return m_PageExtent; };
+
+        // the atlas in pages (atlas slot s is at column s % width, row s / width), or {0, 0} for sparse textures.
+        [[nodiscard]] inline vk::Extent2D getAtlasExtent() const noexcept { return m_AtlasExtent; };
+
+        [[nodiscard]] inline uint32_t getPageCount() const noexcept { return static_cast<uint32_t>(m_Pages.size()); };
+
+        // pages of all mip levels are numbered mip by mip, row by row.
+        [[nodiscard]] inline uint32_t pageIndex(const VirtualPage &page) const noexcept { return m_Levels[page.mip].firstPage + page.y * m_Levels[page.mip].pagesX + page.x; };
+
+        [[nodiscard]] VirtualTextureStats getStats() const noexcept;
+
+        VirtualTexture(const VirtualTexture &) = delete;
+        VirtualTexture &operator=(const VirtualTexture &) = delete;
+
+      private:
+        static constexpr uint32_t NO_SLOT = UINT32_MAX;
+        static constexpr uint32_t NO_PAGE = UINT32_MAX;
+
+        enum class RequestResult {
+            eQueued,
+            eEvicted, // no free slot, a page was evicted to make room
+            eFull,    // no free slot, and nothing can be evicted
+        };
+
+        enum class PageState : uint8_t {
+            eAbsent,
+            ePending,  // handed to the streaming thread
+            eResident,
+            eFailed,   // the loader couldn't load it
+        };
+
+        struct Level {
+            vk::Extent2D extent;
+            uint32_t pagesX, pagesY;
+            uint32_t firstPage;
+        };
+
+        struct Page {
+            VirtualPage page;
+            PageState state = PageState::eAbsent;
+            bool pinned = false; // part of the always resident levels
+            uint32_t slot = NO_SLOT;
+            uint32_t boundSlot = NO_SLOT; // sparse: the slot whose memory the page is bound to, which can outlast residency
+            uint64_t lastRequested = 0;
+        };
+
+        struct Slot {
+            uint32_t page = NO_PAGE;
+            uint32_t boundPage = NO_PAGE; // sparse: the page whose memory binding still points at this slot, unbound when the slot is reused
+            uint64_t freeAfter = 0;       // evicted slots can be reused once frames that may still sample them have finished
+        };
+
+        struct MappedBuffer {
+            vk::Buffer buffer;
+            vk::DeviceMemory memory;
+            std::byte *mapped = nullptr;
+            bool coherent = true;
+        };
+
+        struct FrameData {
+            MappedBuffer pageTable;
+            MappedBuffer feedback;
+            bool recorded = false;
+        };
+
+        // one page for the streaming thread, and back.
+        struct Upload {
+            uint32_t page;
+            uint32_t slot;
+            uint32_t unbindPage;  // sparse: bound to the slot before, or NO_PAGE
+            uint32_t staging;     // staging page index
+            bool loaded = false;
+            uint64_t bindValue = 0; // sparse: m_BindTimeline value that signals once the page is bound, 0 if it isn't bound yet
+        };
+
+        void createSparse();
+        void createAtlas();
+        void createLevels();
+        void createSlots(uint32_t slotCount);
+
+        static MappedBuffer createMappedBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, bool readback);
+        static void destroyMappedBuffer(MappedBuffer &buffer);
+
+        [[nodiscard]] vk::Extent2D pageExtent(const VirtualPage &page) const noexcept;
+        [[nodiscard]] uint32_t parentPage(uint32_t pageIndex) const noexcept; // NO_PAGE for the last level
+
+        void readFeedback(FrameData &frame);
+        RequestResult request(uint32_t pageIndex);
+        bool evict();
+        void completeUploads(const vk::CommandBuffer &cmd);
+        void bindPages(std::span<Upload *const> uploads);
+        void copyPage(const vk::CommandBuffer &cmd, const Upload &upload);
+
+        void streamLoop(const std::stop_token &stopToken);
+
+        VirtualTextureOptions m_Options;
+        Loader m_Loader;
+
+        bool m_Sparse = false;
+        bool m_BindOnStreamThread = false; // binds on the main queue stay on the render loop
+        uint32_t m_TexelSize;
+        vk::Extent2D m_PageExtent;
+        vk::Extent2D m_AtlasExtent{0, 0};
+        vk::DeviceSize m_SlotSize;        // bytes of device memory per slot
+        vk::DeviceSize m_StagingPageSize; // bytes per staging page
+        uint32_t m_MipTailFirstLod;       // mipLevels if there is no mip tail
+        uint32_t m_PinnedFirstMip;
+
+        vk::Image m_Image;
+        vk::ImageView m_ImageView;
+        vk::DeviceMemory m_Memory;         // the slots (sparse) or the atlas image
+        vk::DeviceMemory m_MipTailMemory;  // sparse only
+        vk::Semaphore m_BindTimeline;      // sparse only
+        uint64_t m_BindValue = 0;          // last value a bind was submitted with
+
+        std::vector<Level> m_Levels;
+        std::vector<Page> m_Pages;
+        std::vector<Slot> m_Slots;
+        std::vector<uint32_t> m_FreeSlots;
+        std::vector<uint32_t> m_RetiringSlots; // evicted, free after Slot::freeAfter
+        std::vector<uint32_t> m_PageTable; // what the next update() writes into the frame's page table
+        std::vector<uint32_t> m_Wanted;    // scratch, pages requested by the last feedback readback
+
+        FrameSet<FrameData> m_Frames;
+        FrameData *m_Current = nullptr;
+        uint64_t m_FrameNumber = 0;
+
+        MappedBuffer m_Staging;
+        std::vector<std::pair<uint32_t, uint64_t>> m_RetiringStaging; // staging page, frame number after which it is free
+
+        // shared with the streaming thread
+        std::mutex m_Mutex;
+        std::condition_variable_any m_Condition;
+        RingQueue<Upload> m_Requests{64};
+        std::vector<Upload> m_Finished;
+        std::vector<uint32_t> m_FreeStaging;
+
+        std::vector<Upload> m_Uploads;   // finished loading, waiting for their bind (render thread only)
+        std::vector<Upload *> m_Binding; // scratch
+
+        uint32_t m_ResidentPages = 0;
+        uint32_t m_MipTailPages = 0;
+        uint32_t m_PendingPages = 0;
+        uint64_t m_UploadedPages = 0;
+        uint64_t m_EvictedPages = 0;
+        uint64_t m_RejectedRequests = 0;
+
+        std::jthread m_StreamThread;
+    };
+
+} // namespace kat
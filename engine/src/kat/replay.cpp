@@ -0,0 +1,216 @@
+#include "replay.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+namespace kat::replay {
+    namespace {
+        std::atomic_bool s_Capturing = false;
+
+        std::mutex s_Mutex;
+        std::ofstream s_File;          // guarded by s_Mutex
+        std::vector<char> s_Frame;     // ops of the current frame, guarded by s_Mutex
+        uint64_t s_FrameIndex = 0;     // guarded by s_Mutex
+
+        // commands recorded on this thread since its last otc submit.
+        thread_local RecordedCommands t_Pending;
+
+        template<typename T>
+        void append(std::vector<char> &out, OpType type, const T &payload) {
+            const OpHeader header{type, {}, std::is_empty_v<T> ? 0U : static_cast<uint32_t>(sizeof(T))};
+            out.insert(out.end(), reinterpret_cast<const char *>(&header), reinterpret_cast<const char *>(&header) + sizeof(header));
+
+            if constexpr (!std::is_empty_v<T>) {
+                out.insert(out.end(), reinterpret_cast<const char *>(&payload), reinterpret_cast<const char *>(&payload) + sizeof(T));
+            }
+        }
+
+        // payloads may be shorter (older versions) or longer (newer versions) than the struct we know about.
+        template<typename T>
+        T parse(const std::vector<char> &payload) {
+            T value{};
+            if constexpr (!std::is_empty_v<T>) {
+                std::memcpy(&value, payload.data(), std::min(payload.size(), sizeof(T)));
+            }
+            return value;
+        }
+    } // namespace
+
+    bool beginCapture(const std::string &path, const std::string &deviceName) {
+        std::lock_guard lk(s_Mutex);
+
+        s_File = std::ofstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!s_File) {
+            spdlog::error("Failed to open replay capture {}", path);
+            return false;
+        }
+
+        FileHeader header{};
+        std::strncpy(header.deviceName, deviceName.c_str(), sizeof(header.deviceName) - 1);
+        s_File.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        s_Frame.clear();
+        s_FrameIndex = 0;
+        s_Capturing.store(true, std::memory_order_release);
+        return true;
+    }
+
+    void endCapture() {
+        std::lock_guard lk(s_Mutex);
+        if (!s_Capturing.load(std::memory_order_relaxed)) return;
+
+        s_Capturing.store(false, std::memory_order_release);
+
+        // the last frame is incomplete, readers drop it.
+        s_File.write(s_Frame.data(), static_cast<std::streamsize>(s_Frame.size()));
+        s_File.close();
+        s_Frame.clear();
+    }
+
+    bool isCapturing() noexcept {
+        return s_Capturing.load(std::memory_order_relaxed);
+    }
+
+    RecordedCommands takeRecordedCommands() {
+        return std::exchange(t_Pending, RecordedCommands{});
+    }
+
+    void appendRecordedCommands(const RecordedCommands &commands) {
+        if (!isCapturing()) return;
+
+        t_Pending.bytes.insert(t_Pending.bytes.end(), commands.bytes.begin(), commands.bytes.end());
+        t_Pending.count += commands.count;
+    }
+
+    void recordBarrier(uint32_t memoryBarriers, uint32_t bufferBarriers, uint32_t imageBarriers) {
+        if (!isCapturing()) return;
+
+        append(t_Pending.bytes, OpType::eBarrier, BarrierOp{memoryBarriers, bufferBarriers, imageBarriers});
+        t_Pending.count++;
+    }
+
+    void recordBeginRenderPass(uint32_t width, uint32_t height, uint32_t clearValues) {
+        if (!isCapturing()) return;
+
+        append(t_Pending.bytes, OpType::eBeginRenderPass, BeginRenderPassOp{width, height, clearValues});
+        t_Pending.count++;
+    }
+
+    void recordEndRenderPass() {
+        if (!isCapturing()) return;
+
+        append(t_Pending.bytes, OpType::eEndRenderPass, EndRenderPassOp{});
+        t_Pending.count++;
+    }
+
+    void recordSubmit(uint64_t recordNanoseconds, uint32_t waitSemaphores, uint32_t signalSemaphores, bool fence) {
+        if (!isCapturing()) {
+            t_Pending.bytes.clear();
+            t_Pending.count = 0;
+            return;
+        }
+
+        const SubmitOp op{recordNanoseconds, t_Pending.count, static_cast<uint8_t>(waitSemaphores), static_cast<uint8_t>(signalSemaphores), static_cast<uint8_t>(fence ? 1 : 0), 0};
+
+        {
+            std::lock_guard lk(s_Mutex);
+            if (s_Capturing.load(std::memory_order_relaxed)) {
+                append(s_Frame, OpType::eSubmit, op);
+                s_Frame.insert(s_Frame.end(), t_Pending.bytes.begin(), t_Pending.bytes.end());
+            }
+        }
+
+        t_Pending.bytes.clear(); // keeps its capacity
+        t_Pending.count = 0;
+    }
+
+    void recordPresent(uint64_t nanoseconds, uint32_t swapchains, int32_t result) {
+        if (!isCapturing()) return;
+
+        std::lock_guard lk(s_Mutex);
+        if (!s_Capturing.load(std::memory_order_relaxed)) return; // ended while we were waiting for the lock
+
+        append(s_Frame, OpType::ePresent, PresentOp{nanoseconds, swapchains, result});
+    }
+
+    void recordFrame(uint64_t nanoseconds) {
+        if (!isCapturing()) return;
+
+        std::lock_guard lk(s_Mutex);
+        if (!s_Capturing.load(std::memory_order_relaxed)) return;
+
+        append(s_Frame, OpType::eFrame, FrameOp{s_FrameIndex++, nanoseconds});
+
+        s_File.write(s_Frame.data(), static_cast<std::streamsize>(s_Frame.size()));
+        s_Frame.clear();
+    }
+
+    CaptureReader::CaptureReader(const std::string &path) : m_File(path, std::ios::in | std::ios::binary) {
+        if (!m_File) return;
+
+        if (!m_File.read(reinterpret_cast<char *>(&m_Header), sizeof(m_Header))) return;
+        if (std::memcmp(m_Header.magic, "KATR", 4) != 0) return;
+        if (m_Header.version > FORMAT_VERSION) return;
+
+        m_Valid = true;
+    }
+
+    bool CaptureReader::readOp(OpHeader &header, std::vector<char> &payload) {
+        if (!m_File.read(reinterpret_cast<char *>(&header), sizeof(header))) return false;
+
+        payload.resize(header.size);
+        return header.size == 0 || static_cast<bool>(m_File.read(payload.data(), header.size));
+    }
+
+    bool CaptureReader::next(Frame &frame) {
+        if (!m_Valid) return false;
+
+        frame.ops.clear();
+
+        OpHeader header{};
+        while (readOp(header, m_Payload)) {
+            switch (header.type) {
+                case OpType::eFrame:
+                    frame.op = parse<FrameOp>(m_Payload);
+                    return true;
+                case OpType::ePresent:
+                    frame.ops.emplace_back(parse<PresentOp>(m_Payload));
+                    break;
+                case OpType::eSubmit: {
+                    Submit submit{parse<SubmitOp>(m_Payload), {}};
+                    submit.commands.reserve(submit.op.commandCount);
+
+                    for (uint32_t i = 0; i < submit.op.commandCount; i++) {
+                        if (!readOp(header, m_Payload)) return false;
+
+                        switch (header.type) {
+                            case OpType::eBarrier:
+                                submit.commands.emplace_back(parse<BarrierOp>(m_Payload));
+                                break;
+                            case OpType::eBeginRenderPass:
+                                submit.commands.emplace_back(parse<BeginRenderPassOp>(m_Payload));
+                                break;
+                            case OpType::eEndRenderPass:
+                                submit.commands.emplace_back(EndRenderPassOp{});
+                                break;
+                            default:
+                                break; // unknown command, skipped
+                        }
+                    }
+
+                    frame.ops.emplace_back(std::move(submit));
+                    break;
+                }
+                default:
+                    break; // unknown op, skipped
+            }
+        }
+
+        return false; // end of file (an incomplete last frame is dropped)
+    }
+} // namespace kat::replay
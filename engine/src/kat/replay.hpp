@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace kat::replay {
+    /**
+     * Capture of the engine-level operations of every frame (otc submits and what was recorded into them, presents, frame boundaries),
+     * written to a compact binary file that can be replayed headless with katengine_replay.
+     *
+     * Commands recorded through CommandRecorder are grouped with the next otc submit made from the same thread.
+     * Only the shape of the work is kept (counts, extents, sync), not the resources it touched, so a replay reproduces the engine's
+     * overhead and roughly the gpu load of a frame, not its output.
+     *
+     * File layout: FileHeader, then a stream of (OpHeader, payload) records. Unknown op types can be skipped using OpHeader::size.
+     */
+
+    constexpr uint32_t FORMAT_VERSION = 1;
+
+    enum class OpType : uint8_t {
+        eFrame = 1,          // end of a frame
+        eSubmit = 2,         // followed by SubmitOp::commandCount command records
+        eBarrier = 3,        // command
+        eBeginRenderPass = 4, // command
+        eEndRenderPass = 5,  // command
+        ePresent = 6,
+    };
+
+    struct FileHeader {
+        char magic[4] = {'K', 'A', 'T', 'R'};
+        uint32_t version = FORMAT_VERSION;
+        char deviceName[256] = {};
+    };
+
+    struct OpHeader {
+        OpType type;
+        uint8_t reserved[3];
+        uint32_t size; // of the payload that follows
+    };
+
+    struct FrameOp {
+        uint64_t frame;
+        uint64_t nanoseconds; // wall time of the frame (start of one render loop cycle to the next)
+    };
+
+    struct SubmitOp {
+        uint64_t recordNanoseconds; // cpu time spent recording the command buffer
+        uint32_t commandCount;
+        uint8_t waitSemaphores;
+        uint8_t signalSemaphores;
+        uint8_t fence; // 1 if the submit signaled a fence
+        uint8_t reserved;
+    };
+
+    struct BarrierOp {
+        uint32_t memoryBarriers;
+        uint32_t bufferBarriers;
+        uint32_t imageBarriers;
+    };
+
+    struct BeginRenderPassOp {
+        uint32_t width, height;
+        uint32_t clearValues;
+    };
+
+    struct EndRenderPassOp {};
+
+    struct PresentOp {
+        uint64_t nanoseconds; // cpu time spent in the present call
+        uint32_t swapchains;  // 0 for engine-owned images
+        int32_t result;       // vk::Result
+    };
+
+    bool beginCapture(const std::string &path, const std::string &deviceName);
+    void endCapture();
+
+    [[nodiscard]] bool isCapturing() noexcept;
+
+    // commands recorded into a command buffer, kept by whoever submits that command buffer more than once (see StaticCommandCache).
+    struct RecordedCommands {
+        std::vector<char> bytes; // (OpHeader, payload) records
+        uint32_t count = 0;
+    };
+
+    // move the commands recorded on this thread since its last submit out, they won't be part of that submit anymore.
+    [[nodiscard]] RecordedCommands takeRecordedCommands();
+
+    // add commands taken earlier to the next submit made from this thread.
+    void appendRecordedCommands(const RecordedCommands &commands);
+
+    // hooks called by the engine. they do nothing unless a capture is running.
+    void recordBarrier(uint32_t memoryBarriers, uint32_t bufferBarriers, uint32_t imageBarriers);
+    void recordBeginRenderPass(uint32_t width, uint32_t height, uint32_t clearValues);
+    void recordEndRenderPass();
+    void recordSubmit(uint64_t recordNanoseconds, uint32_t waitSemaphores, uint32_t signalSemaphores, bool fence);
+    void recordPresent(uint64_t nanoseconds, uint32_t swapchains, int32_t result);
+    void recordFrame(uint64_t nanoseconds);
+
+    // ---- reading ----
+
+    using Command = std::variant<BarrierOp, BeginRenderPassOp, EndRenderPassOp>;
+
+    struct Submit {
+        SubmitOp op;
+        std::vector<Command> commands;
+    };
+
+    struct Frame {
+        FrameOp op;
+        std::vector<std::variant<Submit, PresentOp>> ops;
+    };
+
+    class CaptureReader {
+      public:
+        explicit CaptureReader(const std::string &path);
+
+        [[nodiscard]] inline bool isValid() const noexcept { return m_Valid; };
+
+        [[nodiscard]] inline const FileHeader &getHeader() const noexcept { return m_Header; };
+
+        // reads the next complete frame, returns false at the end of the file.
+        bool next(Frame &frame);
+
+      private:
+        bool readOp(OpHeader &header, std::vector<char> &payload);
+
+        std::ifstream m_File;
+        FileHeader m_Header;
+        bool m_Valid = false;
+        std::vector<char> m_Payload;
+    };
+} // namespace kat::replay
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace kat {
+
+    /**
+     * FIFO queue backed by a power-of-two ring buffer.
+     *
+     * Unlike std::queue (std::deque), pushing and popping never allocates once the queue has grown to its peak size,
+     * so it is safe to use on the frame loop. Not thread safe.
+     */
+    template<typename T>
+    class RingQueue {
+      public:
+        inline explicit RingQueue(size_t initialCapacity = 16) {
+            size_t capacity = 1;
+            while (capacity < initialCapacity) capacity <<= 1;
+            m_Storage.resize(capacity);
+        };
+
+        [[nodiscard]] inline bool empty() const noexcept { return m_Size == 0; };
+
+        [[nodiscard]] inline size_t size() const noexcept { return m_Size; };
+
+        [[nodiscard]] inline size_t capacity() const noexcept { return m_Storage.size(); };
+
+        inline void push(T value) {
+            if (m_Size == m_Storage.size()) grow();
+            m_Storage[(m_Head + m_Size) & (m_Storage.size() - 1)] = std::move(value);
+            m_Size++;
+        };
+
+        template<typename... Args>
+        inline void emplace(Args &&...args) {
+            push(T{std::forward<Args>(args)...});
+        };
+
+        [[nodiscard]] inline T &front() noexcept {
+            assert(m_Size > 0);
+            return m_Storage[m_Head];
+        };
+
+        // the i-th value from the front
+        [[nodiscard]] inline T &operator[](size_t i) noexcept {
+            assert(i < m_Size);
+            return m_Storage[(m_Head + i) & (m_Storage.size() - 1)];
+        };
+
+        inline T pop() {
+            assert(m_Size > 0);
+            T value = std::move(m_Storage[m_Head]);
+            m_Storage[m_Head] = T{}; // release whatever the moved-from value may still hold.
+            m_Head = (m_Head + 1) & (m_Storage.size() - 1);
+            m_Size--;
+            return value;
+        };
+
+      private:
+        inline void grow() {
+            std::vector<T> storage(m_Storage.size() * 2);
+            for (size_t i = 0; i < m_Size; i++) {
+                storage[i] = std::move(m_Storage[(m_Head + i) & (m_Storage.size() - 1)]);
+            }
+            m_Storage = std::move(storage);
+            m_Head = 0;
+        };
+
+        std::vector<T> m_Storage;
+        size_t m_Head = 0;
+        size_t m_Size = 0;
+    };
+
+} // namespace kat
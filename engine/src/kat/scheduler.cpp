@@ -0,0 +1,307 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+#include "kat/trace.hpp"
+
+namespace kat {
+    namespace {
+        constexpr uint64_t POLL_INTERVAL = 500'000; // ns between checks of awaited fences and otcs
+
+        // started right away and destroyed when done, for spawn() and whenAll().
+        struct Detached {
+            struct promise_type {
+                inline Detached get_return_object() const noexcept { return {}; };
+                [[nodiscard]] inline std::suspend_never initial_suspend() const noexcept { return {}; };
+                [[nodiscard]] inline std::suspend_never final_suspend() const noexcept { return {}; };
+                inline void return_void() const noexcept {};
+                inline void unhandled_exception() const noexcept { std::terminate(); }; // the bodies catch everything
+            };
+        };
+
+        struct Join {
+            std::atomic<size_t> remaining;
+            std::coroutine_handle<> continuation;
+            std::mutex mutex;
+            std::exception_ptr exception; // the first one, guarded by mutex
+        };
+
+        Detached joinOne(Scheduler &scheduler, Task<void> &task, Join &join) {
+            co_await scheduler.schedule();
+            try {
+                co_await task;
+            } catch (...) {
+                std::lock_guard lk(join.mutex);
+                if (!join.exception) join.exception = std::current_exception();
+            }
+
+            if (join.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) scheduler.resume(join.continuation);
+        }
+
+        // starts the tasks once the joining coroutine is suspended. remaining starts one higher, so the last task can't resume it before that.
+        struct JoinAwaiter {
+            Scheduler &scheduler;
+            std::vector<Task<void>> &tasks;
+            Join &join;
+
+            [[nodiscard]] inline bool await_ready() const noexcept { return false; };
+
+            inline bool await_suspend(std::coroutine_handle<> handle) const {
+                join.continuation = handle;
+                for (auto &task: tasks) joinOne(scheduler, task, join);
+                return join.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+            };
+
+            inline void await_resume() const noexcept {};
+        };
+    } // namespace
+
+    Scheduler::Scheduler(uint32_t threadCount) {
+        if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+
+        m_Wake = vku::createTimelineSemaphore();
+
+        m_Workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++) m_Workers.emplace_back([this]() { workerLoop(); });
+        m_WaitThread = std::thread([this]() { waitLoop(); });
+
+        spdlog::debug("Started scheduler with {} worker threads", threadCount);
+    }
+
+    Scheduler::~Scheduler() {
+        stopThreads();
+
+        size_t waits;
+        {
+            std::lock_guard lk(m_WaitMutex);
+            waits = m_TimelineWaits.size() + m_FenceWaits.size();
+        }
+        if (waits > 0 || m_Spawned > 0 || !m_Ready.empty()) {
+            spdlog::warn("Scheduler destroyed with {} coroutines waiting on the GPU, {} queued and {} spawned tasks unfinished", waits, m_Ready.size(), m_Spawned.load());
+        }
+
+        kat::destroy(m_Wake);
+    }
+
+    bool Scheduler::TimelineAwaiter::await_ready() const {
+        return vku::getSemaphoreValue(semaphore) >= value;
+    }
+
+    void Scheduler::TimelineAwaiter::await_suspend(std::coroutine_handle<> handle) const {
+        scheduler->addWait(TimelineWait{semaphore, value, handle});
+    }
+
+    bool Scheduler::FenceAwaiter::await_ready() const {
+        return vku::isFenceSignaled(fence);
+    }
+
+    void Scheduler::FenceAwaiter::await_suspend(std::coroutine_handle<> handle) const {
+        scheduler->addWait(FenceWait{fence, handle});
+    }
+
+    void Scheduler::resume(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard lk(m_Mutex);
+            m_Ready.push(handle);
+        }
+        m_Condition.notify_one();
+    }
+
+    void Scheduler::spawn(Task<void> task) {
+        m_Spawned.fetch_add(1, std::memory_order_relaxed);
+
+        [](Scheduler &scheduler, Task<void> task) -> Detached {
+            co_await scheduler.schedule();
+            try {
+                co_await task;
+            } catch (const std::exception &e) {
+                spdlog::error("Spawned task failed: {}", e.what());
+            } catch (...) {
+                spdlog::error("Spawned task failed");
+            }
+            scheduler.m_Spawned.fetch_sub(1, std::memory_order_relaxed);
+        }(*this, std::move(task));
+    }
+
+    Task<void> Scheduler::whenAll(std::vector<Task<void>> tasks) {
+        if (tasks.empty()) co_return;
+
+        Join join;
+        join.remaining = tasks.size() + 1;
+        co_await JoinAwaiter{*this, tasks, join};
+
+        if (join.exception) std::rethrow_exception(join.exception);
+    }
+
+    bool Scheduler::drain() {
+        stopThreads();
+
+        bool resumed = false;
+        while (true) {
+            collectSatisfied();
+
+            std::coroutine_handle<> handle;
+            {
+                std::lock_guard lk(m_Mutex);
+                if (m_Ready.empty()) break;
+                handle = m_Ready.pop();
+            }
+
+            handle.resume();
+            resumed = true;
+        }
+        return resumed;
+    }
+
+    void Scheduler::addWait(const TimelineWait &wait) {
+        std::lock_guard lk(m_WaitMutex);
+        m_TimelineWaits.push_back(wait);
+        wake();
+    }
+
+    void Scheduler::addWait(const FenceWait &wait) {
+        std::lock_guard lk(m_WaitMutex);
+        m_FenceWaits.push_back(wait);
+        wake();
+    }
+
+    void Scheduler::notifyPoll() {
+        std::lock_guard lk(m_WaitMutex);
+        wake();
+    }
+
+    void Scheduler::wake() {
+        globalState->device.signalSemaphore(vk::SemaphoreSignalInfo(m_Wake, ++m_WakeValue));
+    }
+
+    void Scheduler::collectSatisfied() {
+        m_Satisfied.clear();
+        {
+            std::lock_guard lk(m_WaitMutex);
+            std::erase_if(m_TimelineWaits, [this](const TimelineWait &wait) {
+                if (vku::getSemaphoreValue(wait.semaphore) < wait.value) return false;
+                m_Satisfied.push_back(wait.handle);
+                return true;
+            });
+            std::erase_if(m_FenceWaits, [this](const FenceWait &wait) {
+                if (!vku::isFenceSignaled(wait.fence)) return false;
+                m_Satisfied.push_back(wait.handle);
+                return true;
+            });
+        }
+
+        if (m_Satisfied.empty()) return;
+        {
+            std::lock_guard lk(m_Mutex);
+            for (const auto handle: m_Satisfied) m_Ready.push(handle);
+        }
+        m_Condition.notify_all();
+    }
+
+    void Scheduler::stopThreads() {
+        if (m_Stopping.exchange(true)) return;
+
+        {
+            std::lock_guard lk(m_WaitMutex);
+            wake();
+        }
+        {
+            std::lock_guard lk(m_Mutex); // so no worker misses the notification between checking m_Stopping and waiting
+        }
+        m_Condition.notify_all();
+
+        // workers finish whatever is queued first
+        for (auto &worker: m_Workers) worker.join();
+        m_WaitThread.join();
+    }
+
+    void Scheduler::workerLoop() {
+        trace::setThreadName("worker");
+
+        while (true) {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock lk(m_Mutex);
+                m_Condition.wait(lk, [this]() { return !m_Ready.empty() || m_Stopping.load(); });
+                if (m_Ready.empty()) return;
+                handle = m_Ready.pop();
+            }
+
+            handle.resume();
+        }
+    }
+
+    void Scheduler::waitLoop() {
+        trace::setThreadName("gpu waits");
+
+        std::vector<vk::Semaphore> semaphores;
+        std::vector<uint64_t> values;
+
+        while (!m_Stopping) {
+            bool poll;
+            {
+                std::lock_guard lk(m_WaitMutex);
+
+                // anything added after this wakes the wait below.
+                semaphores.assign(1, m_Wake);
+                values.assign(1, m_WakeValue + 1);
+                for (const auto &wait: m_TimelineWaits) {
+                    semaphores.push_back(wait.semaphore);
+                    values.push_back(wait.value);
+                }
+                poll = !m_FenceWaits.empty();
+            }
+            {
+                std::lock_guard lk(globalState->mutOTCL);
+                poll |= globalState->otclContinuations > 0;
+            }
+
+            // fences can't be waited on together with semaphores, so they are polled.
+            try {
+                KAT_TRACE_ZONE("waitSemaphores");
+                (void) globalState->device.waitSemaphores(vk::SemaphoreWaitInfo(vk::SemaphoreWaitFlagBits::eAny, semaphores, values), poll ? POLL_INTERVAL : UINT64_MAX);
+            } catch (const std::exception &e) {
+                spdlog::error("Scheduler stopped waiting on the GPU: {}", e.what());
+                return;
+            }
+
+            if (poll) otclc(); // resumes otc continuations
+            collectSatisfied();
+        }
+    }
+
+    bool AsyncMutex::LockAwaiter::await_ready() const {
+        std::lock_guard lk(mutex->m_Mutex);
+        if (mutex->m_Locked) return false;
+        mutex->m_Locked = true;
+        return true;
+    }
+
+    bool AsyncMutex::LockAwaiter::await_suspend(std::coroutine_handle<> handle) const {
+        std::lock_guard lk(mutex->m_Mutex);
+        if (!mutex->m_Locked) {
+            mutex->m_Locked = true;
+            return false;
+        }
+        mutex->m_Waiters.push(handle);
+        return true;
+    }
+
+    bool AsyncMutex::hasWaiters() {
+        std::lock_guard lk(m_Mutex);
+        return !m_Waiters.empty();
+    }
+
+    void AsyncMutex::unlock() {
+        std::coroutine_handle<> next;
+        {
+            std::lock_guard lk(m_Mutex);
+            if (m_Waiters.empty()) {
+                m_Locked = false;
+                return;
+            }
+            next = m_Waiters.pop(); // stays locked, ownership goes straight to the next waiter
+        }
+        m_Scheduler.resume(next);
+    }
+} // namespace kat
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "kat/engine.hpp"
+#include "kat/task.hpp"
+
+namespace kat {
+
+    namespace detail {
+        // runs a coroutine to completion for Scheduler::run(), wait() blocks until it has finished.
+        class BlockingTask {
+          public:
+            struct promise_type {
+                struct FinalAwaiter {
+                    [[nodiscard]] inline bool await_ready() const noexcept { return false; };
+                    inline void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept { handle.promise().done.release(); };
+                    inline void await_resume() const noexcept {};
+                };
+
+                inline BlockingTask get_return_object() noexcept { return BlockingTask(std::coroutine_handle<promise_type>::from_promise(*this)); };
+                [[nodiscard]] inline std::suspend_always initial_suspend() const noexcept { return {}; };
+                [[nodiscard]] inline FinalAwaiter final_suspend() const noexcept { return {}; };
+                inline void return_void() const noexcept {};
+                inline void unhandled_exception() const noexcept { std::terminate(); }; // the body catches everything
+
+                std::binary_semaphore done{0};
+            };
+
+            inline ~BlockingTask() {
+                if (m_Handle) m_Handle.destroy();
+            };
+
+            inline void wait() {
+                m_Handle.resume();
+                m_Handle.promise().done.acquire();
+            };
+
+            BlockingTask(const BlockingTask &) = delete;
+            BlockingTask &operator=(const BlockingTask &) = delete;
+
+          private:
+            inline explicit BlockingTask(std::coroutine_handle<promise_type> handle) noexcept : m_Handle(handle) {};
+
+            std::coroutine_handle<promise_type> m_Handle;
+        };
+    } // namespace detail
+
+    /**
+     * Resumes coroutines (see kat/task.hpp): on a pool of worker threads, or once GPU work has finished.
+     *
+     * The engine creates one at the end of startup (globalState->scheduler, see setSchedulerThreads()). A separate thread blocks on every awaited timeline
+     * semaphore at once (vkWaitSemaphores with eAny) and hands the coroutines whose values were reached to the workers, so nothing busy waits on the GPU;
+     * fences and otcs (which only have fences) are polled by that thread while they are awaited. Awaiting something that has already happened doesn't suspend.
+     *
+     * Workers run whatever they resume to its next suspension, so don't block in coroutines for long (a file read is fine, waiting on the GPU isn't).
+     */
+    class Scheduler {
+      public:
+        explicit Scheduler(uint32_t threadCount = 0); // 0 is one less than there are cores
+        ~Scheduler();                                 // coroutines that are still suspended are leaked (and logged)
+
+        struct ScheduleAwaiter {
+            Scheduler *scheduler;
+
+            [[nodiscard]] inline bool await_ready() const noexcept { return false; };
+            inline void await_suspend(std::coroutine_handle<> handle) const { scheduler->resume(handle); };
+            inline void await_resume() const noexcept {};
+        };
+
+        struct TimelineAwaiter {
+            Scheduler *scheduler;
+            vk::Semaphore semaphore;
+            uint64_t value;
+
+            [[nodiscard]] bool await_ready() const;
+            void await_suspend(std::coroutine_handle<> handle) const;
+            inline void await_resume() const noexcept {};
+        };
+
+        struct FenceAwaiter {
+            Scheduler *scheduler;
+            vk::Fence fence;
+
+            [[nodiscard]] bool await_ready() const;
+            void await_suspend(std::coroutine_handle<> handle) const;
+            inline void await_resume() const noexcept {};
+        };
+
+        // continue on a worker thread.
+        [[nodiscard]] inline ScheduleAwaiter schedule() noexcept { return ScheduleAwaiter{this}; };
+
+        // continue on a worker thread once a timeline semaphore has reached value (e.g. AsyncCompute or StagingRing submissions).
+        [[nodiscard]] inline TimelineAwaiter wait(vk::Semaphore timeline, uint64_t value) noexcept { return TimelineAwaiter{this, timeline, value}; };
+
+        // continue on a worker thread once a fence has signaled. the fence isn't reset.
+        [[nodiscard]] inline FenceAwaiter wait(vk::Fence fence) noexcept { return FenceAwaiter{this, fence}; };
+
+        // queue a suspended coroutine for the workers. thread safe.
+        void resume(std::coroutine_handle<> handle);
+
+        // run task on the workers without waiting for it. exceptions are logged.
+        void spawn(Task<void> task);
+
+        // run every task concurrently, finishes once all of them have. rethrows the first exception (after all of them have finished).
+        Task<void> whenAll(std::vector<Task<void>> tasks);
+
+        /**
+         * Run task on the workers and block the calling thread until it has finished, for code that isn't a coroutine itself.
+         * Never call this from a worker (or anything the task waits on).
+         */
+        template<typename T>
+        T run(Task<T> task);
+
+        /**
+         * Stop the threads (the first time), then resume everything that can be resumed on the calling thread: coroutines queued for the workers,
+         * and GPU waits that are already satisfied. Called during wrapup, with the device idle.
+         *
+         * @return Whether anything was resumed.
+         */
+        bool drain();
+
+        // wake the wait thread so it starts polling, after something it polls (an otc with a continuation) was added. thread safe.
+        void notifyPoll();
+
+        [[nodiscard]] inline uint32_t getThreadCount() const noexcept { return static_cast<uint32_t>(m_Workers.size()); };
+
+        // spawned tasks that haven't finished yet.
+        [[nodiscard]] inline uint32_t getSpawnedCount() const noexcept { return m_Spawned.load(std::memory_order_relaxed); };
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+      private:
+        struct TimelineWait {
+            vk::Semaphore semaphore;
+            uint64_t value;
+            std::coroutine_handle<> handle;
+        };
+
+        struct FenceWait {
+            vk::Fence fence;
+            std::coroutine_handle<> handle;
+        };
+
+        void addWait(const TimelineWait &wait);
+        void addWait(const FenceWait &wait);
+        void wake(); // with m_WaitMutex held
+        void collectSatisfied();
+        void stopThreads();
+
+        void workerLoop();
+        void waitLoop();
+
+        std::atomic_bool m_Stopping = false;
+
+        // coroutines ready to run
+        std::mutex m_Mutex;
+        std::condition_variable m_Condition;
+        RingQueue<std::coroutine_handle<>> m_Ready{256};
+        std::vector<std::thread> m_Workers;
+
+        // GPU waits
+        std::mutex m_WaitMutex;
+        std::vector<TimelineWait> m_TimelineWaits;
+        std::vector<FenceWait> m_FenceWaits;
+        vk::Semaphore m_Wake; // signaled from the host to wake the wait thread when a wait is added
+        uint64_t m_WakeValue = 0;
+        std::thread m_WaitThread;
+        std::vector<std::coroutine_handle<>> m_Satisfied; // scratch, wait thread (or drain()) only
+
+        std::atomic<uint32_t> m_Spawned = 0;
+    };
+
+    template<typename T>
+    T Scheduler::run(Task<T> task) {
+        using Result = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+        std::optional<Result> result;
+        std::exception_ptr exception;
+
+        auto blocking = [](Scheduler &scheduler, Task<T> &task, std::optional<Result> &result, std::exception_ptr &exception) -> detail::BlockingTask {
+            co_await scheduler.schedule();
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await task;
+                    result.emplace();
+                } else {
+                    result.emplace(co_await task);
+                }
+            } catch (...) {
+                exception = std::current_exception();
+            }
+        }(*this, task, result, exception);
+        blocking.wait();
+
+        if (exception) std::rethrow_exception(exception);
+        if constexpr (!std::is_void_v<T>) return std::move(*result);
+    }
+
+    /**
+     * A mutex for coroutines: lock() suspends instead of blocking the thread, and waiters are resumed on the scheduler, one at a time.
+     * For state that coroutines keep using across suspensions, or that takes long enough to be worth giving the thread to something else.
+     *
+     *     auto lock = co_await mutex.lock();
+     */
+    class AsyncMutex {
+      public:
+        class Lock {
+          public:
+            inline Lock(Lock &&other) noexcept : m_Mutex(std::exchange(other.m_Mutex, nullptr)) {};
+            inline Lock &operator=(Lock &&other) noexcept {
+                if (this != &other) {
+                    unlock();
+                    m_Mutex = std::exchange(other.m_Mutex, nullptr);
+                }
+                return *this;
+            };
+            inline ~Lock() { unlock(); };
+
+            inline void unlock() {
+                if (m_Mutex) std::exchange(m_Mutex, nullptr)->unlock();
+            };
+
+            Lock(const Lock &) = delete;
+            Lock &operator=(const Lock &) = delete;
+
+          private:
+            friend AsyncMutex;
+            inline explicit Lock(AsyncMutex *mutex) noexcept : m_Mutex(mutex) {};
+
+            AsyncMutex *m_Mutex;
+        };
+
+        struct LockAwaiter {
+            AsyncMutex *mutex;
+
+            [[nodiscard]] bool await_ready() const;
+            bool await_suspend(std::coroutine_handle<> handle) const;
+            [[nodiscard]] inline Lock await_resume() const noexcept { return Lock(mutex); };
+        };
+
+        explicit AsyncMutex(Scheduler &scheduler) : m_Scheduler(scheduler) {};
+
+        [[nodiscard]] inline LockAwaiter lock() noexcept { return LockAwaiter{this}; };
+
+        // whether coroutines are waiting for the lock, so the holder can tell if it is the last one for now.
+        [[nodiscard]] bool hasWaiters();
+
+        AsyncMutex(const AsyncMutex &) = delete;
+        AsyncMutex &operator=(const AsyncMutex &) = delete;
+
+      private:
+        void unlock();
+
+        Scheduler &m_Scheduler;
+        std::mutex m_Mutex;
+        bool m_Locked = false;
+        RingQueue<std::coroutine_handle<>> m_Waiters{16};
+    };
+
+    namespace vku {
+        struct OTCAwaiter {
+            RecordFunction record;
+            OTCSync sync;
+
+            [[nodiscard]] inline bool await_ready() const noexcept { return false; };
+            inline void await_suspend(std::coroutine_handle<> handle) const { otc(record, handle, sync); };
+            inline void await_resume() const noexcept {};
+        };
+
+        /**
+         * otc, continuing on globalState->scheduler once the command buffer has finished.
+         *
+         *     co_await vku::otcAsync([&](const vk::CommandBuffer &cmd) { ... });
+         */
+        [[nodiscard]] inline OTCAwaiter otcAsync(const RecordFunction &f, OTCSync sync = {}) { return OTCAwaiter{f, sync}; }
+    } // namespace vku
+
+} // namespace kat
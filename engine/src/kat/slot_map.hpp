@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace kat {
+
+    /**
+     * Stable handle into a SlotMap.
+     *
+     * The generation is bumped every time a slot is reused, so handles to erased values never alias newer ones.
+     */
+    struct SlotHandle {
+        uint32_t index = std::numeric_limits<uint32_t>::max();
+        uint32_t generation = 0;
+
+        [[nodiscard]] inline bool valid() const noexcept { return index != std::numeric_limits<uint32_t>::max(); };
+
+        inline bool operator==(const SlotHandle &) const noexcept = default;
+    };
+
+    /**
+     * Generation-indexed slot map.
+     *
+     * Values are kept densely packed (erasing swaps the last value into the hole), so iterating is a linear walk over a vector.
+     * Handles stay valid across insertions and erasures of other values. Not thread safe.
+     */
+    template<typename T>
+    class SlotMap {
+        struct Slot {
+            uint32_t denseIndex;
+            uint32_t generation;
+        };
+
+      public:
+        using iterator = typename std::vector<T>::iterator;
+        using const_iterator = typename std::vector<T>::const_iterator;
+
+        inline SlotMap() = default;
+
+        SlotHandle insert(T value) {
+            uint32_t slotIndex;
+            if (!m_FreeSlots.empty()) {
+                slotIndex = m_FreeSlots.back();
+                m_FreeSlots.pop_back();
+            } else {
+                slotIndex = static_cast<uint32_t>(m_Slots.size());
+                m_Slots.push_back(Slot{0, 0});
+            }
+
+            Slot &slot = m_Slots[slotIndex];
+            slot.denseIndex = static_cast<uint32_t>(m_Values.size());
+
+            m_Values.push_back(std::move(value));
+            m_DenseToSlot.push_back(slotIndex);
+
+            return SlotHandle{slotIndex, slot.generation};
+        };
+
+        // returns false if the handle was stale (already erased or never valid)
+        bool erase(const SlotHandle &handle) {
+            if (!contains(handle)) return false;
+
+            Slot &slot = m_Slots[handle.index];
+            const uint32_t hole = slot.denseIndex;
+            const uint32_t last = static_cast<uint32_t>(m_Values.size() - 1);
+
+            if (hole != last) {
+                m_Values[hole] = std::move(m_Values[last]);
+                m_DenseToSlot[hole] = m_DenseToSlot[last];
+                m_Slots[m_DenseToSlot[hole]].denseIndex = hole;
+            }
+
+            m_Values.pop_back();
+            m_DenseToSlot.pop_back();
+
+            slot.generation++;
+            m_FreeSlots.push_back(handle.index);
+            return true;
+        };
+
+        [[nodiscard]] inline bool contains(const SlotHandle &handle) const noexcept {
+            return handle.index < m_Slots.size() && m_Slots[handle.index].generation == handle.generation && m_Slots[handle.index].denseIndex < m_Values.size() && m_DenseToSlot[m_Slots[handle.index].denseIndex] == handle.index;
+        };
+
+        [[nodiscard]] inline T *get(const SlotHandle &handle) noexcept {
+            return contains(handle) ? &m_Values[m_Slots[handle.index].denseIndex] : nullptr;
+        };
+
+        [[nodiscard]] inline const T *get(const SlotHandle &handle) const noexcept {
+            return contains(handle) ? &m_Values[m_Slots[handle.index].denseIndex] : nullptr;
+        };
+
+        // handle of the value at a dense index (the position it is visited in when iterating)
+        [[nodiscard]] inline SlotHandle handleAt(size_t denseIndex) const noexcept {
+            assert(denseIndex < m_Values.size());
+            const uint32_t slotIndex = m_DenseToSlot[denseIndex];
+            return SlotHandle{slotIndex, m_Slots[slotIndex].generation};
+        };
+
+        [[nodiscard]] inline size_t size() const noexcept { return m_Values.size(); };
+
+        [[nodiscard]] inline bool empty() const noexcept { return m_Values.empty(); };
+
+        inline void clear() {
+            for (size_t i = m_Values.size(); i > 0; i--) {
+                erase(handleAt(i - 1));
+            }
+        };
+
+        inline iterator begin() noexcept { return m_Values.begin(); };
+
+        inline iterator end() noexcept { return m_Values.end(); };
+
+        inline const_iterator begin() const noexcept { return m_Values.begin(); };
+
+        inline const_iterator end() const noexcept { return m_Values.end(); };
+
+      private:
+        std::vector<T> m_Values;
+        std::vector<uint32_t> m_DenseToSlot;
+        std::vector<Slot> m_Slots;
+        std::vector<uint32_t> m_FreeSlots;
+    };
+
+} // namespace kat
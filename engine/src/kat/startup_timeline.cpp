@@ -0,0 +1,88 @@
+#include "startup_timeline.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "kat/trace.hpp"
+
+namespace kat {
+    namespace {
+        double toMilliseconds(std::chrono::nanoseconds duration) {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        }
+    } // namespace
+
+    StartupTimeline::StartupTimeline() : m_Start(Clock::now()), m_Finish(m_Start) {
+        m_Threads.push_back(std::this_thread::get_id());
+    }
+
+    void StartupTimeline::record(const char *name, Clock::time_point begin, Clock::time_point end) {
+#if KATENGINE_TRACING
+        if (trace::isEnabled()) {
+            // the tracer has its own epoch, line the step up with it from the current time.
+            const auto now = Clock::now();
+            const uint64_t traceNow = trace::now();
+            const auto toTrace = [&](Clock::time_point t) { return traceNow - static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - t).count()); };
+            trace::record(name, toTrace(begin), toTrace(end));
+        }
+#endif
+
+        std::lock_guard lk(m_Mutex);
+        m_Steps.push_back(StartupStep{name, begin - m_Start, end - m_Start, threadIndex(std::this_thread::get_id())});
+    }
+
+    void StartupTimeline::finish() {
+        std::lock_guard lk(m_Mutex);
+        m_Finish = Clock::now();
+    }
+
+    std::vector<StartupStep> StartupTimeline::getSteps() const {
+        std::vector<StartupStep> steps;
+        {
+            std::lock_guard lk(m_Mutex);
+            steps = m_Steps;
+        }
+
+        std::ranges::sort(steps, [](const auto &a, const auto &b) { return a.begin < b.begin; });
+        return steps;
+    }
+
+    std::chrono::nanoseconds StartupTimeline::getTotal() const {
+        std::lock_guard lk(m_Mutex);
+        return m_Finish - m_Start;
+    }
+
+    void StartupTimeline::log(spdlog::logger &logger) const {
+        logger.info("Startup took {:.1f} ms", toMilliseconds(getTotal()));
+        for (const auto &step: getSteps()) {
+            logger.info("  [{}] {:>8.1f} ms +{:>7.1f} ms  {}", step.thread, toMilliseconds(step.begin), toMilliseconds(step.end - step.begin), step.name);
+        }
+    }
+
+    bool StartupTimeline::append(const std::string &path) const {
+        std::ofstream out(path, std::ios::out | std::ios::app);
+        if (!out) return false;
+
+        const auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        out << "{\"timestamp\":" << timestamp << ",\"startup\":{\"total\":" << toMilliseconds(getTotal()) << ",\"steps\":[";
+
+        bool first = true;
+        for (const auto &step: getSteps()) {
+            if (!first) out << ",";
+            first = false;
+            out << "{\"name\":\"" << step.name << "\",\"thread\":" << step.thread << ",\"begin\":" << toMilliseconds(step.begin) << ",\"duration\":" << toMilliseconds(step.end - step.begin) << "}";
+        }
+
+        out << "]}}\n";
+        return static_cast<bool>(out);
+    }
+
+    uint32_t StartupTimeline::threadIndex(std::thread::id id) {
+        const auto it = std::ranges::find(m_Threads, id);
+        if (it != m_Threads.end()) return static_cast<uint32_t>(it - m_Threads.begin());
+
+        m_Threads.push_back(id);
+        return static_cast<uint32_t>(m_Threads.size() - 1);
+    }
+} // namespace kat
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+namespace kat {
+
+    struct StartupStep {
+        const char *name;
+        std::chrono::nanoseconds begin; // since the timeline started
+        std::chrono::nanoseconds end;
+        uint32_t thread; // 0 is the thread that started the timeline, the others are numbered in the order they first recorded a step
+    };
+
+    /**
+     * Records when each step of engine startup ran, and on which thread, so cold start regressions (and steps that stopped overlapping) show up.
+     *
+     * The timeline starts with init() and ends with startup(). It is logged at the end of startup, appended to the metrics export file if there is one,
+     * and steps also show up in the cpu trace (see kat/trace.hpp). Thread safe.
+     */
+    class StartupTimeline {
+      public:
+        using Clock = std::chrono::steady_clock;
+
+        class Scope {
+          public:
+            inline Scope(StartupTimeline &timeline, const char *name) : m_Timeline(timeline), m_Name(name), m_Begin(Clock::now()) {};
+
+            inline ~Scope() { m_Timeline.record(m_Name, m_Begin, Clock::now()); };
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+          private:
+            StartupTimeline &m_Timeline;
+            const char *m_Name;
+            Clock::time_point m_Begin;
+        };
+
+        StartupTimeline();
+
+        // times everything until the returned scope is destroyed. name must outlive the timeline (use a string literal).
+        [[nodiscard]] inline Scope step(const char *name) { return {*this, name}; };
+
+        void record(const char *name, Clock::time_point begin, Clock::time_point end);
+
+        // marks the end of startup, getTotal() is measured up to here.
+        void finish();
+
+        [[nodiscard]] std::vector<StartupStep> getSteps() const;
+
+        [[nodiscard]] std::chrono::nanoseconds getTotal() const;
+
+        void log(spdlog::logger &logger) const;
+
+        // appends one JSON object (JSON lines), returns false if the file couldn't be written.
+        bool append(const std::string &path) const;
+
+      private:
+        uint32_t threadIndex(std::thread::id id); // caller holds m_Mutex
+
+        Clock::time_point m_Start;
+        Clock::time_point m_Finish;
+
+        mutable std::mutex m_Mutex;
+        std::vector<StartupStep> m_Steps;
+        std::vector<std::thread::id> m_Threads;
+    };
+
+} // namespace kat
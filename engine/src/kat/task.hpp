@@ -0,0 +1,135 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace kat {
+
+    template<typename T = void>
+    class Task;
+
+    namespace detail {
+        struct TaskPromiseBase {
+            // resumed when the task finishes, by symmetric transfer so long chains of awaits don't grow the stack.
+            struct FinalAwaiter {
+                [[nodiscard]] inline bool await_ready() const noexcept { return false; };
+
+                template<typename P>
+                inline std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+                    const auto continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                };
+
+                inline void await_resume() const noexcept {};
+            };
+
+            [[nodiscard]] inline std::suspend_always initial_suspend() const noexcept { return {}; };
+            [[nodiscard]] inline FinalAwaiter final_suspend() const noexcept { return {}; };
+
+            inline void unhandled_exception() noexcept { exception = std::current_exception(); };
+
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+        };
+
+        template<typename T>
+        struct TaskPromise : TaskPromiseBase {
+            inline Task<T> get_return_object() noexcept;
+
+            template<typename U>
+            inline void return_value(U &&v) { value.emplace(std::forward<U>(v)); };
+
+            inline T result() {
+                if (exception) std::rethrow_exception(exception);
+                return std::move(*value);
+            };
+
+            std::optional<T> value;
+        };
+
+        template<>
+        struct TaskPromise<void> : TaskPromiseBase {
+            inline Task<void> get_return_object() noexcept;
+
+            inline void return_void() const noexcept {};
+
+            inline void result() const {
+                if (exception) std::rethrow_exception(exception);
+            };
+        };
+    } // namespace detail
+
+    /**
+     * A lazily started coroutine: nothing runs until it is co_awaited, and the awaiting coroutine continues on whichever thread the task finishes on.
+     *
+     * Exceptions propagate to the awaiter. Hop threads with the Scheduler's awaitables (kat/scheduler.hpp), and start tasks from outside a coroutine with
+     * Scheduler::spawn() or Scheduler::run(). Destroying a task that was never awaited destroys the coroutine without running it.
+     */
+    template<typename T>
+    class Task {
+      public:
+        using promise_type = detail::TaskPromise<T>;
+
+        inline Task() noexcept = default;
+
+        inline Task(Task &&other) noexcept : m_Handle(std::exchange(other.m_Handle, {})) {};
+
+        inline Task &operator=(Task &&other) noexcept {
+            if (this != &other) {
+                if (m_Handle) m_Handle.destroy();
+                m_Handle = std::exchange(other.m_Handle, {});
+            }
+            return *this;
+        };
+
+        inline ~Task() {
+            if (m_Handle) m_Handle.destroy();
+        };
+
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            [[nodiscard]] inline bool await_ready() const noexcept { return handle.done(); };
+
+            inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            };
+
+            inline T await_resume() { return handle.promise().result(); };
+        };
+
+        // throws std::runtime_error for an empty (default constructed or moved from) task, there is nothing to resume or return.
+        inline Awaiter operator co_await() const {
+            if (!m_Handle) throw std::runtime_error("Awaited an empty task");
+            return Awaiter{m_Handle};
+        };
+
+        [[nodiscard]] inline bool isDone() const noexcept { return !m_Handle || m_Handle.done(); };
+
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+
+      private:
+        friend promise_type;
+
+        inline explicit Task(std::coroutine_handle<promise_type> handle) noexcept : m_Handle(handle) {};
+
+        std::coroutine_handle<promise_type> m_Handle;
+    };
+
+    namespace detail {
+        template<typename T>
+        inline Task<T> TaskPromise<T>::get_return_object() noexcept {
+            return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+        }
+
+        inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+            return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+        }
+    } // namespace detail
+
+} // namespace kat
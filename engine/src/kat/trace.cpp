@@ -0,0 +1,136 @@
+#include "trace.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kat::trace {
+    namespace {
+        // fields are relaxed atomics so the exporter can read buffers that are still being written to.
+        struct Event {
+            std::atomic<const char *> name;
+            std::atomic<uint64_t> begin;
+            std::atomic<uint64_t> end;
+        };
+
+        struct ThreadBuffer {
+            std::array<Event, THREAD_BUFFER_SIZE> events;
+            std::atomic<uint64_t> head = 0; // total number of events ever written
+            std::atomic<const char *> name = nullptr;
+            uint32_t tid;
+        };
+
+        const std::chrono::steady_clock::time_point s_Epoch = std::chrono::steady_clock::now();
+        std::atomic_bool s_Enabled = true;
+
+        // buffers are never freed (threads come and go, but their events should still be exported).
+        std::mutex s_RegistryMutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> s_Registry;
+
+        ThreadBuffer *threadBuffer() {
+            thread_local ThreadBuffer *buffer = [] {
+                std::lock_guard lk(s_RegistryMutex);
+                auto &b = s_Registry.emplace_back(std::make_unique<ThreadBuffer>());
+                b->tid = static_cast<uint32_t>(s_Registry.size());
+                return b.get();
+            }();
+            return buffer;
+        }
+
+        void writeEscaped(std::ostream &out, const char *s) {
+            for (; *s; s++) {
+                switch (*s) {
+                    case '"':
+                        out << "\\\"";
+                        break;
+                    case '\\':
+                        out << "\\\\";
+                        break;
+                    default:
+                        if (static_cast<unsigned char>(*s) >= 0x20) out << *s;
+                        break;
+                }
+            }
+        }
+    } // namespace
+
+    void setEnabled(bool enabled) noexcept {
+        s_Enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool isEnabled() noexcept {
+        return s_Enabled.load(std::memory_order_relaxed);
+    }
+
+    uint64_t now() noexcept {
+        // + 1 so that 0 can mean "not recording" in Zone.
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_Epoch).count()) + 1;
+    }
+
+    void record(const char *name, uint64_t begin, uint64_t end) noexcept {
+        ThreadBuffer *buffer = threadBuffer();
+
+        const uint64_t index = buffer->head.load(std::memory_order_relaxed);
+        Event &e = buffer->events[index & (THREAD_BUFFER_SIZE - 1)];
+        e.name.store(name, std::memory_order_relaxed);
+        e.begin.store(begin, std::memory_order_relaxed);
+        e.end.store(end, std::memory_order_relaxed);
+
+        buffer->head.store(index + 1, std::memory_order_release);
+    }
+
+    void setThreadName(const char *name) {
+        threadBuffer()->name.store(name, std::memory_order_relaxed);
+    }
+
+    bool writeChromeTrace(const std::string &path) {
+        std::ofstream out(path, std::ios::out | std::ios::trunc);
+        if (!out) {
+            spdlog::error("Failed to open trace output {}", path);
+            return false;
+        }
+
+        out << std::fixed << std::setprecision(3); // timestamps are in microseconds, keep nanosecond precision
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+
+        std::lock_guard lk(s_RegistryMutex);
+        for (const auto &buffer: s_Registry) {
+            if (const char *name = buffer->name.load(std::memory_order_relaxed)) {
+                out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"";
+                writeEscaped(out, name);
+                out << "\"}}";
+                first = false;
+            }
+
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            const uint64_t start = head > THREAD_BUFFER_SIZE ? head - THREAD_BUFFER_SIZE : 0;
+
+            for (uint64_t i = start; i < head; i++) {
+                const Event &e = buffer->events[i & (THREAD_BUFFER_SIZE - 1)];
+                const char *name = e.name.load(std::memory_order_relaxed);
+                const uint64_t begin = e.begin.load(std::memory_order_relaxed);
+                const uint64_t end = e.end.load(std::memory_order_relaxed);
+
+                // the writer may have lapped us (or be writing this slot right now) while we were reading it.
+                if (buffer->head.load(std::memory_order_acquire) - i >= THREAD_BUFFER_SIZE) continue;
+                if (!name) continue;
+
+                out << (first ? "" : ",") << "\n{\"name\":\"";
+                writeEscaped(out, name);
+                out << "\",\"cat\":\"kat\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                    << ",\"ts\":" << static_cast<double>(begin) / 1000.0
+                    << ",\"dur\":" << static_cast<double>(end - begin) / 1000.0 << "}";
+                first = false;
+            }
+        }
+
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+} // namespace kat::trace
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "kat/engine.hpp"
+
+namespace kat::trace {
+    /**
+     * Low overhead cpu zone tracer.
+     *
+     * Every thread records into its own fixed-size ring buffer (lock free, old events are overwritten), and writeChromeTrace() exports
+     * whatever is in the buffers as Chrome trace event JSON, which chrome://tracing and ui.perfetto.dev can both open.
+     *
+     * Zones are compiled out unless KATENGINE_TRACING is enabled (by default only in debug builds, define KATENGINE_TRACING=1 to trace release builds).
+     */
+
+    constexpr size_t THREAD_BUFFER_SIZE = 1 << 14; // events per thread, power of two
+
+    void setEnabled(bool enabled) noexcept;
+    [[nodiscard]] bool isEnabled() noexcept;
+
+    // nanoseconds since the tracer was initialized
+    [[nodiscard]] uint64_t now() noexcept;
+
+    void record(const char *name, uint64_t begin, uint64_t end) noexcept;
+
+    // name shown for the calling thread in the trace viewer, must outlive the tracer (use a string literal).
+    void setThreadName(const char *name);
+
+    /**
+     * Write every buffered event to a Chrome trace event JSON file.
+     *
+     * Can be called while other threads are still tracing, events that get overwritten while exporting are left out.
+     */
+    bool writeChromeTrace(const std::string &path);
+
+    class Zone {
+      public:
+        inline explicit Zone(const char *name) noexcept : m_Name(name), m_Begin(isEnabled() ? now() : 0) {};
+
+        inline ~Zone() {
+            if (m_Begin != 0) record(m_Name, m_Begin, now());
+        };
+
+        Zone(const Zone &) = delete;
+        Zone &operator=(const Zone &) = delete;
+
+      private:
+        const char *m_Name;
+        uint64_t m_Begin;
+    };
+} // namespace kat::trace
+
+#define KAT_TRACE_CONCAT_(a, b) a##b
+#define KAT_TRACE_CONCAT(a, b) KAT_TRACE_CONCAT_(a, b)
+
+#if KATENGINE_TRACING
+#define KAT_TRACE_ZONE(name) ::kat::trace::Zone KAT_TRACE_CONCAT(katTraceZone_, __LINE__)(name)
+#else
+#define KAT_TRACE_ZONE(name) ((void) 0)
+#endif
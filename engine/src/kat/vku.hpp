@@ -60,5 +60,14 @@ namespace kat::vku {
 
             return {dependencyFlags, static_cast<uint32_t>(memoryBarriers.size()), mbs, static_cast<uint32_t>(bufferMemoryBarriers.size()), bmbs, static_cast<uint32_t>(imageMemoryBarriers.size()), imbs};
         };
+
+        // union of the destination stages of every barrier.
+        [[nodiscard]] inline vk::PipelineStageFlags2 destinationStages() const noexcept {
+            vk::PipelineStageFlags2 stages{};
+            for (const auto &b: memoryBarriers) stages |= b.destination.stageMask;
+            for (const auto &b: bufferMemoryBarriers) stages |= b.destination.stageMask;
+            for (const auto &b: imageMemoryBarriers) stages |= b.destination.stageMask;
+            return stages;
+        };
     };
 } // namespace kat::vku
\ No newline at end of file
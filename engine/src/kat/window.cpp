@@ -1,5 +1,7 @@
 #include "window.hpp"
 #include "kat/engine.hpp"
+#include "kat/replay.hpp"
+#include "kat/trace.hpp"
 
 namespace kat {
     FrameSyncResources::FrameSyncResources() {
@@ -9,10 +11,9 @@ namespace kat {
     }
 
     FrameSyncResources::~FrameSyncResources() {
-        vku::waitFence(inFlightFence);
-        kat::destroy(inFlightFence);
-        kat::destroy(imageAvailableSemaphore);
-        kat::destroy(renderFinishedSemaphore);
+        kat::deferDestroyOTCFence(inFlightFence); // otcs of the window handler use it (see BaseWindowHandler::onRender)
+        kat::deferDestroy(imageAvailableSemaphore);
+        kat::deferDestroy(renderFinishedSemaphore);
     }
 
     vk::PresentModeKHR selectPresentMode(const std::vector<vk::PresentModeKHR> &presentModes, bool vsync) {
@@ -55,89 +56,211 @@ namespace kat {
         return surfaceFormats[0];
     }
 
-    Window::Window(const std::string &title, const vk::Extent2D &size, const WindowOptions &options, size_t id) : m_Id(id), m_EnableVsync(options.vsync) {
+    bool Window::wantsNativeWindow(const WindowOptions &options) {
+        return !(options.headless || globalState->headless || !globalState->glfwAvailable);
+    }
+
+    Window::NativeWindow Window::openNativeWindow(const std::string &title, const vk::Extent2D &size, const WindowOptions &options) {
         glfwDefaultWindowHints();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, options.resizable);
 
-        m_Window = glfwCreateWindow(size.width, size.height, title.c_str(), nullptr, nullptr);
-        glfwSetWindowUserPointer(m_Window, this);
+        NativeWindow native;
+        native.window = glfwCreateWindow(size.width, size.height, title.c_str(), nullptr, nullptr);
+        if (!native.window) throw std::runtime_error("Failed to create window " + title);
 
         VkSurfaceKHR s;
-        glfwCreateWindowSurface(globalState->instance, m_Window, nullptr, &s);
-        m_Surface = s;
+        if (glfwCreateWindowSurface(globalState->instance, native.window, nullptr, &s) != VK_SUCCESS) {
+            glfwDestroyWindow(native.window);
+            throw std::runtime_error("Failed to create a surface for window " + title);
+        }
+        native.surface = s;
+        return native;
+    }
 
-        globalState->activeWindowCount++;
+    Window::Window(const std::string &title, const vk::Extent2D &size, const WindowOptions &options, NativeWindow native) : m_EnableVsync(options.vsync), m_RequestedExtent(size) {
+        m_Headless = !wantsNativeWindow(options);
 
-        glfwSetWindowCloseCallback(m_Window, +[](GLFWwindow *window_) {
-            auto* window = static_cast<Window *>(glfwGetWindowUserPointer(window_));
+        if (!m_Headless) {
+            if (!native.window) native = openNativeWindow(title, size, options);
 
-            // TODO: cancelable on close event.
+            m_Window = native.window;
+            m_Surface = native.surface;
+            glfwSetWindowUserPointer(m_Window, this);
 
-            // following code should only be run if window should actually be closed
-            kat::Window::destroy(window->m_Id); });
+            glfwSetWindowCloseCallback(m_Window, +[](GLFWwindow *window_) {
+                auto* window = static_cast<Window *>(glfwGetWindowUserPointer(window_));
 
-        auto formats = globalState->physicalDevice.getSurfaceFormatsKHR(m_Surface);
-        auto presentModes = globalState->physicalDevice.getSurfacePresentModesKHR(m_Surface);
+                // TODO: cancelable on close event.
 
-        m_SwapchainFormat = selectSurfaceFormat(formats);
-        m_PresentMode = selectPresentMode(presentModes, m_EnableVsync);
+                // following code should only be run if window should actually be closed
+                kat::Window::destroy(window->m_Id); });
+        } else if (globalState->headlessSurfaceSupported && globalState->capabilities.swapchain && options.useHeadlessSurface) {
+            m_Surface = globalState->instance.createHeadlessSurfaceEXT(vk::HeadlessSurfaceCreateInfoEXT());
 
-        spdlog::info("Present Mode: {}", vk::to_string(m_PresentMode));
+            if (!globalState->physicalDevice.getSurfaceSupportKHR(globalState->mainFamily, m_Surface)) {
+                spdlog::warn("Main queue family can't present to headless surfaces, falling back to engine-owned images");
+                kat::destroy(m_Surface);
+                m_Surface = nullptr;
+            }
+        }
+
+        globalState->activeWindowCount++;
 
-        recreateSwapchain();
+        if (m_Surface) {
+            auto formats = globalState->physicalDevice.getSurfaceFormatsKHR(m_Surface);
+            auto presentModes = globalState->physicalDevice.getSurfacePresentModesKHR(m_Surface);
+
+            m_SwapchainFormat = selectSurfaceFormat(formats);
+            m_PresentMode = selectPresentMode(presentModes, m_EnableVsync);
+
+            spdlog::info("Present Mode: {}", vk::to_string(m_PresentMode));
+
+            recreateSwapchain();
+        } else {
+            spdlog::info("Window \"{}\" is headless, rendering into engine-owned images", title);
+            createOffscreenImages(options.headlessFormat);
+        }
 
         m_WindowHandler = std::make_shared<kat::BaseWindowHandler>(); // default window handler impl
     }
 
     Window::~Window() {
         globalState->activeWindowCount--;
-        // in case this somehow happens earlier than it should;
-        globalState->activeWindows.erase(m_Id);
 
+        // frames that are still rendering keep using these, so everything goes through deferred destruction instead of waiting on them.
         for (const auto &iv: m_ImageViews) {
-            kat::destroy(iv);
+            kat::deferDestroy(iv);
+        }
+
+        if (!m_Swapchain) {
+            // engine-owned images
+            for (const auto &image: m_Images) {
+                kat::deferDestroy(image);
+            }
+
+            for (const auto &memory: m_ImageMemory) {
+                vku::deferFreeMemory(memory);
+            }
         }
 
-        kat::destroy(m_Swapchain);
+        // queued in this order, so the swapchain is gone before its surface.
+        kat::deferDestroy(m_Swapchain);
+        kat::deferDestroy(m_Surface);
+
+        if (m_Window) {
+            // the surface still needs the native window, it is handed back to the event loop once the surface has been destroyed.
+            glfwSetWindowCloseCallback(m_Window, nullptr);
+            glfwSetWindowUserPointer(m_Window, nullptr);
+            glfwHideWindow(m_Window);
 
+            enqueueDeferredDestroy(DeferredDestroy{reinterpret_cast<uintptr_t>(m_Window), 0, +[](uint64_t handle, uint64_t) {
+                std::lock_guard lk(globalState->mutRetiredNativeWindows);
+                globalState->retiredNativeWindows.push_back(reinterpret_cast<GLFWwindow *>(static_cast<uintptr_t>(handle)));
+            }});
+        }
+    }
 
-        kat::destroy(m_Surface);
+    void Window::createOffscreenImages(vk::Format format) {
+        m_SwapchainFormat = vk::SurfaceFormatKHR(format, vk::ColorSpaceKHR::eSrgbNonlinear);
+        m_PresentMode = vk::PresentModeKHR::eImmediate; // not actually presented anywhere, this is just what it behaves like.
+        m_CurrentExtent = m_RequestedExtent;
+
+        // one image per frame in flight, so the image index is always the frame index.
+        m_Images.resize(MAX_FRAMES_IN_FLIGHT);
+        m_ImageMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        m_ImageViews.resize(MAX_FRAMES_IN_FLIGHT);
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            auto ici = vk::ImageCreateInfo()
+                               .setImageType(vk::ImageType::e2D)
+                               .setFormat(format)
+                               .setExtent(vk::Extent3D(m_CurrentExtent, 1))
+                               .setMipLevels(1)
+                               .setArrayLayers(1)
+                               .setSamples(vk::SampleCountFlagBits::e1)
+                               .setTiling(vk::ImageTiling::eOptimal)
+                               .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+                               .setSharingMode(vk::SharingMode::eExclusive)
+                               .setInitialLayout(vk::ImageLayout::eUndefined);
+
+            m_Images[i] = globalState->device.createImage(ici);
+
+            auto requirements = globalState->device.getImageMemoryRequirements(m_Images[i]);
+            m_ImageMemory[i] = vku::allocateMemory(vk::MemoryAllocateInfo(requirements.size, vku::findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)));
+            globalState->device.bindImageMemory(m_Images[i], m_ImageMemory[i], 0);
 
-        glfwDestroyWindow(m_Window);
+            m_ImageViews[i] = globalState->device.createImageView(vk::ImageViewCreateInfo(
+                    {}, m_Images[i], vk::ImageViewType::e2D, format,
+                    vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA),
+                    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+        }
     }
 
-    std::tuple<size_t, Window *> Window::create(const std::string &title, const vk::Extent2D &size, const WindowOptions &options) {
-        size_t id = globalState->nextWindowId++;
-        globalState->activeWindows[id] = std::unique_ptr<Window>(new Window(title, size, options, id));
-        return std::make_tuple(id, globalState->activeWindows[id].get());
+    std::tuple<WindowId, Window *> Window::create(const std::string &title, const vk::Extent2D &size, const WindowOptions &options) {
+        return create(title, size, options, {});
     }
 
-    void Window::destroy(size_t id) {
-        globalState->activeWindows.erase(id);
+    std::tuple<WindowId, Window *> Window::create(const std::string &title, const vk::Extent2D &size, const WindowOptions &options, NativeWindow native) {
+        auto *window = new Window(title, size, options, native);
+
+        std::lock_guard lk(globalState->mutWindows);
+        window->m_Id = globalState->activeWindows.insert(std::unique_ptr<Window>(window));
+        return std::make_tuple(window->m_Id, window);
+    }
+
+    void Window::destroy(WindowId id) {
+        std::lock_guard lk(globalState->mutPendingWindowRemovals);
+        globalState->pendingWindowRemovals.push_back(id);
+    }
+
+    WindowId Window::getId() const noexcept {
+        return m_Id;
     }
 
     bool Window::isOpen() const {
+        if (!m_Window) return !m_Closed;
         return !glfwWindowShouldClose(m_Window);
     }
 
     void Window::setClosed(bool closed) const {
+        if (!m_Window) {
+            // nothing else will ever close a headless window, so closing it destroys it.
+            if (closed && !m_Closed) Window::destroy(m_Id);
+            m_Closed = closed;
+            return;
+        }
+
         glfwSetWindowShouldClose(m_Window, closed);
     }
 
+    bool Window::isHeadless() const noexcept {
+        return m_Headless;
+    }
+
+    bool Window::hasSwapchain() const noexcept {
+        return static_cast<bool>(m_Swapchain);
+    }
+
+    vk::ImageLayout Window::getPresentLayout() const noexcept {
+        return m_Swapchain ? vk::ImageLayout::ePresentSrcKHR : vk::ImageLayout::eTransferSrcOptimal;
+    }
+
     vk::SurfaceKHR Window::getSurface() const {
         return m_Surface;
     }
 
     void Window::recreateSwapchain() {
+        if (!m_Surface) return; // engine-owned images don't get resized.
+
         vk::SwapchainKHR oldSwapchain = m_Swapchain;
 
         auto capabilities = globalState->physicalDevice.getSurfaceCapabilitiesKHR(m_Surface);
 
         m_CurrentExtent = capabilities.currentExtent;
         if (m_CurrentExtent.height == UINT32_MAX) {
-            int w, h;
-            glfwGetFramebufferSize(m_Window, &w, &h);
+            int w = static_cast<int>(m_RequestedExtent.width), h = static_cast<int>(m_RequestedExtent.height);
+            if (m_Window) glfwGetFramebufferSize(m_Window, &w, &h);
             m_CurrentExtent.width = std::clamp(static_cast<uint32_t>(w), capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
             m_CurrentExtent.height = std::clamp(static_cast<uint32_t>(h), capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
         }
@@ -162,20 +285,18 @@ namespace kat {
                            .setClipped(true)
                            .setOldSwapchain(oldSwapchain);
 
-        if (oldSwapchain) {
-            // wait for all in flight frames to complete rendering so we don't pull resources out from under them.
-            for (const auto &s: m_SyncResources) {
-                vku::waitFence(s.inFlightFence);
-            }
+        m_Swapchain = globalState->device.createSwapchainKHR(sci);
 
+        if (oldSwapchain) {
+            // frames in flight may still be using these, they go once the gpu is done with them.
             for (const auto &iv: m_ImageViews) {
-                kat::destroy(iv);
+                kat::deferDestroy(iv);
             }
 
-            kat::destroy(oldSwapchain);
-        }
+            kat::deferDestroy(oldSwapchain);
 
-        m_Swapchain = globalState->device.createSwapchainKHR(sci);
+            globalState->metrics.swapchainRecreations.add();
+        }
 
         m_Images = globalState->device.getSwapchainImagesKHR(m_Swapchain);
 
@@ -188,28 +309,100 @@ namespace kat {
         }
     }
 
-    bool Window::acquireFrame() {
+    bool Window::acquireFrame(uint64_t timeout) {
+        KAT_TRACE_ZONE("acquireFrame");
+
         const auto &syncResources = m_SyncResources[m_CurrentFrame];
 
         m_CurrentFrameResources.sync = &m_SyncResources[m_CurrentFrame];
+        m_CurrentFrameResources.frameIndex = m_CurrentFrame;
+
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const bool ready = vku::waitFence(syncResources.inFlightFence, timeout);
+            globalState->metrics.fenceWait.record(std::chrono::steady_clock::now() - start);
+
+            if (!ready) return false; // previous use of this frame hasn't finished yet.
+        }
 
-        vku::waitFence(syncResources.inFlightFence);
+        if (!m_Swapchain) {
+            // engine-owned images: nothing to acquire, but the imageAvailableSemaphore still has to be signaled for whoever waits on it.
+            vku::resetFence(syncResources.inFlightFence);
 
-        auto r = globalState->device.acquireNextImageKHR(m_Swapchain, UINT64_MAX, syncResources.imageAvailableSemaphore);
-        if (r.result == vk::Result::eErrorOutOfDateKHR) {
+            vk::SemaphoreSubmitInfo signalInfo(syncResources.imageAvailableSemaphore, 0, vk::PipelineStageFlagBits2::eAllCommands);
+            vku::queueSubmit(globalState->mainQueue, vk::SubmitInfo2({}, {}, {}, signalInfo));
+
+            m_CurrentFrameResources.imageIndex = m_CurrentFrame;
+            m_CurrentFrameResources.image = m_Images[m_CurrentFrame];
+            m_CurrentFrameResources.imageView = m_ImageViews[m_CurrentFrame];
+            return true;
+        }
+
+        const auto acquireStart = std::chrono::steady_clock::now();
+        uint32_t imageIndex = 0;
+        const auto result = static_cast<vk::Result>(globalState->dispatch.vkAcquireNextImageKHR(static_cast<VkDevice>(globalState->device), static_cast<VkSwapchainKHR>(m_Swapchain), timeout,
+                                                                                             static_cast<VkSemaphore>(syncResources.imageAvailableSemaphore), VK_NULL_HANDLE, &imageIndex));
+        globalState->metrics.acquireWait.record(std::chrono::steady_clock::now() - acquireStart);
+        if (result == vk::Result::eErrorOutOfDateKHR) {
             recreateSwapchain();
             return false; // frame is skipped.
         }
 
+        if (result == vk::Result::eTimeout || result == vk::Result::eNotReady) {
+            return false; // no image available yet, nothing was signaled so the frame can just be tried again later.
+        }
+
+        if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
+            throw std::runtime_error("Failed to acquire swapchain image: " + vk::to_string(result));
+        }
+
         vku::resetFence(syncResources.inFlightFence);
 
-        m_CurrentFrameResources.imageIndex = r.value;
-        m_CurrentFrameResources.image = m_Images[r.value];
-        m_CurrentFrameResources.imageView = m_ImageViews[r.value];
+        m_CurrentFrameResources.imageIndex = imageIndex;
+        m_CurrentFrameResources.image = m_Images[imageIndex];
+        m_CurrentFrameResources.imageView = m_ImageViews[imageIndex];
 
         return true;
     }
 
+    void Window::present() {
+        if (!m_Swapchain) {
+            // engine-owned images: "presenting" just consumes the renderFinishedSemaphore so it can be signaled again next time.
+            vk::SemaphoreSubmitInfo waitInfo(m_CurrentFrameResources.sync->renderFinishedSemaphore, 0, vk::PipelineStageFlagBits2::eAllCommands);
+            vku::queueSubmit(globalState->mainQueue, vk::SubmitInfo2({}, waitInfo));
+            m_LastPresentResult = vk::Result::eSuccess;
+            replay::recordPresent(0, 0, static_cast<int32_t>(vk::Result::eSuccess));
+            return;
+        }
+
+        vk::PresentInfoKHR presentInfo{};
+        presentInfo.setSwapchains(m_Swapchain);
+        presentInfo.setImageIndices(m_CurrentFrameResources.imageIndex);
+        presentInfo.setWaitSemaphores(m_CurrentFrameResources.sync->renderFinishedSemaphore);
+
+        handlePresentResult(vku::present(presentInfo));
+    }
+
+    void Window::handlePresentResult(vk::Result result) {
+        m_LastPresentResult = result;
+
+        switch (result) {
+            case vk::Result::eSuccess:
+                break;
+            case vk::Result::eSuboptimalKHR:
+            case vk::Result::eErrorOutOfDateKHR:
+                recreateSwapchain();
+                break;
+            default:
+                spdlog::error("Failed to present window {}: {}", m_Id.index, vk::to_string(result));
+                break;
+        }
+    }
+
+    vk::Result Window::getLastPresentResult() const noexcept {
+        return m_LastPresentResult;
+    }
+
     void Window::nextFrame() {
         m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
@@ -254,7 +447,7 @@ namespace kat {
         return m_ImageViews;
     }
 
-    void BaseWindowHandler::onRender(const std::shared_ptr<Window> &window, const WindowFrameResources &resources) {
+    void BaseWindowHandler::onRender(Window &window, const WindowFrameResources &resources) {
         vku::OTCSync otcs{};
         otcs.wait = resources.sync->imageAvailableSemaphore;
         otcs.signal = resources.sync->renderFinishedSemaphore;
@@ -290,11 +483,11 @@ namespace kat {
             imb2.srcQueueFamilyIndex = globalState->mainFamily;
             imb2.dstQueueFamilyIndex = globalState->mainFamily;
             imb2.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-            imb2.newLayout = vk::ImageLayout::ePresentSrcKHR;
+            imb2.newLayout = window.getPresentLayout();
             imb2.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
 
             cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, imb2));
-        }, resources.sync->inFlightFence, otcs, window);
+        }, resources.sync->inFlightFence, otcs);
     }
 
     BaseWindowHandler::BaseWindowHandler() {
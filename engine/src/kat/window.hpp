@@ -2,11 +2,16 @@
 
 #include <memory>
 #include <concepts>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #include <vulkan/vulkan.hpp>
 
 #include <GLFW/glfw3.h>
 
+#include "kat/slot_map.hpp"
+
 namespace kat {
 
     constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
@@ -17,6 +22,26 @@ namespace kat {
     struct WindowOptions {
         bool vsync = false;
         bool resizable = false;
+
+        /**
+         * Don't open a GLFW window. Headless windows are still full render targets and run through the normal frame loop.
+         *
+         * Windows are always headless if the engine is in headless mode (see setHeadless()) or GLFW failed to initialize.
+         */
+        bool headless = false;
+
+        // headless only: present through a VK_EXT_headless_surface swapchain when available, instead of rendering into engine-owned images.
+        bool useHeadlessSurface = true;
+
+        // headless only: format of the engine-owned images.
+        vk::Format headlessFormat = vk::Format::eR8G8B8A8Unorm;
+    };
+
+    // a window to create as part of startup(), see startup(const std::vector<WindowCreateInfo> &).
+    struct WindowCreateInfo {
+        std::string title;
+        vk::Extent2D size;
+        WindowOptions options{};
     };
 
 
@@ -45,24 +70,63 @@ namespace kat {
         vk::Image image;
         vk::ImageView imageView;
         uint32_t imageIndex;
+        uint32_t frameIndex; // which of the MAX_FRAMES_IN_FLIGHT frames this is (per-frame resources can be indexed with it)
 
         const FrameSyncResources* sync;
     };
 
     class BaseWindowHandler;
 
+    using WindowId = SlotHandle;
+
     class Window {
-        Window(const std::string &title, const vk::Extent2D &size, const WindowOptions &options, size_t id);
+        // the GLFW window and its surface, which only need the instance.
+        struct NativeWindow {
+            GLFWwindow *window = nullptr;
+            vk::SurfaceKHR surface;
+        };
+
+        // a null native window is opened by the constructor (if the window isn't headless).
+        Window(const std::string &title, const vk::Extent2D &size, const WindowOptions &options, NativeWindow native = {});
 
       public:
-        static std::tuple<size_t, Window *> create(const std::string &title, const vk::Extent2D &size, const WindowOptions &options = {});
-        static void destroy(size_t id);
+        /**
+         * Create a window and add it to the engine's window registry. Thread safe, window handlers can call it too.
+         *
+         * The render loop only holds the registry lock while it takes its snapshot of the windows, so this doesn't wait for a frame to finish.
+         * The window is rendered from the next render loop cycle on.
+         */
+        static std::tuple<WindowId, Window *> create(const std::string &title, const vk::Extent2D &size, const WindowOptions &options = {});
+
+        /**
+         * Queue a window to be destroyed. It leaves the registry at the next frame boundary, but stays alive until the render loop cycles whose snapshots
+         * still contain it have finished. Its vulkan objects are deferred (see deferDestroy()) after that.
+         */
+        static void destroy(WindowId id);
+
+        [[nodiscard]] WindowId getId() const noexcept;
 
         ~Window();
 
         [[nodiscard]] bool isOpen() const;
+
+        /**
+         * Headless windows have no event loop to close them, so closing one queues it for destruction.
+         */
         void setClosed(bool closed) const;
 
+        [[nodiscard]] bool isHeadless() const noexcept;
+
+        /**
+         * Whether the window presents through a swapchain. Headless windows without headless surface support render into engine-owned images instead.
+         */
+        [[nodiscard]] bool hasSwapchain() const noexcept;
+
+        /**
+         * The layout images have to be in when they are presented (ePresentSrcKHR for swapchains, eTransferSrcOptimal for engine-owned images).
+         */
+        [[nodiscard]] vk::ImageLayout getPresentLayout() const noexcept;
+
         [[nodiscard]] vk::SurfaceKHR getSurface() const;
 
         void recreateSwapchain();
@@ -73,9 +137,24 @@ namespace kat {
          * Call getCurrentFrameResources() to get the current frame resources.
          * This function can fail, and will return false in that event.
          *
+         * @param timeout How long to wait (in nanoseconds) for the frame to become available. A timeout of 0 never blocks.
          * @return Whether or not the acquire was successful. If return value is false, skip the frame (failure will not reset the fence).
          */
-        bool acquireFrame();
+        bool acquireFrame(uint64_t timeout = UINT64_MAX);
+
+        /**
+         * Present the current frame on its own (used by PresentStrategy::eIndependent).
+         *
+         * The result is handled the same way as a batched present (see handlePresentResult()).
+         */
+        void present();
+
+        /**
+         * Record the result of presenting this window's swapchain, recreating the swapchain if it is out of date or suboptimal.
+         */
+        void handlePresentResult(vk::Result result);
+
+        [[nodiscard]] vk::Result getLastPresentResult() const noexcept;
 
         void nextFrame();
 
@@ -107,11 +186,26 @@ namespace kat {
 
 
       private:
-        size_t m_Id;
-        GLFWwindow *m_Window;
+        friend std::vector<std::tuple<WindowId, Window *>> startup(const std::vector<WindowCreateInfo> &windows);
+
+        static bool wantsNativeWindow(const WindowOptions &options);
+
+        // has to be called on the main thread (GLFW only creates windows there).
+        static NativeWindow openNativeWindow(const std::string &title, const vk::Extent2D &size, const WindowOptions &options);
+
+        static std::tuple<WindowId, Window *> create(const std::string &title, const vk::Extent2D &size, const WindowOptions &options, NativeWindow native);
+
+        void createOffscreenImages(vk::Format format);
+
+        WindowId m_Id;
+        GLFWwindow *m_Window = nullptr;
         vk::SurfaceKHR m_Surface;
 
         bool m_EnableVsync;
+        bool m_Headless = false;
+        mutable bool m_Closed = false;
+
+        vk::Extent2D m_RequestedExtent;
 
         vk::SurfaceFormatKHR m_SwapchainFormat;
         vk::PresentModeKHR m_PresentMode;
@@ -120,6 +214,7 @@ namespace kat {
         vk::Extent2D m_CurrentExtent;
         std::vector<vk::Image> m_Images;
         std::vector<vk::ImageView> m_ImageViews;
+        std::vector<vk::DeviceMemory> m_ImageMemory; // only used for engine-owned images
 
         FrameSet<FrameSyncResources> m_SyncResources;
 
@@ -127,6 +222,8 @@ namespace kat {
 
         uint32_t m_CurrentFrame = 0;
 
+        vk::Result m_LastPresentResult = vk::Result::eSuccess;
+
         std::shared_ptr<BaseWindowHandler> m_WindowHandler;
     };
 
@@ -135,7 +232,7 @@ namespace kat {
         BaseWindowHandler();
 
         // TODO: fancier rendering, or maybe include some utilities and other things to pull off more advanced offscreen rendering stuff.
-        virtual void onRender(const std::shared_ptr<Window>& window, const WindowFrameResources& resources);
+        virtual void onRender(Window &window, const WindowFrameResources &resources);
     };
 
 } // namespace kat
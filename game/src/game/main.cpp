@@ -3,20 +3,31 @@
 #include <cstdlib>
 #include <iostream>
 
+#include <kat/alloc_counter.hpp>
+
+KAT_INSTALL_ALLOCATION_COUNTER()
+
 int main(int argc, char *argv[]) {
     kat::init();
 
     kat::setValidationLayersEnabled(true);
+    kat::setAsyncLogging(true);
     //    kat::setApiDumpEnabled(true);
 
-    kat::startup();
+    if (KAT_IS_DEBUG) kat::setTraceOutput("logs/trace.json");
+    //    kat::setReplayCapture("logs/capture.katr");
+    kat::setMetricsExport(std::chrono::seconds(10));
+    kat::setPipelineCachePath("cache/pipelines.bin");
+
+    // the window opens while the device is being created.
+    const auto windows = kat::startup({kat::WindowCreateInfo{"Hello!", vk::Extent2D{800, 600}, kat::WindowOptions{false}}});
 
     kat::globalState->doRenderSetup = true;
     kat::globalState->isRenderSetupOnlyOperation = true;
 
     kat::Window *window;
-    size_t windowId;
-    std::tie(windowId, window) = kat::Window::create("Hello!", vk::Extent2D{800, 600}, kat::WindowOptions{false});
+    kat::WindowId windowId;
+    std::tie(windowId, window) = windows[0];
 
     window->setWindowHandler(std::make_shared<WindowHandler>(window));
 
@@ -31,7 +42,7 @@ int main(int argc, char *argv[]) {
 WindowHandler::WindowHandler(kat::Window *window) : m_Window(window), kat::BaseWindowHandler() {
     m_RenderPass = std::make_shared<kat::RenderPass>(kat::RenderPassInfo(
             {
-                    kat::AttachmentInfo{window->getSurfaceFormat().format, vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR, kat::LSO_STANDARD_CLEAR_STORE, kat::LSO_DONT_CARE, vk::SampleCountFlagBits::e1},
+                    kat::AttachmentInfo{window->getSurfaceFormat().format, vk::ImageLayout::eUndefined, window->getPresentLayout(), kat::LSO_STANDARD_CLEAR_STORE, kat::LSO_DONT_CARE, vk::SampleCountFlagBits::e1},
             },
             {
                     kat::SubpassInfo{vk::PipelineBindPoint::eGraphics, 0, {}, {kat::AttachmentReference{0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor}}, {}, std::nullopt, {}, std::nullopt, std::nullopt, std::nullopt, std::nullopt},
@@ -42,27 +53,38 @@ WindowHandler::WindowHandler(kat::Window *window) : m_Window(window), kat::BaseW
         m_Framebuffers.push_back(kat::globalState->device.createFramebuffer(vk::FramebufferCreateInfo({}, m_RenderPass->get(), iv, m_Window->getCurrentExtent().width, m_Window->getCurrentExtent().height, 1)));
     }
 
+    m_BeginInfo.clearValues.resize(1);
+
     thisFrame = glfwGetTime();
     delta = 1.0f / 0.6f; // due to the 1:100 frame to delta ratio im using for smoothing purposes rn.
     lastFrame = thisFrame - delta;
 }
 
-void WindowHandler::onRender(const std::shared_ptr<kat::Window> &window, const kat::WindowFrameResources &resources) {
+void WindowHandler::onRender(kat::Window &window, const kat::WindowFrameResources &resources) {
     kat::vku::OTCSync otcs{};
     otcs.wait = resources.sync->imageAvailableSemaphore;
     otcs.signal = resources.sync->renderFinishedSemaphore;
 
-    kat::vku::otc([&](const vk::CommandBuffer &cmd) {
-        float n = (sinf(float(glfwGetTime())) + 1.0f) / 2.0f;
+    const float n = (sinf(float(glfwGetTime())) + 1.0f) / 2.0f;
+
+    // the clear color is baked into the recording, so it is quantized to a few steps and the pass is only re-recorded when it moves to another one (or the target changes).
+    constexpr float SHADE_STEPS = 8.0f;
+    const auto shade = static_cast<uint8_t>(n * SHADE_STEPS + 0.5f);
+    const vk::Framebuffer framebuffer = m_Framebuffers[resources.imageIndex];
+    const vk::Extent2D extent = window.getCurrentExtent();
 
-        vk::ClearColorValue clearValue{n, 0.0f, 0.0f, 1.0f};
-        std::vector<vk::ClearValue> cvs = {vk::ClearValue(clearValue)};
+    const uint64_t key = kat::DependencyKey().add(m_RenderPass->get()).add(framebuffer).add(extent).add(shade).get();
 
-        cmd.beginRenderPass2(vk::RenderPassBeginInfo(m_RenderPass->get(), m_Framebuffers[resources.imageIndex], vk::Rect2D(vk::Offset2D(0, 0), window->getCurrentExtent()), cvs), vk::SubpassBeginInfo());
+    const vk::CommandBuffer cmd = m_StaticCommands.get(resources.imageIndex, key, [&](kat::CommandRecorder &recorder) {
+        m_BeginInfo.framebuffer = framebuffer;
+        m_BeginInfo.renderArea = vk::Rect2D(vk::Offset2D(0, 0), extent);
+        m_BeginInfo.clearValues[0] = vk::ClearValue(vk::ClearColorValue{float(shade) / SHADE_STEPS, 0.0f, 0.0f, 1.0f});
 
-        cmd.endRenderPass2(vk::SubpassEndInfo());
+        recorder.beginRenderPass(m_RenderPass, m_BeginInfo);
+        recorder.endRenderPass();
+    });
 
-    }, resources.sync->inFlightFence, otcs, window);
+    kat::vku::submit(cmd, resources.sync->inFlightFence, otcs);
 
     fcounter++;
 
@@ -73,11 +95,19 @@ void WindowHandler::onRender(const std::shared_ptr<kat::Window> &window, const k
         delta = thisFrame - lastFrame;
         double fps = 100.0f / delta;
         highest_fps = std::max(highest_fps, fps);
+
+        // onRender runs on the render thread, so this counts every allocation the render loop made over the last 100 frames.
+        uint64_t allocations = kat::alloc::threadCount();
+        if (fcounter > 100) { // first 100 frames are warmup (scratch storage and recycle lists growing)
+            highest_allocations = std::max(highest_allocations, allocations - lastAllocationCount);
+        }
+        lastAllocationCount = allocations;
     }
 }
 
 WindowHandler::~WindowHandler() {
     spdlog::debug("Highest FPS: {}", highest_fps);
+    spdlog::debug("Most render loop allocations in 100 frames (after warmup): {}", highest_allocations);
 
     for (const auto& f : m_Framebuffers) {
         kat::destroy(f);
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <kat/render/command_recorder.hpp>
 #include <kat/render/render_pass.hpp>
+#include <kat/render/static_commands.hpp>
 #include <kat/engine.hpp>
 #include <kat/window.hpp>
 
@@ -10,7 +12,7 @@ class WindowHandler : public kat::BaseWindowHandler {
     virtual ~WindowHandler();
 
 
-    void onRender(const std::shared_ptr<kat::Window> &window, const kat::WindowFrameResources &resources) override;
+    void onRender(kat::Window &window, const kat::WindowFrameResources &resources) override;
 
   private:
 
@@ -18,6 +20,8 @@ class WindowHandler : public kat::BaseWindowHandler {
 
     std::shared_ptr<kat::RenderPass> m_RenderPass;
     std::vector<vk::Framebuffer> m_Framebuffers;
+    kat::cmd::RenderPassBeginInfo m_BeginInfo; // reused every recording so it doesn't allocate
+    kat::StaticCommandCache m_StaticCommands;  // one recording per swapchain image
 
     double lastFrame;
     double thisFrame;
@@ -26,4 +30,7 @@ class WindowHandler : public kat::BaseWindowHandler {
     double highest_fps = 0.0f;
 
     size_t fcounter = 0;
+
+    uint64_t lastAllocationCount = 0;
+    uint64_t highest_allocations = 0;
 };